@@ -2,3 +2,6 @@
 
 #define BUILD_ENABLE_VULKAN_DEBUG								1
 #define BUILD_ENABLE_VULKAN_RUNTIME_DEBUG						1
+
+// Allows presenting software rendered frames through MIT-SHM on XCB, needs libxcb-shm.
+#define BUILD_ENABLE_XCB_SHM_PRESENT							1
@@ -0,0 +1,155 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "CommandBufferCache.h"
+#include "Renderer.h"
+#include "DeletionQueue.h"
+#include "Shared.h"
+
+#include <algorithm>
+
+CommandBufferCache::CommandBufferCache( Renderer * renderer )
+{
+	_renderer		= renderer;
+	_device			= renderer->GetVulkanDevice();
+
+	VkCommandPoolCreateInfo pool_create_info {};
+	pool_create_info.sType				= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_create_info.queueFamilyIndex	= renderer->GetVulkanGraphicsQueueFamilyIndex();
+	ErrorCheck( vkCreateCommandPool( _device, &pool_create_info, nullptr, &_command_pool ) );
+
+	// Everything destroyed through the deletion queue invalidates what was recorded with it.
+	renderer->GetDeletionQueue()->AddDestroyListener( [ this ]( uint64_t handle ) {
+		Invalidate( handle );
+	} );
+}
+
+CommandBufferCache::~CommandBufferCache()
+{
+	// Frees every command buffer of the pool, the owner makes sure none is pending anymore.
+	vkDestroyCommandPool( _device, _command_pool, nullptr );
+	_entries.clear();
+	_dependents.clear();
+}
+
+VkCommandBuffer CommandBufferCache::Get( const std::string & name, const std::vector<uint64_t> & dependencies, const RecordFunction & record,
+	VkCommandBufferLevel level, const VkCommandBufferInheritanceInfo * inheritance_info )
+{
+	std::vector<uint64_t> all_dependencies = dependencies;
+	if( inheritance_info ) {
+		all_dependencies.push_back( Handle( inheritance_info->renderPass ) );
+		all_dependencies.push_back( Handle( inheritance_info->framebuffer ) );
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		auto existing = _entries.find( name );
+		if( existing != _entries.end() ) {
+			if( existing->second.level == level && existing->second.dependencies == all_dependencies ) {
+				++_reuse_count;
+				return existing->second.command_buffer;
+			}
+			// Same content over different objects, record it again.
+			_Remove( name );
+		}
+	}
+
+	Entry entry;
+	entry.level			= level;
+	entry.dependencies	= std::move( all_dependencies );
+
+	// Recorded without holding _mutex, record may ask the cache for other command buffers or
+	// invalidate handles. The pool lock is recursive for the nested recordings of the same thread.
+	{
+		std::lock_guard<std::recursive_mutex> pool_lock( _pool_mutex );
+
+		VkCommandBufferAllocateInfo command_buffer_allocate_info {};
+		command_buffer_allocate_info.sType					= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_allocate_info.commandPool			= _command_pool;
+		command_buffer_allocate_info.commandBufferCount		= 1;
+		command_buffer_allocate_info.level					= level;
+		ErrorCheck( vkAllocateCommandBuffers( _device, &command_buffer_allocate_info, &entry.command_buffer ) );
+
+		// Simultaneous use, the same command buffer is pending in every frame in flight.
+		VkCommandBufferBeginInfo begin_info {};
+		begin_info.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags				= VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		if( inheritance_info ) {
+			begin_info.flags			|= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			begin_info.pInheritanceInfo	= inheritance_info;
+		}
+		ErrorCheck( vkBeginCommandBuffer( entry.command_buffer, &begin_info ) );
+		record( entry.command_buffer );
+		ErrorCheck( vkEndCommandBuffer( entry.command_buffer ) );
+	}
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	++_record_count;
+	// Another thread recorded the same name in the meantime, the newer recording replaces it.
+	_Remove( name );
+	for( auto handle : entry.dependencies ) {
+		_dependents[ handle ].push_back( name );
+	}
+	auto command_buffer = entry.command_buffer;
+	_entries[ name ] = std::move( entry );
+	return command_buffer;
+}
+
+void CommandBufferCache::Invalidate( uint64_t handle )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	auto dependents = _dependents.find( handle );
+	if( dependents == _dependents.end() ) return;
+
+	auto names = std::move( dependents->second );
+	_dependents.erase( dependents );
+	for( auto & name : names ) {
+		_Remove( name );
+	}
+}
+
+void CommandBufferCache::InvalidateAll()
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	while( !_entries.empty() ) {
+		auto name = _entries.begin()->first;
+		_Remove( name );
+	}
+	_dependents.clear();
+}
+
+uint64_t CommandBufferCache::GetRecordCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return _record_count;
+}
+
+uint64_t CommandBufferCache::GetReuseCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return _reuse_count;
+}
+
+void CommandBufferCache::_Remove( const std::string & name )
+{
+	auto existing = _entries.find( name );
+	if( existing == _entries.end() ) return;
+
+	for( auto handle : existing->second.dependencies ) {
+		auto dependents = _dependents.find( handle );
+		if( dependents == _dependents.end() ) continue;
+		auto & names = dependents->second;
+		names.erase( std::remove( names.begin(), names.end(), name ), names.end() );
+		if( names.empty() ) {
+			_dependents.erase( dependents );
+		}
+	}
+
+	// Frames in flight may still execute the command buffer, it is freed once they are done.
+	auto command_buffer = existing->second.command_buffer;
+	_entries.erase( existing );
+	_renderer->GetDeletionQueue()->Defer( [ this, command_buffer ]() {
+		std::lock_guard<std::recursive_mutex> pool_lock( _pool_mutex );
+		vkFreeCommandBuffers( _device, _command_pool, 1, &command_buffer );
+	} );
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+
+class Renderer;
+
+// Keeps command buffers for content that does not change from frame to frame. A command
+// buffer is recorded once, without ONE_TIME_SUBMIT and with SIMULTANEOUS_USE so every
+// frame in flight can submit it, and handed out again until one of the objects it
+// references changes. Objects handed to the renderer's DeletionQueue invalidate the
+// command buffers that depend on them, anything else calls Invalidate() itself, the
+// window does that for its swapchain images. Thread safe.
+class CommandBufferCache
+{
+public:
+	// Records the commands between begin and end, the cache begins and ends the command buffer.
+	typedef std::function<void( VkCommandBuffer command_buffer )>	RecordFunction;
+
+	CommandBufferCache( Renderer * renderer );
+	~CommandBufferCache();
+
+	// Command buffer for name, recorded by record if there is no valid one. dependencies are
+	// the handles of everything the commands reference, see Handle(). Secondary command
+	// buffers also depend on the render pass and framebuffer of inheritance_info. record runs
+	// without the cache locked and may use the cache itself, the objects it references have to
+	// stay alive until Get() returns.
+	VkCommandBuffer						Get( const std::string & name, const std::vector<uint64_t> & dependencies, const RecordFunction & record,
+											VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+											const VkCommandBufferInheritanceInfo * inheritance_info = nullptr );
+
+	// Command buffers that reference handle are recorded again the next time they are asked for.
+	void								Invalidate( uint64_t handle );
+	void								InvalidateAll();
+
+	template<typename T>
+	static uint64_t						Handle( T handle )
+	{
+		return (uint64_t)handle;
+	}
+
+	uint64_t							GetRecordCount() const;
+	uint64_t							GetReuseCount() const;
+
+private:
+	struct Entry
+	{
+		VkCommandBuffer						command_buffer			= VK_NULL_HANDLE;
+		VkCommandBufferLevel				level					= VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		std::vector<uint64_t>				dependencies;
+	};
+
+	void								_Remove( const std::string & name );
+
+	Renderer						*	_renderer						= nullptr;
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	mutable std::mutex					_mutex;
+	std::recursive_mutex				_pool_mutex;					// recording and freeing, held apart from _mutex
+	VkCommandPool						_command_pool					= VK_NULL_HANDLE;
+	std::unordered_map<std::string, Entry>	_entries;
+	std::unordered_map<uint64_t, std::vector<std::string>>	_dependents;	// handle to the names that reference it
+
+	uint64_t							_record_count					= 0;
+	uint64_t							_reuse_count					= 0;
+};
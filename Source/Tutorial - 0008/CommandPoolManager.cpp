@@ -0,0 +1,126 @@
+
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "CommandPoolManager.h"
+#include "Shared.h"
+
+// Every manager gets a unique id so a thread's cached pools are never mistaken
+// for the pools of another manager that happens to reuse the same address.
+static std::atomic<uint64_t>	command_pool_manager_id_counter( 1 );
+
+struct CommandPoolManagerThreadCache
+{
+	uint64_t		manager_id		= 0;
+	void		*	thread_pools	= nullptr;
+};
+static thread_local CommandPoolManagerThreadCache	command_pool_manager_thread_cache;
+
+CommandPoolManager::CommandPoolManager( VkDevice device, uint32_t queue_family_index )
+{
+	_device					= device;
+	_queue_family_index		= queue_family_index;
+	_id						= command_pool_manager_id_counter++;
+	_frame_slot				= 0;
+}
+
+CommandPoolManager::~CommandPoolManager()
+{
+	for( auto thread_pools : _threads ) {
+		for( auto & frame_pool : thread_pools->frames ) {
+			// destroying the pool frees its command buffers too
+			vkDestroyCommandPool( _device, frame_pool.pool, nullptr );
+		}
+		delete thread_pools;
+	}
+	_threads.clear();
+}
+
+void CommandPoolManager::BeginFrame( uint32_t frame_slot )
+{
+	_frame_slot = frame_slot;
+
+	std::lock_guard<std::mutex> lock( _threads_mutex );
+	for( auto thread_pools : _threads ) {
+		if( frame_slot >= thread_pools->frames.size() ) continue;
+		auto & frame_pool = thread_pools->frames[ frame_slot ];
+		if( frame_pool.primary_used + frame_pool.secondary_used == 0 ) continue;
+
+		// One reset for the whole pool, the command buffers go back to the initial state and are reused.
+		ErrorCheck( vkResetCommandPool( _device, frame_pool.pool, 0 ) );
+		frame_pool.primary_used		= 0;
+		frame_pool.secondary_used	= 0;
+	}
+}
+
+VkCommandBuffer CommandPoolManager::GetCommandBuffer( VkCommandBufferLevel level )
+{
+	auto & frame_pool		= _GetFramePool( _GetThreadPools(), _frame_slot );
+	auto & buffers			= level == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? frame_pool.primary : frame_pool.secondary;
+	auto & used				= level == VK_COMMAND_BUFFER_LEVEL_PRIMARY ? frame_pool.primary_used : frame_pool.secondary_used;
+
+	if( used == buffers.size() ) {
+		// Grow in small batches, after the first few frames this never happens again.
+		uint32_t count		= buffers.empty() ? 4 : uint32_t( buffers.size() );
+		size_t first		= buffers.size();
+		buffers.resize( first + count );
+
+		VkCommandBufferAllocateInfo command_buffer_allocate_info {};
+		command_buffer_allocate_info.sType					= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_allocate_info.commandPool			= frame_pool.pool;
+		command_buffer_allocate_info.commandBufferCount		= count;
+		command_buffer_allocate_info.level					= level;
+		ErrorCheck( vkAllocateCommandBuffers( _device, &command_buffer_allocate_info, &buffers[ first ] ) );
+	}
+	return buffers[ used++ ];
+}
+
+uint32_t CommandPoolManager::GetCurrentFrameSlot() const
+{
+	return _frame_slot;
+}
+
+CommandPoolManager::ThreadPools * CommandPoolManager::_GetThreadPools()
+{
+	auto & cache = command_pool_manager_thread_cache;
+	if( cache.manager_id == _id ) {
+		return (ThreadPools*)cache.thread_pools;
+	}
+
+	std::lock_guard<std::mutex> lock( _threads_mutex );
+	auto this_thread = std::this_thread::get_id();
+	ThreadPools * thread_pools = nullptr;
+	for( auto t : _threads ) {
+		if( t->thread == this_thread ) {
+			thread_pools = t;
+			break;
+		}
+	}
+	if( !thread_pools ) {
+		thread_pools			= new ThreadPools;
+		thread_pools->thread	= this_thread;
+		_threads.push_back( thread_pools );
+	}
+	cache.manager_id		= _id;
+	cache.thread_pools		= thread_pools;
+	return thread_pools;
+}
+
+CommandPoolManager::FramePool & CommandPoolManager::_GetFramePool( ThreadPools * thread_pools, uint32_t frame_slot )
+{
+	if( frame_slot >= thread_pools->frames.size() ) {
+		// BeginFrame() walks the frame pools of every thread, only grow under the lock.
+		std::lock_guard<std::mutex> lock( _threads_mutex );
+		size_t first = thread_pools->frames.size();
+		thread_pools->frames.resize( frame_slot + 1 );
+		for( size_t i=first; i < thread_pools->frames.size(); ++i ) {
+			// Transient, the command buffers are rerecorded every time the frame slot comes around.
+			VkCommandPoolCreateInfo pool_create_info {};
+			pool_create_info.sType				= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			pool_create_info.queueFamilyIndex	= _queue_family_index;
+			pool_create_info.flags				= VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			ErrorCheck( vkCreateCommandPool( _device, &pool_create_info, nullptr, &thread_pools->frames[ i ].pool ) );
+		}
+	}
+	return thread_pools->frames[ frame_slot ];
+}
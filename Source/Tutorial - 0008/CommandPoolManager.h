@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+// Hands out command buffers from a pool that belongs to the calling thread and
+// the current frame slot. Pools are reset as a whole when the frame slot comes
+// around again and their command buffers are recycled instead of allocated again,
+// resetting individual command buffers is the slowest option on most drivers.
+// Recording threads never share a pool so no locking is needed while recording.
+class CommandPoolManager
+{
+public:
+	CommandPoolManager( VkDevice device, uint32_t queue_family_index );
+	~CommandPoolManager();
+
+	// Call after the fence of the frame that last used frame_slot has signaled and
+	// before any thread records for the new frame.
+	void								BeginFrame( uint32_t frame_slot );
+
+	// Command buffer from the calling thread's pool for the current frame slot, valid until
+	// the slot comes around again.
+	VkCommandBuffer						GetCommandBuffer( VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY );
+
+	uint32_t							GetCurrentFrameSlot() const;
+
+private:
+	struct FramePool
+	{
+		VkCommandPool						pool					= VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer>		primary;
+		std::vector<VkCommandBuffer>		secondary;
+		uint32_t							primary_used			= 0;
+		uint32_t							secondary_used			= 0;
+	};
+
+	struct ThreadPools
+	{
+		std::thread::id						thread;
+		std::vector<FramePool>				frames;
+	};
+
+	ThreadPools						*	_GetThreadPools();
+	FramePool						&	_GetFramePool( ThreadPools * thread_pools, uint32_t frame_slot );
+
+	VkDevice							_device							= VK_NULL_HANDLE;
+	uint32_t							_queue_family_index				= 0;
+	uint64_t							_id								= 0;
+	std::atomic<uint32_t>				_frame_slot;
+
+	std::mutex							_threads_mutex;
+	std::vector<ThreadPools*>			_threads;
+};
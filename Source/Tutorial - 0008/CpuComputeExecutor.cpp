@@ -0,0 +1,3203 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "CpuComputeExecutor.h"
+#include "JobSystem.h"
+
+#include <vulkan/spirv.hpp>
+#include <vulkan/GLSL.std.450.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <map>
+#include <cmath>
+#include <cstring>
+#include <assert.h>
+
+namespace {
+
+// SPIR-V 1.3 storage class, newer than the headers.
+const uint32_t StorageClassStorageBuffer		= 12;
+
+const uint32_t LANE_DONE						= UINT32_MAX;
+const uint32_t MAX_LANE_COUNT					= 1024;
+const uint32_t MAX_INLINE_DEPTH					= 64;
+
+// A register holds the bits of one 32 bit component for every lane, bools are 0 or 1.
+union Word
+{
+	uint32_t							u;
+	int32_t								i;
+	float								f;
+};
+
+inline Word UintWord( uint32_t value )		{ Word word; word.u = value; return word; }
+inline Word FloatWord( float value )		{ Word word; word.f = value; return word; }
+inline Word BoolWord( bool value )			{ Word word; word.u = value ? 1 : 0; return word; }
+
+enum class Code : uint16_t
+{
+	COPY,
+
+	// Integers and bools, one result component per operand component.
+	IADD, ISUB, IMUL, UDIV, SDIV, UMOD, SREM, SMOD, SNEGATE, CARRY, BORROW, UMUL_HIGH, SMUL_HIGH,
+	SHIFT_LEFT, SHIFT_RIGHT, SHIFT_RIGHT_ARITHMETIC, AND, OR, XOR, NOT, BOOL_NOT,
+	IEQUAL, INOT_EQUAL, ULESS, ULESS_EQUAL, UGREATER, UGREATER_EQUAL, SLESS, SLESS_EQUAL, SGREATER, SGREATER_EQUAL,
+	UMIN, UMAX, SMIN, SMAX, UCLAMP, SCLAMP, SABS, SSIGN,
+	BIT_COUNT, BIT_REVERSE, BIT_INSERT, BIT_SEXTRACT, BIT_UEXTRACT, FIND_LSB, FIND_SMSB, FIND_UMSB,
+	SELECT,
+
+	// Floats, one result component per operand component.
+	FADD, FSUB, FMUL, FDIV, FREM, FMOD, FNEGATE, FMUL_ADD,
+	FORD_EQUAL, FORD_NOT_EQUAL, FORD_LESS, FORD_LESS_EQUAL, FORD_GREATER, FORD_GREATER_EQUAL,
+	FUNORD_EQUAL, FUNORD_NOT_EQUAL, FUNORD_LESS, FUNORD_LESS_EQUAL, FUNORD_GREATER, FUNORD_GREATER_EQUAL,
+	IS_NAN, IS_INF,
+	FMIN, FMAX, FCLAMP, NMIN, NMAX, NCLAMP, FMIX, STEP, SMOOTH_STEP, FMA,
+	FABS, FSIGN, FLOOR, CEIL, TRUNC, ROUND, ROUND_EVEN, FRACT, MODF_FRACTION, RADIANS, DEGREES,
+	SIN, COS, TAN, ASIN, ACOS, ATAN, SINH, COSH, TANH, ASINH, ACOSH, ATANH, ATAN2,
+	POW, EXP, LOG, EXP2, LOG2, SQRT, INVERSE_SQRT, LDEXP, FREXP_MANTISSA, FREXP_EXPONENT, QUANTIZE_F16,
+	FLOAT_TO_UINT, FLOAT_TO_INT, INT_TO_FLOAT, UINT_TO_FLOAT,
+
+	// Across the components of a vector, count is the size of the input vector.
+	DOT, LENGTH, DISTANCE, NORMALIZE, CROSS, FACE_FORWARD, REFLECT, REFRACT, ANY, ALL,
+	PACK_SNORM4X8, PACK_UNORM4X8, PACK_SNORM2X16, PACK_UNORM2X16, PACK_HALF2X16,
+	VECTOR_EXTRACT, VECTOR_INSERT,
+	// count is the size of the output vector.
+	UNPACK_SNORM4X8, UNPACK_UNORM4X8, UNPACK_SNORM2X16, UNPACK_UNORM2X16, UNPACK_HALF2X16,
+
+	// Memory, pointers are byte offsets into the region of their variable.
+	ADDRESS,				// result = operand 0 + value
+	INDEX,					// result = operand 0 + operand 1 * value
+	LOAD,					// value is the layout of the loaded type
+	STORE,
+	ATOMIC,					// value is the SPIR-V opcode
+	ARRAY_LENGTH,			// value is the offset of the array in the buffer, value2 the stride
+	IMAGE_READ,
+	IMAGE_WRITE,			// value is the component count of the texel
+	IMAGE_SIZE,
+};
+
+struct Operation
+{
+	Code								code					= Code::COPY;
+	uint32_t							count					= 1;
+	uint32_t							result					= 0;		// first register of the result
+	uint32_t							operands[ 4 ]			= {};		// first register of each operand
+	uint32_t							steps[ 4 ]				= { 1, 1, 1, 1 };	// 0 uses the first component of the operand for every component
+	uint32_t							region					= 0;
+	uint32_t							value					= 0;
+	uint32_t							value2					= 0;
+};
+
+enum class Exit : uint8_t
+{
+	BRANCH,
+	CONDITIONAL,
+	SWITCH,
+	RETURN,
+};
+
+struct Block
+{
+	uint32_t							first_operation			= 0;
+	uint32_t							operation_count			= 0;
+	Exit								exit					= Exit::RETURN;
+	uint32_t							condition				= 0;		// register of the condition or the selector
+	uint32_t							targets[ 2 ]			= {};		// true and false target, the default of a switch
+	uint32_t							first_case				= 0;
+	uint32_t							case_count				= 0;
+};
+
+enum class RegionType : uint8_t
+{
+	BUFFER,
+	PUSH_CONSTANTS,
+	WORKGROUP,
+	INVOCATION,			// private and function variables and the built-in inputs, one copy per lane
+	IMAGE,
+};
+
+struct Region
+{
+	RegionType							type					= RegionType::INVOCATION;
+	uint32_t							set						= 0;
+	uint32_t							binding					= 0;
+	uint32_t							offset					= 0;		// into the workgroup or invocation memory
+	uint32_t							size					= 0;
+	uint32_t							builtin					= UINT32_MAX;
+};
+
+// Where a region is for the workgroup that runs.
+struct RegionMemory
+{
+	uint8_t							*	data					= nullptr;
+	size_t								size					= 0;
+	size_t								lane_stride				= 0;
+	const CpuStorageImage			*	image					= nullptr;
+	bool								shared					= false;	// other workgroups use it at the same time
+};
+
+// Division by zero, INT_MIN / -1 and too wide shifts are undefined in SPIR-V, they must not
+// crash the executor.
+inline uint32_t DivideUnsigned( uint32_t a, uint32_t b )		{ return b ? a / b : 0; }
+inline uint32_t ModuloUnsigned( uint32_t a, uint32_t b )		{ return b ? a % b : 0; }
+
+inline uint32_t DivideSigned( uint32_t a, uint32_t b )
+{
+	if( b == 0 ) return 0;
+	if( a == 0x80000000u && b == 0xFFFFFFFFu ) return a;
+	return uint32_t( int32_t( a ) / int32_t( b ) );
+}
+
+inline uint32_t RemainderSigned( uint32_t a, uint32_t b )
+{
+	if( b == 0 || b == 0xFFFFFFFFu ) return 0;
+	return uint32_t( int32_t( a ) % int32_t( b ) );
+}
+
+inline uint32_t ModuloSigned( uint32_t a, uint32_t b )
+{
+	uint32_t remainder = RemainderSigned( a, b );
+	if( remainder != 0 && ( int32_t( remainder ) < 0 ) != ( int32_t( b ) < 0 ) ) remainder += b;
+	return remainder;
+}
+
+inline uint32_t ShiftRightArithmetic( uint32_t a, uint32_t b )	{ return uint32_t( int32_t( a ) >> ( b & 31 ) ); }
+inline uint32_t BitMask( uint32_t count )						{ return count >= 32 ? 0xFFFFFFFFu : ( 1u << count ) - 1; }
+
+inline uint32_t BitCount( uint32_t value )
+{
+	value = value - ( ( value >> 1 ) & 0x55555555u );
+	value = ( value & 0x33333333u ) + ( ( value >> 2 ) & 0x33333333u );
+	return ( ( ( value + ( value >> 4 ) ) & 0x0F0F0F0Fu ) * 0x01010101u ) >> 24;
+}
+
+inline uint32_t BitReverse( uint32_t value )
+{
+	value = ( ( value >> 1 ) & 0x55555555u ) | ( ( value & 0x55555555u ) << 1 );
+	value = ( ( value >> 2 ) & 0x33333333u ) | ( ( value & 0x33333333u ) << 2 );
+	value = ( ( value >> 4 ) & 0x0F0F0F0Fu ) | ( ( value & 0x0F0F0F0Fu ) << 4 );
+	value = ( ( value >> 8 ) & 0x00FF00FFu ) | ( ( value & 0x00FF00FFu ) << 8 );
+	return ( value >> 16 ) | ( value << 16 );
+}
+
+// -1 if no bit is set.
+inline uint32_t FindLsb( uint32_t value )
+{
+	if( !value ) return UINT32_MAX;
+	uint32_t bit = 0;
+	while( !( value & 1 ) ) { value >>= 1; ++bit; }
+	return bit;
+}
+
+inline uint32_t FindMsb( uint32_t value )
+{
+	if( !value ) return UINT32_MAX;
+	uint32_t bit = 31;
+	while( !( value & 0x80000000u ) ) { value <<= 1; --bit; }
+	return bit;
+}
+
+inline uint32_t BitFieldInsert( uint32_t base, uint32_t insert, uint32_t offset, uint32_t count )
+{
+	uint32_t mask = BitMask( count ) << ( offset & 31 );
+	return ( base & ~mask ) | ( ( insert << ( offset & 31 ) ) & mask );
+}
+
+inline uint32_t BitFieldExtract( uint32_t base, uint32_t offset, uint32_t count, bool sign_extend )
+{
+	if( count == 0 ) return 0;
+	uint32_t value = ( base >> ( offset & 31 ) ) & BitMask( count );
+	if( sign_extend && count < 32 && ( value >> ( count - 1 ) ) & 1 ) value |= ~BitMask( count );
+	return value;
+}
+
+// Out of range conversions are undefined, they saturate here. NaN converts to zero.
+inline uint32_t FloatToUint( float value )
+{
+	if( !( value > 0.0f ) ) return 0;
+	if( value >= 4294967296.0f ) return UINT32_MAX;
+	return uint32_t( value );
+}
+
+inline uint32_t FloatToInt( float value )
+{
+	if( value != value ) return 0;
+	if( value <= -2147483648.0f ) return 0x80000000u;
+	if( value >= 2147483648.0f ) return 0x7FFFFFFFu;
+	return uint32_t( int32_t( value ) );
+}
+
+inline float Saturate( float value )			{ return value > 0.0f ? ( value < 1.0f ? value : 1.0f ) : 0.0f; }
+inline float SignedSaturate( float value )		{ return value > -1.0f ? ( value < 1.0f ? value : 1.0f ) : -1.0f; }
+inline uint32_t PackUnorm( float value, float scale )	{ return uint32_t( std::round( Saturate( value ) * scale ) ); }
+inline uint32_t PackSnorm( float value, float scale )	{ return uint32_t( int32_t( std::round( SignedSaturate( value ) * scale ) ) ); }
+
+// Round to nearest even, too large values become infinity.
+uint32_t FloatToHalf( float value )
+{
+	uint32_t bits;
+	std::memcpy( &bits, &value, sizeof( bits ) );
+	uint32_t sign		= ( bits >> 16 ) & 0x8000u;
+	uint32_t exponent	= ( bits >> 23 ) & 0xFFu;
+	uint32_t mantissa	= bits & 0x7FFFFFu;
+	if( exponent == 0xFF ) return sign | 0x7C00u | ( mantissa ? 0x200u : 0 );
+
+	int32_t half_exponent = int32_t( exponent ) - 127 + 15;
+	if( half_exponent >= 31 ) return sign | 0x7C00u;
+	if( half_exponent <= 0 ) {
+		if( half_exponent < -10 ) return sign;
+		mantissa		|= 0x800000u;
+		uint32_t shift	= uint32_t( 14 - half_exponent );
+		uint32_t half	= mantissa >> shift;
+		uint32_t rest	= mantissa & ( ( 1u << shift ) - 1 );
+		uint32_t middle	= 1u << ( shift - 1 );
+		if( rest > middle || ( rest == middle && ( half & 1 ) ) ) ++half;
+		return sign | half;
+	}
+	uint32_t half = sign | ( uint32_t( half_exponent ) << 10 ) | ( mantissa >> 13 );
+	uint32_t rest = mantissa & 0x1FFFu;
+	if( rest > 0x1000u || ( rest == 0x1000u && ( half & 1 ) ) ) ++half;
+	return half;
+}
+
+float HalfToFloat( uint32_t half )
+{
+	uint32_t sign		= ( half & 0x8000u ) << 16;
+	uint32_t exponent	= ( half >> 10 ) & 0x1Fu;
+	uint32_t mantissa	= half & 0x3FFu;
+	if( exponent == 0 ) {
+		float value = std::ldexp( float( mantissa ), -24 );
+		return sign ? -value : value;
+	}
+	uint32_t bits = sign | ( exponent == 31 ? 0x7F800000u : ( exponent - 15 + 127 ) << 23 ) | ( mantissa << 13 );
+	float value;
+	std::memcpy( &value, &bits, sizeof( value ) );
+	return value;
+}
+
+// Atomics on buffers are shared with the workgroups of other threads.
+std::mutex								atomic_mutexes[ 64 ];
+
+} // namespace
+
+struct CpuComputeProgram
+{
+	std::vector<Operation>				operations;
+	std::vector<Block>					blocks;					// block 0 runs first, lanes in lower blocks run first
+	std::vector<std::pair<uint32_t, uint32_t>>	cases;			// switch literal and target block
+	std::vector<std::vector<uint32_t>>	layouts;				// byte offset of every component of a type in memory
+	std::vector<Region>					regions;
+	std::vector<std::pair<uint32_t, uint32_t>>	constants;		// register and bits
+	uint32_t							register_count			= 0;
+	uint32_t							invocation_memory_size	= 0;
+	uint32_t							workgroup_memory_size	= 0;
+	uint32_t							workgroup_size[ 3 ]		= { 1, 1, 1 };
+	uint32_t							lane_count				= 1;
+};
+
+// Everything one thread needs to run workgroups of the program.
+struct CpuComputeContext
+{
+	Word							*	Register( uint32_t index )
+	{
+		return registers.data() + size_t( index ) * lane_count;
+	}
+
+	std::vector<Word>					registers;
+	std::vector<uint8_t>				invocation_memory;
+	std::vector<uint8_t>				workgroup_memory;
+	std::vector<RegionMemory>			regions;
+	std::vector<uint32_t>				lane_blocks;
+	std::vector<uint32_t>				active_lanes;
+	uint32_t							lane_count				= 0;
+	bool								dense					= true;		// every lane is active
+};
+
+namespace {
+
+// The lane loops. All lanes in order when every lane is active, which the compiler can
+// vectorize, the active ones otherwise.
+template<typename Function>
+inline void ForEachLane( const CpuComputeContext & context, Function function )
+{
+	if( context.dense ) {
+		for( uint32_t lane=0; lane < context.lane_count; ++lane ) function( lane );
+	} else {
+		for( auto lane : context.active_lanes ) function( lane );
+	}
+}
+
+template<typename Function>
+void Unary( CpuComputeContext & context, const Operation & operation, Function function )
+{
+	for( uint32_t c=0; c < operation.count; ++c ) {
+		Word		*	result	= context.Register( operation.result + c );
+		const Word	*	a		= context.Register( operation.operands[ 0 ] + c * operation.steps[ 0 ] );
+		ForEachLane( context, [ = ]( uint32_t lane ) {
+			result[ lane ] = function( a[ lane ] );
+		} );
+	}
+}
+
+template<typename Function>
+void Binary( CpuComputeContext & context, const Operation & operation, Function function )
+{
+	for( uint32_t c=0; c < operation.count; ++c ) {
+		Word		*	result	= context.Register( operation.result + c );
+		const Word	*	a		= context.Register( operation.operands[ 0 ] + c * operation.steps[ 0 ] );
+		const Word	*	b		= context.Register( operation.operands[ 1 ] + c * operation.steps[ 1 ] );
+		ForEachLane( context, [ = ]( uint32_t lane ) {
+			result[ lane ] = function( a[ lane ], b[ lane ] );
+		} );
+	}
+}
+
+template<typename Function>
+void Ternary( CpuComputeContext & context, const Operation & operation, Function function )
+{
+	for( uint32_t c=0; c < operation.count; ++c ) {
+		Word		*	result	= context.Register( operation.result + c );
+		const Word	*	a		= context.Register( operation.operands[ 0 ] + c * operation.steps[ 0 ] );
+		const Word	*	b		= context.Register( operation.operands[ 1 ] + c * operation.steps[ 1 ] );
+		const Word	*	d		= context.Register( operation.operands[ 2 ] + c * operation.steps[ 2 ] );
+		ForEachLane( context, [ = ]( uint32_t lane ) {
+			result[ lane ] = function( a[ lane ], b[ lane ], d[ lane ] );
+		} );
+	}
+}
+
+// Components an operation across components reads from each operand and writes to the
+// result, n is the count of the operation.
+uint32_t AcrossOperandCount( Code code, uint32_t operand, uint32_t n )
+{
+	switch( code ) {
+	case Code::DOT:
+	case Code::DISTANCE:
+	case Code::REFLECT:				return operand < 2 ? n : 0;
+	case Code::LENGTH:
+	case Code::NORMALIZE:
+	case Code::ANY:
+	case Code::ALL:
+	case Code::PACK_SNORM4X8:
+	case Code::PACK_UNORM4X8:
+	case Code::PACK_SNORM2X16:
+	case Code::PACK_UNORM2X16:
+	case Code::PACK_HALF2X16:		return operand < 1 ? n : 0;
+	case Code::CROSS:				return operand < 2 ? 3 : 0;
+	case Code::FACE_FORWARD:		return n;
+	case Code::REFRACT:				return operand < 2 ? n : 1;
+	case Code::VECTOR_EXTRACT:		return operand == 0 ? n : operand == 1 ? 1 : 0;
+	case Code::VECTOR_INSERT:		return operand == 0 ? n : 1;
+	default:						return operand < 1 ? 1 : 0;		// the unpacks
+	}
+}
+
+uint32_t AcrossResultCount( Code code, uint32_t n )
+{
+	switch( code ) {
+	case Code::NORMALIZE:
+	case Code::FACE_FORWARD:
+	case Code::REFLECT:
+	case Code::REFRACT:
+	case Code::VECTOR_INSERT:
+	case Code::UNPACK_SNORM4X8:
+	case Code::UNPACK_UNORM4X8:
+	case Code::UNPACK_SNORM2X16:
+	case Code::UNPACK_UNORM2X16:
+	case Code::UNPACK_HALF2X16:		return n;
+	case Code::CROSS:				return 3;
+	default:						return 1;
+	}
+}
+
+// Registers of the components of a vector, components past count repeat the last one.
+template<typename Pointer>
+void Components( CpuComputeContext & context, uint32_t first, uint32_t count, Pointer components[ 4 ] )
+{
+	for( uint32_t c=0; c < 4; ++c ) {
+		components[ c ] = context.Register( first + std::min( c, std::max( count, 1u ) - 1 ) );
+	}
+}
+
+void ExecuteAcrossComponents( CpuComputeContext & context, const Operation & operation )
+{
+	const Word * a[ 4 ];
+	const Word * b[ 4 ];
+	const Word * d[ 4 ];
+	uint32_t n = operation.count;
+	Components( context, operation.operands[ 0 ], AcrossOperandCount( operation.code, 0, n ), a );
+	Components( context, operation.operands[ 1 ], AcrossOperandCount( operation.code, 1, n ), b );
+	Components( context, operation.operands[ 2 ], AcrossOperandCount( operation.code, 2, n ), d );
+	Word * result[ 4 ];
+	Components( context, operation.result, AcrossResultCount( operation.code, n ), result );
+
+	switch( operation.code ) {
+	case Code::DOT:
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			float sum = 0.0f;
+			for( uint32_t c=0; c < n; ++c ) sum += a[ c ][ lane ].f * b[ c ][ lane ].f;
+			result[ 0 ][ lane ].f = sum;
+		} );
+		break;
+	case Code::LENGTH:
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			float sum = 0.0f;
+			for( uint32_t c=0; c < n; ++c ) sum += a[ c ][ lane ].f * a[ c ][ lane ].f;
+			result[ 0 ][ lane ].f = std::sqrt( sum );
+		} );
+		break;
+	case Code::DISTANCE:
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			float sum = 0.0f;
+			for( uint32_t c=0; c < n; ++c ) {
+				float difference = a[ c ][ lane ].f - b[ c ][ lane ].f;
+				sum += difference * difference;
+			}
+			result[ 0 ][ lane ].f = std::sqrt( sum );
+		} );
+		break;
+	case Code::NORMALIZE:
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			float sum = 0.0f;
+			for( uint32_t c=0; c < n; ++c ) sum += a[ c ][ lane ].f * a[ c ][ lane ].f;
+			float scale = 1.0f / std::sqrt( sum );
+			float normalized[ 4 ];
+			for( uint32_t c=0; c < n; ++c ) normalized[ c ] = a[ c ][ lane ].f * scale;
+			for( uint32_t c=0; c < n; ++c ) result[ c ][ lane ].f = normalized[ c ];
+		} );
+		break;
+	case Code::CROSS:
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			float x = a[ 1 ][ lane ].f * b[ 2 ][ lane ].f - b[ 1 ][ lane ].f * a[ 2 ][ lane ].f;
+			float y = a[ 2 ][ lane ].f * b[ 0 ][ lane ].f - b[ 2 ][ lane ].f * a[ 0 ][ lane ].f;
+			float z = a[ 0 ][ lane ].f * b[ 1 ][ lane ].f - b[ 0 ][ lane ].f * a[ 1 ][ lane ].f;
+			result[ 0 ][ lane ].f = x;
+			result[ 1 ][ lane ].f = y;
+			result[ 2 ][ lane ].f = z;
+		} );
+		break;
+	case Code::FACE_FORWARD:
+		// N, I and Nref.
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			float dot = 0.0f;
+			for( uint32_t c=0; c < n; ++c ) dot += d[ c ][ lane ].f * b[ c ][ lane ].f;
+			float values[ 4 ];
+			for( uint32_t c=0; c < n; ++c ) values[ c ] = dot < 0.0f ? a[ c ][ lane ].f : -a[ c ][ lane ].f;
+			for( uint32_t c=0; c < n; ++c ) result[ c ][ lane ].f = values[ c ];
+		} );
+		break;
+	case Code::REFLECT:
+		// I and N.
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			float dot = 0.0f;
+			for( uint32_t c=0; c < n; ++c ) dot += a[ c ][ lane ].f * b[ c ][ lane ].f;
+			float values[ 4 ];
+			for( uint32_t c=0; c < n; ++c ) values[ c ] = a[ c ][ lane ].f - 2.0f * dot * b[ c ][ lane ].f;
+			for( uint32_t c=0; c < n; ++c ) result[ c ][ lane ].f = values[ c ];
+		} );
+		break;
+	case Code::REFRACT:
+		// I, N and the scalar eta.
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			float dot = 0.0f;
+			for( uint32_t c=0; c < n; ++c ) dot += a[ c ][ lane ].f * b[ c ][ lane ].f;
+			float eta	= d[ 0 ][ lane ].f;
+			float k		= 1.0f - eta * eta * ( 1.0f - dot * dot );
+			float values[ 4 ];
+			for( uint32_t c=0; c < n; ++c ) values[ c ] = k < 0.0f ? 0.0f : eta * a[ c ][ lane ].f - ( eta * dot + std::sqrt( k ) ) * b[ c ][ lane ].f;
+			for( uint32_t c=0; c < n; ++c ) result[ c ][ lane ].f = values[ c ];
+		} );
+		break;
+	case Code::ANY:
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			uint32_t any = 0;
+			for( uint32_t c=0; c < n; ++c ) any |= a[ c ][ lane ].u;
+			result[ 0 ][ lane ].u = any;
+		} );
+		break;
+	case Code::ALL:
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			uint32_t all = 1;
+			for( uint32_t c=0; c < n; ++c ) all &= a[ c ][ lane ].u;
+			result[ 0 ][ lane ].u = all;
+		} );
+		break;
+	case Code::PACK_SNORM4X8:
+	case Code::PACK_UNORM4X8:
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			uint32_t packed = 0;
+			for( uint32_t c=0; c < 4; ++c ) {
+				uint32_t bits = operation.code == Code::PACK_UNORM4X8 ? PackUnorm( a[ c ][ lane ].f, 255.0f ) : PackSnorm( a[ c ][ lane ].f, 127.0f );
+				packed |= ( bits & 0xFFu ) << ( c * 8 );
+			}
+			result[ 0 ][ lane ].u = packed;
+		} );
+		break;
+	case Code::PACK_SNORM2X16:
+	case Code::PACK_UNORM2X16:
+	case Code::PACK_HALF2X16:
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			uint32_t packed = 0;
+			for( uint32_t c=0; c < 2; ++c ) {
+				uint32_t bits;
+				if( operation.code == Code::PACK_UNORM2X16 )		bits = PackUnorm( a[ c ][ lane ].f, 65535.0f );
+				else if( operation.code == Code::PACK_SNORM2X16 )	bits = PackSnorm( a[ c ][ lane ].f, 32767.0f );
+				else												bits = FloatToHalf( a[ c ][ lane ].f );
+				packed |= ( bits & 0xFFFFu ) << ( c * 16 );
+			}
+			result[ 0 ][ lane ].u = packed;
+		} );
+		break;
+	case Code::UNPACK_SNORM4X8:
+	case Code::UNPACK_UNORM4X8:
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			uint32_t packed = a[ 0 ][ lane ].u;
+			for( uint32_t c=0; c < 4; ++c ) {
+				uint32_t bits = ( packed >> ( c * 8 ) ) & 0xFFu;
+				result[ c ][ lane ].f = operation.code == Code::UNPACK_UNORM4X8 ? float( bits ) / 255.0f :
+					SignedSaturate( float( int8_t( bits ) ) / 127.0f );
+			}
+		} );
+		break;
+	case Code::UNPACK_SNORM2X16:
+	case Code::UNPACK_UNORM2X16:
+	case Code::UNPACK_HALF2X16:
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			uint32_t packed = a[ 0 ][ lane ].u;
+			for( uint32_t c=0; c < 2; ++c ) {
+				uint32_t bits = ( packed >> ( c * 16 ) ) & 0xFFFFu;
+				if( operation.code == Code::UNPACK_UNORM2X16 )			result[ c ][ lane ].f = float( bits ) / 65535.0f;
+				else if( operation.code == Code::UNPACK_SNORM2X16 )		result[ c ][ lane ].f = SignedSaturate( float( int16_t( bits ) ) / 32767.0f );
+				else													result[ c ][ lane ].f = HalfToFloat( bits );
+			}
+		} );
+		break;
+	case Code::VECTOR_EXTRACT:
+		// Vector and index, an index out of range reads zero.
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			uint32_t index = b[ 0 ][ lane ].u;
+			result[ 0 ][ lane ].u = index < n ? a[ index ][ lane ].u : 0;
+		} );
+		break;
+	case Code::VECTOR_INSERT:
+		// Vector, component and index.
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			uint32_t index = d[ 0 ][ lane ].u;
+			for( uint32_t c=0; c < n; ++c ) result[ c ][ lane ].u = c == index ? b[ 0 ][ lane ].u : a[ c ][ lane ].u;
+		} );
+		break;
+	default:
+		assert( 0 && "Cpu compute executor: not an operation across components." );
+		break;
+	}
+}
+
+void ExecuteMemory( const CpuComputeProgram & program, CpuComputeContext & context, const Operation & operation )
+{
+	auto & memory = context.regions[ operation.region ];
+	switch( operation.code ) {
+	case Code::LOAD:
+	{
+		auto & layout		= program.layouts[ operation.value ];
+		const Word * offset	= context.Register( operation.operands[ 0 ] );
+		for( uint32_t c=0; c < operation.count; ++c ) {
+			Word * result				= context.Register( operation.result + c );
+			uint32_t component_offset	= layout[ c ];
+			ForEachLane( context, [ & ]( uint32_t lane ) {
+				uint64_t at = uint64_t( offset[ lane ].u ) + component_offset;
+				if( at + sizeof( Word ) <= memory.size ) {
+					std::memcpy( &result[ lane ], memory.data + lane * memory.lane_stride + at, sizeof( Word ) );
+				} else {
+					result[ lane ].u = 0;
+				}
+			} );
+		}
+		break;
+	}
+	case Code::STORE:
+	{
+		auto & layout		= program.layouts[ operation.value ];
+		const Word * offset	= context.Register( operation.operands[ 0 ] );
+		for( uint32_t c=0; c < operation.count; ++c ) {
+			const Word * value			= context.Register( operation.operands[ 1 ] + c );
+			uint32_t component_offset	= layout[ c ];
+			ForEachLane( context, [ & ]( uint32_t lane ) {
+				uint64_t at = uint64_t( offset[ lane ].u ) + component_offset;
+				if( at + sizeof( Word ) <= memory.size ) {
+					std::memcpy( memory.data + lane * memory.lane_stride + at, &value[ lane ], sizeof( Word ) );
+				}
+			} );
+		}
+		break;
+	}
+	case Code::ATOMIC:
+	{
+		// The lanes of a workgroup run one after the other, only other workgroups need the lock.
+		const Word * offset		= context.Register( operation.operands[ 0 ] );
+		const Word * value		= context.Register( operation.operands[ 1 ] );
+		const Word * comparator	= context.Register( operation.operands[ 2 ] );
+		Word * result			= context.Register( operation.result );
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			uint64_t at = offset[ lane ].u;
+			if( at + sizeof( Word ) > memory.size ) {
+				result[ lane ].u = 0;
+				return;
+			}
+			uint8_t * address = memory.data + lane * memory.lane_stride + at;
+			std::unique_lock<std::mutex> lock;
+			if( memory.shared ) {
+				lock = std::unique_lock<std::mutex>( atomic_mutexes[ ( uintptr_t( address ) >> 2 ) & 63 ] );
+			}
+			uint32_t original;
+			std::memcpy( &original, address, sizeof( original ) );
+			uint32_t operand	= value[ lane ].u;
+			uint32_t updated	= original;
+			switch( operation.value ) {
+			case spv::OpAtomicLoad:				break;
+			case spv::OpAtomicStore:			updated = operand; break;
+			case spv::OpAtomicExchange:			updated = operand; break;
+			case spv::OpAtomicCompareExchange:	updated = original == comparator[ lane ].u ? operand : original; break;
+			case spv::OpAtomicIIncrement:		updated = original + 1; break;
+			case spv::OpAtomicIDecrement:		updated = original - 1; break;
+			case spv::OpAtomicIAdd:				updated = original + operand; break;
+			case spv::OpAtomicISub:				updated = original - operand; break;
+			case spv::OpAtomicSMin:				updated = int32_t( operand ) < int32_t( original ) ? operand : original; break;
+			case spv::OpAtomicUMin:				updated = std::min( original, operand ); break;
+			case spv::OpAtomicSMax:				updated = int32_t( operand ) > int32_t( original ) ? operand : original; break;
+			case spv::OpAtomicUMax:				updated = std::max( original, operand ); break;
+			case spv::OpAtomicAnd:				updated = original & operand; break;
+			case spv::OpAtomicOr:				updated = original | operand; break;
+			case spv::OpAtomicXor:				updated = original ^ operand; break;
+			default:							break;
+			}
+			std::memcpy( address, &updated, sizeof( updated ) );
+			result[ lane ].u = original;
+		} );
+		break;
+	}
+	case Code::ARRAY_LENGTH:
+	{
+		Word * result		= context.Register( operation.result );
+		uint32_t length		= memory.size > operation.value ? uint32_t( ( memory.size - operation.value ) / operation.value2 ) : 0;
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			result[ lane ].u = length;
+		} );
+		break;
+	}
+	case Code::IMAGE_READ:
+	{
+		// Components the format does not have read as 0, alpha as 1, outside the image everything is 0.
+		auto image			= memory.image;
+		const Word * x		= context.Register( operation.operands[ 0 ] );
+		const Word * y		= context.Register( operation.operands[ 0 ] + 1 );
+		Word * result[ 4 ];
+		Components( context, operation.result, operation.count, result );
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			Word texel[ 4 ] = { UintWord( 0 ), UintWord( 0 ), UintWord( 0 ), UintWord( 0 ) };
+			if( x[ lane ].u < image->width && y[ lane ].u < image->height ) {
+				auto row = static_cast<const uint8_t*>( image->data ) + size_t( y[ lane ].u ) * image->row_pitch;
+				switch( image->format ) {
+				case VK_FORMAT_R8G8B8A8_UNORM:
+					for( uint32_t c=0; c < 4; ++c ) texel[ c ].f = float( row[ x[ lane ].u * 4 + c ] ) / 255.0f;
+					break;
+				case VK_FORMAT_R32G32B32A32_SFLOAT:
+					std::memcpy( texel, row + x[ lane ].u * 16, 16 );
+					break;
+				case VK_FORMAT_R32_SFLOAT:
+					std::memcpy( texel, row + x[ lane ].u * 4, 4 );
+					texel[ 3 ].f = 1.0f;
+					break;
+				default:
+					std::memcpy( texel, row + x[ lane ].u * 4, 4 );
+					texel[ 3 ].u = 1;
+					break;
+				}
+			}
+			for( uint32_t c=0; c < operation.count; ++c ) result[ c ][ lane ] = texel[ c ];
+		} );
+		break;
+	}
+	case Code::IMAGE_WRITE:
+	{
+		auto image			= memory.image;
+		const Word * x		= context.Register( operation.operands[ 0 ] );
+		const Word * y		= context.Register( operation.operands[ 0 ] + 1 );
+		const Word * texel[ 4 ];
+		Components( context, operation.operands[ 1 ], operation.value, texel );
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			if( x[ lane ].u >= image->width || y[ lane ].u >= image->height ) return;
+			auto row = static_cast<uint8_t*>( image->data ) + size_t( y[ lane ].u ) * image->row_pitch;
+			switch( image->format ) {
+			case VK_FORMAT_R8G8B8A8_UNORM:
+				for( uint32_t c=0; c < 4; ++c ) row[ x[ lane ].u * 4 + c ] = uint8_t( PackUnorm( c < operation.value ? texel[ c ][ lane ].f : 0.0f, 255.0f ) );
+				break;
+			case VK_FORMAT_R32G32B32A32_SFLOAT:
+				for( uint32_t c=0; c < 4; ++c ) {
+					Word component = c < operation.value ? texel[ c ][ lane ] : UintWord( 0 );
+					std::memcpy( row + x[ lane ].u * 16 + c * 4, &component, 4 );
+				}
+				break;
+			default:
+				std::memcpy( row + x[ lane ].u * 4, &texel[ 0 ][ lane ], 4 );
+				break;
+			}
+		} );
+		break;
+	}
+	case Code::IMAGE_SIZE:
+	{
+		Word * width	= context.Register( operation.result );
+		Word * height	= context.Register( operation.result + 1 );
+		auto image		= memory.image;
+		ForEachLane( context, [ & ]( uint32_t lane ) {
+			width[ lane ].u		= image->width;
+			height[ lane ].u	= image->height;
+		} );
+		break;
+	}
+	default:
+		assert( 0 && "Cpu compute executor: not a memory operation." );
+		break;
+	}
+}
+
+void Execute( const CpuComputeProgram & program, CpuComputeContext & context, const Operation & operation )
+{
+	switch( operation.code ) {
+	case Code::COPY:					Unary( context, operation, []( Word a ) { return a; } ); break;
+
+	case Code::IADD:					Binary( context, operation, []( Word a, Word b ) { return UintWord( a.u + b.u ); } ); break;
+	case Code::ISUB:					Binary( context, operation, []( Word a, Word b ) { return UintWord( a.u - b.u ); } ); break;
+	case Code::IMUL:					Binary( context, operation, []( Word a, Word b ) { return UintWord( a.u * b.u ); } ); break;
+	case Code::UDIV:					Binary( context, operation, []( Word a, Word b ) { return UintWord( DivideUnsigned( a.u, b.u ) ); } ); break;
+	case Code::SDIV:					Binary( context, operation, []( Word a, Word b ) { return UintWord( DivideSigned( a.u, b.u ) ); } ); break;
+	case Code::UMOD:					Binary( context, operation, []( Word a, Word b ) { return UintWord( ModuloUnsigned( a.u, b.u ) ); } ); break;
+	case Code::SREM:					Binary( context, operation, []( Word a, Word b ) { return UintWord( RemainderSigned( a.u, b.u ) ); } ); break;
+	case Code::SMOD:					Binary( context, operation, []( Word a, Word b ) { return UintWord( ModuloSigned( a.u, b.u ) ); } ); break;
+	case Code::SNEGATE:					Unary( context, operation, []( Word a ) { return UintWord( 0u - a.u ); } ); break;
+	case Code::CARRY:					Binary( context, operation, []( Word a, Word b ) { return UintWord( a.u + b.u < a.u ? 1 : 0 ); } ); break;
+	case Code::BORROW:					Binary( context, operation, []( Word a, Word b ) { return UintWord( a.u < b.u ? 1 : 0 ); } ); break;
+	case Code::UMUL_HIGH:				Binary( context, operation, []( Word a, Word b ) { return UintWord( uint32_t( ( uint64_t( a.u ) * b.u ) >> 32 ) ); } ); break;
+	case Code::SMUL_HIGH:				Binary( context, operation, []( Word a, Word b ) { return UintWord( uint32_t( uint64_t( int64_t( a.i ) * b.i ) >> 32 ) ); } ); break;
+	case Code::SHIFT_LEFT:				Binary( context, operation, []( Word a, Word b ) { return UintWord( a.u << ( b.u & 31 ) ); } ); break;
+	case Code::SHIFT_RIGHT:				Binary( context, operation, []( Word a, Word b ) { return UintWord( a.u >> ( b.u & 31 ) ); } ); break;
+	case Code::SHIFT_RIGHT_ARITHMETIC:	Binary( context, operation, []( Word a, Word b ) { return UintWord( ShiftRightArithmetic( a.u, b.u ) ); } ); break;
+	case Code::AND:						Binary( context, operation, []( Word a, Word b ) { return UintWord( a.u & b.u ); } ); break;
+	case Code::OR:						Binary( context, operation, []( Word a, Word b ) { return UintWord( a.u | b.u ); } ); break;
+	case Code::XOR:						Binary( context, operation, []( Word a, Word b ) { return UintWord( a.u ^ b.u ); } ); break;
+	case Code::NOT:						Unary( context, operation, []( Word a ) { return UintWord( ~a.u ); } ); break;
+	case Code::BOOL_NOT:				Unary( context, operation, []( Word a ) { return UintWord( a.u ^ 1 ); } ); break;
+	case Code::IEQUAL:					Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.u == b.u ); } ); break;
+	case Code::INOT_EQUAL:				Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.u != b.u ); } ); break;
+	case Code::ULESS:					Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.u < b.u ); } ); break;
+	case Code::ULESS_EQUAL:				Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.u <= b.u ); } ); break;
+	case Code::UGREATER:				Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.u > b.u ); } ); break;
+	case Code::UGREATER_EQUAL:			Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.u >= b.u ); } ); break;
+	case Code::SLESS:					Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.i < b.i ); } ); break;
+	case Code::SLESS_EQUAL:				Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.i <= b.i ); } ); break;
+	case Code::SGREATER:				Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.i > b.i ); } ); break;
+	case Code::SGREATER_EQUAL:			Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.i >= b.i ); } ); break;
+	case Code::UMIN:					Binary( context, operation, []( Word a, Word b ) { return b.u < a.u ? b : a; } ); break;
+	case Code::UMAX:					Binary( context, operation, []( Word a, Word b ) { return a.u < b.u ? b : a; } ); break;
+	case Code::SMIN:					Binary( context, operation, []( Word a, Word b ) { return b.i < a.i ? b : a; } ); break;
+	case Code::SMAX:					Binary( context, operation, []( Word a, Word b ) { return a.i < b.i ? b : a; } ); break;
+	case Code::UCLAMP:					Ternary( context, operation, []( Word x, Word low, Word high ) { return UintWord( std::min( std::max( x.u, low.u ), high.u ) ); } ); break;
+	case Code::SCLAMP:					Ternary( context, operation, []( Word x, Word low, Word high ) { return UintWord( uint32_t( std::min( std::max( x.i, low.i ), high.i ) ) ); } ); break;
+	case Code::SABS:					Unary( context, operation, []( Word a ) { return UintWord( a.i < 0 ? 0u - a.u : a.u ); } ); break;
+	case Code::SSIGN:					Unary( context, operation, []( Word a ) { return UintWord( a.i > 0 ? 1u : a.i < 0 ? UINT32_MAX : 0u ); } ); break;
+	case Code::BIT_COUNT:				Unary( context, operation, []( Word a ) { return UintWord( BitCount( a.u ) ); } ); break;
+	case Code::BIT_REVERSE:				Unary( context, operation, []( Word a ) { return UintWord( BitReverse( a.u ) ); } ); break;
+	case Code::BIT_SEXTRACT:			Ternary( context, operation, []( Word base, Word offset, Word count ) { return UintWord( BitFieldExtract( base.u, offset.u, count.u, true ) ); } ); break;
+	case Code::BIT_UEXTRACT:			Ternary( context, operation, []( Word base, Word offset, Word count ) { return UintWord( BitFieldExtract( base.u, offset.u, count.u, false ) ); } ); break;
+	case Code::FIND_LSB:				Unary( context, operation, []( Word a ) { return UintWord( FindLsb( a.u ) ); } ); break;
+	case Code::FIND_SMSB:				Unary( context, operation, []( Word a ) { return UintWord( FindMsb( a.i < 0 ? ~a.u : a.u ) ); } ); break;
+	case Code::FIND_UMSB:				Unary( context, operation, []( Word a ) { return UintWord( FindMsb( a.u ) ); } ); break;
+	case Code::SELECT:					Ternary( context, operation, []( Word condition, Word a, Word b ) { return condition.u ? a : b; } ); break;
+	case Code::BIT_INSERT:
+		for( uint32_t c=0; c < operation.count; ++c ) {
+			Word		*	result	= context.Register( operation.result + c );
+			const Word	*	base	= context.Register( operation.operands[ 0 ] + c * operation.steps[ 0 ] );
+			const Word	*	insert	= context.Register( operation.operands[ 1 ] + c * operation.steps[ 1 ] );
+			const Word	*	offset	= context.Register( operation.operands[ 2 ] + c * operation.steps[ 2 ] );
+			const Word	*	count	= context.Register( operation.operands[ 3 ] + c * operation.steps[ 3 ] );
+			ForEachLane( context, [ = ]( uint32_t lane ) {
+				result[ lane ].u = BitFieldInsert( base[ lane ].u, insert[ lane ].u, offset[ lane ].u, count[ lane ].u );
+			} );
+		}
+		break;
+
+	case Code::FADD:					Binary( context, operation, []( Word a, Word b ) { return FloatWord( a.f + b.f ); } ); break;
+	case Code::FSUB:					Binary( context, operation, []( Word a, Word b ) { return FloatWord( a.f - b.f ); } ); break;
+	case Code::FMUL:					Binary( context, operation, []( Word a, Word b ) { return FloatWord( a.f * b.f ); } ); break;
+	case Code::FDIV:					Binary( context, operation, []( Word a, Word b ) { return FloatWord( a.f / b.f ); } ); break;
+	case Code::FREM:					Binary( context, operation, []( Word a, Word b ) { return FloatWord( std::fmod( a.f, b.f ) ); } ); break;
+	case Code::FMOD:					Binary( context, operation, []( Word a, Word b ) { return FloatWord( a.f - b.f * std::floor( a.f / b.f ) ); } ); break;
+	case Code::FNEGATE:					Unary( context, operation, []( Word a ) { return FloatWord( -a.f ); } ); break;
+	case Code::FMUL_ADD:				Ternary( context, operation, []( Word a, Word b, Word d ) { return FloatWord( a.f * b.f + d.f ); } ); break;
+	case Code::FORD_EQUAL:				Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.f == b.f ); } ); break;
+	case Code::FORD_NOT_EQUAL:			Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.f < b.f || a.f > b.f ); } ); break;
+	case Code::FORD_LESS:				Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.f < b.f ); } ); break;
+	case Code::FORD_LESS_EQUAL:			Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.f <= b.f ); } ); break;
+	case Code::FORD_GREATER:			Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.f > b.f ); } ); break;
+	case Code::FORD_GREATER_EQUAL:		Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.f >= b.f ); } ); break;
+	case Code::FUNORD_EQUAL:			Binary( context, operation, []( Word a, Word b ) { return BoolWord( !( a.f < b.f || a.f > b.f ) ); } ); break;
+	case Code::FUNORD_NOT_EQUAL:		Binary( context, operation, []( Word a, Word b ) { return BoolWord( a.f != b.f ); } ); break;
+	case Code::FUNORD_LESS:				Binary( context, operation, []( Word a, Word b ) { return BoolWord( !( a.f >= b.f ) ); } ); break;
+	case Code::FUNORD_LESS_EQUAL:		Binary( context, operation, []( Word a, Word b ) { return BoolWord( !( a.f > b.f ) ); } ); break;
+	case Code::FUNORD_GREATER:			Binary( context, operation, []( Word a, Word b ) { return BoolWord( !( a.f <= b.f ) ); } ); break;
+	case Code::FUNORD_GREATER_EQUAL:	Binary( context, operation, []( Word a, Word b ) { return BoolWord( !( a.f < b.f ) ); } ); break;
+	case Code::IS_NAN:					Unary( context, operation, []( Word a ) { return BoolWord( a.f != a.f ); } ); break;
+	case Code::IS_INF:					Unary( context, operation, []( Word a ) { return BoolWord( ( a.u & 0x7FFFFFFFu ) == 0x7F800000u ); } ); break;
+	case Code::FMIN:					Binary( context, operation, []( Word a, Word b ) { return b.f < a.f ? b : a; } ); break;
+	case Code::FMAX:					Binary( context, operation, []( Word a, Word b ) { return a.f < b.f ? b : a; } ); break;
+	case Code::FCLAMP:					Ternary( context, operation, []( Word x, Word low, Word high ) { return FloatWord( std::min( std::max( x.f, low.f ), high.f ) ); } ); break;
+	case Code::NMIN:					Binary( context, operation, []( Word a, Word b ) { return FloatWord( std::fmin( a.f, b.f ) ); } ); break;
+	case Code::NMAX:					Binary( context, operation, []( Word a, Word b ) { return FloatWord( std::fmax( a.f, b.f ) ); } ); break;
+	case Code::NCLAMP:					Ternary( context, operation, []( Word x, Word low, Word high ) { return FloatWord( std::fmin( std::fmax( x.f, low.f ), high.f ) ); } ); break;
+	case Code::FMIX:					Ternary( context, operation, []( Word x, Word y, Word a ) { return FloatWord( x.f * ( 1.0f - a.f ) + y.f * a.f ); } ); break;
+	case Code::STEP:					Binary( context, operation, []( Word edge, Word x ) { return FloatWord( x.f < edge.f ? 0.0f : 1.0f ); } ); break;
+	case Code::SMOOTH_STEP:
+		Ternary( context, operation, []( Word edge0, Word edge1, Word x ) {
+			float t = Saturate( ( x.f - edge0.f ) / ( edge1.f - edge0.f ) );
+			return FloatWord( t * t * ( 3.0f - 2.0f * t ) );
+		} );
+		break;
+	case Code::FMA:						Ternary( context, operation, []( Word a, Word b, Word d ) { return FloatWord( std::fma( a.f, b.f, d.f ) ); } ); break;
+	case Code::FABS:					Unary( context, operation, []( Word a ) { return UintWord( a.u & 0x7FFFFFFFu ); } ); break;
+	case Code::FSIGN:					Unary( context, operation, []( Word a ) { return FloatWord( a.f > 0.0f ? 1.0f : a.f < 0.0f ? -1.0f : 0.0f ); } ); break;
+	case Code::FLOOR:					Unary( context, operation, []( Word a ) { return FloatWord( std::floor( a.f ) ); } ); break;
+	case Code::CEIL:					Unary( context, operation, []( Word a ) { return FloatWord( std::ceil( a.f ) ); } ); break;
+	case Code::TRUNC:					Unary( context, operation, []( Word a ) { return FloatWord( std::trunc( a.f ) ); } ); break;
+	case Code::ROUND:					Unary( context, operation, []( Word a ) { return FloatWord( std::round( a.f ) ); } ); break;
+	case Code::ROUND_EVEN:				Unary( context, operation, []( Word a ) { return FloatWord( std::nearbyint( a.f ) ); } ); break;
+	case Code::FRACT:					Unary( context, operation, []( Word a ) { return FloatWord( a.f - std::floor( a.f ) ); } ); break;
+	case Code::MODF_FRACTION:			Unary( context, operation, []( Word a ) { return FloatWord( a.f - std::trunc( a.f ) ); } ); break;
+	case Code::RADIANS:					Unary( context, operation, []( Word a ) { return FloatWord( a.f * 0.01745329251994329577f ); } ); break;
+	case Code::DEGREES:					Unary( context, operation, []( Word a ) { return FloatWord( a.f * 57.2957795130823208768f ); } ); break;
+	case Code::SIN:						Unary( context, operation, []( Word a ) { return FloatWord( std::sin( a.f ) ); } ); break;
+	case Code::COS:						Unary( context, operation, []( Word a ) { return FloatWord( std::cos( a.f ) ); } ); break;
+	case Code::TAN:						Unary( context, operation, []( Word a ) { return FloatWord( std::tan( a.f ) ); } ); break;
+	case Code::ASIN:					Unary( context, operation, []( Word a ) { return FloatWord( std::asin( a.f ) ); } ); break;
+	case Code::ACOS:					Unary( context, operation, []( Word a ) { return FloatWord( std::acos( a.f ) ); } ); break;
+	case Code::ATAN:					Unary( context, operation, []( Word a ) { return FloatWord( std::atan( a.f ) ); } ); break;
+	case Code::SINH:					Unary( context, operation, []( Word a ) { return FloatWord( std::sinh( a.f ) ); } ); break;
+	case Code::COSH:					Unary( context, operation, []( Word a ) { return FloatWord( std::cosh( a.f ) ); } ); break;
+	case Code::TANH:					Unary( context, operation, []( Word a ) { return FloatWord( std::tanh( a.f ) ); } ); break;
+	case Code::ASINH:					Unary( context, operation, []( Word a ) { return FloatWord( std::asinh( a.f ) ); } ); break;
+	case Code::ACOSH:					Unary( context, operation, []( Word a ) { return FloatWord( std::acosh( a.f ) ); } ); break;
+	case Code::ATANH:					Unary( context, operation, []( Word a ) { return FloatWord( std::atanh( a.f ) ); } ); break;
+	case Code::ATAN2:					Binary( context, operation, []( Word y, Word x ) { return FloatWord( std::atan2( y.f, x.f ) ); } ); break;
+	case Code::POW:						Binary( context, operation, []( Word a, Word b ) { return FloatWord( std::pow( a.f, b.f ) ); } ); break;
+	case Code::EXP:						Unary( context, operation, []( Word a ) { return FloatWord( std::exp( a.f ) ); } ); break;
+	case Code::LOG:						Unary( context, operation, []( Word a ) { return FloatWord( std::log( a.f ) ); } ); break;
+	case Code::EXP2:					Unary( context, operation, []( Word a ) { return FloatWord( std::exp2( a.f ) ); } ); break;
+	case Code::LOG2:					Unary( context, operation, []( Word a ) { return FloatWord( std::log2( a.f ) ); } ); break;
+	case Code::SQRT:					Unary( context, operation, []( Word a ) { return FloatWord( std::sqrt( a.f ) ); } ); break;
+	case Code::INVERSE_SQRT:			Unary( context, operation, []( Word a ) { return FloatWord( 1.0f / std::sqrt( a.f ) ); } ); break;
+	case Code::LDEXP:					Binary( context, operation, []( Word a, Word b ) { return FloatWord( std::ldexp( a.f, b.i ) ); } ); break;
+	case Code::FREXP_MANTISSA:			Unary( context, operation, []( Word a ) { int exponent; return FloatWord( std::frexp( a.f, &exponent ) ); } ); break;
+	case Code::FREXP_EXPONENT:			Unary( context, operation, []( Word a ) { int exponent; std::frexp( a.f, &exponent ); return UintWord( uint32_t( exponent ) ); } ); break;
+	case Code::QUANTIZE_F16:			Unary( context, operation, []( Word a ) { return FloatWord( HalfToFloat( FloatToHalf( a.f ) ) ); } ); break;
+	case Code::FLOAT_TO_UINT:			Unary( context, operation, []( Word a ) { return UintWord( FloatToUint( a.f ) ); } ); break;
+	case Code::FLOAT_TO_INT:			Unary( context, operation, []( Word a ) { return UintWord( FloatToInt( a.f ) ); } ); break;
+	case Code::INT_TO_FLOAT:			Unary( context, operation, []( Word a ) { return FloatWord( float( a.i ) ); } ); break;
+	case Code::UINT_TO_FLOAT:			Unary( context, operation, []( Word a ) { return FloatWord( float( a.u ) ); } ); break;
+
+	case Code::DOT:
+	case Code::LENGTH:
+	case Code::DISTANCE:
+	case Code::NORMALIZE:
+	case Code::CROSS:
+	case Code::FACE_FORWARD:
+	case Code::REFLECT:
+	case Code::REFRACT:
+	case Code::ANY:
+	case Code::ALL:
+	case Code::PACK_SNORM4X8:
+	case Code::PACK_UNORM4X8:
+	case Code::PACK_SNORM2X16:
+	case Code::PACK_UNORM2X16:
+	case Code::PACK_HALF2X16:
+	case Code::UNPACK_SNORM4X8:
+	case Code::UNPACK_UNORM4X8:
+	case Code::UNPACK_SNORM2X16:
+	case Code::UNPACK_UNORM2X16:
+	case Code::UNPACK_HALF2X16:
+	case Code::VECTOR_EXTRACT:
+	case Code::VECTOR_INSERT:
+		ExecuteAcrossComponents( context, operation );
+		break;
+
+	case Code::ADDRESS:
+	{
+		Word		*	result	= context.Register( operation.result );
+		const Word	*	base	= context.Register( operation.operands[ 0 ] );
+		uint32_t		offset	= operation.value;
+		ForEachLane( context, [ = ]( uint32_t lane ) {
+			result[ lane ].u = base[ lane ].u + offset;
+		} );
+		break;
+	}
+	case Code::INDEX:
+	{
+		Word		*	result	= context.Register( operation.result );
+		const Word	*	base	= context.Register( operation.operands[ 0 ] );
+		const Word	*	index	= context.Register( operation.operands[ 1 ] );
+		uint32_t		stride	= operation.value;
+		ForEachLane( context, [ = ]( uint32_t lane ) {
+			result[ lane ].u = base[ lane ].u + index[ lane ].u * stride;
+		} );
+		break;
+	}
+	case Code::LOAD:
+	case Code::STORE:
+	case Code::ATOMIC:
+	case Code::ARRAY_LENGTH:
+	case Code::IMAGE_READ:
+	case Code::IMAGE_WRITE:
+	case Code::IMAGE_SIZE:
+		ExecuteMemory( program, context, operation );
+		break;
+	}
+}
+
+void RunWorkgroup( const CpuComputeProgram & program, CpuComputeContext & context, const uint32_t workgroup_id[ 3 ], const uint32_t group_count[ 3 ] )
+{
+	// The built-in inputs of every lane.
+	for( size_t r=0; r < program.regions.size(); ++r ) {
+		auto & region = program.regions[ r ];
+		if( region.builtin == UINT32_MAX ) continue;
+		for( uint32_t lane=0; lane < context.lane_count; ++lane ) {
+			uint32_t local_id[ 3 ] = {
+				lane % program.workgroup_size[ 0 ],
+				lane / program.workgroup_size[ 0 ] % program.workgroup_size[ 1 ],
+				lane / ( program.workgroup_size[ 0 ] * program.workgroup_size[ 1 ] ),
+			};
+			uint32_t value[ 3 ] = {};
+			switch( region.builtin ) {
+			case spv::BuiltInNumWorkgroups:				std::memcpy( value, group_count, sizeof( value ) ); break;
+			case spv::BuiltInWorkgroupId:				std::memcpy( value, workgroup_id, sizeof( value ) ); break;
+			case spv::BuiltInLocalInvocationId:			std::memcpy( value, local_id, sizeof( value ) ); break;
+			case spv::BuiltInLocalInvocationIndex:		value[ 0 ] = lane; break;
+			case spv::BuiltInGlobalInvocationId:
+				for( uint32_t i=0; i < 3; ++i ) value[ i ] = workgroup_id[ i ] * program.workgroup_size[ i ] + local_id[ i ];
+				break;
+			default:
+				break;
+			}
+			std::memcpy( context.invocation_memory.data() + lane * program.invocation_memory_size + region.offset, value, region.size );
+		}
+	}
+	// Undefined until written, zero is as good as anything and makes runs repeatable.
+	std::fill( context.workgroup_memory.begin(), context.workgroup_memory.end(), uint8_t( 0 ) );
+
+	std::fill( context.lane_blocks.begin(), context.lane_blocks.end(), 0 );
+	while( true ) {
+		// Lanes in the lowest block run next, the blocks of a construct come before its merge
+		// block so lanes that branched apart meet again there.
+		uint32_t current	= LANE_DONE;
+		uint32_t count		= 0;
+		for( auto block : context.lane_blocks ) {
+			if( block < current ) {
+				current		= block;
+				count		= 1;
+			} else if( block == current ) {
+				++count;
+			}
+		}
+		if( current == LANE_DONE ) break;
+
+		context.dense = count == context.lane_count;
+		if( !context.dense ) {
+			context.active_lanes.clear();
+			for( uint32_t lane=0; lane < context.lane_count; ++lane ) {
+				if( context.lane_blocks[ lane ] == current ) context.active_lanes.push_back( lane );
+			}
+		}
+
+		auto & block = program.blocks[ current ];
+		for( uint32_t i=0; i < block.operation_count; ++i ) {
+			Execute( program, context, program.operations[ block.first_operation + i ] );
+		}
+
+		auto & lane_blocks = context.lane_blocks;
+		switch( block.exit ) {
+		case Exit::BRANCH:
+			ForEachLane( context, [ & ]( uint32_t lane ) {
+				lane_blocks[ lane ] = block.targets[ 0 ];
+			} );
+			break;
+		case Exit::CONDITIONAL:
+		{
+			const Word * condition = context.Register( block.condition );
+			ForEachLane( context, [ & ]( uint32_t lane ) {
+				lane_blocks[ lane ] = block.targets[ condition[ lane ].u ? 0 : 1 ];
+			} );
+			break;
+		}
+		case Exit::SWITCH:
+		{
+			const Word * selector = context.Register( block.condition );
+			ForEachLane( context, [ & ]( uint32_t lane ) {
+				uint32_t target = block.targets[ 0 ];
+				for( uint32_t c=0; c < block.case_count; ++c ) {
+					if( program.cases[ block.first_case + c ].first == selector[ lane ].u ) {
+						target = program.cases[ block.first_case + c ].second;
+						break;
+					}
+				}
+				lane_blocks[ lane ] = target;
+			} );
+			break;
+		}
+		case Exit::RETURN:
+			ForEachLane( context, [ & ]( uint32_t lane ) {
+				lane_blocks[ lane ] = LANE_DONE;
+			} );
+			break;
+		}
+	}
+}
+
+// What the lowering keeps about every id of the module.
+struct IdInfo
+{
+	uint32_t							opcode					= 0;
+	uint32_t							offset					= 0;		// first word of the defining instruction
+	uint32_t							component_count			= 0;		// registers a value of the type takes
+	uint32_t							set						= UINT32_MAX;
+	uint32_t							binding					= UINT32_MAX;
+	uint32_t							builtin					= UINT32_MAX;
+	uint32_t							spec_id					= UINT32_MAX;
+	uint32_t							array_stride			= 0;
+	bool								row_major				= false;
+};
+
+struct MemberInfo
+{
+	uint32_t							offset					= UINT32_MAX;
+	uint32_t							matrix_stride			= 0;
+	bool								row_major				= false;
+};
+
+enum class ValueKind : uint8_t
+{
+	NONE,
+	REGISTERS,
+	POINTER,			// reg holds the byte offset into the region
+	IMAGE,
+};
+
+struct Value
+{
+	ValueKind							kind					= ValueKind::NONE;
+	uint32_t							reg						= 0;
+	uint32_t							count					= 0;
+	uint32_t							type					= 0;		// pointee type for pointers
+	uint32_t							region					= 0;
+	uint32_t							matrix_stride			= 0;		// of the matrices a pointer points into
+};
+
+struct Function
+{
+	uint32_t							result_type				= 0;
+	uint32_t							begin					= 0;		// first instruction after OpFunction
+	uint32_t							end						= 0;		// OpFunctionEnd
+	std::vector<uint32_t>				parameters;
+};
+
+struct Phi
+{
+	uint32_t							offset					= 0;		// OpPhi
+	uint32_t							result					= 0;
+	uint32_t							shadow					= 0;		// written by the predecessors, copied to result when the block starts
+	uint32_t							count					= 0;
+};
+
+// One inlined copy of a function.
+struct Instance
+{
+	const Function					*	function				= nullptr;
+	std::unordered_map<uint32_t, Value>	values;
+	std::unordered_map<uint32_t, uint32_t>	blocks;							// label to block
+	std::unordered_map<uint32_t, std::vector<Phi>>	phis;					// by label
+	uint32_t							label					= 0;		// of the block being lowered
+	uint32_t							return_block			= UINT32_MAX;	// UINT32_MAX for the entry point
+	Value								return_value;
+	uint32_t							depth					= 0;
+};
+
+struct PendingBlock
+{
+	std::vector<Operation>				operations;
+	Exit								exit					= Exit::RETURN;
+	uint32_t							condition				= 0;
+	uint32_t							targets[ 2 ]			= {};
+	std::vector<std::pair<uint32_t, uint32_t>>	cases;
+	uint32_t							merge					= UINT32_MAX;
+	uint32_t							continue_target			= UINT32_MAX;
+};
+
+class Lowering
+{
+public:
+	Lowering( const uint32_t * code, size_t word_count, const VkSpecializationInfo * specialization_info, CpuComputeProgram & program, std::string & error ) :
+		_code( code ), _word_count( word_count ), _specialization_info( specialization_info ), _program( program ), _error( error )
+	{
+	}
+
+	bool								Lower();
+
+private:
+	bool								_Fail( const std::string & message );
+	bool								_ValidId( uint32_t id ) const;
+	bool								_ParseGlobal( uint32_t offset, uint32_t opcode, const uint32_t * operands, uint32_t operand_count );
+	bool								_Decorate( uint32_t id, uint32_t decoration, const uint32_t * literals, uint32_t literal_count );
+	bool								_AddType( uint32_t opcode, const uint32_t * operands, uint32_t operand_count, uint32_t offset );
+	bool								_AddConstant( uint32_t opcode, const uint32_t * operands, uint32_t operand_count, uint32_t offset );
+	bool								_FoldSpecConstantOp( const uint32_t * operands, uint32_t operand_count, std::vector<uint32_t> & bits );
+	bool								_AddVariable( const uint32_t * operands, uint32_t operand_count );
+	void								_SetConstant( uint32_t id, uint32_t type, const std::vector<uint32_t> & bits );
+	bool								_SpecializationValue( uint32_t id, uint32_t & value ) const;
+
+	uint32_t							_Allocate( uint32_t count );
+	uint32_t							_Constant( uint32_t bits );
+	uint32_t							_AddRegion( const Region & region );
+	uint32_t							_NewBlock();
+	Operation						&	_Emit( Code code, uint32_t count, uint32_t result );
+	void								_EmitCopy( uint32_t result, uint32_t source, uint32_t count );
+
+	const uint32_t					*	_Type( uint32_t type ) const;		// operands of the defining instruction
+	uint32_t							_Opcode( uint32_t type ) const;
+	uint32_t							_ComponentCount( uint32_t type ) const;
+	uint32_t							_PackedSize( uint32_t type, uint32_t matrix_stride = 0 ) const;
+	uint32_t							_ArrayStride( uint32_t type ) const;
+	uint32_t							_MemberOffset( uint32_t type, uint32_t member ) const;
+	const MemberInfo				*	_FindMember( uint32_t type, uint32_t member ) const;
+	void								_AppendLayout( uint32_t type, uint32_t offset, uint32_t matrix_stride, std::vector<uint32_t> & layout ) const;
+	uint32_t							_Layout( uint32_t type, uint32_t matrix_stride );
+	bool								_FlatOffset( uint32_t type, const uint32_t * indices, uint32_t index_count, uint32_t & offset, uint32_t & result_type ) const;
+
+	uint32_t							_LowerFunction( uint32_t function_id, const std::vector<Value> & arguments, uint32_t return_block, const Value & return_value, uint32_t depth );
+	bool								_LowerInstruction( Instance & instance, uint32_t offset );
+	bool								_LowerExtendedInstruction( Instance & instance, const uint32_t * operands, uint32_t operand_count );
+	bool								_LowerAccessChain( Instance & instance, const uint32_t * operands, uint32_t operand_count );
+	bool								_LowerAtomic( Instance & instance, uint32_t opcode, const uint32_t * operands, uint32_t operand_count );
+	void								_EmitPhiCopies( Instance & instance, uint32_t successor );
+	Value								_Get( Instance & instance, uint32_t id, ValueKind kind );
+	Value								_Result( Instance & instance, uint32_t type, uint32_t id );
+	void								_Componentwise( Code code, const Value & result, std::initializer_list<Value> operands );
+	void								_MatrixTimesVector( const Value & result, const Value & matrix, uint32_t vector_reg, uint32_t matrix_type );
+	void								_Finish();
+	bool								_Verify();
+
+	const uint32_t					*	_code;
+	size_t								_word_count;
+	const VkSpecializationInfo		*	_specialization_info;
+	CpuComputeProgram				&	_program;
+	std::string						&	_error;
+
+	std::vector<IdInfo>					_ids;
+	std::map<std::pair<uint32_t, uint32_t>, MemberInfo>	_members;
+	std::vector<Value>					_globals;
+	std::unordered_map<uint32_t, std::vector<uint32_t>>	_constant_bits;
+	std::unordered_map<uint32_t, Function>	_functions;
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t>	_layouts;
+	std::vector<PendingBlock>			_blocks;
+	uint32_t							_current				= 0;
+	uint32_t							_entry_point			= UINT32_MAX;
+	uint32_t							_glsl					= UINT32_MAX;
+	uint32_t							_zero					= 0;
+	std::vector<std::pair<uint32_t, uint32_t>>	_private_initializers;	// variable and constant
+};
+
+bool Lowering::_Fail( const std::string & message )
+{
+	if( _error.empty() ) _error = message;
+	return false;
+}
+
+bool Lowering::_ValidId( uint32_t id ) const
+{
+	return id > 0 && id < _ids.size();
+}
+
+uint32_t Lowering::_Allocate( uint32_t count )
+{
+	uint32_t first = _program.register_count;
+	_program.register_count += std::max( count, 1u );
+	return first;
+}
+
+uint32_t Lowering::_Constant( uint32_t bits )
+{
+	uint32_t reg = _Allocate( 1 );
+	_program.constants.push_back( std::make_pair( reg, bits ) );
+	return reg;
+}
+
+uint32_t Lowering::_AddRegion( const Region & region )
+{
+	_program.regions.push_back( region );
+	return uint32_t( _program.regions.size() - 1 );
+}
+
+uint32_t Lowering::_NewBlock()
+{
+	_blocks.push_back( PendingBlock() );
+	return uint32_t( _blocks.size() - 1 );
+}
+
+Operation & Lowering::_Emit( Code code, uint32_t count, uint32_t result )
+{
+	auto & operations = _blocks[ _current ].operations;
+	operations.push_back( Operation() );
+	auto & operation	= operations.back();
+	operation.code		= code;
+	operation.count		= count;
+	operation.result	= result;
+	return operation;
+}
+
+void Lowering::_EmitCopy( uint32_t result, uint32_t source, uint32_t count )
+{
+	if( count == 0 ) return;
+	_Emit( Code::COPY, count, result ).operands[ 0 ] = source;
+}
+
+const uint32_t * Lowering::_Type( uint32_t type ) const
+{
+	// Something that is not a type reads as zeros, which no caller takes for a valid type.
+	static const uint32_t none[ 8 ] = {};
+	if( !_ValidId( type ) || !_ids[ type ].offset ) return none;
+	return _code + _ids[ type ].offset + 1;
+}
+
+uint32_t Lowering::_Opcode( uint32_t type ) const
+{
+	return _ValidId( type ) ? _ids[ type ].opcode : 0;
+}
+
+uint32_t Lowering::_ComponentCount( uint32_t type ) const
+{
+	return _ValidId( type ) ? _ids[ type ].component_count : 0;
+}
+
+const MemberInfo * Lowering::_FindMember( uint32_t type, uint32_t member ) const
+{
+	auto found = _members.find( std::make_pair( type, member ) );
+	return found != _members.end() ? &found->second : nullptr;
+}
+
+// Types with Offset and ArrayStride decorations are laid out by them, everything else is
+// packed, 4 bytes per component.
+uint32_t Lowering::_PackedSize( uint32_t type, uint32_t matrix_stride ) const
+{
+	auto operands = _Type( type );
+	switch( _Opcode( type ) ) {
+	case spv::OpTypeBool:
+	case spv::OpTypeInt:
+	case spv::OpTypeFloat:
+		return 4;
+	case spv::OpTypeVector:
+		return 4 * operands[ 2 ];
+	case spv::OpTypeMatrix:
+		return operands[ 2 ] * ( matrix_stride ? matrix_stride : _PackedSize( operands[ 1 ] ) );
+	case spv::OpTypeArray:
+		return _ArrayStride( type ) * ( _ComponentCount( operands[ 1 ] ) ? _ComponentCount( type ) / _ComponentCount( operands[ 1 ] ) : 0 );
+	case spv::OpTypeStruct:
+	{
+		uint32_t size		= 0;
+		uint32_t member_count	= ( _code[ _ids[ type ].offset ] >> spv::WordCountShift ) - 2;
+		for( uint32_t m=0; m < member_count; ++m ) {
+			auto member = _FindMember( type, m );
+			size = std::max( size, _MemberOffset( type, m ) + _PackedSize( operands[ 1 + m ], member ? member->matrix_stride : 0 ) );
+		}
+		return size;
+	}
+	default:
+		return 0;
+	}
+}
+
+uint32_t Lowering::_ArrayStride( uint32_t type ) const
+{
+	if( _ids[ type ].array_stride ) return _ids[ type ].array_stride;
+	return _PackedSize( _Type( type )[ 1 ] );
+}
+
+uint32_t Lowering::_MemberOffset( uint32_t type, uint32_t member ) const
+{
+	auto info = _FindMember( type, member );
+	if( info && info->offset != UINT32_MAX ) return info->offset;
+	uint32_t offset = 0;
+	for( uint32_t m=0; m < member; ++m ) {
+		auto previous = _FindMember( type, m );
+		offset += _PackedSize( _Type( type )[ 1 + m ], previous ? previous->matrix_stride : 0 );
+	}
+	return offset;
+}
+
+void Lowering::_AppendLayout( uint32_t type, uint32_t offset, uint32_t matrix_stride, std::vector<uint32_t> & layout ) const
+{
+	auto operands = _Type( type );
+	switch( _Opcode( type ) ) {
+	case spv::OpTypeBool:
+	case spv::OpTypeInt:
+	case spv::OpTypeFloat:
+		layout.push_back( offset );
+		break;
+	case spv::OpTypeVector:
+		for( uint32_t c=0; c < operands[ 2 ]; ++c ) layout.push_back( offset + c * 4 );
+		break;
+	case spv::OpTypeMatrix:
+	{
+		uint32_t stride = matrix_stride ? matrix_stride : _PackedSize( operands[ 1 ] );
+		for( uint32_t c=0; c < operands[ 2 ]; ++c ) _AppendLayout( operands[ 1 ], offset + c * stride, 0, layout );
+		break;
+	}
+	case spv::OpTypeArray:
+	{
+		uint32_t length = _ComponentCount( operands[ 1 ] ) ? _ComponentCount( type ) / _ComponentCount( operands[ 1 ] ) : 0;
+		for( uint32_t e=0; e < length; ++e ) _AppendLayout( operands[ 1 ], offset + e * _ArrayStride( type ), matrix_stride, layout );
+		break;
+	}
+	case spv::OpTypeStruct:
+	{
+		uint32_t member_count = ( _code[ _ids[ type ].offset ] >> spv::WordCountShift ) - 2;
+		for( uint32_t m=0; m < member_count; ++m ) {
+			auto member = _FindMember( type, m );
+			_AppendLayout( operands[ 1 + m ], offset + _MemberOffset( type, m ), member ? member->matrix_stride : 0, layout );
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+uint32_t Lowering::_Layout( uint32_t type, uint32_t matrix_stride )
+{
+	auto key		= std::make_pair( type, matrix_stride );
+	auto existing	= _layouts.find( key );
+	if( existing != _layouts.end() ) return existing->second;
+
+	std::vector<uint32_t> layout;
+	_AppendLayout( type, 0, matrix_stride, layout );
+	_program.layouts.push_back( std::move( layout ) );
+	uint32_t index	= uint32_t( _program.layouts.size() - 1 );
+	_layouts[ key ]	= index;
+	return index;
+}
+
+// First register of a member of a composite, for OpCompositeExtract and OpCompositeInsert.
+bool Lowering::_FlatOffset( uint32_t type, const uint32_t * indices, uint32_t index_count, uint32_t & offset, uint32_t & result_type ) const
+{
+	offset = 0;
+	for( uint32_t i=0; i < index_count; ++i ) {
+		auto operands	= _Type( type );
+		uint32_t index	= indices[ i ];
+		switch( _Opcode( type ) ) {
+		case spv::OpTypeVector:
+			if( index >= operands[ 2 ] ) return false;
+			offset		+= index;
+			type		= operands[ 1 ];
+			break;
+		case spv::OpTypeMatrix:
+		case spv::OpTypeArray:
+			if( index >= _ComponentCount( type ) / std::max( _ComponentCount( operands[ 1 ] ), 1u ) ) return false;
+			offset		+= index * _ComponentCount( operands[ 1 ] );
+			type		= operands[ 1 ];
+			break;
+		case spv::OpTypeStruct:
+		{
+			uint32_t member_count = ( _code[ _ids[ type ].offset ] >> spv::WordCountShift ) - 2;
+			if( index >= member_count ) return false;
+			for( uint32_t m=0; m < index; ++m ) offset += _ComponentCount( operands[ 1 + m ] );
+			type		= operands[ 1 + index ];
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+	result_type = type;
+	return true;
+}
+
+bool Lowering::_Decorate( uint32_t id, uint32_t decoration, const uint32_t * literals, uint32_t literal_count )
+{
+	auto & info = _ids[ id ];
+	switch( decoration ) {
+	case spv::DecorationSpecId:			if( literal_count < 1 ) return false; info.spec_id			= literals[ 0 ]; break;
+	case spv::DecorationArrayStride:	if( literal_count < 1 ) return false; info.array_stride		= literals[ 0 ]; break;
+	case spv::DecorationBuiltIn:		if( literal_count < 1 ) return false; info.builtin			= literals[ 0 ]; break;
+	case spv::DecorationBinding:		if( literal_count < 1 ) return false; info.binding			= literals[ 0 ]; break;
+	case spv::DecorationDescriptorSet:	if( literal_count < 1 ) return false; info.set				= literals[ 0 ]; break;
+	case spv::DecorationRowMajor:		info.row_major = true; break;
+	default:							break;
+	}
+	return true;
+}
+
+bool Lowering::_SpecializationValue( uint32_t id, uint32_t & value ) const
+{
+	if( !_specialization_info || _ids[ id ].spec_id == UINT32_MAX ) return false;
+	for( uint32_t i=0; i < _specialization_info->mapEntryCount; ++i ) {
+		auto & entry = _specialization_info->pMapEntries[ i ];
+		if( entry.constantID != _ids[ id ].spec_id ) continue;
+		if( entry.size < sizeof( uint32_t ) || entry.offset + sizeof( uint32_t ) > _specialization_info->dataSize ) return false;
+		std::memcpy( &value, static_cast<const uint8_t*>( _specialization_info->pData ) + entry.offset, sizeof( value ) );
+		return true;
+	}
+	return false;
+}
+
+void Lowering::_SetConstant( uint32_t id, uint32_t type, const std::vector<uint32_t> & bits )
+{
+	Value value;
+	value.kind		= ValueKind::REGISTERS;
+	value.count		= uint32_t( bits.size() );
+	value.type		= type;
+	value.reg		= _Allocate( value.count );
+	for( uint32_t c=0; c < value.count; ++c ) {
+		_program.constants.push_back( std::make_pair( value.reg + c, bits[ c ] ) );
+	}
+	_globals[ id ]		= value;
+	_constant_bits[ id ]	= bits;
+}
+
+bool Lowering::_AddType( uint32_t opcode, const uint32_t * operands, uint32_t operand_count, uint32_t offset )
+{
+	uint32_t id = operands[ 0 ];
+	auto & info	= _ids[ id ];
+	info.opcode	= opcode;
+	info.offset	= offset;
+
+	auto valid_type = [ this ]( uint32_t type ) {
+		return _ValidId( type ) && _ids[ type ].opcode != 0;
+	};
+	switch( opcode ) {
+	case spv::OpTypeBool:
+		info.component_count = 1;
+		break;
+	case spv::OpTypeInt:
+	case spv::OpTypeFloat:
+		if( operand_count < 2 ) return false;
+		if( operands[ 1 ] != 32 ) return _Fail( "only 32 bit integers and floats are supported" );
+		info.component_count = 1;
+		break;
+	case spv::OpTypeVector:
+		if( operand_count < 3 || !valid_type( operands[ 1 ] ) || operands[ 2 ] < 2 || operands[ 2 ] > 4 ) return false;
+		info.component_count = operands[ 2 ];
+		break;
+	case spv::OpTypeMatrix:
+		if( operand_count < 3 || _Opcode( operands[ 1 ] ) != spv::OpTypeVector || operands[ 2 ] < 2 || operands[ 2 ] > 4 ) return false;
+		info.component_count = operands[ 2 ] * _ComponentCount( operands[ 1 ] );
+		break;
+	case spv::OpTypeArray:
+	{
+		if( operand_count < 3 || !valid_type( operands[ 1 ] ) ) return false;
+		auto length = _constant_bits.find( operands[ 2 ] );
+		if( length == _constant_bits.end() || length->second.size() != 1 ) return false;
+		info.component_count = length->second[ 0 ] * _ComponentCount( operands[ 1 ] );
+		break;
+	}
+	case spv::OpTypeStruct:
+		for( uint32_t m=1; m < operand_count; ++m ) {
+			if( !valid_type( operands[ m ] ) ) return false;
+			auto member = _FindMember( id, m - 1 );
+			if( member && member->row_major && _Opcode( operands[ m ] ) != spv::OpTypeStruct ) return _Fail( "row major matrices are not supported" );
+			info.component_count += _ComponentCount( operands[ m ] );
+		}
+		break;
+	case spv::OpTypeRuntimeArray:
+		if( operand_count < 2 || !valid_type( operands[ 1 ] ) ) return false;
+		break;
+	case spv::OpTypePointer:
+		if( operand_count < 3 || !valid_type( operands[ 2 ] ) ) return false;
+		break;
+	case spv::OpTypeImage:
+		if( operand_count < 8 ) return false;
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+bool Lowering::_FoldSpecConstantOp( const uint32_t * operands, uint32_t operand_count, std::vector<uint32_t> & bits )
+{
+	// Integer and logical instructions on constants, the ones shaders may use.
+	if( operand_count < 4 ) return false;
+	uint32_t opcode = operands[ 2 ];
+	auto constant = [ this ]( uint32_t id ) -> const std::vector<uint32_t> * {
+		auto found = _constant_bits.find( id );
+		return found != _constant_bits.end() ? &found->second : nullptr;
+	};
+
+	if( opcode == spv::OpCompositeExtract ) {
+		auto composite = constant( operands[ 3 ] );
+		if( !composite || !_ValidId( _globals[ operands[ 3 ] ].type ) ) return false;
+		uint32_t offset, type;
+		if( !_FlatOffset( _globals[ operands[ 3 ] ].type, operands + 4, operand_count - 4, offset, type ) ) return false;
+		bits.assign( composite->begin() + offset, composite->begin() + offset + _ComponentCount( type ) );
+		return true;
+	}
+
+	std::vector<const std::vector<uint32_t>*> inputs;
+	for( uint32_t i=3; i < operand_count; ++i ) {
+		auto input = constant( operands[ i ] );
+		if( !input ) return false;
+		inputs.push_back( input );
+	}
+	uint32_t count = _ComponentCount( operands[ 0 ] );
+	for( auto input : inputs ) {
+		if( input->size() != count && input->size() != 1 ) return false;
+	}
+	auto get = [ & ]( uint32_t i, uint32_t c ) {
+		return i < inputs.size() ? ( *inputs[ i ] )[ inputs[ i ]->size() == 1 ? 0 : c ] : 0;
+	};
+
+	bits.resize( count );
+	for( uint32_t c=0; c < count; ++c ) {
+		uint32_t a = get( 0, c ), b = get( 1, c ), d = get( 2, c );
+		switch( opcode ) {
+		case spv::OpSConvert:
+		case spv::OpUConvert:					bits[ c ] = a; break;
+		case spv::OpSNegate:					bits[ c ] = 0u - a; break;
+		case spv::OpNot:						bits[ c ] = ~a; break;
+		case spv::OpIAdd:						bits[ c ] = a + b; break;
+		case spv::OpISub:						bits[ c ] = a - b; break;
+		case spv::OpIMul:						bits[ c ] = a * b; break;
+		case spv::OpUDiv:						bits[ c ] = DivideUnsigned( a, b ); break;
+		case spv::OpSDiv:						bits[ c ] = DivideSigned( a, b ); break;
+		case spv::OpUMod:						bits[ c ] = ModuloUnsigned( a, b ); break;
+		case spv::OpSRem:						bits[ c ] = RemainderSigned( a, b ); break;
+		case spv::OpSMod:						bits[ c ] = ModuloSigned( a, b ); break;
+		case spv::OpShiftRightLogical:			bits[ c ] = a >> ( b & 31 ); break;
+		case spv::OpShiftRightArithmetic:		bits[ c ] = ShiftRightArithmetic( a, b ); break;
+		case spv::OpShiftLeftLogical:			bits[ c ] = a << ( b & 31 ); break;
+		case spv::OpBitwiseOr:
+		case spv::OpLogicalOr:					bits[ c ] = a | b; break;
+		case spv::OpBitwiseXor:					bits[ c ] = a ^ b; break;
+		case spv::OpBitwiseAnd:
+		case spv::OpLogicalAnd:					bits[ c ] = a & b; break;
+		case spv::OpLogicalNot:					bits[ c ] = a ^ 1; break;
+		case spv::OpLogicalEqual:
+		case spv::OpIEqual:						bits[ c ] = a == b; break;
+		case spv::OpLogicalNotEqual:
+		case spv::OpINotEqual:					bits[ c ] = a != b; break;
+		case spv::OpSelect:						bits[ c ] = a ? b : d; break;
+		case spv::OpULessThan:					bits[ c ] = a < b; break;
+		case spv::OpSLessThan:					bits[ c ] = int32_t( a ) < int32_t( b ); break;
+		case spv::OpUGreaterThan:				bits[ c ] = a > b; break;
+		case spv::OpSGreaterThan:				bits[ c ] = int32_t( a ) > int32_t( b ); break;
+		case spv::OpULessThanEqual:				bits[ c ] = a <= b; break;
+		case spv::OpSLessThanEqual:				bits[ c ] = int32_t( a ) <= int32_t( b ); break;
+		case spv::OpUGreaterThanEqual:			bits[ c ] = a >= b; break;
+		case spv::OpSGreaterThanEqual:			bits[ c ] = int32_t( a ) >= int32_t( b ); break;
+		default:								return _Fail( "OpSpecConstantOp with opcode " + std::to_string( opcode ) + " is not supported" );
+		}
+	}
+	return true;
+}
+
+bool Lowering::_AddConstant( uint32_t opcode, const uint32_t * operands, uint32_t operand_count, uint32_t offset )
+{
+	if( operand_count < 2 || !_ValidId( operands[ 0 ] ) || !_ValidId( operands[ 1 ] ) ) return false;
+	uint32_t type	= operands[ 0 ];
+	uint32_t id		= operands[ 1 ];
+	_ids[ id ].opcode	= opcode;
+	_ids[ id ].offset	= offset;
+
+	std::vector<uint32_t> bits;
+	uint32_t specialized = 0;
+	switch( opcode ) {
+	case spv::OpConstantTrue:
+	case spv::OpConstantFalse:
+		bits.push_back( opcode == spv::OpConstantTrue ? 1 : 0 );
+		break;
+	case spv::OpSpecConstantTrue:
+	case spv::OpSpecConstantFalse:
+		bits.push_back( opcode == spv::OpSpecConstantTrue ? 1 : 0 );
+		if( _SpecializationValue( id, specialized ) ) bits[ 0 ] = specialized ? 1 : 0;
+		break;
+	case spv::OpConstant:
+	case spv::OpSpecConstant:
+		if( operand_count < 3 ) return false;
+		bits.push_back( operands[ 2 ] );
+		if( opcode == spv::OpSpecConstant && _SpecializationValue( id, specialized ) ) bits[ 0 ] = specialized;
+		break;
+	case spv::OpConstantComposite:
+	case spv::OpSpecConstantComposite:
+		for( uint32_t i=2; i < operand_count; ++i ) {
+			auto constituent = _constant_bits.find( operands[ i ] );
+			if( constituent == _constant_bits.end() ) return false;
+			bits.insert( bits.end(), constituent->second.begin(), constituent->second.end() );
+		}
+		break;
+	case spv::OpConstantNull:
+	case spv::OpUndef:
+		bits.assign( _ComponentCount( type ), 0 );
+		break;
+	case spv::OpSpecConstantOp:
+		if( !_FoldSpecConstantOp( operands, operand_count, bits ) ) return _Fail( _error.empty() ? "invalid OpSpecConstantOp" : _error );
+		break;
+	default:
+		return _Fail( "constants of opcode " + std::to_string( opcode ) + " are not supported" );
+	}
+	if( bits.size() != _ComponentCount( type ) ) return false;
+	_SetConstant( id, type, bits );
+
+	if( _ids[ id ].builtin == spv::BuiltInWorkgroupSize && bits.size() == 3 ) {
+		std::copy( bits.begin(), bits.end(), _program.workgroup_size );
+	}
+	return true;
+}
+
+bool Lowering::_AddVariable( const uint32_t * operands, uint32_t operand_count )
+{
+	if( operand_count < 3 || _Opcode( operands[ 0 ] ) != spv::OpTypePointer || !_ValidId( operands[ 1 ] ) ) return false;
+	uint32_t id			= operands[ 1 ];
+	uint32_t type		= _Type( operands[ 0 ] )[ 2 ];
+	auto & info			= _ids[ id ];
+	info.opcode			= spv::OpVariable;
+
+	Region region;
+	region.set			= info.set;
+	region.binding		= info.binding;
+	switch( operands[ 2 ] ) {
+	case spv::StorageClassUniformConstant:
+		if( _Opcode( type ) == spv::OpTypeArray || _Opcode( type ) == spv::OpTypeRuntimeArray ) return _Fail( "arrays of descriptors are not supported" );
+		if( _Opcode( type ) != spv::OpTypeImage ) return _Fail( "samplers and sampled images are not supported" );
+		if( _Type( type )[ 2 ] != spv::Dim2D || _Type( type )[ 4 ] || _Type( type )[ 5 ] || _Type( type )[ 6 ] != 2 ) {
+			return _Fail( "only two dimensional storage images are supported" );
+		}
+		region.type = RegionType::IMAGE;
+		break;
+	case spv::StorageClassUniform:
+	case StorageClassStorageBuffer:
+		if( _Opcode( type ) != spv::OpTypeStruct ) return _Fail( "arrays of descriptors are not supported" );
+		region.type = RegionType::BUFFER;
+		break;
+	case spv::StorageClassPushConstant:
+		region.type = RegionType::PUSH_CONSTANTS;
+		break;
+	case spv::StorageClassWorkgroup:
+		region.type						= RegionType::WORKGROUP;
+		region.offset					= _program.workgroup_memory_size;
+		region.size						= _PackedSize( type );
+		_program.workgroup_memory_size	+= region.size;
+		break;
+	case spv::StorageClassPrivate:
+	case spv::StorageClassInput:
+		region.type						= RegionType::INVOCATION;
+		region.offset					= _program.invocation_memory_size;
+		region.size						= _PackedSize( type );
+		_program.invocation_memory_size	+= region.size;
+		if( operands[ 2 ] == spv::StorageClassInput ) {
+			switch( info.builtin ) {
+			case spv::BuiltInNumWorkgroups:
+			case spv::BuiltInWorkgroupId:
+			case spv::BuiltInLocalInvocationId:
+			case spv::BuiltInGlobalInvocationId:
+			case spv::BuiltInLocalInvocationIndex:
+				if( region.size != 4 && region.size != 12 ) return false;
+				region.builtin = info.builtin;
+				break;
+			default:
+				return _Fail( "the built-in " + std::to_string( info.builtin ) + " is not supported" );
+			}
+		}
+		if( operand_count > 3 ) _private_initializers.push_back( std::make_pair( id, operands[ 3 ] ) );
+		break;
+	default:
+		return _Fail( "variables of storage class " + std::to_string( operands[ 2 ] ) + " are not supported" );
+	}
+
+	Value value;
+	value.kind		= region.type == RegionType::IMAGE ? ValueKind::IMAGE : ValueKind::POINTER;
+	value.reg		= _zero;
+	value.type		= type;
+	value.region	= _AddRegion( region );
+	_globals[ id ]	= value;
+	return true;
+}
+
+bool Lowering::_ParseGlobal( uint32_t offset, uint32_t opcode, const uint32_t * operands, uint32_t operand_count )
+{
+	switch( opcode ) {
+	case spv::OpCapability:
+		if( operand_count < 1 ) return false;
+		switch( operands[ 0 ] ) {
+		case spv::CapabilityMatrix:
+		case spv::CapabilityShader:
+		case spv::CapabilityStorageImageExtendedFormats:
+		case spv::CapabilityImageQuery:
+		case spv::CapabilityStorageImageReadWithoutFormat:
+		case spv::CapabilityStorageImageWriteWithoutFormat:
+			return true;
+		default:
+			return _Fail( "the capability " + std::to_string( operands[ 0 ] ) + " is not supported" );
+		}
+	case spv::OpExtension:
+		return _Fail( "extensions are not supported" );
+	case spv::OpExtInstImport:
+	{
+		if( operand_count < 2 || !_ValidId( operands[ 0 ] ) ) return false;
+		const char * name	= reinterpret_cast<const char*>( operands + 1 );
+		size_t length		= 0;
+		while( length < ( operand_count - 1 ) * 4 && name[ length ] ) ++length;
+		if( std::string( name, length ) != "GLSL.std.450" ) return _Fail( "the instruction set " + std::string( name, length ) + " is not supported" );
+		_glsl = operands[ 0 ];
+		return true;
+	}
+	case spv::OpEntryPoint:
+		if( operand_count < 2 ) return false;
+		if( _entry_point == UINT32_MAX && operands[ 0 ] == spv::ExecutionModelGLCompute ) _entry_point = operands[ 1 ];
+		return true;
+	case spv::OpExecutionMode:
+		if( operand_count >= 5 && operands[ 0 ] == _entry_point && operands[ 1 ] == spv::ExecutionModeLocalSize ) {
+			std::copy( operands + 2, operands + 5, _program.workgroup_size );
+		}
+		return true;
+	case spv::OpDecorate:
+		if( operand_count < 2 || !_ValidId( operands[ 0 ] ) ) return false;
+		return _Decorate( operands[ 0 ], operands[ 1 ], operands + 2, operand_count - 2 );
+	case spv::OpMemberDecorate:
+	{
+		if( operand_count < 3 || !_ValidId( operands[ 0 ] ) ) return false;
+		auto & member = _members[ std::make_pair( operands[ 0 ], operands[ 1 ] ) ];
+		if( operands[ 2 ] == spv::DecorationOffset && operand_count > 3 )			member.offset			= operands[ 3 ];
+		if( operands[ 2 ] == spv::DecorationMatrixStride && operand_count > 3 )	member.matrix_stride	= operands[ 3 ];
+		if( operands[ 2 ] == spv::DecorationRowMajor )								member.row_major		= true;
+		return true;
+	}
+	case spv::OpGroupDecorate:
+		// Decoration groups are decorated before they are applied, copy what the group got.
+		for( uint32_t i=1; i < operand_count; ++i ) {
+			if( !_ValidId( operands[ 0 ] ) || !_ValidId( operands[ i ] ) ) return false;
+			auto & group	= _ids[ operands[ 0 ] ];
+			auto & target	= _ids[ operands[ i ] ];
+			if( group.set != UINT32_MAX )			target.set				= group.set;
+			if( group.binding != UINT32_MAX )		target.binding			= group.binding;
+			if( group.builtin != UINT32_MAX )		target.builtin			= group.builtin;
+			if( group.spec_id != UINT32_MAX )		target.spec_id			= group.spec_id;
+			if( group.array_stride )				target.array_stride		= group.array_stride;
+		}
+		return true;
+	case spv::OpTypeVoid:
+	case spv::OpTypeBool:
+	case spv::OpTypeInt:
+	case spv::OpTypeFloat:
+	case spv::OpTypeVector:
+	case spv::OpTypeMatrix:
+	case spv::OpTypeImage:
+	case spv::OpTypeSampler:
+	case spv::OpTypeSampledImage:
+	case spv::OpTypeArray:
+	case spv::OpTypeRuntimeArray:
+	case spv::OpTypeStruct:
+	case spv::OpTypePointer:
+	case spv::OpTypeFunction:
+		if( operand_count < 1 || !_ValidId( operands[ 0 ] ) ) return false;
+		return _AddType( opcode, operands, operand_count, offset );
+	case spv::OpConstantTrue:
+	case spv::OpConstantFalse:
+	case spv::OpConstant:
+	case spv::OpConstantComposite:
+	case spv::OpConstantNull:
+	case spv::OpSpecConstantTrue:
+	case spv::OpSpecConstantFalse:
+	case spv::OpSpecConstant:
+	case spv::OpSpecConstantComposite:
+	case spv::OpSpecConstantOp:
+	case spv::OpUndef:
+	case spv::OpConstantSampler:
+		return _AddConstant( opcode, operands, operand_count, offset );
+	case spv::OpVariable:
+		return _AddVariable( operands, operand_count );
+	default:
+		// Debug instructions, the memory model and the rest of the annotations.
+		return true;
+	}
+}
+
+Value Lowering::_Get( Instance & instance, uint32_t id, ValueKind kind )
+{
+	auto local = instance.values.find( id );
+	Value value;
+	if( local != instance.values.end() ) {
+		value = local->second;
+	} else if( _ValidId( id ) ) {
+		value = _globals[ id ];
+	}
+	if( value.kind != kind ) {
+		_Fail( "id " + std::to_string( id ) + " is not defined or not of the expected kind" );
+	}
+	return value;
+}
+
+Value Lowering::_Result( Instance & instance, uint32_t type, uint32_t id )
+{
+	Value value;
+	value.kind		= ValueKind::REGISTERS;
+	value.type		= type;
+	value.count		= _ComponentCount( type );
+	value.reg		= _Allocate( value.count );
+	instance.values[ id ] = value;
+	return value;
+}
+
+// One result component per operand component, a scalar operand is used for every component.
+void Lowering::_Componentwise( Code code, const Value & result, std::initializer_list<Value> operands )
+{
+	auto & operation = _Emit( code, result.count, result.reg );
+	uint32_t i = 0;
+	for( auto & operand : operands ) {
+		operation.operands[ i ]	= operand.reg;
+		operation.steps[ i ]	= operand.count == 1 ? 0 : 1;
+		++i;
+	}
+}
+
+// result = matrix * vector, the sum of the columns scaled by the components of the vector.
+void Lowering::_MatrixTimesVector( const Value & result, const Value & matrix, uint32_t vector_reg, uint32_t matrix_type )
+{
+	uint32_t columns	= _Type( matrix_type )[ 2 ];
+	uint32_t rows		= _ComponentCount( _Type( matrix_type )[ 1 ] );
+	for( uint32_t c=0; c < columns; ++c ) {
+		auto & operation		= _Emit( c == 0 ? Code::FMUL : Code::FMUL_ADD, rows, result.reg );
+		operation.operands[ 0 ]	= matrix.reg + c * rows;
+		operation.operands[ 1 ]	= vector_reg + c;
+		operation.operands[ 2 ]	= result.reg;
+		operation.steps[ 1 ]	= 0;
+	}
+}
+
+void Lowering::_EmitPhiCopies( Instance & instance, uint32_t successor )
+{
+	auto phis = instance.phis.find( successor );
+	if( phis == instance.phis.end() ) return;
+	for( auto & phi : phis->second ) {
+		uint32_t count				= _code[ phi.offset ] >> spv::WordCountShift;
+		const uint32_t * operands	= _code + phi.offset + 1;
+		bool found					= false;
+		for( uint32_t i=2; i + 1 < count - 1; i += 2 ) {
+			if( operands[ i + 1 ] != instance.label ) continue;
+			auto value = _Get( instance, operands[ i ], ValueKind::REGISTERS );
+			_EmitCopy( phi.shadow, value.reg, phi.count );
+			found = true;
+			break;
+		}
+		if( !found ) _Fail( "OpPhi without a value for one of its predecessors" );
+	}
+}
+
+bool Lowering::_LowerAccessChain( Instance & instance, const uint32_t * operands, uint32_t operand_count )
+{
+	auto base = _Get( instance, operands[ 2 ], ValueKind::POINTER );
+	if( !_error.empty() ) return false;
+
+	// Constant indices fold into one offset, every other index adds its stride.
+	uint32_t type			= base.type;
+	uint32_t matrix_stride	= base.matrix_stride;
+	uint32_t constant		= 0;
+	std::vector<std::pair<uint32_t, uint32_t>> dynamic;
+	for( uint32_t i=3; i < operand_count; ++i ) {
+		auto index_bits	= _constant_bits.find( operands[ i ] );
+		bool is_constant	= index_bits != _constant_bits.end() && index_bits->second.size() == 1;
+		uint32_t index		= is_constant ? index_bits->second[ 0 ] : 0;
+		auto type_operands	= _Type( type );
+		uint32_t stride		= 0;
+		switch( _Opcode( type ) ) {
+		case spv::OpTypeStruct:
+		{
+			uint32_t member_count = ( _code[ _ids[ type ].offset ] >> spv::WordCountShift ) - 2;
+			if( !is_constant || index >= member_count ) return false;
+			auto member		= _FindMember( type, index );
+			constant		+= _MemberOffset( type, index );
+			matrix_stride	= member ? member->matrix_stride : 0;
+			type			= type_operands[ 1 + index ];
+			continue;
+		}
+		case spv::OpTypeArray:
+		case spv::OpTypeRuntimeArray:
+			stride			= _ArrayStride( type );
+			type			= type_operands[ 1 ];
+			break;
+		case spv::OpTypeMatrix:
+			stride			= matrix_stride ? matrix_stride : _PackedSize( type_operands[ 1 ] );
+			type			= type_operands[ 1 ];
+			break;
+		case spv::OpTypeVector:
+			stride			= 4;
+			type			= type_operands[ 1 ];
+			break;
+		default:
+			return false;
+		}
+		if( is_constant ) {
+			constant += index * stride;
+		} else {
+			auto index_value = _Get( instance, operands[ i ], ValueKind::REGISTERS );
+			if( !_error.empty() ) return false;
+			dynamic.push_back( std::make_pair( index_value.reg, stride ) );
+		}
+	}
+
+	Value result			= base;
+	result.type				= type;
+	result.matrix_stride	= matrix_stride;
+	if( constant || !dynamic.empty() ) {
+		result.reg				= _Allocate( 1 );
+		auto & address			= _Emit( Code::ADDRESS, 1, result.reg );
+		address.operands[ 0 ]	= base.reg;
+		address.value			= constant;
+		for( auto & index : dynamic ) {
+			auto & operation		= _Emit( Code::INDEX, 1, result.reg );
+			operation.operands[ 0 ]	= result.reg;
+			operation.operands[ 1 ]	= index.first;
+			operation.value			= index.second;
+		}
+	}
+	instance.values[ operands[ 1 ] ] = result;
+	return true;
+}
+
+bool Lowering::_LowerAtomic( Instance & instance, uint32_t opcode, const uint32_t * operands, uint32_t operand_count )
+{
+	// Everything but OpAtomicStore has a result type and a result first.
+	bool store					= opcode == spv::OpAtomicStore;
+	const uint32_t * arguments	= store ? operands : operands + 2;
+	uint32_t argument_count		= store ? operand_count : operand_count - 2;
+	if( argument_count < 3 ) return false;
+
+	auto pointer = _Get( instance, arguments[ 0 ], ValueKind::POINTER );
+	if( !_error.empty() ) return false;
+	if( _ComponentCount( pointer.type ) != 1 ) return false;
+
+	uint32_t value_index		= opcode == spv::OpAtomicCompareExchange ? 5 : 3;
+	Value value, comparator;
+	value.reg = comparator.reg	= _zero;
+	if( store || ( opcode != spv::OpAtomicLoad && opcode != spv::OpAtomicIIncrement && opcode != spv::OpAtomicIDecrement ) ) {
+		if( argument_count <= value_index ) return false;
+		value = _Get( instance, arguments[ value_index ], ValueKind::REGISTERS );
+	}
+	if( opcode == spv::OpAtomicCompareExchange ) {
+		if( argument_count < 7 ) return false;
+		comparator = _Get( instance, arguments[ 6 ], ValueKind::REGISTERS );
+	}
+	if( !_error.empty() ) return false;
+
+	uint32_t result				= store ? _Allocate( 1 ) : _Result( instance, operands[ 0 ], operands[ 1 ] ).reg;
+	auto & operation			= _Emit( Code::ATOMIC, 1, result );
+	operation.operands[ 0 ]		= pointer.reg;
+	operation.operands[ 1 ]		= value.reg;
+	operation.operands[ 2 ]		= comparator.reg;
+	operation.region			= pointer.region;
+	operation.value				= opcode;
+	return true;
+}
+
+bool Lowering::_LowerExtendedInstruction( Instance & instance, const uint32_t * operands, uint32_t operand_count )
+{
+	if( operand_count < 4 || operands[ 2 ] != _glsl ) return _Fail( "only the GLSL.std.450 instruction set is supported" );
+	uint32_t instruction = operands[ 3 ];
+
+	std::vector<Value> arguments;
+	for( uint32_t i=4; i < operand_count; ++i ) {
+		// Modf and Frexp write their second result through a pointer.
+		bool pointer = i == 5 && ( instruction == GLSLstd450Modf || instruction == GLSLstd450Frexp );
+		arguments.push_back( _Get( instance, operands[ i ], pointer ? ValueKind::POINTER : ValueKind::REGISTERS ) );
+	}
+	if( !_error.empty() ) return false;
+
+	auto argument_count = [ & ]( uint32_t count ) {
+		return arguments.size() == count || _Fail( "wrong number of operands for GLSL.std.450 instruction " + std::to_string( instruction ) );
+	};
+
+	// Componentwise instructions first.
+	Code code		= Code::COPY;
+	uint32_t arity	= 0;
+	switch( instruction ) {
+	case GLSLstd450Round:			code = Code::ROUND;				arity = 1; break;
+	case GLSLstd450RoundEven:		code = Code::ROUND_EVEN;		arity = 1; break;
+	case GLSLstd450Trunc:			code = Code::TRUNC;				arity = 1; break;
+	case GLSLstd450FAbs:			code = Code::FABS;				arity = 1; break;
+	case GLSLstd450SAbs:			code = Code::SABS;				arity = 1; break;
+	case GLSLstd450FSign:			code = Code::FSIGN;				arity = 1; break;
+	case GLSLstd450SSign:			code = Code::SSIGN;				arity = 1; break;
+	case GLSLstd450Floor:			code = Code::FLOOR;				arity = 1; break;
+	case GLSLstd450Ceil:			code = Code::CEIL;				arity = 1; break;
+	case GLSLstd450Fract:			code = Code::FRACT;				arity = 1; break;
+	case GLSLstd450Radians:			code = Code::RADIANS;			arity = 1; break;
+	case GLSLstd450Degrees:			code = Code::DEGREES;			arity = 1; break;
+	case GLSLstd450Sin:				code = Code::SIN;				arity = 1; break;
+	case GLSLstd450Cos:				code = Code::COS;				arity = 1; break;
+	case GLSLstd450Tan:				code = Code::TAN;				arity = 1; break;
+	case GLSLstd450Asin:			code = Code::ASIN;				arity = 1; break;
+	case GLSLstd450Acos:			code = Code::ACOS;				arity = 1; break;
+	case GLSLstd450Atan:			code = Code::ATAN;				arity = 1; break;
+	case GLSLstd450Sinh:			code = Code::SINH;				arity = 1; break;
+	case GLSLstd450Cosh:			code = Code::COSH;				arity = 1; break;
+	case GLSLstd450Tanh:			code = Code::TANH;				arity = 1; break;
+	case GLSLstd450Asinh:			code = Code::ASINH;				arity = 1; break;
+	case GLSLstd450Acosh:			code = Code::ACOSH;				arity = 1; break;
+	case GLSLstd450Atanh:			code = Code::ATANH;				arity = 1; break;
+	case GLSLstd450Atan2:			code = Code::ATAN2;				arity = 2; break;
+	case GLSLstd450Pow:				code = Code::POW;				arity = 2; break;
+	case GLSLstd450Exp:				code = Code::EXP;				arity = 1; break;
+	case GLSLstd450Log:				code = Code::LOG;				arity = 1; break;
+	case GLSLstd450Exp2:			code = Code::EXP2;				arity = 1; break;
+	case GLSLstd450Log2:			code = Code::LOG2;				arity = 1; break;
+	case GLSLstd450Sqrt:			code = Code::SQRT;				arity = 1; break;
+	case GLSLstd450InverseSqrt:		code = Code::INVERSE_SQRT;		arity = 1; break;
+	case GLSLstd450FMin:			code = Code::FMIN;				arity = 2; break;
+	case GLSLstd450UMin:			code = Code::UMIN;				arity = 2; break;
+	case GLSLstd450SMin:			code = Code::SMIN;				arity = 2; break;
+	case GLSLstd450FMax:			code = Code::FMAX;				arity = 2; break;
+	case GLSLstd450UMax:			code = Code::UMAX;				arity = 2; break;
+	case GLSLstd450SMax:			code = Code::SMAX;				arity = 2; break;
+	case GLSLstd450FClamp:			code = Code::FCLAMP;			arity = 3; break;
+	case GLSLstd450UClamp:			code = Code::UCLAMP;			arity = 3; break;
+	case GLSLstd450SClamp:			code = Code::SCLAMP;			arity = 3; break;
+	case GLSLstd450FMix:			code = Code::FMIX;				arity = 3; break;
+	case GLSLstd450Step:			code = Code::STEP;				arity = 2; break;
+	case GLSLstd450SmoothStep:		code = Code::SMOOTH_STEP;		arity = 3; break;
+	case GLSLstd450Fma:				code = Code::FMA;				arity = 3; break;
+	case GLSLstd450Ldexp:			code = Code::LDEXP;				arity = 2; break;
+	case GLSLstd450FindILsb:		code = Code::FIND_LSB;			arity = 1; break;
+	case GLSLstd450FindSMsb:		code = Code::FIND_SMSB;			arity = 1; break;
+	case GLSLstd450FindUMsb:		code = Code::FIND_UMSB;			arity = 1; break;
+	case GLSLstd450NMin:			code = Code::NMIN;				arity = 2; break;
+	case GLSLstd450NMax:			code = Code::NMAX;				arity = 2; break;
+	case GLSLstd450NClamp:			code = Code::NCLAMP;			arity = 3; break;
+	default:						break;
+	}
+	if( arity ) {
+		if( !argument_count( arity ) ) return false;
+		auto result = _Result( instance, operands[ 0 ], operands[ 1 ] );
+		auto & operation = _Emit( code, result.count, result.reg );
+		for( uint32_t i=0; i < arity; ++i ) {
+			operation.operands[ i ] = arguments[ i ].reg;
+		}
+		return true;
+	}
+
+	auto across = [ & ]( Code across_code, uint32_t count, uint32_t required_arguments ) {
+		if( !argument_count( required_arguments ) ) return false;
+		auto result = _Result( instance, operands[ 0 ], operands[ 1 ] );
+		auto & operation = _Emit( across_code, count, result.reg );
+		for( uint32_t i=0; i < required_arguments; ++i ) {
+			operation.operands[ i ] = arguments[ i ].reg;
+		}
+		return true;
+	};
+	uint32_t input_count = arguments.empty() ? 0 : arguments[ 0 ].count;
+	switch( instruction ) {
+	case GLSLstd450Length:				return across( Code::LENGTH, input_count, 1 );
+	case GLSLstd450Distance:			return across( Code::DISTANCE, input_count, 2 );
+	case GLSLstd450Cross:				return across( Code::CROSS, 3, 2 );
+	case GLSLstd450Normalize:			return across( Code::NORMALIZE, input_count, 1 );
+	case GLSLstd450FaceForward:			return across( Code::FACE_FORWARD, input_count, 3 );
+	case GLSLstd450Reflect:				return across( Code::REFLECT, input_count, 2 );
+	case GLSLstd450Refract:				return across( Code::REFRACT, input_count, 3 );
+	case GLSLstd450PackSnorm4x8:		return across( Code::PACK_SNORM4X8, 4, 1 );
+	case GLSLstd450PackUnorm4x8:		return across( Code::PACK_UNORM4X8, 4, 1 );
+	case GLSLstd450PackSnorm2x16:		return across( Code::PACK_SNORM2X16, 2, 1 );
+	case GLSLstd450PackUnorm2x16:		return across( Code::PACK_UNORM2X16, 2, 1 );
+	case GLSLstd450PackHalf2x16:		return across( Code::PACK_HALF2X16, 2, 1 );
+	case GLSLstd450UnpackSnorm4x8:		return across( Code::UNPACK_SNORM4X8, 4, 1 );
+	case GLSLstd450UnpackUnorm4x8:		return across( Code::UNPACK_UNORM4X8, 4, 1 );
+	case GLSLstd450UnpackSnorm2x16:		return across( Code::UNPACK_SNORM2X16, 2, 1 );
+	case GLSLstd450UnpackUnorm2x16:		return across( Code::UNPACK_UNORM2X16, 2, 1 );
+	case GLSLstd450UnpackHalf2x16:		return across( Code::UNPACK_HALF2X16, 2, 1 );
+	case GLSLstd450Modf:
+	case GLSLstd450ModfStruct:
+	case GLSLstd450Frexp:
+	case GLSLstd450FrexpStruct:
+	{
+		// The struct forms return both parts, the others store the second through the pointer.
+		bool with_pointer = instruction == GLSLstd450Modf || instruction == GLSLstd450Frexp;
+		bool modf = instruction == GLSLstd450Modf || instruction == GLSLstd450ModfStruct;
+		if( !argument_count( with_pointer ? 2 : 1 ) ) return false;
+		auto result		= _Result( instance, operands[ 0 ], operands[ 1 ] );
+		uint32_t count	= arguments[ 0 ].count;
+		uint32_t second	= with_pointer ? _Allocate( count ) : result.reg + count;
+		_Emit( modf ? Code::MODF_FRACTION : Code::FREXP_MANTISSA, count, result.reg ).operands[ 0 ] = arguments[ 0 ].reg;
+		_Emit( modf ? Code::TRUNC : Code::FREXP_EXPONENT, count, second ).operands[ 0 ] = arguments[ 0 ].reg;
+		if( with_pointer ) {
+			auto & store			= _Emit( Code::STORE, count, 0 );
+			store.operands[ 0 ]		= arguments[ 1 ].reg;
+			store.operands[ 1 ]		= second;
+			store.region			= arguments[ 1 ].region;
+			store.value				= _Layout( arguments[ 1 ].type, arguments[ 1 ].matrix_stride );
+		}
+		return true;
+	}
+	default:
+		return _Fail( "GLSL.std.450 instruction " + std::to_string( instruction ) + " is not supported" );
+	}
+}
+
+bool Lowering::_LowerInstruction( Instance & instance, uint32_t offset )
+{
+	uint32_t opcode				= _code[ offset ] & spv::OpCodeMask;
+	uint32_t operand_count		= ( _code[ offset ] >> spv::WordCountShift ) - 1;
+	const uint32_t * operands	= _code + offset + 1;
+
+	// Componentwise instructions that map to one operation.
+	Code code		= Code::COPY;
+	uint32_t arity	= 0;
+	switch( opcode ) {
+	case spv::OpSNegate:					code = Code::SNEGATE;					arity = 1; break;
+	case spv::OpFNegate:					code = Code::FNEGATE;					arity = 1; break;
+	case spv::OpIAdd:						code = Code::IADD;						arity = 2; break;
+	case spv::OpFAdd:						code = Code::FADD;						arity = 2; break;
+	case spv::OpISub:						code = Code::ISUB;						arity = 2; break;
+	case spv::OpFSub:						code = Code::FSUB;						arity = 2; break;
+	case spv::OpIMul:						code = Code::IMUL;						arity = 2; break;
+	case spv::OpFMul:						code = Code::FMUL;						arity = 2; break;
+	case spv::OpUDiv:						code = Code::UDIV;						arity = 2; break;
+	case spv::OpSDiv:						code = Code::SDIV;						arity = 2; break;
+	case spv::OpFDiv:						code = Code::FDIV;						arity = 2; break;
+	case spv::OpUMod:						code = Code::UMOD;						arity = 2; break;
+	case spv::OpSRem:						code = Code::SREM;						arity = 2; break;
+	case spv::OpSMod:						code = Code::SMOD;						arity = 2; break;
+	case spv::OpFRem:						code = Code::FREM;						arity = 2; break;
+	case spv::OpFMod:						code = Code::FMOD;						arity = 2; break;
+	case spv::OpVectorTimesScalar:
+	case spv::OpMatrixTimesScalar:			code = Code::FMUL;						arity = 2; break;
+	case spv::OpShiftRightLogical:			code = Code::SHIFT_RIGHT;				arity = 2; break;
+	case spv::OpShiftRightArithmetic:		code = Code::SHIFT_RIGHT_ARITHMETIC;	arity = 2; break;
+	case spv::OpShiftLeftLogical:			code = Code::SHIFT_LEFT;				arity = 2; break;
+	case spv::OpBitwiseOr:
+	case spv::OpLogicalOr:					code = Code::OR;						arity = 2; break;
+	case spv::OpBitwiseXor:					code = Code::XOR;						arity = 2; break;
+	case spv::OpBitwiseAnd:
+	case spv::OpLogicalAnd:					code = Code::AND;						arity = 2; break;
+	case spv::OpNot:						code = Code::NOT;						arity = 1; break;
+	case spv::OpLogicalNot:					code = Code::BOOL_NOT;					arity = 1; break;
+	case spv::OpLogicalEqual:
+	case spv::OpIEqual:						code = Code::IEQUAL;					arity = 2; break;
+	case spv::OpLogicalNotEqual:
+	case spv::OpINotEqual:					code = Code::INOT_EQUAL;				arity = 2; break;
+	case spv::OpULessThan:					code = Code::ULESS;						arity = 2; break;
+	case spv::OpULessThanEqual:				code = Code::ULESS_EQUAL;				arity = 2; break;
+	case spv::OpUGreaterThan:				code = Code::UGREATER;					arity = 2; break;
+	case spv::OpUGreaterThanEqual:			code = Code::UGREATER_EQUAL;			arity = 2; break;
+	case spv::OpSLessThan:					code = Code::SLESS;						arity = 2; break;
+	case spv::OpSLessThanEqual:				code = Code::SLESS_EQUAL;				arity = 2; break;
+	case spv::OpSGreaterThan:				code = Code::SGREATER;					arity = 2; break;
+	case spv::OpSGreaterThanEqual:			code = Code::SGREATER_EQUAL;			arity = 2; break;
+	case spv::OpFOrdEqual:					code = Code::FORD_EQUAL;				arity = 2; break;
+	case spv::OpFOrdNotEqual:				code = Code::FORD_NOT_EQUAL;			arity = 2; break;
+	case spv::OpFOrdLessThan:				code = Code::FORD_LESS;					arity = 2; break;
+	case spv::OpFOrdLessThanEqual:			code = Code::FORD_LESS_EQUAL;			arity = 2; break;
+	case spv::OpFOrdGreaterThan:			code = Code::FORD_GREATER;				arity = 2; break;
+	case spv::OpFOrdGreaterThanEqual:		code = Code::FORD_GREATER_EQUAL;		arity = 2; break;
+	case spv::OpFUnordEqual:				code = Code::FUNORD_EQUAL;				arity = 2; break;
+	case spv::OpFUnordNotEqual:				code = Code::FUNORD_NOT_EQUAL;			arity = 2; break;
+	case spv::OpFUnordLessThan:				code = Code::FUNORD_LESS;				arity = 2; break;
+	case spv::OpFUnordLessThanEqual:		code = Code::FUNORD_LESS_EQUAL;			arity = 2; break;
+	case spv::OpFUnordGreaterThan:			code = Code::FUNORD_GREATER;			arity = 2; break;
+	case spv::OpFUnordGreaterThanEqual:		code = Code::FUNORD_GREATER_EQUAL;		arity = 2; break;
+	case spv::OpIsNan:						code = Code::IS_NAN;					arity = 1; break;
+	case spv::OpIsInf:						code = Code::IS_INF;					arity = 1; break;
+	case spv::OpSelect:						code = Code::SELECT;					arity = 3; break;
+	case spv::OpConvertFToU:				code = Code::FLOAT_TO_UINT;				arity = 1; break;
+	case spv::OpConvertFToS:				code = Code::FLOAT_TO_INT;				arity = 1; break;
+	case spv::OpConvertSToF:				code = Code::INT_TO_FLOAT;				arity = 1; break;
+	case spv::OpConvertUToF:				code = Code::UINT_TO_FLOAT;				arity = 1; break;
+	case spv::OpQuantizeToF16:				code = Code::QUANTIZE_F16;				arity = 1; break;
+	case spv::OpBitcast:
+	case spv::OpUConvert:
+	case spv::OpSConvert:
+	case spv::OpFConvert:
+	case spv::OpCopyObject:					code = Code::COPY;						arity = 1; break;
+	case spv::OpBitFieldInsert:				code = Code::BIT_INSERT;				arity = 4; break;
+	case spv::OpBitFieldSExtract:			code = Code::BIT_SEXTRACT;				arity = 3; break;
+	case spv::OpBitFieldUExtract:			code = Code::BIT_UEXTRACT;				arity = 3; break;
+	case spv::OpBitReverse:					code = Code::BIT_REVERSE;				arity = 1; break;
+	case spv::OpBitCount:					code = Code::BIT_COUNT;					arity = 1; break;
+	default:								break;
+	}
+	if( arity ) {
+		if( operand_count != 2 + arity ) return false;
+		// Pointers and images are copied as they are, they do not live in registers.
+		if( opcode == spv::OpCopyObject ) {
+			auto local = instance.values.find( operands[ 2 ] );
+			Value source = local != instance.values.end() ? local->second : _ValidId( operands[ 2 ] ) ? _globals[ operands[ 2 ] ] : Value();
+			if( source.kind == ValueKind::POINTER || source.kind == ValueKind::IMAGE ) {
+				instance.values[ operands[ 1 ] ] = source;
+				return true;
+			}
+		}
+		Value arguments[ 4 ];
+		for( uint32_t i=0; i < arity; ++i ) {
+			arguments[ i ] = _Get( instance, operands[ 2 + i ], ValueKind::REGISTERS );
+		}
+		if( !_error.empty() ) return false;
+		auto result = _Result( instance, operands[ 0 ], operands[ 1 ] );
+		if( arity == 1 )		_Componentwise( code, result, { arguments[ 0 ] } );
+		else if( arity == 2 )	_Componentwise( code, result, { arguments[ 0 ], arguments[ 1 ] } );
+		else if( arity == 3 )	_Componentwise( code, result, { arguments[ 0 ], arguments[ 1 ], arguments[ 2 ] } );
+		else					_Componentwise( code, result, { arguments[ 0 ], arguments[ 1 ], arguments[ 2 ], arguments[ 3 ] } );
+		return true;
+	}
+
+	switch( opcode ) {
+	case spv::OpNop:
+	case spv::OpLine:
+	case spv::OpNoLine:
+	case spv::OpName:
+	case spv::OpMemoryBarrier:
+	case spv::OpFunctionParameter:
+	case spv::OpPhi:
+		// Lanes of a workgroup run in one thread, memory is always coherent. Parameters and
+		// phis get their registers before the function is lowered.
+		return true;
+
+	case spv::OpLabel:
+		if( operand_count < 1 ) return false;
+		_current		= instance.blocks[ operands[ 0 ] ];
+		instance.label	= operands[ 0 ];
+		if( instance.phis.count( operands[ 0 ] ) ) {
+			for( auto & phi : instance.phis[ operands[ 0 ] ] ) {
+				_EmitCopy( phi.result, phi.shadow, phi.count );
+			}
+		}
+		return true;
+
+	case spv::OpSelectionMerge:
+		if( operand_count < 1 || !instance.blocks.count( operands[ 0 ] ) ) return false;
+		_blocks[ _current ].merge = instance.blocks[ operands[ 0 ] ];
+		return true;
+
+	case spv::OpLoopMerge:
+		if( operand_count < 2 || !instance.blocks.count( operands[ 0 ] ) || !instance.blocks.count( operands[ 1 ] ) ) return false;
+		_blocks[ _current ].merge			= instance.blocks[ operands[ 0 ] ];
+		_blocks[ _current ].continue_target	= instance.blocks[ operands[ 1 ] ];
+		return true;
+
+	case spv::OpBranch:
+		if( operand_count < 1 || !instance.blocks.count( operands[ 0 ] ) ) return false;
+		_EmitPhiCopies( instance, operands[ 0 ] );
+		_blocks[ _current ].exit			= Exit::BRANCH;
+		_blocks[ _current ].targets[ 0 ]	= instance.blocks[ operands[ 0 ] ];
+		return true;
+
+	case spv::OpBranchConditional:
+	{
+		if( operand_count < 3 || !instance.blocks.count( operands[ 1 ] ) || !instance.blocks.count( operands[ 2 ] ) ) return false;
+		auto condition = _Get( instance, operands[ 0 ], ValueKind::REGISTERS );
+		_EmitPhiCopies( instance, operands[ 1 ] );
+		if( operands[ 2 ] != operands[ 1 ] ) _EmitPhiCopies( instance, operands[ 2 ] );
+		auto & block		= _blocks[ _current ];
+		block.exit			= Exit::CONDITIONAL;
+		block.condition		= condition.reg;
+		block.targets[ 0 ]	= instance.blocks[ operands[ 1 ] ];
+		block.targets[ 1 ]	= instance.blocks[ operands[ 2 ] ];
+		return true;
+	}
+
+	case spv::OpSwitch:
+	{
+		if( operand_count < 2 || operand_count % 2 || !instance.blocks.count( operands[ 1 ] ) ) return false;
+		auto selector = _Get( instance, operands[ 0 ], ValueKind::REGISTERS );
+		std::vector<uint32_t> successors( 1, operands[ 1 ] );
+		for( uint32_t i=2; i < operand_count; i += 2 ) {
+			if( !instance.blocks.count( operands[ i + 1 ] ) ) return false;
+			successors.push_back( operands[ i + 1 ] );
+		}
+		std::sort( successors.begin(), successors.end() );
+		successors.erase( std::unique( successors.begin(), successors.end() ), successors.end() );
+		for( auto successor : successors ) {
+			_EmitPhiCopies( instance, successor );
+		}
+		auto & block		= _blocks[ _current ];
+		block.exit			= Exit::SWITCH;
+		block.condition		= selector.reg;
+		block.targets[ 0 ]	= instance.blocks[ operands[ 1 ] ];
+		for( uint32_t i=2; i < operand_count; i += 2 ) {
+			block.cases.push_back( std::make_pair( operands[ i ], instance.blocks[ operands[ i + 1 ] ] ) );
+		}
+		return true;
+	}
+
+	case spv::OpReturnValue:
+	{
+		if( operand_count < 1 ) return false;
+		auto value = _Get( instance, operands[ 0 ], ValueKind::REGISTERS );
+		if( !_error.empty() ) return false;
+		_EmitCopy( instance.return_value.reg, value.reg, instance.return_value.count );
+	}
+	// fall through
+	case spv::OpReturn:
+	case spv::OpUnreachable:
+		if( instance.return_block == UINT32_MAX ) {
+			_blocks[ _current ].exit			= Exit::RETURN;
+		} else {
+			_blocks[ _current ].exit			= Exit::BRANCH;
+			_blocks[ _current ].targets[ 0 ]	= instance.return_block;
+		}
+		return true;
+
+	case spv::OpControlBarrier:
+	{
+		// Every lane has to get here before any lane goes on, the rest of the block is a
+		// block of its own that the lanes wait in.
+		uint32_t next = _NewBlock();
+		_blocks[ _current ].exit			= Exit::BRANCH;
+		_blocks[ _current ].targets[ 0 ]	= next;
+		_current = next;
+		return true;
+	}
+
+	case spv::OpFunctionCall:
+	{
+		if( operand_count < 3 || !_functions.count( operands[ 2 ] ) ) return false;
+		if( instance.depth >= MAX_INLINE_DEPTH ) return _Fail( "function calls are nested too deep" );
+		std::vector<Value> arguments;
+		for( uint32_t i=3; i < operand_count; ++i ) {
+			auto local = instance.values.find( operands[ i ] );
+			Value argument = local != instance.values.end() ? local->second : _ValidId( operands[ i ] ) ? _globals[ operands[ i ] ] : Value();
+			if( argument.kind == ValueKind::NONE ) return _Fail( "function argument " + std::to_string( operands[ i ] ) + " is not defined" );
+			arguments.push_back( argument );
+		}
+		Value result;
+		if( _Opcode( operands[ 0 ] ) != spv::OpTypeVoid ) {
+			result = _Result( instance, operands[ 0 ], operands[ 1 ] );
+		}
+		// The rest of the block runs after the callee returns.
+		uint32_t caller			= _current;
+		uint32_t continuation	= _NewBlock();
+		uint32_t entry			= _LowerFunction( operands[ 2 ], arguments, continuation, result, instance.depth + 1 );
+		if( entry == UINT32_MAX ) return false;
+		_blocks[ caller ].exit			= Exit::BRANCH;
+		_blocks[ caller ].targets[ 0 ]	= entry;
+		_current = continuation;
+		return true;
+	}
+
+	case spv::OpVariable:
+	{
+		if( operand_count < 3 || _Opcode( operands[ 0 ] ) != spv::OpTypePointer ) return false;
+		if( operands[ 2 ] != spv::StorageClassFunction ) return _Fail( "only function variables can be declared in functions" );
+		Region region;
+		region.type						= RegionType::INVOCATION;
+		region.offset					= _program.invocation_memory_size;
+		region.size						= _PackedSize( _Type( operands[ 0 ] )[ 2 ] );
+		_program.invocation_memory_size	+= region.size;
+
+		Value value;
+		value.kind		= ValueKind::POINTER;
+		value.reg		= _zero;
+		value.type		= _Type( operands[ 0 ] )[ 2 ];
+		value.region	= _AddRegion( region );
+		instance.values[ operands[ 1 ] ] = value;
+		if( operand_count > 3 ) {
+			auto initializer = _Get( instance, operands[ 3 ], ValueKind::REGISTERS );
+			if( !_error.empty() ) return false;
+			auto & store			= _Emit( Code::STORE, initializer.count, 0 );
+			store.operands[ 0 ]		= value.reg;
+			store.operands[ 1 ]		= initializer.reg;
+			store.region			= value.region;
+			store.value				= _Layout( value.type, 0 );
+		}
+		return true;
+	}
+
+	case spv::OpUndef:
+	{
+		if( operand_count < 2 ) return false;
+		Value value		= _Result( instance, operands[ 0 ], operands[ 1 ] );
+		for( uint32_t c=0; c < value.count; ++c ) {
+			_program.constants.push_back( std::make_pair( value.reg + c, 0u ) );
+		}
+		return true;
+	}
+
+	case spv::OpAccessChain:
+	case spv::OpInBoundsAccessChain:
+		if( operand_count < 3 ) return false;
+		return _LowerAccessChain( instance, operands, operand_count );
+
+	case spv::OpLoad:
+	{
+		if( operand_count < 3 ) return false;
+		auto local		= instance.values.find( operands[ 2 ] );
+		Value pointer	= local != instance.values.end() ? local->second : _ValidId( operands[ 2 ] ) ? _globals[ operands[ 2 ] ] : Value();
+		if( pointer.kind == ValueKind::IMAGE ) {
+			instance.values[ operands[ 1 ] ] = pointer;
+			return true;
+		}
+		if( pointer.kind != ValueKind::POINTER ) return _Fail( "OpLoad from something that is not a pointer" );
+		auto result				= _Result( instance, operands[ 0 ], operands[ 1 ] );
+		auto & load				= _Emit( Code::LOAD, result.count, result.reg );
+		load.operands[ 0 ]		= pointer.reg;
+		load.region				= pointer.region;
+		load.value				= _Layout( pointer.type, pointer.matrix_stride );
+		return true;
+	}
+
+	case spv::OpStore:
+	{
+		if( operand_count < 2 ) return false;
+		auto pointer	= _Get( instance, operands[ 0 ], ValueKind::POINTER );
+		auto value		= _Get( instance, operands[ 1 ], ValueKind::REGISTERS );
+		if( !_error.empty() ) return false;
+		auto & store			= _Emit( Code::STORE, value.count, 0 );
+		store.operands[ 0 ]		= pointer.reg;
+		store.operands[ 1 ]		= value.reg;
+		store.region			= pointer.region;
+		store.value				= _Layout( pointer.type, pointer.matrix_stride );
+		return true;
+	}
+
+	case spv::OpCopyMemory:
+	{
+		if( operand_count < 2 ) return false;
+		auto target		= _Get( instance, operands[ 0 ], ValueKind::POINTER );
+		auto source		= _Get( instance, operands[ 1 ], ValueKind::POINTER );
+		if( !_error.empty() ) return false;
+		uint32_t count			= _ComponentCount( source.type );
+		uint32_t temporary		= _Allocate( count );
+		auto & load				= _Emit( Code::LOAD, count, temporary );
+		load.operands[ 0 ]		= source.reg;
+		load.region				= source.region;
+		load.value				= _Layout( source.type, source.matrix_stride );
+		auto & store			= _Emit( Code::STORE, count, 0 );
+		store.operands[ 0 ]		= target.reg;
+		store.operands[ 1 ]		= temporary;
+		store.region			= target.region;
+		store.value				= _Layout( target.type, target.matrix_stride );
+		return true;
+	}
+
+	case spv::OpArrayLength:
+	{
+		if( operand_count < 4 ) return false;
+		auto pointer = _Get( instance, operands[ 2 ], ValueKind::POINTER );
+		if( !_error.empty() ) return false;
+		if( _Opcode( pointer.type ) != spv::OpTypeStruct ) return false;
+		uint32_t member_count	= ( _code[ _ids[ pointer.type ].offset ] >> spv::WordCountShift ) - 2;
+		if( operands[ 3 ] >= member_count ) return false;
+		uint32_t array_type		= _Type( pointer.type )[ 1 + operands[ 3 ] ];
+		if( _Opcode( array_type ) != spv::OpTypeRuntimeArray || !_ArrayStride( array_type ) ) return false;
+		auto result				= _Result( instance, operands[ 0 ], operands[ 1 ] );
+		auto & operation		= _Emit( Code::ARRAY_LENGTH, 1, result.reg );
+		operation.region		= pointer.region;
+		operation.value			= _MemberOffset( pointer.type, operands[ 3 ] );
+		operation.value2		= _ArrayStride( array_type );
+		return true;
+	}
+
+	case spv::OpAtomicLoad:
+	case spv::OpAtomicStore:
+	case spv::OpAtomicExchange:
+	case spv::OpAtomicCompareExchange:
+	case spv::OpAtomicIIncrement:
+	case spv::OpAtomicIDecrement:
+	case spv::OpAtomicIAdd:
+	case spv::OpAtomicISub:
+	case spv::OpAtomicSMin:
+	case spv::OpAtomicUMin:
+	case spv::OpAtomicSMax:
+	case spv::OpAtomicUMax:
+	case spv::OpAtomicAnd:
+	case spv::OpAtomicOr:
+	case spv::OpAtomicXor:
+		return _LowerAtomic( instance, opcode, operands, operand_count );
+
+	case spv::OpCompositeConstruct:
+	{
+		if( operand_count < 2 ) return false;
+		std::vector<Value> constituents;
+		uint32_t count = 0;
+		for( uint32_t i=2; i < operand_count; ++i ) {
+			constituents.push_back( _Get( instance, operands[ i ], ValueKind::REGISTERS ) );
+			count += constituents.back().count;
+		}
+		if( !_error.empty() ) return false;
+		auto result = _Result( instance, operands[ 0 ], operands[ 1 ] );
+		if( count != result.count ) return false;
+		uint32_t constituent_offset = 0;
+		for( auto & constituent : constituents ) {
+			_EmitCopy( result.reg + constituent_offset, constituent.reg, constituent.count );
+			constituent_offset += constituent.count;
+		}
+		return true;
+	}
+
+	case spv::OpCompositeExtract:
+	{
+		if( operand_count < 3 ) return false;
+		auto composite = _Get( instance, operands[ 2 ], ValueKind::REGISTERS );
+		if( !_error.empty() ) return false;
+		uint32_t element_offset, type;
+		if( !_FlatOffset( composite.type, operands + 3, operand_count - 3, element_offset, type ) ) return false;
+		auto result = _Result( instance, operands[ 0 ], operands[ 1 ] );
+		_EmitCopy( result.reg, composite.reg + element_offset, result.count );
+		return true;
+	}
+
+	case spv::OpCompositeInsert:
+	{
+		if( operand_count < 4 ) return false;
+		auto object		= _Get( instance, operands[ 2 ], ValueKind::REGISTERS );
+		auto composite	= _Get( instance, operands[ 3 ], ValueKind::REGISTERS );
+		if( !_error.empty() ) return false;
+		uint32_t element_offset, type;
+		if( !_FlatOffset( composite.type, operands + 4, operand_count - 4, element_offset, type ) ) return false;
+		auto result = _Result( instance, operands[ 0 ], operands[ 1 ] );
+		_EmitCopy( result.reg, composite.reg, result.count );
+		_EmitCopy( result.reg + element_offset, object.reg, object.count );
+		return true;
+	}
+
+	case spv::OpVectorShuffle:
+	{
+		if( operand_count < 4 ) return false;
+		auto first	= _Get( instance, operands[ 2 ], ValueKind::REGISTERS );
+		auto second	= _Get( instance, operands[ 3 ], ValueKind::REGISTERS );
+		if( !_error.empty() ) return false;
+		auto result = _Result( instance, operands[ 0 ], operands[ 1 ] );
+		if( operand_count - 4 != result.count ) return false;
+		for( uint32_t c=0; c < result.count; ++c ) {
+			uint32_t component = operands[ 4 + c ];
+			if( component == UINT32_MAX ) continue;		// undefined
+			if( component >= first.count + second.count ) return false;
+			_EmitCopy( result.reg + c, component < first.count ? first.reg + component : second.reg + component - first.count, 1 );
+		}
+		return true;
+	}
+
+	case spv::OpVectorExtractDynamic:
+	case spv::OpVectorInsertDynamic:
+	{
+		bool insert = opcode == spv::OpVectorInsertDynamic;
+		if( operand_count < ( insert ? 5u : 4u ) ) return false;
+		auto vector		= _Get( instance, operands[ 2 ], ValueKind::REGISTERS );
+		auto second		= _Get( instance, operands[ 3 ], ValueKind::REGISTERS );
+		auto third		= insert ? _Get( instance, operands[ 4 ], ValueKind::REGISTERS ) : Value();
+		if( !_error.empty() ) return false;
+		auto result				= _Result( instance, operands[ 0 ], operands[ 1 ] );
+		auto & operation		= _Emit( insert ? Code::VECTOR_INSERT : Code::VECTOR_EXTRACT, vector.count, result.reg );
+		operation.operands[ 0 ]	= vector.reg;
+		operation.operands[ 1 ]	= second.reg;
+		operation.operands[ 2 ]	= third.reg;
+		return true;
+	}
+
+	case spv::OpDot:
+	case spv::OpAny:
+	case spv::OpAll:
+	{
+		if( operand_count < ( opcode == spv::OpDot ? 4u : 3u ) ) return false;
+		auto a	= _Get( instance, operands[ 2 ], ValueKind::REGISTERS );
+		auto b	= opcode == spv::OpDot ? _Get( instance, operands[ 3 ], ValueKind::REGISTERS ) : a;
+		if( !_error.empty() ) return false;
+		auto result				= _Result( instance, operands[ 0 ], operands[ 1 ] );
+		auto & operation		= _Emit( opcode == spv::OpDot ? Code::DOT : opcode == spv::OpAny ? Code::ANY : Code::ALL, a.count, result.reg );
+		operation.operands[ 0 ]	= a.reg;
+		operation.operands[ 1 ]	= b.reg;
+		return true;
+	}
+
+	case spv::OpIAddCarry:
+	case spv::OpISubBorrow:
+	case spv::OpUMulExtended:
+	case spv::OpSMulExtended:
+	{
+		// A struct of two vectors, the low bits and the carry, borrow or high bits.
+		if( operand_count < 4 ) return false;
+		auto a	= _Get( instance, operands[ 2 ], ValueKind::REGISTERS );
+		auto b	= _Get( instance, operands[ 3 ], ValueKind::REGISTERS );
+		if( !_error.empty() ) return false;
+		auto result		= _Result( instance, operands[ 0 ], operands[ 1 ] );
+		Value low		= a;
+		Value high		= a;
+		low.reg			= result.reg;
+		high.reg		= result.reg + a.count;
+		Code low_code	= opcode == spv::OpIAddCarry ? Code::IADD : opcode == spv::OpISubBorrow ? Code::ISUB : Code::IMUL;
+		Code high_code	= opcode == spv::OpIAddCarry ? Code::CARRY : opcode == spv::OpISubBorrow ? Code::BORROW : opcode == spv::OpUMulExtended ? Code::UMUL_HIGH : Code::SMUL_HIGH;
+		_Componentwise( low_code, low, { a, b } );
+		_Componentwise( high_code, high, { a, b } );
+		return true;
+	}
+
+	case spv::OpTranspose:
+	{
+		if( operand_count < 3 ) return false;
+		auto matrix = _Get( instance, operands[ 2 ], ValueKind::REGISTERS );
+		if( !_error.empty() ) return false;
+		if( _Opcode( matrix.type ) != spv::OpTypeMatrix ) return false;
+		auto result			= _Result( instance, operands[ 0 ], operands[ 1 ] );
+		uint32_t columns	= _Type( matrix.type )[ 2 ];
+		uint32_t rows		= matrix.count / columns;
+		for( uint32_t c=0; c < columns; ++c ) {
+			for( uint32_t r=0; r < rows; ++r ) {
+				_EmitCopy( result.reg + r * columns + c, matrix.reg + c * rows + r, 1 );
+			}
+		}
+		return true;
+	}
+
+	case spv::OpOuterProduct:
+	{
+		if( operand_count < 4 ) return false;
+		auto a	= _Get( instance, operands[ 2 ], ValueKind::REGISTERS );
+		auto b	= _Get( instance, operands[ 3 ], ValueKind::REGISTERS );
+		if( !_error.empty() ) return false;
+		auto result = _Result( instance, operands[ 0 ], operands[ 1 ] );
+		for( uint32_t c=0; c < b.count; ++c ) {
+			auto & operation		= _Emit( Code::FMUL, a.count, result.reg + c * a.count );
+			operation.operands[ 0 ]	= a.reg;
+			operation.operands[ 1 ]	= b.reg + c;
+			operation.steps[ 1 ]	= 0;
+		}
+		return true;
+	}
+
+	case spv::OpMatrixTimesVector:
+	case spv::OpVectorTimesMatrix:
+	case spv::OpMatrixTimesMatrix:
+	{
+		if( operand_count < 4 ) return false;
+		auto a	= _Get( instance, operands[ 2 ], ValueKind::REGISTERS );
+		auto b	= _Get( instance, operands[ 3 ], ValueKind::REGISTERS );
+		if( !_error.empty() ) return false;
+		uint32_t matrix_type = opcode == spv::OpVectorTimesMatrix ? b.type : a.type;
+		if( _Opcode( matrix_type ) != spv::OpTypeMatrix || ( opcode == spv::OpMatrixTimesMatrix && _Opcode( b.type ) != spv::OpTypeMatrix ) ) return false;
+		auto result = _Result( instance, operands[ 0 ], operands[ 1 ] );
+		if( opcode == spv::OpMatrixTimesVector ) {
+			_MatrixTimesVector( result, a, b.reg, a.type );
+		} else if( opcode == spv::OpVectorTimesMatrix ) {
+			// One dot product per column.
+			for( uint32_t c=0; c < result.count; ++c ) {
+				auto & operation		= _Emit( Code::DOT, a.count, result.reg + c );
+				operation.operands[ 0 ]	= a.reg;
+				operation.operands[ 1 ]	= b.reg + c * a.count;
+			}
+		} else {
+			// Every column of the result is a times a column of b.
+			uint32_t rows			= _ComponentCount( _Type( a.type )[ 1 ] );
+			uint32_t b_rows			= _ComponentCount( _Type( b.type )[ 1 ] );
+			for( uint32_t c=0; c < result.count / rows; ++c ) {
+				Value column	= result;
+				column.reg		= result.reg + c * rows;
+				_MatrixTimesVector( column, a, b.reg + c * b_rows, a.type );
+			}
+		}
+		return true;
+	}
+
+	case spv::OpExtInst:
+		return _LowerExtendedInstruction( instance, operands, operand_count );
+
+	case spv::OpImageRead:
+	case spv::OpImageWrite:
+	case spv::OpImageQuerySize:
+	{
+		bool write = opcode == spv::OpImageWrite;
+		const uint32_t * arguments = write ? operands : operands + 2;
+		if( operand_count < ( write ? 3u : opcode == spv::OpImageRead ? 4u : 3u ) ) return false;
+		auto image = _Get( instance, arguments[ 0 ], ValueKind::IMAGE );
+		if( !_error.empty() ) return false;
+		if( opcode == spv::OpImageQuerySize ) {
+			auto result				= _Result( instance, operands[ 0 ], operands[ 1 ] );
+			if( result.count != 2 ) return false;
+			_Emit( Code::IMAGE_SIZE, 2, result.reg ).region = image.region;
+			return true;
+		}
+		auto coordinate = _Get( instance, arguments[ 1 ], ValueKind::REGISTERS );
+		if( !_error.empty() ) return false;
+		if( coordinate.count != 2 ) return false;
+		if( write ) {
+			auto texel = _Get( instance, arguments[ 2 ], ValueKind::REGISTERS );
+			if( !_error.empty() || texel.count > 4 ) return false;
+			auto & operation		= _Emit( Code::IMAGE_WRITE, 1, 0 );
+			operation.operands[ 0 ]	= coordinate.reg;
+			operation.operands[ 1 ]	= texel.reg;
+			operation.region		= image.region;
+			operation.value			= texel.count;
+		} else {
+			auto result				= _Result( instance, operands[ 0 ], operands[ 1 ] );
+			if( result.count > 4 ) return false;
+			auto & operation		= _Emit( Code::IMAGE_READ, result.count, result.reg );
+			operation.operands[ 0 ]	= coordinate.reg;
+			operation.region		= image.region;
+		}
+		return true;
+	}
+
+	default:
+		return _Fail( "opcode " + std::to_string( opcode ) + " is not supported" );
+	}
+}
+
+uint32_t Lowering::_LowerFunction( uint32_t function_id, const std::vector<Value> & arguments, uint32_t return_block, const Value & return_value, uint32_t depth )
+{
+	auto & function = _functions[ function_id ];
+	if( arguments.size() != function.parameters.size() ) {
+		_Fail( "function called with the wrong number of arguments" );
+		return UINT32_MAX;
+	}
+
+	Instance instance;
+	instance.function		= &function;
+	instance.return_block	= return_block;
+	instance.return_value	= return_value;
+	instance.depth			= depth;
+	for( size_t i=0; i < arguments.size(); ++i ) {
+		instance.values[ function.parameters[ i ] ] = arguments[ i ];
+	}
+
+	// Every label gets its block and every phi its registers before anything branches to them.
+	uint32_t entry	= UINT32_MAX;
+	uint32_t label	= 0;
+	for( uint32_t offset=function.begin; offset < function.end; offset += _code[ offset ] >> spv::WordCountShift ) {
+		uint32_t opcode				= _code[ offset ] & spv::OpCodeMask;
+		uint32_t operand_count		= ( _code[ offset ] >> spv::WordCountShift ) - 1;
+		const uint32_t * operands	= _code + offset + 1;
+		if( opcode == spv::OpLabel && operand_count >= 1 ) {
+			label = operands[ 0 ];
+			instance.blocks[ label ] = _NewBlock();
+			if( entry == UINT32_MAX ) entry = instance.blocks[ label ];
+		} else if( opcode == spv::OpPhi && operand_count >= 2 ) {
+			Phi phi;
+			phi.offset	= offset;
+			phi.count	= _ComponentCount( operands[ 0 ] );
+			phi.result	= _Allocate( phi.count );
+			phi.shadow	= _Allocate( phi.count );
+			instance.phis[ label ].push_back( phi );
+
+			Value value;
+			value.kind	= ValueKind::REGISTERS;
+			value.reg	= phi.result;
+			value.count	= phi.count;
+			value.type	= operands[ 0 ];
+			instance.values[ operands[ 1 ] ] = value;
+		}
+	}
+	if( entry == UINT32_MAX ) {
+		_Fail( "function without blocks" );
+		return UINT32_MAX;
+	}
+
+	for( uint32_t offset=function.begin; offset < function.end; offset += _code[ offset ] >> spv::WordCountShift ) {
+		if( !_LowerInstruction( instance, offset ) || !_error.empty() ) {
+			_Fail( "invalid instruction at word " + std::to_string( offset ) );
+			return UINT32_MAX;
+		}
+	}
+	return entry;
+}
+
+// Orders the blocks so lanes that run the lowest block first meet again: a depth first walk
+// that visits the merge and continue blocks of a construct before its other successors
+// puts them after the blocks of the construct in reverse post order.
+void Lowering::_Finish()
+{
+	std::vector<std::vector<uint32_t>> successors( _blocks.size() );
+	for( size_t b=0; b < _blocks.size(); ++b ) {
+		auto & block = _blocks[ b ];
+		if( block.merge != UINT32_MAX )				successors[ b ].push_back( block.merge );
+		if( block.continue_target != UINT32_MAX )	successors[ b ].push_back( block.continue_target );
+		switch( block.exit ) {
+		case Exit::BRANCH:
+			successors[ b ].push_back( block.targets[ 0 ] );
+			break;
+		case Exit::CONDITIONAL:
+			successors[ b ].push_back( block.targets[ 0 ] );
+			successors[ b ].push_back( block.targets[ 1 ] );
+			break;
+		case Exit::SWITCH:
+			successors[ b ].push_back( block.targets[ 0 ] );
+			for( auto & c : block.cases ) successors[ b ].push_back( c.second );
+			break;
+		case Exit::RETURN:
+			break;
+		}
+	}
+
+	std::vector<uint32_t> post_order;
+	std::vector<bool> visited( _blocks.size(), false );
+	std::vector<std::pair<uint32_t, uint32_t>> stack;
+	stack.push_back( std::make_pair( 0u, 0u ) );
+	visited[ 0 ] = true;
+	while( !stack.empty() ) {
+		uint32_t block	= stack.back().first;
+		uint32_t next	= stack.back().second;
+		if( next < successors[ block ].size() ) {
+			++stack.back().second;
+			uint32_t successor = successors[ block ][ next ];
+			if( !visited[ successor ] ) {
+				visited[ successor ] = true;
+				stack.push_back( std::make_pair( successor, 0u ) );
+			}
+		} else {
+			post_order.push_back( block );
+			stack.pop_back();
+		}
+	}
+
+	std::vector<uint32_t> position( _blocks.size(), UINT32_MAX );
+	for( size_t i=0; i < post_order.size(); ++i ) {
+		position[ post_order[ post_order.size() - 1 - i ] ] = uint32_t( i );
+	}
+	_program.blocks.resize( post_order.size() );
+	for( size_t i=0; i < post_order.size(); ++i ) {
+		auto & pending				= _blocks[ post_order[ post_order.size() - 1 - i ] ];
+		auto & block				= _program.blocks[ i ];
+		block.first_operation		= uint32_t( _program.operations.size() );
+		block.operation_count		= uint32_t( pending.operations.size() );
+		block.exit					= pending.exit;
+		block.condition				= pending.condition;
+		block.targets[ 0 ]			= position[ pending.targets[ 0 ] ];
+		block.targets[ 1 ]			= position[ pending.targets[ 1 ] ];
+		block.first_case			= uint32_t( _program.cases.size() );
+		block.case_count			= uint32_t( pending.cases.size() );
+		_program.operations.insert( _program.operations.end(), pending.operations.begin(), pending.operations.end() );
+		for( auto & c : pending.cases ) {
+			_program.cases.push_back( std::make_pair( c.first, position[ c.second ] ) );
+		}
+	}
+	_blocks.clear();
+}
+
+// Invalid modules can lower to operations on registers, layouts or regions that do not
+// exist, they are turned away here so a dispatch never touches memory it does not own.
+bool Lowering::_Verify()
+{
+	auto & program = _program;
+	auto registers = [ &program ]( uint32_t first, uint32_t count ) {
+		return uint64_t( first ) + count <= program.register_count;
+	};
+	for( auto & operation : program.operations ) {
+		uint32_t count	= operation.count;
+		bool valid		= true;
+		switch( operation.code ) {
+		case Code::DOT:
+		case Code::LENGTH:
+		case Code::DISTANCE:
+		case Code::NORMALIZE:
+		case Code::CROSS:
+		case Code::FACE_FORWARD:
+		case Code::REFLECT:
+		case Code::REFRACT:
+		case Code::ANY:
+		case Code::ALL:
+		case Code::PACK_SNORM4X8:
+		case Code::PACK_UNORM4X8:
+		case Code::PACK_SNORM2X16:
+		case Code::PACK_UNORM2X16:
+		case Code::PACK_HALF2X16:
+		case Code::UNPACK_SNORM4X8:
+		case Code::UNPACK_UNORM4X8:
+		case Code::UNPACK_SNORM2X16:
+		case Code::UNPACK_UNORM2X16:
+		case Code::UNPACK_HALF2X16:
+		case Code::VECTOR_EXTRACT:
+		case Code::VECTOR_INSERT:
+			valid = count >= 1 && count <= 4 && registers( operation.result, AcrossResultCount( operation.code, count ) );
+			for( uint32_t i=0; i < 3; ++i ) {
+				valid = valid && registers( operation.operands[ i ], std::max( AcrossOperandCount( operation.code, i, count ), 1u ) );
+			}
+			break;
+		case Code::ADDRESS:
+		case Code::INDEX:
+			valid = registers( operation.result, 1 ) && registers( operation.operands[ 0 ], 1 ) && registers( operation.operands[ 1 ], 1 );
+			break;
+		case Code::LOAD:
+		case Code::STORE:
+			valid = operation.region < program.regions.size() && program.regions[ operation.region ].type != RegionType::IMAGE &&
+				operation.value < program.layouts.size() && program.layouts[ operation.value ].size() >= count &&
+				registers( operation.operands[ 0 ], 1 ) &&
+				( operation.code == Code::LOAD ? registers( operation.result, count ) : registers( operation.operands[ 1 ], count ) );
+			break;
+		case Code::ATOMIC:
+			valid = operation.region < program.regions.size() && program.regions[ operation.region ].type != RegionType::IMAGE &&
+				registers( operation.result, 1 ) && registers( operation.operands[ 0 ], 1 ) &&
+				registers( operation.operands[ 1 ], 1 ) && registers( operation.operands[ 2 ], 1 );
+			break;
+		case Code::ARRAY_LENGTH:
+			valid = operation.region < program.regions.size() && program.regions[ operation.region ].type == RegionType::BUFFER &&
+				operation.value2 != 0 && registers( operation.result, 1 );
+			break;
+		case Code::IMAGE_READ:
+		case Code::IMAGE_WRITE:
+		case Code::IMAGE_SIZE:
+			valid = operation.region < program.regions.size() && program.regions[ operation.region ].type == RegionType::IMAGE;
+			if( operation.code == Code::IMAGE_READ )		valid = valid && count >= 1 && count <= 4 && registers( operation.result, count ) && registers( operation.operands[ 0 ], 2 );
+			if( operation.code == Code::IMAGE_WRITE )		valid = valid && operation.value >= 1 && operation.value <= 4 && registers( operation.operands[ 1 ], operation.value ) && registers( operation.operands[ 0 ], 2 );
+			if( operation.code == Code::IMAGE_SIZE )		valid = valid && registers( operation.result, 2 );
+			break;
+		default:
+			// Componentwise, an operand with step 0 is one register.
+			valid = registers( operation.result, count );
+			for( uint32_t i=0; i < 4; ++i ) {
+				valid = valid && registers( operation.operands[ i ], operation.steps[ i ] ? count : 1 );
+			}
+			break;
+		}
+		if( !valid ) return _Fail( "the module lowers to an invalid operation, it is not valid SPIR-V" );
+	}
+	for( auto & block : program.blocks ) {
+		if( block.exit == Exit::RETURN ) continue;
+		bool valid = block.targets[ 0 ] < program.blocks.size() && registers( block.condition, 1 );
+		if( block.exit == Exit::CONDITIONAL ) valid = valid && block.targets[ 1 ] < program.blocks.size();
+		for( uint32_t c=0; c < block.case_count; ++c ) {
+			valid = valid && program.cases[ block.first_case + c ].second < program.blocks.size();
+		}
+		if( !valid ) return _Fail( "the module has an invalid branch, it is not valid SPIR-V" );
+	}
+	return true;
+}
+
+bool Lowering::Lower()
+{
+	if( _word_count < 5 || _code[ 0 ] != spv::MagicNumber ) return _Fail( "not a SPIR-V module" );
+	uint32_t bound = _code[ 3 ];
+	if( bound == 0 || bound > ( 1u << 22 ) ) return _Fail( "invalid id bound" );
+	_ids.assign( bound, IdInfo() );
+	_globals.assign( bound, Value() );
+	_zero = _Constant( 0 );
+
+	// Everything up to the first function, then the extent of every function.
+	size_t position		= 5;
+	Function * function	= nullptr;
+	while( position < _word_count ) {
+		uint32_t opcode		= _code[ position ] & spv::OpCodeMask;
+		uint32_t count		= _code[ position ] >> spv::WordCountShift;
+		if( count == 0 || position + count > _word_count ) return _Fail( "truncated instruction at word " + std::to_string( position ) );
+		const uint32_t * operands	= _code + position + 1;
+		uint32_t operand_count		= count - 1;
+
+		if( opcode == spv::OpFunction ) {
+			if( function || operand_count < 2 || !_ValidId( operands[ 1 ] ) ) return _Fail( "invalid OpFunction" );
+			function				= &_functions[ operands[ 1 ] ];
+			function->result_type	= operands[ 0 ];
+			function->begin			= uint32_t( position + count );
+		} else if( opcode == spv::OpFunctionEnd ) {
+			if( !function ) return _Fail( "OpFunctionEnd outside of a function" );
+			function->end			= uint32_t( position );
+			function				= nullptr;
+		} else if( function ) {
+			if( opcode == spv::OpFunctionParameter ) {
+				if( operand_count < 2 ) return _Fail( "invalid OpFunctionParameter" );
+				function->parameters.push_back( operands[ 1 ] );
+			}
+		} else if( !_ParseGlobal( uint32_t( position ), opcode, operands, operand_count ) ) {
+			return _Fail( "invalid instruction at word " + std::to_string( position ) );
+		}
+		position += count;
+	}
+	if( function ) return _Fail( "function without OpFunctionEnd" );
+	if( _entry_point == UINT32_MAX || !_functions.count( _entry_point ) ) return _Fail( "no GLCompute entry point" );
+
+	_program.lane_count = _program.workgroup_size[ 0 ] * _program.workgroup_size[ 1 ] * _program.workgroup_size[ 2 ];
+	if( _program.lane_count == 0 || _program.lane_count > MAX_LANE_COUNT ) return _Fail( "workgroups of more than 1024 invocations are not supported" );
+
+	// Block 0 initializes the private variables and goes on to the entry point.
+	_current = _NewBlock();
+	for( auto & initializer : _private_initializers ) {
+		auto & variable			= _globals[ initializer.first ];
+		auto & value			= _globals[ initializer.second ];
+		if( value.kind != ValueKind::REGISTERS ) return _Fail( "variable initializers must be constants" );
+		auto & store			= _Emit( Code::STORE, value.count, 0 );
+		store.operands[ 0 ]		= variable.reg;
+		store.operands[ 1 ]		= value.reg;
+		store.region			= variable.region;
+		store.value				= _Layout( variable.type, 0 );
+	}
+	uint32_t entry = _LowerFunction( _entry_point, std::vector<Value>(), UINT32_MAX, Value(), 0 );
+	if( entry == UINT32_MAX ) return false;
+	_blocks[ 0 ].exit			= Exit::BRANCH;
+	_blocks[ 0 ].targets[ 0 ]	= entry;
+
+	_Finish();
+	return _Verify();
+}
+
+} // namespace
+
+CpuComputeExecutor::CpuComputeExecutor( JobSystem * job_system )
+{
+	_job_system		= job_system;
+}
+
+CpuComputeExecutor::~CpuComputeExecutor()
+{
+	_FreeProgram();
+}
+
+bool CpuComputeExecutor::Load( const uint32_t * code, size_t word_count, const VkSpecializationInfo * specialization_info )
+{
+	_FreeProgram();
+	_error.clear();
+
+	auto program = new CpuComputeProgram();
+	Lowering lowering( code, word_count, specialization_info, *program, _error );
+	if( !lowering.Lower() ) {
+		if( _error.empty() ) _error = "invalid module";
+		delete program;
+		return false;
+	}
+	_program = program;
+	std::copy( program->workgroup_size, program->workgroup_size + 3, _workgroup_size );
+	return true;
+}
+
+const std::string & CpuComputeExecutor::GetError() const
+{
+	return _error;
+}
+
+const uint32_t * CpuComputeExecutor::GetWorkgroupSize() const
+{
+	return _workgroup_size;
+}
+
+void CpuComputeExecutor::SetBuffer( uint32_t set, uint32_t binding, void * data, size_t size )
+{
+	auto & entry	= _GetBinding( set, binding );
+	entry.data		= data;
+	entry.size		= size;
+}
+
+void CpuComputeExecutor::SetStorageImage( uint32_t set, uint32_t binding, const CpuStorageImage & image )
+{
+	assert( ( image.format == VK_FORMAT_R8G8B8A8_UNORM || image.format == VK_FORMAT_R32_SFLOAT || image.format == VK_FORMAT_R32G32B32A32_SFLOAT ||
+		image.format == VK_FORMAT_R32_UINT || image.format == VK_FORMAT_R32_SINT ) && "Cpu compute executor: image format is not supported." );
+	_GetBinding( set, binding ).image = image;
+}
+
+void CpuComputeExecutor::SetPushConstants( const void * data, uint32_t size )
+{
+	assert( size <= sizeof( _push_constants ) && "Cpu compute executor: too many push constants." );
+	std::memcpy( _push_constants, data, std::min( size_t( size ), sizeof( _push_constants ) ) );
+}
+
+void CpuComputeExecutor::Dispatch( uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z )
+{
+	assert( _program && "Cpu compute executor: no shader loaded." );
+	if( !_program ) return;
+
+	// Where the buffers, images and push constants are, the same for every workgroup. Images
+	// are pointed to, bindings the shader uses but nobody set are added before that.
+	for( auto & region : _program->regions ) {
+		if( region.type == RegionType::BUFFER || region.type == RegionType::IMAGE ) {
+			_GetBinding( region.set, region.binding );
+		}
+	}
+	std::vector<RegionMemory> bound( _program->regions.size() );
+	for( size_t r=0; r < _program->regions.size(); ++r ) {
+		auto & region = _program->regions[ r ];
+		if( region.type == RegionType::BUFFER || region.type == RegionType::IMAGE ) {
+			auto & binding = _GetBinding( region.set, region.binding );
+			if( region.type == RegionType::BUFFER ) {
+				assert( binding.data && "Cpu compute executor: buffer not bound." );
+				bound[ r ].data		= static_cast<uint8_t*>( binding.data );
+				bound[ r ].size		= binding.data ? binding.size : 0;
+				bound[ r ].shared	= true;
+			} else {
+				assert( binding.image.data && "Cpu compute executor: image not bound." );
+				bound[ r ].image	= &binding.image;
+			}
+		} else if( region.type == RegionType::PUSH_CONSTANTS ) {
+			bound[ r ].data		= _push_constants;
+			bound[ r ].size		= sizeof( _push_constants );
+		}
+	}
+
+	uint32_t group_count[ 3 ]	= { group_count_x, group_count_y, group_count_z };
+	uint32_t total				= group_count_x * group_count_y * group_count_z;
+	if( total == 0 ) return;
+
+	auto program	= _program;
+	auto job		= _job_system->ParallelFor( total, [ & ]( uint32_t begin, uint32_t end ) {
+		auto context = _AcquireContext();
+		for( size_t r=0; r < program->regions.size(); ++r ) {
+			auto & region = program->regions[ r ];
+			if( region.type == RegionType::WORKGROUP ) {
+				context->regions[ r ].data			= context->workgroup_memory.data() + region.offset;
+				context->regions[ r ].size			= region.size;
+			} else if( region.type == RegionType::INVOCATION ) {
+				context->regions[ r ].data			= context->invocation_memory.data() + region.offset;
+				context->regions[ r ].size			= region.size;
+				context->regions[ r ].lane_stride	= program->invocation_memory_size;
+			} else {
+				context->regions[ r ]				= bound[ r ];
+			}
+		}
+		for( uint32_t group=begin; group < end; ++group ) {
+			uint32_t workgroup_id[ 3 ] = {
+				group % group_count_x,
+				group / group_count_x % group_count_y,
+				group / ( group_count_x * group_count_y ),
+			};
+			RunWorkgroup( *program, *context, workgroup_id, group_count );
+		}
+		_ReleaseContext( context );
+	} );
+	_job_system->Wait( job );
+}
+
+CpuComputeExecutor::Binding & CpuComputeExecutor::_GetBinding( uint32_t set, uint32_t binding )
+{
+	for( auto & entry : _bindings ) {
+		if( entry.set == set && entry.binding == binding ) return entry;
+	}
+	_bindings.push_back( Binding() );
+	_bindings.back().set		= set;
+	_bindings.back().binding	= binding;
+	return _bindings.back();
+}
+
+CpuComputeContext * CpuComputeExecutor::_AcquireContext()
+{
+	{
+		std::lock_guard<std::mutex> lock( _contexts_mutex );
+		if( !_free_contexts.empty() ) {
+			auto context = _free_contexts.back();
+			_free_contexts.pop_back();
+			return context;
+		}
+	}
+	// Constants are never written, they are filled in once.
+	auto context		= new CpuComputeContext();
+	auto & program		= *_program;
+	context->lane_count	= program.lane_count;
+	context->registers.resize( size_t( program.register_count ) * program.lane_count );
+	context->invocation_memory.resize( size_t( program.invocation_memory_size ) * program.lane_count );
+	context->workgroup_memory.resize( program.workgroup_memory_size );
+	context->regions.resize( program.regions.size() );
+	context->lane_blocks.resize( program.lane_count );
+	context->active_lanes.reserve( program.lane_count );
+	for( auto & constant : program.constants ) {
+		auto reg = context->Register( constant.first );
+		std::fill( reg, reg + program.lane_count, UintWord( constant.second ) );
+	}
+	return context;
+}
+
+void CpuComputeExecutor::_ReleaseContext( CpuComputeContext * context )
+{
+	std::lock_guard<std::mutex> lock( _contexts_mutex );
+	_free_contexts.push_back( context );
+}
+
+void CpuComputeExecutor::_FreeProgram()
+{
+	for( auto context : _free_contexts ) {
+		delete context;
+	}
+	_free_contexts.clear();
+	delete _program;
+	_program = nullptr;
+}
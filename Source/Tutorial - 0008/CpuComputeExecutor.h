@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <string>
+#include <mutex>
+
+class JobSystem;
+struct CpuComputeProgram;
+struct CpuComputeContext;
+
+// A storage image in host memory. Formats are VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R32_SFLOAT,
+// VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R32_UINT and VK_FORMAT_R32_SINT.
+struct CpuStorageImage
+{
+	void							*	data					= nullptr;
+	uint32_t							width					= 0;
+	uint32_t							height					= 0;
+	uint32_t							row_pitch				= 0;		// bytes
+	VkFormat							format					= VK_FORMAT_UNDEFINED;
+};
+
+// Runs GLSL compute shaders on the cpu, for machines without a gpu and as a reference to
+// compare gpu results against. Load() lowers the SPIR-V to a register machine in SSA form,
+// function calls are inlined and the blocks are ordered so the blocks of a construct come
+// before its merge block. Dispatch() runs the workgroups on the job system, every workgroup
+// is one batch with one lane per invocation: each instruction runs for all lanes of the batch
+// that are in the same block before the next instruction starts, so the per instruction cost
+// of the interpreter is paid once per batch and the lane loops vectorize. Lanes that branch
+// apart run the lowest block first and meet again at the merge block, control barriers are
+// a block boundary every lane has to reach.
+//
+// Covers 32 bit integers, floats and bools, vectors, matrices, arrays and structs, storage
+// and uniform buffers, push constants, workgroup memory and atomics, storage images without
+// samplers, specialization constants and the GLSL.std.450 instructions apart from the
+// matrix inverse and determinant, the interpolation and the double instructions. Out of
+// range buffer and image accesses read zero and do not write, like robust buffer access.
+class CpuComputeExecutor
+{
+public:
+	CpuComputeExecutor( JobSystem * job_system );
+	~CpuComputeExecutor();
+
+	// False if the module is not a compute shader or uses something the executor does not
+	// implement, GetError() says what.
+	bool								Load( const uint32_t * code, size_t word_count, const VkSpecializationInfo * specialization_info = nullptr );
+	const std::string				&	GetError() const;
+	const uint32_t					*	GetWorkgroupSize() const;
+
+	// Bindings stay until they are replaced, the memory has to outlive the dispatches that use it.
+	void								SetBuffer( uint32_t set, uint32_t binding, void * data, size_t size );
+	void								SetStorageImage( uint32_t set, uint32_t binding, const CpuStorageImage & image );
+	void								SetPushConstants( const void * data, uint32_t size );
+
+	// Runs every workgroup and returns once all of them have finished.
+	void								Dispatch( uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z );
+
+private:
+	struct Binding
+	{
+		uint32_t							set						= 0;
+		uint32_t							binding					= 0;
+		void							*	data					= nullptr;
+		size_t								size					= 0;
+		CpuStorageImage						image;
+	};
+
+	Binding							&	_GetBinding( uint32_t set, uint32_t binding );
+	CpuComputeContext				*	_AcquireContext();
+	void								_ReleaseContext( CpuComputeContext * context );
+	void								_FreeProgram();
+
+	JobSystem						*	_job_system						= nullptr;
+	CpuComputeProgram				*	_program						= nullptr;
+	std::string							_error;
+	uint32_t							_workgroup_size[ 3 ]			= { 0, 0, 0 };
+
+	std::vector<Binding>				_bindings;
+	uint8_t								_push_constants[ 256 ]			= {};
+
+	std::mutex							_contexts_mutex;
+	std::vector<CpuComputeContext*>		_free_contexts;					// one per thread that ran a workgroup, reused by the next dispatch
+};
@@ -0,0 +1,288 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "DeletionQueue.h"
+
+#include <assert.h>
+#include <algorithm>
+
+DeletionQueue::DeletionQueue( VkDevice device )
+{
+	_device		= device;
+}
+
+DeletionQueue::~DeletionQueue()
+{
+	Flush();
+}
+
+void DeletionQueue::BeginFrame( uint64_t frame_number, uint64_t completed_frame_count )
+{
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		assert( frame_number >= _frame && "Deletion queue: frame numbers have to grow." );
+		_frame		= frame_number;
+	}
+	_DestroyBefore( completed_frame_count );
+}
+
+void DeletionQueue::Flush()
+{
+	// Deferred functions may queue more objects.
+	while( GetPendingCount() > 0 ) {
+		_DestroyBefore( UINT64_MAX );
+	}
+}
+
+void DeletionQueue::DestroyBuffer( VkBuffer buffer )
+{
+	_Push( ObjectType::BUFFER, (uint64_t)buffer );
+}
+
+void DeletionQueue::DestroyBufferView( VkBufferView buffer_view )
+{
+	_Push( ObjectType::BUFFER_VIEW, (uint64_t)buffer_view );
+}
+
+void DeletionQueue::DestroyImage( VkImage image )
+{
+	_Push( ObjectType::IMAGE, (uint64_t)image );
+}
+
+void DeletionQueue::DestroyImageView( VkImageView image_view )
+{
+	_Push( ObjectType::IMAGE_VIEW, (uint64_t)image_view );
+}
+
+void DeletionQueue::FreeMemory( VkDeviceMemory memory )
+{
+	_Push( ObjectType::DEVICE_MEMORY, (uint64_t)memory );
+}
+
+void DeletionQueue::DestroySampler( VkSampler sampler )
+{
+	_Push( ObjectType::SAMPLER, (uint64_t)sampler );
+}
+
+void DeletionQueue::DestroyShaderModule( VkShaderModule shader_module )
+{
+	_Push( ObjectType::SHADER_MODULE, (uint64_t)shader_module );
+}
+
+void DeletionQueue::DestroyPipeline( VkPipeline pipeline )
+{
+	_Push( ObjectType::PIPELINE, (uint64_t)pipeline );
+}
+
+void DeletionQueue::DestroyPipelineLayout( VkPipelineLayout pipeline_layout )
+{
+	_Push( ObjectType::PIPELINE_LAYOUT, (uint64_t)pipeline_layout );
+}
+
+void DeletionQueue::DestroyPipelineCache( VkPipelineCache pipeline_cache )
+{
+	_Push( ObjectType::PIPELINE_CACHE, (uint64_t)pipeline_cache );
+}
+
+void DeletionQueue::DestroyDescriptorSetLayout( VkDescriptorSetLayout descriptor_set_layout )
+{
+	_Push( ObjectType::DESCRIPTOR_SET_LAYOUT, (uint64_t)descriptor_set_layout );
+}
+
+void DeletionQueue::DestroyDescriptorPool( VkDescriptorPool descriptor_pool )
+{
+	_Push( ObjectType::DESCRIPTOR_POOL, (uint64_t)descriptor_pool );
+}
+
+void DeletionQueue::DestroyRenderPass( VkRenderPass render_pass )
+{
+	_Push( ObjectType::RENDER_PASS, (uint64_t)render_pass );
+}
+
+void DeletionQueue::DestroyFramebuffer( VkFramebuffer framebuffer )
+{
+	_Push( ObjectType::FRAMEBUFFER, (uint64_t)framebuffer );
+}
+
+void DeletionQueue::DestroyCommandPool( VkCommandPool command_pool )
+{
+	_Push( ObjectType::COMMAND_POOL, (uint64_t)command_pool );
+}
+
+void DeletionQueue::DestroyQueryPool( VkQueryPool query_pool )
+{
+	_Push( ObjectType::QUERY_POOL, (uint64_t)query_pool );
+}
+
+void DeletionQueue::DestroyFence( VkFence fence )
+{
+	_Push( ObjectType::FENCE, (uint64_t)fence );
+}
+
+void DeletionQueue::DestroySemaphore( VkSemaphore semaphore )
+{
+	_Push( ObjectType::SEMAPHORE, (uint64_t)semaphore );
+}
+
+void DeletionQueue::DestroyEvent( VkEvent event )
+{
+	_Push( ObjectType::EVENT, (uint64_t)event );
+}
+
+void DeletionQueue::DestroySwapchain( VkSwapchainKHR swapchain )
+{
+	_Push( ObjectType::SWAPCHAIN, (uint64_t)swapchain );
+}
+
+void DeletionQueue::Defer( std::function<void()> function )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	uint64_t index = _functions.size();
+	if( !_free_functions.empty() ) {
+		index = _free_functions.back();
+		_free_functions.pop_back();
+		_functions[ index ] = std::move( function );
+	} else {
+		_functions.push_back( std::move( function ) );
+	}
+	Entry entry;
+	entry.frame		= _frame;
+	entry.type		= ObjectType::FUNCTION;
+	entry.handle	= index;
+	_entries.push_back( entry );
+	_max_pending_count = std::max( _max_pending_count, uint32_t( _entries.size() ) );
+}
+
+void DeletionQueue::AddDestroyListener( std::function<void( uint64_t handle )> listener )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	_listeners.push_back( std::move( listener ) );
+}
+
+uint32_t DeletionQueue::GetPendingCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return uint32_t( _entries.size() );
+}
+
+uint32_t DeletionQueue::GetMaxPendingCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return _max_pending_count;
+}
+
+void DeletionQueue::_Push( ObjectType type, uint64_t handle )
+{
+	if( handle == 0 ) return;		// VK_NULL_HANDLE, same as the vkDestroy functions
+
+	// Listeners are only added at startup, they run without the lock so they can queue objects themselves.
+	for( auto & listener : _listeners ) {
+		listener( handle );
+	}
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	Entry entry;
+	entry.frame		= _frame;
+	entry.type		= type;
+	entry.handle	= handle;
+	_entries.push_back( entry );
+	_max_pending_count = std::max( _max_pending_count, uint32_t( _entries.size() ) );
+}
+
+void DeletionQueue::_Destroy( const Entry & entry )
+{
+	switch( entry.type ) {
+	case ObjectType::BUFFER:
+		vkDestroyBuffer( _device, (VkBuffer)entry.handle, nullptr );
+		break;
+	case ObjectType::BUFFER_VIEW:
+		vkDestroyBufferView( _device, (VkBufferView)entry.handle, nullptr );
+		break;
+	case ObjectType::IMAGE:
+		vkDestroyImage( _device, (VkImage)entry.handle, nullptr );
+		break;
+	case ObjectType::IMAGE_VIEW:
+		vkDestroyImageView( _device, (VkImageView)entry.handle, nullptr );
+		break;
+	case ObjectType::DEVICE_MEMORY:
+		vkFreeMemory( _device, (VkDeviceMemory)entry.handle, nullptr );
+		break;
+	case ObjectType::SAMPLER:
+		vkDestroySampler( _device, (VkSampler)entry.handle, nullptr );
+		break;
+	case ObjectType::SHADER_MODULE:
+		vkDestroyShaderModule( _device, (VkShaderModule)entry.handle, nullptr );
+		break;
+	case ObjectType::PIPELINE:
+		vkDestroyPipeline( _device, (VkPipeline)entry.handle, nullptr );
+		break;
+	case ObjectType::PIPELINE_LAYOUT:
+		vkDestroyPipelineLayout( _device, (VkPipelineLayout)entry.handle, nullptr );
+		break;
+	case ObjectType::PIPELINE_CACHE:
+		vkDestroyPipelineCache( _device, (VkPipelineCache)entry.handle, nullptr );
+		break;
+	case ObjectType::DESCRIPTOR_SET_LAYOUT:
+		vkDestroyDescriptorSetLayout( _device, (VkDescriptorSetLayout)entry.handle, nullptr );
+		break;
+	case ObjectType::DESCRIPTOR_POOL:
+		vkDestroyDescriptorPool( _device, (VkDescriptorPool)entry.handle, nullptr );
+		break;
+	case ObjectType::RENDER_PASS:
+		vkDestroyRenderPass( _device, (VkRenderPass)entry.handle, nullptr );
+		break;
+	case ObjectType::FRAMEBUFFER:
+		vkDestroyFramebuffer( _device, (VkFramebuffer)entry.handle, nullptr );
+		break;
+	case ObjectType::COMMAND_POOL:
+		vkDestroyCommandPool( _device, (VkCommandPool)entry.handle, nullptr );
+		break;
+	case ObjectType::QUERY_POOL:
+		vkDestroyQueryPool( _device, (VkQueryPool)entry.handle, nullptr );
+		break;
+	case ObjectType::FENCE:
+		vkDestroyFence( _device, (VkFence)entry.handle, nullptr );
+		break;
+	case ObjectType::SEMAPHORE:
+		vkDestroySemaphore( _device, (VkSemaphore)entry.handle, nullptr );
+		break;
+	case ObjectType::EVENT:
+		vkDestroyEvent( _device, (VkEvent)entry.handle, nullptr );
+		break;
+	case ObjectType::SWAPCHAIN:
+		vkDestroySwapchainKHR( _device, (VkSwapchainKHR)entry.handle, nullptr );
+		break;
+	case ObjectType::FUNCTION:
+	{
+		std::function<void()> function;
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			function = std::move( _functions[ entry.handle ] );
+			_functions[ entry.handle ] = nullptr;
+			_free_functions.push_back( entry.handle );
+		}
+		function();
+		break;
+	}
+	default:
+		assert( 0 && "Deletion queue: unknown object type." );
+		break;
+	}
+}
+
+void DeletionQueue::_DestroyBefore( uint64_t frame )
+{
+	// Entries are in frame order, take the finished ones out and destroy them without
+	// the lock so deferred functions can queue more objects.
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		auto end = std::find_if( _entries.begin(), _entries.end(), [ frame ]( const Entry & entry ) { return entry.frame >= frame; } );
+		if( end == _entries.begin() ) return;
+		_finished.assign( _entries.begin(), end );
+		_entries.erase( _entries.begin(), end );
+	}
+	for( auto & entry : _finished ) {
+		_Destroy( entry );
+	}
+	_finished.clear();
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <mutex>
+#include <functional>
+
+// Destroys Vulkan objects once the frames that could still use them have finished on
+// the gpu, objects can be destroyed at any time without waiting for the queue to go idle.
+// Every object is tagged with the frame that is recorded when it is handed over, the
+// window retires the tags as the fences of its frame slots signal. Thread safe.
+//
+// Objects are kept in frame order in one list whose storage is reused, the memory it
+// takes is bounded by the most objects ever destroyed within the frames in flight.
+class DeletionQueue
+{
+public:
+	DeletionQueue( VkDevice device );
+
+	// The owner makes sure the gpu is done with everything still queued.
+	~DeletionQueue();
+
+	// frame_number is the frame about to be recorded, every frame before completed_frame_count has finished.
+	// BeginFrame() and Flush() are called from one thread, objects can be queued from any thread.
+	void								BeginFrame( uint64_t frame_number, uint64_t completed_frame_count );
+
+	// Destroys everything right away, only after the queue has gone idle.
+	void								Flush();
+
+	void								DestroyBuffer( VkBuffer buffer );
+	void								DestroyBufferView( VkBufferView buffer_view );
+	void								DestroyImage( VkImage image );
+	void								DestroyImageView( VkImageView image_view );
+	void								FreeMemory( VkDeviceMemory memory );
+	void								DestroySampler( VkSampler sampler );
+	void								DestroyShaderModule( VkShaderModule shader_module );
+	void								DestroyPipeline( VkPipeline pipeline );
+	void								DestroyPipelineLayout( VkPipelineLayout pipeline_layout );
+	void								DestroyPipelineCache( VkPipelineCache pipeline_cache );
+	void								DestroyDescriptorSetLayout( VkDescriptorSetLayout descriptor_set_layout );
+	void								DestroyDescriptorPool( VkDescriptorPool descriptor_pool );
+	void								DestroyRenderPass( VkRenderPass render_pass );
+	void								DestroyFramebuffer( VkFramebuffer framebuffer );
+	void								DestroyCommandPool( VkCommandPool command_pool );
+	void								DestroyQueryPool( VkQueryPool query_pool );
+	void								DestroyFence( VkFence fence );
+	void								DestroySemaphore( VkSemaphore semaphore );
+	void								DestroyEvent( VkEvent event );
+	void								DestroySwapchain( VkSwapchainKHR swapchain );
+
+	// Anything else that has to wait for the frames in flight, for example returning
+	// a sub-allocation to its owner.
+	void								Defer( std::function<void()> function );
+
+	// Called with the handle of every object as it is handed over, before it is queued. Objects
+	// that cache something about other objects use it to drop what refers to them.
+	void								AddDestroyListener( std::function<void( uint64_t handle )> listener );
+
+	uint32_t							GetPendingCount() const;
+	uint32_t							GetMaxPendingCount() const;
+
+private:
+	enum class ObjectType : uint32_t
+	{
+		BUFFER,
+		BUFFER_VIEW,
+		IMAGE,
+		IMAGE_VIEW,
+		DEVICE_MEMORY,
+		SAMPLER,
+		SHADER_MODULE,
+		PIPELINE,
+		PIPELINE_LAYOUT,
+		PIPELINE_CACHE,
+		DESCRIPTOR_SET_LAYOUT,
+		DESCRIPTOR_POOL,
+		RENDER_PASS,
+		FRAMEBUFFER,
+		COMMAND_POOL,
+		QUERY_POOL,
+		FENCE,
+		SEMAPHORE,
+		EVENT,
+		SWAPCHAIN,
+		FUNCTION,
+	};
+
+	struct Entry
+	{
+		uint64_t							frame					= 0;
+		ObjectType							type					= ObjectType::FUNCTION;
+		uint64_t							handle					= 0;		// index into _functions for FUNCTION
+	};
+
+	void								_Push( ObjectType type, uint64_t handle );
+	void								_Destroy( const Entry & entry );
+	void								_DestroyBefore( uint64_t frame );
+
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	mutable std::mutex					_mutex;
+	std::vector<Entry>					_entries;
+	std::vector<Entry>					_finished;						// only used by the thread that retires frames
+	std::vector<std::function<void()>>	_functions;
+	std::vector<uint64_t>				_free_functions;
+	std::vector<std::function<void( uint64_t handle )>>	_listeners;		// added before any object is queued
+	uint64_t							_frame							= 0;
+	uint32_t							_max_pending_count				= 0;
+};
@@ -0,0 +1,115 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "FenceCompletionService.h"
+#include "SyncObjectPools.h"
+#include "Shared.h"
+
+// New fences are picked up at the latest after this long, the service thread sleeps in
+// vkWaitForFences and can not be woken up early.
+static const uint64_t fence_completion_service_wait_timeout		= 1000000;		// 1 ms in nanoseconds
+
+FenceCompletionService::FenceCompletionService( VkDevice device, FencePool * fence_pool )
+{
+	_device			= device;
+	_fence_pool		= fence_pool;
+	_watched_count	= 0;
+	_thread			= std::thread( &FenceCompletionService::_ServiceLoop, this );
+}
+
+FenceCompletionService::~FenceCompletionService()
+{
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_should_run = false;
+	}
+	_condition.notify_all();
+	_thread.join();
+}
+
+std::future<void> FenceCompletionService::Watch( VkFence fence, std::function<void()> callback, bool release_fence )
+{
+	WatchedFence watched;
+	watched.fence			= fence;
+	watched.callback		= std::move( callback );
+	watched.release_fence	= release_fence;
+	auto future				= watched.promise.get_future();
+	++_watched_count;
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_incoming.push_back( std::move( watched ) );
+	}
+	_condition.notify_one();
+	return future;
+}
+
+uint32_t FenceCompletionService::GetWatchedCount() const
+{
+	return _watched_count;
+}
+
+void FenceCompletionService::_ServiceLoop()
+{
+	std::vector<WatchedFence>	watched;
+	std::vector<VkFence>		fences;
+
+	while( true ) {
+		bool should_run;
+		{
+			std::unique_lock<std::mutex> lock( _mutex );
+			if( watched.empty() ) {
+				_condition.wait( lock, [ this ] { return !_incoming.empty() || !_should_run; } );
+			}
+			for( auto & w : _incoming ) {
+				watched.push_back( std::move( w ) );
+			}
+			_incoming.clear();
+			should_run = _should_run;
+		}
+		if( watched.empty() ) {
+			if( !should_run ) return;
+			continue;
+		}
+
+		// When shutting down the queue is idle, waiting on a fence that was never submitted
+		// would never return. Whatever has not signaled yet is not going to.
+		if( !should_run ) {
+			for( auto & w : watched ) {
+				_Complete( w, vkGetFenceStatus( _device, w.fence ) == VK_SUCCESS );
+			}
+			watched.clear();
+			continue;
+		}
+
+		fences.clear();
+		for( auto & w : watched ) {
+			fences.push_back( w.fence );
+		}
+		// Wake up as soon as any of them signals.
+		auto result = vkWaitForFences( _device, uint32_t( fences.size() ), fences.data(), VK_FALSE, fence_completion_service_wait_timeout );
+		if( result == VK_TIMEOUT ) continue;
+		ErrorCheck( result );
+
+		for( size_t i=0; i < watched.size(); ) {
+			if( vkGetFenceStatus( _device, watched[ i ].fence ) == VK_SUCCESS ) {
+				_Complete( watched[ i ], true );
+				watched[ i ] = std::move( watched.back() );
+				watched.pop_back();
+			} else {
+				++i;
+			}
+		}
+	}
+}
+
+void FenceCompletionService::_Complete( WatchedFence & watched, bool signaled )
+{
+	if( signaled && watched.callback ) {
+		watched.callback();
+	}
+	if( watched.release_fence && _fence_pool ) {
+		_fence_pool->Release( watched.fence );
+	}
+	--_watched_count;
+	watched.promise.set_value();
+}
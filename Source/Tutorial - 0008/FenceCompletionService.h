@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <atomic>
+
+class FencePool;
+
+// Watches fences on a background thread and reports their completion through callbacks
+// and futures, so resources can be retired when the gpu is done with them instead of
+// blocking on vkWaitForFences or vkQueueWaitIdle. All watched fences are waited on as
+// one batch, whichever signals first wakes the thread up.
+class FenceCompletionService
+{
+public:
+	// Fences that are watched with release_fence go back to fence_pool once they signal.
+	FenceCompletionService( VkDevice device, FencePool * fence_pool = nullptr );
+
+	// The queue must be idle by now. Fires the callbacks of the watched fences that have
+	// signaled, fences that are still unsignaled were never submitted and are dropped
+	// without their callbacks, their futures become ready all the same.
+	~FenceCompletionService();
+
+	// callback runs on the service thread once fence has signaled, keep it short and hand
+	// longer work to the job system. The future is ready after the callback has returned.
+	// The fence must be submitted already and must not be reset while it is watched.
+	std::future<void>					Watch( VkFence fence, std::function<void()> callback = nullptr, bool release_fence = false );
+
+	uint32_t							GetWatchedCount() const;
+
+private:
+	struct WatchedFence
+	{
+		VkFence								fence					= VK_NULL_HANDLE;
+		std::function<void()>				callback;
+		std::promise<void>					promise;
+		bool								release_fence			= false;
+	};
+
+	void								_ServiceLoop();
+	void								_Complete( WatchedFence & watched, bool signaled );
+
+	VkDevice							_device							= VK_NULL_HANDLE;
+	FencePool						*	_fence_pool						= nullptr;
+
+	std::thread							_thread;
+	std::mutex							_mutex;
+	std::condition_variable				_condition;
+	std::vector<WatchedFence>			_incoming;						// added since the last batch was built
+	bool								_should_run						= true;
+	std::atomic<uint32_t>				_watched_count;
+};
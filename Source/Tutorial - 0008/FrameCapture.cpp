@@ -0,0 +1,486 @@
+
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "FrameCapture.h"
+#include "Renderer.h"
+#include "SyncObjectPools.h"
+#include "FenceCompletionService.h"
+#include "SubmitBatcher.h"
+#include "Shared.h"
+
+#include <assert.h>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define FRAME_CAPTURE_SSE2 1
+#endif
+
+FrameCapture::FrameCapture( Renderer * renderer, uint32_t width, uint32_t height, VkFormat format, std::string file_prefix,
+	CaptureEncoding encoding, uint32_t ring_size )
+{
+	_renderer			= renderer;
+	_device				= renderer->GetVulkanDevice();
+	_width				= width;
+	_height				= height;
+	_ring_size			= ring_size;
+	_format				= format;
+	_file_prefix		= file_prefix;
+	_encoding			= encoding;
+	_encoded_count		= 0;
+	_encode_microseconds	= 0;
+
+	// Readback keeps the byte order of the image, only 8 bit four channel formats are supported.
+	switch( format ) {
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		_swap_red_blue	= true;
+		break;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		_swap_red_blue	= false;
+		break;
+	default:
+		assert( 0 && "Frame capture: unsupported image format." );
+		std::exit( -1 );
+	}
+
+	_InitReadbackRing( ring_size );
+}
+
+FrameCapture::~FrameCapture()
+{
+	// Copies that are still on the gpu are finished and encoded before shutting down.
+	_WaitIdle();
+	_DeInitReadbackRing();
+}
+
+bool FrameCapture::Capture( VkCommandBuffer command_buffer, VkImage image, VkExtent2D extent, VkImageLayout layout, uint64_t frame_number )
+{
+	// The window was resized, readback buffers and encoders use the size of the image.
+	if( extent.width != _width || extent.height != _height ) {
+		_WaitIdle();
+		_DeInitReadbackRing();
+		_width		= extent.width;
+		_height		= extent.height;
+		_next_slot	= 0;
+		_InitReadbackRing( _ring_size );
+	}
+
+	auto & slot = _slots[ _next_slot ];
+	if( slot.state != SlotState::FREE ) {
+		// Never wait for the disk, drop the frame instead.
+		++_dropped_count;
+		return false;
+	}
+	_next_slot		= ( _next_slot + 1 ) % _slots.size();
+
+	VkImageMemoryBarrier barrier {};
+	barrier.sType							= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask					= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask					= VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.oldLayout						= layout;
+	barrier.newLayout						= VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.srcQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+	barrier.image							= image;
+	barrier.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount		= 1;
+	barrier.subresourceRange.layerCount		= 1;
+	// All commands on the source side, the image may have just been moved to its present layout by a barrier
+	// that only has bottom of pipe as its destination.
+	vkCmdPipelineBarrier( command_buffer,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier );
+
+	VkBufferImageCopy region {};
+	region.imageSubresource.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount		= 1;
+	region.imageExtent.width				= _width;
+	region.imageExtent.height				= _height;
+	region.imageExtent.depth				= 1;
+	vkCmdCopyImageToBuffer( command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region );
+
+	VkBufferMemoryBarrier buffer_barrier {};
+	buffer_barrier.sType					= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	buffer_barrier.srcAccessMask			= VK_ACCESS_TRANSFER_WRITE_BIT;
+	buffer_barrier.dstAccessMask			= VK_ACCESS_HOST_READ_BIT;
+	buffer_barrier.srcQueueFamilyIndex		= VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.dstQueueFamilyIndex		= VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.buffer					= slot.buffer;
+	buffer_barrier.size						= VK_WHOLE_SIZE;
+
+	barrier.srcAccessMask					= VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.dstAccessMask					= VK_ACCESS_MEMORY_READ_BIT;
+	barrier.oldLayout						= VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.newLayout						= layout;
+	vkCmdPipelineBarrier( command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0,
+		0, nullptr,
+		1, &buffer_barrier,
+		1, &barrier );
+
+	slot.frame		= frame_number;
+	slot.state		= SlotState::RECORDED;
+	++_captured_count;
+	return true;
+}
+
+void FrameCapture::Update()
+{
+	{
+		std::lock_guard<std::mutex> lock( _encode_jobs_mutex );
+		_encode_jobs.erase( std::remove_if( _encode_jobs.begin(), _encode_jobs.end(), []( const JobHandle & job ) { return job->IsFinished(); } ), _encode_jobs.end() );
+	}
+	_copy_completions.erase( std::remove_if( _copy_completions.begin(), _copy_completions.end(), []( const std::future<void> & completion ) {
+		return completion.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+	} ), _copy_completions.end() );
+
+	std::vector<ReadbackSlot*> recorded;
+	for( auto & slot : _slots ) {
+		if( slot.state != SlotState::RECORDED ) continue;
+		slot.state		= SlotState::COPYING;
+		recorded.push_back( &slot );
+	}
+	if( recorded.empty() ) return;
+
+	// An empty submit signals its fence once all previously submitted work is done,
+	// one fence covers every copy recorded since the last update.
+	auto fence = _renderer->GetFencePool()->Acquire();
+	_renderer->GetSubmitBatcher()->Flush( fence );
+	_copy_completions.push_back( _renderer->GetFenceCompletionService()->Watch( fence, [ this, recorded ]() {
+		for( auto slot : recorded ) {
+			_OnCopyComplete( *slot );
+		}
+	}, true ) );
+}
+
+uint64_t FrameCapture::GetCapturedCount() const
+{
+	return _captured_count;
+}
+
+uint64_t FrameCapture::GetDroppedCount() const
+{
+	return _dropped_count;
+}
+
+uint64_t FrameCapture::GetEncodedCount() const
+{
+	return _encoded_count;
+}
+
+float FrameCapture::GetAverageEncodeMilliseconds() const
+{
+	uint64_t count = _encoded_count;
+	return count ? float( _encode_microseconds ) / float( count ) / 1000.0f : 0.0f;
+}
+
+void FrameCapture::_OnCopyComplete( ReadbackSlot & slot )
+{
+	if( !_memory_coherent ) {
+		VkMappedMemoryRange range {};
+		range.sType			= VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory		= slot.memory;
+		range.size			= VK_WHOLE_SIZE;
+		ErrorCheck( vkInvalidateMappedMemoryRanges( _device, 1, &range ) );
+	}
+	slot.state		= SlotState::ENCODING;
+
+	ReadbackSlot * encode_slot = &slot;
+	auto job = _renderer->GetJobSystem()->Run( [ this, encode_slot ]() {
+		auto begin = std::chrono::steady_clock::now();
+		_Encode( *encode_slot );
+		_encode_microseconds += uint64_t( std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - begin ).count() );
+		++_encoded_count;
+	} );
+
+	std::lock_guard<std::mutex> lock( _encode_jobs_mutex );
+	_encode_jobs.push_back( job );
+}
+
+void FrameCapture::_InitReadbackRing( uint32_t ring_size )
+{
+	auto & memory_properties = _renderer->GetVulkanPhysicalDeviceMemoryProperties();
+
+	_slots = std::vector<ReadbackSlot>( ring_size );
+	for( auto & slot : _slots ) {
+		VkBufferCreateInfo buffer_create_info {};
+		buffer_create_info.sType			= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_create_info.size				= VkDeviceSize( _width ) * _height * 4;
+		buffer_create_info.usage			= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		buffer_create_info.sharingMode		= VK_SHARING_MODE_EXCLUSIVE;
+		ErrorCheck( vkCreateBuffer( _device, &buffer_create_info, nullptr, &slot.buffer ) );
+
+		// The encoders read every byte, cached memory is a lot faster for that.
+		VkMemoryRequirements memory_requirements {};
+		vkGetBufferMemoryRequirements( _device, slot.buffer, &memory_requirements );
+		auto memory_type_index = FindMemoryTypeIndex( &memory_properties, memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT );
+		if( memory_type_index == UINT32_MAX ) {
+			memory_type_index = FindMemoryTypeIndex( &memory_properties, memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+		}
+		if( memory_type_index == UINT32_MAX ) {
+			assert( 0 && "Vulkan ERROR: No host visible memory for frame capture." );
+			std::exit( -1 );
+		}
+		_memory_coherent = ( memory_properties.memoryTypes[ memory_type_index ].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ) != 0;
+
+		VkMemoryAllocateInfo memory_allocate_info {};
+		memory_allocate_info.sType				= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memory_allocate_info.allocationSize		= memory_requirements.size;
+		memory_allocate_info.memoryTypeIndex	= memory_type_index;
+		ErrorCheck( vkAllocateMemory( _device, &memory_allocate_info, nullptr, &slot.memory ) );
+		ErrorCheck( vkBindBufferMemory( _device, slot.buffer, slot.memory, 0 ) );
+
+		void * data = nullptr;
+		ErrorCheck( vkMapMemory( _device, slot.memory, 0, VK_WHOLE_SIZE, 0, &data ) );
+		slot.data	= (const uint8_t*)data;
+		slot.state	= SlotState::FREE;
+	}
+}
+
+void FrameCapture::_WaitIdle()
+{
+	Update();
+	for( auto & completion : _copy_completions ) {
+		completion.wait();
+	}
+	_copy_completions.clear();
+
+	std::lock_guard<std::mutex> lock( _encode_jobs_mutex );
+	for( auto & job : _encode_jobs ) {
+		_renderer->GetJobSystem()->Wait( job );
+	}
+	_encode_jobs.clear();
+}
+
+void FrameCapture::_DeInitReadbackRing()
+{
+	for( auto & slot : _slots ) {
+		vkDestroyBuffer( _device, slot.buffer, nullptr );
+		vkFreeMemory( _device, slot.memory, nullptr );
+	}
+	_slots.clear();
+}
+
+// Converts the readback to RGBA with opaque alpha, swapchain alpha is meaningless with opaque compositing.
+static void SwizzleToRGBA( const uint8_t * source, uint8_t * destination, size_t pixel_count, bool swap_red_blue )
+{
+	size_t i = 0;
+#if FRAME_CAPTURE_SSE2
+	const __m128i alpha			= _mm_set1_epi32( int( 0xFF000000 ) );
+	const __m128i green			= _mm_set1_epi32( 0x0000FF00 );
+	const __m128i low_byte		= _mm_set1_epi32( 0x000000FF );
+	for( ; i + 4 <= pixel_count; i += 4 ) {
+		__m128i p = _mm_loadu_si128( (const __m128i*)( source + i * 4 ) );
+		if( swap_red_blue ) {
+			// B G R A in memory is 0xAARRGGBB as a little endian integer, move R down and B up.
+			__m128i r	= _mm_and_si128( _mm_srli_epi32( p, 16 ), low_byte );
+			__m128i b	= _mm_slli_epi32( _mm_and_si128( p, low_byte ), 16 );
+			p			= _mm_or_si128( _mm_or_si128( _mm_and_si128( p, green ), r ), b );
+		}
+		p = _mm_or_si128( p, alpha );
+		_mm_storeu_si128( (__m128i*)( destination + i * 4 ), p );
+	}
+#endif
+	for( ; i < pixel_count; ++i ) {
+		const uint8_t * s	= source + i * 4;
+		uint8_t * d			= destination + i * 4;
+		d[ 0 ]	= swap_red_blue ? s[ 2 ] : s[ 0 ];
+		d[ 1 ]	= s[ 1 ];
+		d[ 2 ]	= swap_red_blue ? s[ 0 ] : s[ 2 ];
+		d[ 3 ]	= 0xFF;
+	}
+}
+
+static void PutBigEndian32( std::vector<uint8_t> & out, uint32_t value )
+{
+	out.push_back( uint8_t( value >> 24 ) );
+	out.push_back( uint8_t( value >> 16 ) );
+	out.push_back( uint8_t( value >> 8 ) );
+	out.push_back( uint8_t( value ) );
+}
+
+// https://qoiformat.org/qoi-specification.pdf
+static void EncodeQOI( const uint8_t * rgba, uint32_t width, uint32_t height, std::vector<uint8_t> & out )
+{
+	out.clear();
+	out.reserve( size_t( width ) * height * 5 + 22 );
+	out.push_back( 'q' ); out.push_back( 'o' ); out.push_back( 'i' ); out.push_back( 'f' );
+	PutBigEndian32( out, width );
+	PutBigEndian32( out, height );
+	out.push_back( 4 );						// channels
+	out.push_back( 0 );						// sRGB with linear alpha
+
+	uint8_t index[ 64 * 4 ] {};
+	uint8_t previous[ 4 ] { 0, 0, 0, 255 };
+	uint32_t run = 0;
+	size_t pixel_count = size_t( width ) * height;
+
+	for( size_t i=0; i < pixel_count; ++i ) {
+		const uint8_t * p = rgba + i * 4;
+		if( std::memcmp( p, previous, 4 ) == 0 ) {
+			++run;
+			if( run == 62 || i + 1 == pixel_count ) {
+				out.push_back( uint8_t( 0xC0 | ( run - 1 ) ) );		// QOI_OP_RUN
+				run = 0;
+			}
+			continue;
+		}
+		if( run > 0 ) {
+			out.push_back( uint8_t( 0xC0 | ( run - 1 ) ) );
+			run = 0;
+		}
+
+		uint32_t hash = ( p[ 0 ] * 3 + p[ 1 ] * 5 + p[ 2 ] * 7 + p[ 3 ] * 11 ) % 64;
+		if( std::memcmp( index + hash * 4, p, 4 ) == 0 ) {
+			out.push_back( uint8_t( hash ) );							// QOI_OP_INDEX
+		} else {
+			std::memcpy( index + hash * 4, p, 4 );
+			if( p[ 3 ] == previous[ 3 ] ) {
+				int8_t dr = int8_t( p[ 0 ] - previous[ 0 ] );
+				int8_t dg = int8_t( p[ 1 ] - previous[ 1 ] );
+				int8_t db = int8_t( p[ 2 ] - previous[ 2 ] );
+				int8_t dr_dg = int8_t( dr - dg );
+				int8_t db_dg = int8_t( db - dg );
+				if( dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2 ) {
+					out.push_back( uint8_t( 0x40 | ( ( dr + 2 ) << 4 ) | ( ( dg + 2 ) << 2 ) | ( db + 2 ) ) );	// QOI_OP_DIFF
+				} else if( dr_dg > -9 && dr_dg < 8 && dg > -33 && dg < 32 && db_dg > -9 && db_dg < 8 ) {
+					out.push_back( uint8_t( 0x80 | ( dg + 32 ) ) );		// QOI_OP_LUMA
+					out.push_back( uint8_t( ( ( dr_dg + 8 ) << 4 ) | ( db_dg + 8 ) ) );
+				} else {
+					out.push_back( 0xFE );								// QOI_OP_RGB
+					out.push_back( p[ 0 ] ); out.push_back( p[ 1 ] ); out.push_back( p[ 2 ] );
+				}
+			} else {
+				out.push_back( 0xFF );									// QOI_OP_RGBA
+				out.push_back( p[ 0 ] ); out.push_back( p[ 1 ] ); out.push_back( p[ 2 ] ); out.push_back( p[ 3 ] );
+			}
+		}
+		std::memcpy( previous, p, 4 );
+	}
+	for( int i=0; i < 7; ++i ) out.push_back( 0 );
+	out.push_back( 1 );
+}
+
+static uint32_t Crc32( const uint8_t * data, size_t size, uint32_t crc = 0 )
+{
+	static uint32_t table[ 256 ];
+	static bool table_ready = [] {
+		for( uint32_t n=0; n < 256; ++n ) {
+			uint32_t c = n;
+			for( int k=0; k < 8; ++k ) c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+			table[ n ] = c;
+		}
+		return true;
+	}();
+	(void)table_ready;
+
+	crc = ~crc;
+	for( size_t i=0; i < size; ++i ) crc = table[ ( crc ^ data[ i ] ) & 0xFF ] ^ ( crc >> 8 );
+	return ~crc;
+}
+
+static void PutPNGChunk( std::vector<uint8_t> & out, const char * type, const uint8_t * data, size_t size )
+{
+	PutBigEndian32( out, uint32_t( size ) );
+	size_t type_offset = out.size();
+	out.insert( out.end(), type, type + 4 );
+	out.insert( out.end(), data, data + size );
+	PutBigEndian32( out, Crc32( out.data() + type_offset, size + 4 ) );
+}
+
+// PNG with stored deflate blocks, trades file size for zero compression time.
+static void EncodePNG( const uint8_t * rgba, uint32_t width, uint32_t height, std::vector<uint8_t> & out )
+{
+	static const uint8_t signature[] { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	out.clear();
+	out.insert( out.end(), signature, signature + 8 );
+
+	std::vector<uint8_t> header;
+	PutBigEndian32( header, width );
+	PutBigEndian32( header, height );
+	header.push_back( 8 );			// bit depth
+	header.push_back( 6 );			// RGBA
+	header.push_back( 0 );			// deflate
+	header.push_back( 0 );			// adaptive filtering
+	header.push_back( 0 );			// no interlace
+	PutPNGChunk( out, "IHDR", header.data(), header.size() );
+
+	// Every scanline is prefixed with filter type 0, the whole stream is split into 65535 byte stored blocks.
+	size_t row_size		= size_t( width ) * 4 + 1;
+	size_t raw_size		= row_size * height;
+	size_t block_count	= ( raw_size + 65534 ) / 65535;
+
+	std::vector<uint8_t> idat;
+	idat.reserve( 2 + raw_size + block_count * 5 + 4 );
+	idat.push_back( 0x78 );
+	idat.push_back( 0x01 );
+
+	uint32_t adler_a = 1, adler_b = 0;
+	size_t block_left = 0;
+	size_t raw_left = raw_size;
+	for( uint32_t y=0; y < height; ++y ) {
+		for( size_t x=0; x < row_size; ) {
+			if( block_left == 0 ) {
+				block_left = raw_left < 65535 ? raw_left : 65535;
+				raw_left -= block_left;
+				idat.push_back( raw_left == 0 ? 1 : 0 );
+				idat.push_back( uint8_t( block_left ) );
+				idat.push_back( uint8_t( block_left >> 8 ) );
+				idat.push_back( uint8_t( ~block_left ) );
+				idat.push_back( uint8_t( ~block_left >> 8 ) );
+			}
+			size_t count = row_size - x < block_left ? row_size - x : block_left;
+			for( size_t i=0; i < count; ++i, ++x ) {
+				uint8_t value = x == 0 ? 0 : rgba[ size_t( y ) * width * 4 + x - 1 ];
+				idat.push_back( value );
+				adler_a = ( adler_a + value ) % 65521;
+				adler_b = ( adler_b + adler_a ) % 65521;
+			}
+			block_left -= count;
+		}
+	}
+	PutBigEndian32( idat, ( adler_b << 16 ) | adler_a );
+
+	PutPNGChunk( out, "IDAT", idat.data(), idat.size() );
+	PutPNGChunk( out, "IEND", nullptr, 0 );
+}
+
+void FrameCapture::_Encode( ReadbackSlot & slot )
+{
+	// Scratch memory is reused between frames, encoding never allocates after warming up.
+	static thread_local std::vector<uint8_t> rgba;
+	static thread_local std::vector<uint8_t> encoded;
+
+	size_t pixel_count = size_t( _width ) * _height;
+	rgba.resize( pixel_count * 4 );
+	SwizzleToRGBA( slot.data, rgba.data(), pixel_count, _swap_red_blue );
+	uint64_t frame = slot.frame;
+
+	// The readback buffer is not needed anymore, give it back to the ring before touching the disk.
+	slot.state = SlotState::FREE;
+
+	if( _encoding == CaptureEncoding::QOI ) {
+		EncodeQOI( rgba.data(), _width, _height, encoded );
+	} else {
+		EncodePNG( rgba.data(), _width, _height, encoded );
+	}
+
+	std::ostringstream file_name;
+	file_name << _file_prefix << std::setw( 6 ) << std::setfill( '0' ) << frame << ( _encoding == CaptureEncoding::QOI ? ".qoi" : ".png" );
+	std::ofstream file( file_name.str(), std::ios::binary );
+	file.write( (const char*)encoded.data(), encoded.size() );
+}
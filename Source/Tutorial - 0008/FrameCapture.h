@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Platform.h"
+#include "JobSystem.h"
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <future>
+
+class Renderer;
+
+enum class CaptureEncoding
+{
+	QOI,							// "Quite OK Image" format, fast lossless compression
+	PNG,							// stored (uncompressed) deflate blocks, no compression cost but large files
+};
+
+// Continuous capture of rendered frames to disk without stalling the frame loop.
+// Copies go into a ring of host visible readback buffers, once the copy has completed
+// on the gpu the buffer is handed to a job on the renderer's job system that
+// swizzles the pixels to RGBA and encodes them. When every buffer is busy the frame is dropped.
+class FrameCapture
+{
+public:
+	FrameCapture( Renderer * renderer, uint32_t width, uint32_t height, VkFormat format, std::string file_prefix,
+		CaptureEncoding encoding = CaptureEncoding::QOI, uint32_t ring_size = 4 );
+	~FrameCapture();
+
+	// Records the copy of the image into command_buffer, the image is returned to its layout afterwards.
+	// Returns false if the frame was dropped because all readback buffers are busy. When the extent
+	// differs from the last one the captures of the old size are finished and the buffers made again.
+	bool								Capture( VkCommandBuffer command_buffer, VkImage image, VkExtent2D extent, VkImageLayout layout, uint64_t frame_number );
+
+	// Call once per frame after command_buffer has been submitted. Submits a fence for the
+	// recorded copies, the fence completion service starts the encoding once it signals.
+	void								Update();
+
+	uint64_t							GetCapturedCount() const;
+	uint64_t							GetDroppedCount() const;
+	uint64_t							GetEncodedCount() const;
+	float								GetAverageEncodeMilliseconds() const;
+
+private:
+	enum class SlotState : uint32_t
+	{
+		FREE,
+		RECORDED,						// copy recorded, waiting for the command buffer to be submitted
+		COPYING,
+		ENCODING,
+	};
+
+	struct ReadbackSlot
+	{
+		VkBuffer							buffer					= VK_NULL_HANDLE;
+		VkDeviceMemory						memory					= VK_NULL_HANDLE;
+		const uint8_t					*	data					= nullptr;
+		uint64_t							frame					= 0;
+		std::atomic<SlotState>				state;
+	};
+
+	void								_InitReadbackRing( uint32_t ring_size );
+	void								_DeInitReadbackRing();
+	void								_WaitIdle();
+
+	void								_OnCopyComplete( ReadbackSlot & slot );
+	void								_Encode( ReadbackSlot & slot );
+
+	Renderer						*	_renderer						= nullptr;
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	uint32_t							_width							= 0;
+	uint32_t							_height							= 0;
+	uint32_t							_ring_size						= 0;
+	VkFormat							_format							= VK_FORMAT_UNDEFINED;
+	bool								_swap_red_blue					= false;
+	bool								_memory_coherent				= true;
+	std::string							_file_prefix;
+	CaptureEncoding						_encoding						= CaptureEncoding::QOI;
+
+	std::vector<ReadbackSlot>			_slots;
+	uint32_t							_next_slot						= 0;
+
+	std::vector<std::future<void>>		_copy_completions;
+
+	// The readback slot is freed before the encoding is done, the jobs are tracked separately.
+	// Jobs are started from the fence completion service thread.
+	std::mutex							_encode_jobs_mutex;
+	std::vector<JobHandle>				_encode_jobs;
+
+	uint64_t							_captured_count					= 0;
+	uint64_t							_dropped_count					= 0;
+	std::atomic<uint64_t>				_encoded_count;
+	std::atomic<uint64_t>				_encode_microseconds;
+};
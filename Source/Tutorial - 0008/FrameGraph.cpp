@@ -0,0 +1,580 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "FrameGraph.h"
+#include "TransientImageAllocator.h"
+#include "Renderer.h"
+#include "Shared.h"
+
+#include <assert.h>
+#include <algorithm>
+
+// Layout, stages and accesses that a use of a resource stands for.
+struct FrameGraphUsageState
+{
+	VkImageLayout						layout;
+	VkPipelineStageFlags				stages;
+	VkAccessFlags						access;
+	VkImageUsageFlags					image_usage;
+};
+
+static FrameGraphUsageState GetUsageState( FrameGraphUsage usage, bool write, FrameGraphQueue queue )
+{
+	VkPipelineStageFlags shader_stages = queue == FrameGraphQueue::COMPUTE ?
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT :
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+	switch( usage ) {
+	case FrameGraphUsage::COLOR_ATTACHMENT:
+		return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			write ? VkAccessFlags( VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT ) : VkAccessFlags( VK_ACCESS_COLOR_ATTACHMENT_READ_BIT ),
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT };
+	case FrameGraphUsage::DEPTH_STENCIL_ATTACHMENT:
+		return { write ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			write ? VkAccessFlags( VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT ) : VkAccessFlags( VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT ),
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT };
+	case FrameGraphUsage::SAMPLED:
+		return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, shader_stages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_USAGE_SAMPLED_BIT };
+	case FrameGraphUsage::STORAGE:
+		return { VK_IMAGE_LAYOUT_GENERAL, shader_stages,
+			write ? VkAccessFlags( VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT ) : VkAccessFlags( VK_ACCESS_SHADER_READ_BIT ),
+			VK_IMAGE_USAGE_STORAGE_BIT };
+	case FrameGraphUsage::TRANSFER_SRC:
+		return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT };
+	case FrameGraphUsage::TRANSFER_DST:
+		return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT };
+	case FrameGraphUsage::VERTEX_BUFFER:
+		return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, 0 };
+	case FrameGraphUsage::INDEX_BUFFER:
+		return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, 0 };
+	case FrameGraphUsage::UNIFORM_BUFFER:
+		return { VK_IMAGE_LAYOUT_UNDEFINED, shader_stages, VK_ACCESS_UNIFORM_READ_BIT, 0 };
+	case FrameGraphUsage::INDIRECT_BUFFER:
+		return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, 0 };
+	}
+	assert( 0 && "Frame graph: unknown resource usage." );
+	return { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT, 0 };
+}
+
+static bool IsAttachmentUsage( FrameGraphUsage usage )
+{
+	return usage == FrameGraphUsage::COLOR_ATTACHMENT || usage == FrameGraphUsage::DEPTH_STENCIL_ATTACHMENT;
+}
+
+FrameGraphPassBuilder::FrameGraphPassBuilder( FrameGraph * graph, uint32_t pass )
+{
+	_graph		= graph;
+	_pass		= pass;
+}
+
+FrameGraphPassBuilder & FrameGraphPassBuilder::Read( FrameGraphResource resource, FrameGraphUsage usage )
+{
+	FrameGraph::ResourceUse use;
+	use.resource	= resource;
+	use.usage		= usage;
+	use.write		= false;
+	_graph->_passes[ _pass ].uses.push_back( use );
+	return *this;
+}
+
+FrameGraphPassBuilder & FrameGraphPassBuilder::Write( FrameGraphResource resource, FrameGraphUsage usage )
+{
+	FrameGraph::ResourceUse use;
+	use.resource	= resource;
+	use.usage		= usage;
+	use.write		= true;
+	_graph->_passes[ _pass ].uses.push_back( use );
+	return *this;
+}
+
+FrameGraphPassBuilder & FrameGraphPassBuilder::Clear( FrameGraphResource resource, FrameGraphUsage usage, VkClearValue clear_value )
+{
+	Write( resource, usage );
+	auto & use			= _graph->_passes[ _pass ].uses.back();
+	use.clear			= true;
+	use.clear_value		= clear_value;
+	return *this;
+}
+
+FrameGraphPassBuilder & FrameGraphPassBuilder::SetSideEffects()
+{
+	_graph->_passes[ _pass ].side_effects = true;
+	return *this;
+}
+
+FrameGraph::FrameGraph( Renderer * renderer )
+{
+	_renderer		= renderer;
+	_device			= renderer->GetVulkanDevice();
+
+	_transient_allocator	= new TransientImageAllocator( renderer );
+}
+
+FrameGraph::~FrameGraph()
+{
+	delete _transient_allocator;
+}
+
+void FrameGraph::Reset()
+{
+	_resources.clear();
+	_passes.clear();
+	_schedule.clear();
+	_schedule_batches.clear();
+	_compiled		= false;
+	_current_pass	= UINT32_MAX;
+}
+
+FrameGraphResource FrameGraph::CreateImage( std::string name, const FrameGraphImageDesc & desc )
+{
+	Resource resource;
+	resource.name			= name;
+	resource.desc			= desc;
+	_resources.push_back( resource );
+	return FrameGraphResource( _resources.size() - 1 );
+}
+
+FrameGraphResource FrameGraph::ImportImage( std::string name, VkImage image, VkImageView view, const FrameGraphImageDesc & desc,
+	VkImageLayout current_layout, VkPipelineStageFlags current_stage, VkImageLayout final_layout )
+{
+	Resource resource;
+	resource.name				= name;
+	resource.imported			= true;
+	resource.desc				= desc;
+	resource.image				= image;
+	resource.view				= view;
+	resource.current_layout		= current_layout;
+	resource.current_stage		= current_stage;
+	resource.final_layout		= final_layout;
+	_resources.push_back( resource );
+	return FrameGraphResource( _resources.size() - 1 );
+}
+
+FrameGraphResource FrameGraph::ImportBuffer( std::string name, VkBuffer buffer, VkDeviceSize size )
+{
+	Resource resource;
+	resource.name				= name;
+	resource.imported			= true;
+	resource.is_buffer			= true;
+	resource.buffer				= buffer;
+	resource.size				= size;
+	_resources.push_back( resource );
+	return FrameGraphResource( _resources.size() - 1 );
+}
+
+void FrameGraph::MarkOutput( FrameGraphResource resource )
+{
+	_resources[ resource ].output = true;
+}
+
+FrameGraphPassBuilder FrameGraph::AddPass( std::string name, FrameGraphQueue queue, FrameGraphExecuteFunction execute )
+{
+	Pass pass;
+	pass.name		= name;
+	pass.queue		= queue;
+	pass.execute	= std::move( execute );
+	_passes.push_back( std::move( pass ) );
+	return FrameGraphPassBuilder( this, uint32_t( _passes.size() - 1 ) );
+}
+
+void FrameGraph::Compile()
+{
+	_CullPasses();
+	_BuildDependencies();
+	_SchedulePasses();
+	_DeriveAttachmentOps();
+	_FindAsyncComputePasses();
+	_AllocateTransientImages();
+	_compiled = true;
+}
+
+void FrameGraph::Execute( VkCommandBuffer command_buffer )
+{
+	assert( _compiled && "Frame graph: Compile() before Execute()." );
+
+	// Imported resources start in the state they were handed over in. Transient ones may still
+	// be used by the previous frame on the same queue or share memory with an image of an
+	// earlier pass, their first use waits for any earlier write to the memory.
+	for( auto & resource : _resources ) {
+		if( resource.is_buffer ) {
+			_state_tracker.RegisterBuffer( resource.buffer, resource.size, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_WRITE_BIT );
+		} else if( resource.image != VK_NULL_HANDLE ) {
+			_state_tracker.RegisterImage( resource.image, resource.desc.aspect, resource.desc.mip_levels, resource.desc.array_layers,
+				resource.imported ? resource.current_layout : VK_IMAGE_LAYOUT_UNDEFINED,
+				resource.imported ? resource.current_stage : VkPipelineStageFlags( VK_PIPELINE_STAGE_ALL_COMMANDS_BIT ),
+				resource.imported ? 0 : VK_ACCESS_MEMORY_WRITE_BIT );
+		}
+	}
+
+	for( size_t s=0; s < _schedule.size(); ++s ) {
+		// The passes of a batch are independent, their barriers go out together before the first of them.
+		if( s == 0 || _schedule_batches[ s ] != _schedule_batches[ s - 1 ] ) {
+			for( size_t b=s; b < _schedule.size() && _schedule_batches[ b ] == _schedule_batches[ s ]; ++b ) {
+				auto & batch_pass = _passes[ _schedule[ b ] ];
+				for( auto & use : batch_pass.uses ) {
+					_DeclareUse( batch_pass, use );
+				}
+			}
+			_state_tracker.Flush( command_buffer );
+		}
+
+		auto pass_index	= _schedule[ s ];
+		auto & pass		= _passes[ pass_index ];
+		_current_pass	= pass_index;
+		if( pass.execute ) {
+			pass.execute( command_buffer, *this );
+		}
+		_current_pass = UINT32_MAX;
+	}
+
+	for( auto & resource : _resources ) {
+		if( resource.imported && !resource.is_buffer && resource.final_layout != VK_IMAGE_LAYOUT_UNDEFINED ) {
+			_state_tracker.UseImage( resource.image, resource.final_layout, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, VK_ACCESS_MEMORY_READ_BIT );
+		}
+	}
+	_state_tracker.Flush( command_buffer );
+
+	for( auto & resource : _resources ) {
+		if( resource.is_buffer ) {
+			_state_tracker.ForgetBuffer( resource.buffer );
+		} else if( resource.image != VK_NULL_HANDLE ) {
+			_state_tracker.ForgetImage( resource.image );
+		}
+	}
+}
+
+VkImage FrameGraph::GetImage( FrameGraphResource resource ) const
+{
+	return _resources[ resource ].image;
+}
+
+VkImageView FrameGraph::GetImageView( FrameGraphResource resource ) const
+{
+	return _resources[ resource ].view;
+}
+
+VkBuffer FrameGraph::GetBuffer( FrameGraphResource resource ) const
+{
+	return _resources[ resource ].buffer;
+}
+
+const FrameGraphImageDesc & FrameGraph::GetImageDesc( FrameGraphResource resource ) const
+{
+	return _resources[ resource ].desc;
+}
+
+VkImageLayout FrameGraph::GetLayout( FrameGraphResource resource ) const
+{
+	auto use = _FindCurrentUse( resource );
+	if( !use ) return VK_IMAGE_LAYOUT_UNDEFINED;
+	return GetUsageState( use->usage, use->write, _passes[ _current_pass ].queue ).layout;
+}
+
+VkAttachmentLoadOp FrameGraph::GetLoadOp( FrameGraphResource resource ) const
+{
+	auto use = _FindCurrentUse( resource );
+	return use ? use->load_op : VK_ATTACHMENT_LOAD_OP_LOAD;
+}
+
+VkAttachmentStoreOp FrameGraph::GetStoreOp( FrameGraphResource resource ) const
+{
+	auto use = _FindCurrentUse( resource );
+	return use ? use->store_op : VK_ATTACHMENT_STORE_OP_STORE;
+}
+
+VkClearValue FrameGraph::GetClearValue( FrameGraphResource resource ) const
+{
+	auto use = _FindCurrentUse( resource );
+	return use ? use->clear_value : VkClearValue {};
+}
+
+VkAttachmentDescription FrameGraph::GetAttachmentDescription( FrameGraphResource resource ) const
+{
+	auto & desc = _resources[ resource ].desc;
+	VkAttachmentDescription attachment {};
+	attachment.format				= desc.format;
+	attachment.samples				= desc.samples;
+	attachment.loadOp				= GetLoadOp( resource );
+	attachment.storeOp				= GetStoreOp( resource );
+	attachment.stencilLoadOp		= ( desc.aspect & VK_IMAGE_ASPECT_STENCIL_BIT ) ? attachment.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachment.stencilStoreOp		= ( desc.aspect & VK_IMAGE_ASPECT_STENCIL_BIT ) ? attachment.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	// The graph does the transitions with its barriers, the render pass keeps the layout.
+	attachment.initialLayout		= GetLayout( resource );
+	attachment.finalLayout			= attachment.initialLayout;
+	return attachment;
+}
+
+uint32_t FrameGraph::GetPassCount() const
+{
+	return uint32_t( _passes.size() );
+}
+
+uint32_t FrameGraph::GetCulledPassCount() const
+{
+	return uint32_t( _passes.size() - _schedule.size() );
+}
+
+std::vector<std::string> FrameGraph::GetScheduledPassNames() const
+{
+	std::vector<std::string> names;
+	for( auto pass_index : _schedule ) {
+		names.push_back( _passes[ pass_index ].name );
+	}
+	return names;
+}
+
+std::vector<std::string> FrameGraph::GetAsyncComputePassNames() const
+{
+	std::vector<std::string> names;
+	for( auto pass_index : _schedule ) {
+		if( _passes[ pass_index ].async_compute ) {
+			names.push_back( _passes[ pass_index ].name );
+		}
+	}
+	return names;
+}
+
+const ResourceStateTracker & FrameGraph::GetStateTracker() const
+{
+	return _state_tracker;
+}
+
+const TransientImageAllocator & FrameGraph::GetTransientImageAllocator() const
+{
+	return *_transient_allocator;
+}
+
+void FrameGraph::_CullPasses()
+{
+	// Walk backwards from the outputs, a pass lives if it writes something that is needed
+	// and then everything it uses is needed as well.
+	std::vector<bool> needed( _resources.size(), false );
+	for( size_t i=0; i < _resources.size(); ++i ) {
+		auto & resource = _resources[ i ];
+		needed[ i ] = resource.output || ( resource.imported && !resource.is_buffer && resource.final_layout != VK_IMAGE_LAYOUT_UNDEFINED );
+	}
+	for( size_t p=_passes.size(); p-- > 0; ) {
+		auto & pass = _passes[ p ];
+		pass.alive = pass.side_effects;
+		for( auto & use : pass.uses ) {
+			if( use.write && needed[ use.resource ] ) {
+				pass.alive = true;
+			}
+		}
+		if( !pass.alive ) continue;
+		for( auto & use : pass.uses ) {
+			needed[ use.resource ] = true;
+		}
+	}
+}
+
+void FrameGraph::_BuildDependencies()
+{
+	// Read after write, write after read and write after write, in the order the passes were added.
+	for( size_t b=0; b < _passes.size(); ++b ) {
+		auto & later = _passes[ b ];
+		later.dependencies.clear();
+		if( !later.alive ) continue;
+		for( size_t a=0; a < b; ++a ) {
+			auto & earlier = _passes[ a ];
+			if( !earlier.alive ) continue;
+			bool depends = false;
+			for( auto & later_use : later.uses ) {
+				for( auto & earlier_use : earlier.uses ) {
+					if( later_use.resource == earlier_use.resource && ( later_use.write || earlier_use.write ) ) {
+						depends = true;
+					}
+				}
+			}
+			if( depends ) {
+				later.dependencies.push_back( uint32_t( a ) );
+			}
+		}
+	}
+}
+
+void FrameGraph::_SchedulePasses()
+{
+	// Topological order in batches, every batch takes all passes whose dependencies are in
+	// earlier batches. The passes of a batch do not depend on each other and share their
+	// barriers, Execute() flushes once per batch. A ready pass that uses a resource in another
+	// layout than a pass already in the batch waits for the next batch, one barrier can not
+	// put the resource in both layouts.
+	_schedule.clear();
+	_schedule_batches.clear();
+	std::vector<bool> scheduled( _passes.size(), false );
+	uint32_t alive_count = 0;
+	for( auto & pass : _passes ) {
+		alive_count += pass.alive ? 1 : 0;
+	}
+
+	auto same_layouts = []( const Pass & a, const Pass & b ) {
+		for( auto & a_use : a.uses ) {
+			for( auto & b_use : b.uses ) {
+				if( a_use.resource == b_use.resource &&
+					GetUsageState( a_use.usage, a_use.write, a.queue ).layout != GetUsageState( b_use.usage, b_use.write, b.queue ).layout ) {
+					return false;
+				}
+			}
+		}
+		return true;
+	};
+
+	uint32_t batch = 0;
+	while( _schedule.size() < alive_count ) {
+		size_t batch_begin = _schedule.size();
+		for( uint32_t p=0; p < _passes.size(); ++p ) {
+			auto & pass = _passes[ p ];
+			if( !pass.alive || scheduled[ p ] ) continue;
+
+			bool ready = true;
+			for( auto dependency : pass.dependencies ) {
+				ready = ready && scheduled[ dependency ];
+			}
+			for( size_t s=batch_begin; s < _schedule.size() && ready; ++s ) {
+				ready = same_layouts( pass, _passes[ _schedule[ s ] ] );
+			}
+			if( !ready ) continue;
+			_schedule.push_back( p );
+			_schedule_batches.push_back( batch );
+		}
+		assert( _schedule.size() > batch_begin && "Frame graph: dependency cycle." );
+		// Only marked now, a pass can not join the batch of a pass it depends on.
+		for( size_t s=batch_begin; s < _schedule.size(); ++s ) {
+			scheduled[ _schedule[ s ] ] = true;
+		}
+		++batch;
+	}
+}
+
+void FrameGraph::_DeriveAttachmentOps()
+{
+	// Contents only need to be loaded if something wrote them before, and only need to be
+	// stored if something uses them afterwards.
+	std::vector<bool> has_contents( _resources.size(), false );
+	for( size_t i=0; i < _resources.size(); ++i ) {
+		has_contents[ i ] = _resources[ i ].imported && _resources[ i ].current_layout != VK_IMAGE_LAYOUT_UNDEFINED;
+	}
+
+	for( size_t s=0; s < _schedule.size(); ++s ) {
+		auto & pass = _passes[ _schedule[ s ] ];
+		for( auto & use : pass.uses ) {
+			if( IsAttachmentUsage( use.usage ) ) {
+				if( use.clear ) {
+					use.load_op		= VK_ATTACHMENT_LOAD_OP_CLEAR;
+				} else {
+					use.load_op		= has_contents[ use.resource ] ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+				}
+
+				auto & resource = _resources[ use.resource ];
+				bool used_later = resource.imported || resource.output;
+				for( size_t later=s + 1; later < _schedule.size() && !used_later; ++later ) {
+					for( auto & later_use : _passes[ _schedule[ later ] ].uses ) {
+						used_later = used_later || later_use.resource == use.resource;
+					}
+				}
+				use.store_op	= used_later ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			}
+			if( use.write ) {
+				has_contents[ use.resource ] = true;
+			}
+		}
+	}
+}
+
+void FrameGraph::_FindAsyncComputePasses()
+{
+	// depends_on[ a ][ b ] is true if pass a has to wait for pass b, directly or through other passes.
+	// The schedule is a topological order so every dependency is complete when it is reached.
+	std::vector<std::vector<bool>> depends_on( _passes.size(), std::vector<bool>( _passes.size(), false ) );
+	for( auto pass_index : _schedule ) {
+		for( auto dependency : _passes[ pass_index ].dependencies ) {
+			depends_on[ pass_index ][ dependency ] = true;
+			for( size_t i=0; i < _passes.size(); ++i ) {
+				if( depends_on[ dependency ][ i ] ) {
+					depends_on[ pass_index ][ i ] = true;
+				}
+			}
+		}
+	}
+
+	// A compute pass can go to an async compute queue if there is graphics work that neither
+	// waits for it nor is waited on by it, the two can then run at the same time.
+	for( auto compute_index : _schedule ) {
+		auto & pass = _passes[ compute_index ];
+		pass.async_compute = false;
+		if( pass.queue != FrameGraphQueue::COMPUTE ) continue;
+
+		for( auto graphics_index : _schedule ) {
+			if( _passes[ graphics_index ].queue != FrameGraphQueue::GRAPHICS ) continue;
+			if( !depends_on[ compute_index ][ graphics_index ] && !depends_on[ graphics_index ][ compute_index ] ) {
+				pass.async_compute = true;
+				break;
+			}
+		}
+	}
+}
+
+void FrameGraph::_AllocateTransientImages()
+{
+	// Lifetimes are batches of the schedule, images that are never alive at the same time can share memory.
+	// The passes of a batch run without barriers between them, so their images can not alias.
+	std::vector<TransientImageAllocator::Request>	requests;
+	std::vector<FrameGraphResource>					request_resources;
+	for( size_t r=0; r < _resources.size(); ++r ) {
+		auto & resource = _resources[ r ];
+		if( resource.imported ) continue;
+
+		TransientImageAllocator::Request request;
+		request.desc					= resource.desc;
+		request.first_pass				= UINT32_MAX;
+		request.transient_attachment	= true;
+		for( uint32_t s=0; s < _schedule.size(); ++s ) {
+			auto & pass = _passes[ _schedule[ s ] ];
+			for( auto & use : pass.uses ) {
+				if( use.resource != r ) continue;
+				request.usage			|= GetUsageState( use.usage, use.write, pass.queue ).image_usage;
+				request.first_pass		= std::min( request.first_pass, _schedule_batches[ s ] );
+				request.last_pass		= std::max( request.last_pass, _schedule_batches[ s ] );
+				// Contents that are loaded or stored have to exist in memory.
+				if( !IsAttachmentUsage( use.usage ) || use.load_op == VK_ATTACHMENT_LOAD_OP_LOAD || use.store_op == VK_ATTACHMENT_STORE_OP_STORE ) {
+					request.transient_attachment = false;
+				}
+			}
+		}
+		if( request.usage == 0 ) continue;		// culled together with every pass that used it
+		if( request.first_pass != request.last_pass ) {
+			request.transient_attachment = false;
+		}
+		requests.push_back( request );
+		request_resources.push_back( FrameGraphResource( r ) );
+	}
+
+	std::vector<TransientImageAllocator::Allocation> allocations;
+	_transient_allocator->Allocate( requests, allocations );
+	for( size_t i=0; i < allocations.size(); ++i ) {
+		_resources[ request_resources[ i ] ].image	= allocations[ i ].image;
+		_resources[ request_resources[ i ] ].view	= allocations[ i ].view;
+	}
+}
+
+const FrameGraph::ResourceUse * FrameGraph::_FindCurrentUse( FrameGraphResource resource ) const
+{
+	if( _current_pass == UINT32_MAX ) return nullptr;
+	for( auto & use : _passes[ _current_pass ].uses ) {
+		if( use.resource == resource ) return &use;
+	}
+	return nullptr;
+}
+
+void FrameGraph::_DeclareUse( const Pass & pass, const ResourceUse & use )
+{
+	auto & resource		= _resources[ use.resource ];
+	auto state			= GetUsageState( use.usage, use.write, pass.queue );
+	if( resource.is_buffer ) {
+		_state_tracker.UseBuffer( resource.buffer, 0, VK_WHOLE_SIZE, state.stages, state.access );
+	} else {
+		_state_tracker.UseImage( resource.image, state.layout, state.stages, state.access );
+	}
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "Platform.h"
+#include "ResourceStateTracker.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+
+class Renderer;
+class FrameGraph;
+class TransientImageAllocator;
+
+typedef uint32_t						FrameGraphResource;
+const FrameGraphResource				FRAME_GRAPH_INVALID_RESOURCE		= UINT32_MAX;
+
+enum class FrameGraphQueue
+{
+	GRAPHICS,
+	COMPUTE,							// may run on an async compute queue if the graph finds it can overlap
+};
+
+// How a pass touches a resource, the graph derives layouts, stages and accesses from it.
+enum class FrameGraphUsage
+{
+	COLOR_ATTACHMENT,
+	DEPTH_STENCIL_ATTACHMENT,
+	SAMPLED,
+	STORAGE,
+	TRANSFER_SRC,
+	TRANSFER_DST,
+	VERTEX_BUFFER,
+	INDEX_BUFFER,
+	UNIFORM_BUFFER,
+	INDIRECT_BUFFER,
+};
+
+struct FrameGraphImageDesc
+{
+	uint32_t							width					= 0;
+	uint32_t							height					= 0;
+	VkFormat							format					= VK_FORMAT_UNDEFINED;
+	VkImageAspectFlags					aspect					= VK_IMAGE_ASPECT_COLOR_BIT;
+	uint32_t							mip_levels				= 1;
+	uint32_t							array_layers			= 1;
+	VkSampleCountFlagBits				samples					= VK_SAMPLE_COUNT_1_BIT;
+};
+
+// Records the commands of one pass, resources are looked up through the graph.
+typedef std::function<void( VkCommandBuffer command_buffer, const FrameGraph & graph )>	FrameGraphExecuteFunction;
+
+// Declares what a pass reads and writes, returned by FrameGraph::AddPass().
+class FrameGraphPassBuilder
+{
+public:
+	FrameGraphPassBuilder			&	Read( FrameGraphResource resource, FrameGraphUsage usage );
+	FrameGraphPassBuilder			&	Write( FrameGraphResource resource, FrameGraphUsage usage );
+
+	// Attachment write that starts from a cleared image, the graph uses a clear load op.
+	FrameGraphPassBuilder			&	Clear( FrameGraphResource resource, FrameGraphUsage usage, VkClearValue clear_value );
+
+	// The pass does something outside of the graph, it is never culled.
+	FrameGraphPassBuilder			&	SetSideEffects();
+
+private:
+	friend class FrameGraph;
+	FrameGraphPassBuilder( FrameGraph * graph, uint32_t pass );
+
+	FrameGraph						*	_graph							= nullptr;
+	uint32_t							_pass							= 0;
+};
+
+// Describes a frame as passes that declare the resources they read and write. Compile()
+// culls passes whose results are never used, orders the rest in batches of passes that do
+// not depend on each other, derives attachment load and store ops and finds compute passes
+// that could overlap graphics work on an async compute queue. Execute() records the passes
+// with the barriers of a ResourceStateTracker, at most one vkCmdPipelineBarrier per batch.
+//
+// Every frame: Reset(), create and import resources, add passes, Compile(), Execute().
+// Transient images that are not alive at the same time share memory, see TransientImageAllocator.
+class FrameGraph
+{
+public:
+	FrameGraph( Renderer * renderer );
+	~FrameGraph();
+
+	void								Reset();
+
+	FrameGraphResource					CreateImage( std::string name, const FrameGraphImageDesc & desc );
+
+	// The image is transitioned to final_layout after the last pass, imported images are always kept.
+	// current_stage is the stage whatever produced the image is synchronized with, for example the
+	// stage the acquire semaphore of a swapchain image is waited on.
+	FrameGraphResource					ImportImage( std::string name, VkImage image, VkImageView view, const FrameGraphImageDesc & desc,
+											VkImageLayout current_layout, VkPipelineStageFlags current_stage, VkImageLayout final_layout );
+	FrameGraphResource					ImportBuffer( std::string name, VkBuffer buffer, VkDeviceSize size );
+
+	// Passes that contribute to an output are kept, everything else is culled.
+	void								MarkOutput( FrameGraphResource resource );
+
+	FrameGraphPassBuilder				AddPass( std::string name, FrameGraphQueue queue, FrameGraphExecuteFunction execute );
+
+	void								Compile();
+	void								Execute( VkCommandBuffer command_buffer );
+
+	// For use inside the execute functions of the passes.
+	VkImage								GetImage( FrameGraphResource resource ) const;
+	VkImageView							GetImageView( FrameGraphResource resource ) const;
+	VkBuffer							GetBuffer( FrameGraphResource resource ) const;
+	const FrameGraphImageDesc		&	GetImageDesc( FrameGraphResource resource ) const;
+	VkImageLayout						GetLayout( FrameGraphResource resource ) const;
+	VkAttachmentLoadOp					GetLoadOp( FrameGraphResource resource ) const;
+	VkAttachmentStoreOp					GetStoreOp( FrameGraphResource resource ) const;
+	VkClearValue						GetClearValue( FrameGraphResource resource ) const;
+
+	// Attachment description for the current pass, in the layout the graph has put the image in.
+	VkAttachmentDescription				GetAttachmentDescription( FrameGraphResource resource ) const;
+
+	uint32_t							GetPassCount() const;
+	uint32_t							GetCulledPassCount() const;
+	std::vector<std::string>			GetScheduledPassNames() const;
+	std::vector<std::string>			GetAsyncComputePassNames() const;
+	const ResourceStateTracker		&	GetStateTracker() const;
+	const TransientImageAllocator	&	GetTransientImageAllocator() const;
+
+private:
+	friend class FrameGraphPassBuilder;
+
+	struct ResourceUse
+	{
+		FrameGraphResource					resource				= FRAME_GRAPH_INVALID_RESOURCE;
+		FrameGraphUsage						usage					= FrameGraphUsage::SAMPLED;
+		bool								write					= false;
+		bool								clear					= false;
+		VkClearValue						clear_value				= {};
+		VkAttachmentLoadOp					load_op					= VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		VkAttachmentStoreOp					store_op				= VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	};
+
+	struct Pass
+	{
+		std::string							name;
+		FrameGraphQueue						queue					= FrameGraphQueue::GRAPHICS;
+		FrameGraphExecuteFunction			execute;
+		std::vector<ResourceUse>			uses;
+		bool								side_effects			= false;
+		bool								alive					= false;
+		bool								async_compute			= false;
+		std::vector<uint32_t>				dependencies;						// passes that have to run before this one
+	};
+
+	struct Resource
+	{
+		std::string							name;
+		bool								imported				= false;
+		bool								output					= false;
+		bool								is_buffer				= false;
+		FrameGraphImageDesc					desc;
+		VkImage								image					= VK_NULL_HANDLE;
+		VkImageView							view					= VK_NULL_HANDLE;
+		VkBuffer							buffer					= VK_NULL_HANDLE;
+		VkDeviceSize						size					= 0;
+		VkImageLayout						current_layout			= VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags				current_stage			= 0;
+		VkImageLayout						final_layout			= VK_IMAGE_LAYOUT_UNDEFINED;
+	};
+
+	void								_CullPasses();
+	void								_BuildDependencies();
+	void								_SchedulePasses();
+	void								_DeriveAttachmentOps();
+	void								_FindAsyncComputePasses();
+	void								_AllocateTransientImages();
+
+	const ResourceUse				*	_FindCurrentUse( FrameGraphResource resource ) const;
+	void								_DeclareUse( const Pass & pass, const ResourceUse & use );
+
+	Renderer						*	_renderer						= nullptr;
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	std::vector<Resource>				_resources;
+	std::vector<Pass>					_passes;
+	std::vector<uint32_t>				_schedule;
+	std::vector<uint32_t>				_schedule_batches;				// batch of every pass in _schedule
+	TransientImageAllocator			*	_transient_allocator			= nullptr;
+	bool								_compiled						= false;
+	uint32_t							_current_pass					= UINT32_MAX;
+
+	ResourceStateTracker				_state_tracker;
+};
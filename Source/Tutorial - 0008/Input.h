@@ -0,0 +1,37 @@
+#pragma once
+
+#include <bitset>
+#include <chrono>
+#include <stdint.h>
+
+// Platform independent input, the OS specific window code translates
+// its native events into these before handing them to the Window.
+
+enum class InputEventType : uint8_t
+{
+	KEY_DOWN,
+	KEY_UP,
+	MOUSE_MOVE,
+	MOUSE_BUTTON_DOWN,
+	MOUSE_BUTTON_UP,
+	WINDOW_CLOSE,
+};
+
+struct InputEvent
+{
+	InputEventType							type				= InputEventType::KEY_DOWN;
+	uint32_t								code				= 0;			// key code or mouse button index
+	int32_t									x					= 0;			// mouse position in window coordinates
+	int32_t									y					= 0;
+};
+
+// State of the input devices at the moment the input was sampled for a frame.
+struct InputSnapshot
+{
+	std::chrono::steady_clock::time_point	sample_time;
+	uint64_t								frame				= 0;
+	std::bitset<256>						keys;
+	uint32_t								mouse_buttons		= 0;
+	int32_t									mouse_x				= 0;
+	int32_t									mouse_y				= 0;
+};
@@ -0,0 +1,129 @@
+
+#include "InputRecording.h"
+
+#include <algorithm>
+#include <iterator>
+
+static const char		INPUT_RECORDING_MAGIC[ 4 ]		= { 'V', 'K', 'I', 'R' };
+static const uint8_t	INPUT_RECORDING_VERSION			= 1;
+
+// Signed values are zigzag encoded so small negative numbers stay small.
+static uint64_t ZigZagEncode( int64_t value )
+{
+	return ( uint64_t( value ) << 1 ) ^ uint64_t( value >> 63 );
+}
+
+static int64_t ZigZagDecode( uint64_t value )
+{
+	return int64_t( value >> 1 ) ^ -int64_t( value & 1 );
+}
+
+InputRecorder::InputRecorder( std::string file_path )
+{
+	_file.open( file_path, std::ios::binary | std::ios::trunc );
+	if( _file.is_open() ) {
+		_file.write( INPUT_RECORDING_MAGIC, sizeof( INPUT_RECORDING_MAGIC ) );
+		_file.put( char( INPUT_RECORDING_VERSION ) );
+	}
+}
+
+InputRecorder::~InputRecorder()
+{
+	_file.close();
+}
+
+bool InputRecorder::IsOpen() const
+{
+	return _file.is_open();
+}
+
+void InputRecorder::Record( uint64_t frame, uint64_t time_us, const InputEvent & event )
+{
+	if( !_file.is_open() ) return;
+
+	_WriteVarUInt( frame - _last_frame );
+	_WriteVarUInt( time_us - _last_time_us );
+	_file.put( char( event.type ) );
+	_WriteVarUInt( event.code );
+	_WriteVarUInt( ZigZagEncode( event.x ) );
+	_WriteVarUInt( ZigZagEncode( event.y ) );
+
+	_last_frame		= frame;
+	_last_time_us	= time_us;
+}
+
+void InputRecorder::_WriteVarUInt( uint64_t value )
+{
+	while( value >= 0x80 ) {
+		_file.put( char( ( value & 0x7F ) | 0x80 ) );
+		value >>= 7;
+	}
+	_file.put( char( value ) );
+}
+
+InputReplayer::InputReplayer( std::string file_path )
+{
+	std::ifstream file( file_path, std::ios::binary );
+	if( !file.is_open() ) return;
+	std::vector<uint8_t> data( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+
+	if( data.size() < 5 || !std::equal( INPUT_RECORDING_MAGIC, INPUT_RECORDING_MAGIC + 4, data.begin() ) || data[ 4 ] != INPUT_RECORDING_VERSION ) {
+		return;
+	}
+
+	size_t position = 5;
+	bool truncated	= false;
+	auto read_var_uint = [ & ]() -> uint64_t {
+		uint64_t value = 0;
+		for( uint32_t shift=0; shift < 64; shift += 7 ) {
+			if( position >= data.size() ) {
+				truncated = true;
+				return 0;
+			}
+			uint8_t byte = data[ position++ ];
+			value |= uint64_t( byte & 0x7F ) << shift;
+			if( !( byte & 0x80 ) ) break;
+		}
+		return value;
+	};
+
+	uint64_t frame = 0, time_us = 0;
+	while( position < data.size() ) {
+		Record record;
+		frame				+= read_var_uint();
+		time_us				+= read_var_uint();
+		if( position >= data.size() ) break;
+		record.event.type	= InputEventType( data[ position++ ] );
+		record.event.code	= uint32_t( read_var_uint() );
+		record.event.x		= int32_t( ZigZagDecode( read_var_uint() ) );
+		record.event.y		= int32_t( ZigZagDecode( read_var_uint() ) );
+		// A recording cut short by a crash still replays up to the last complete event.
+		if( truncated ) break;
+		record.frame		= frame;
+		record.time_us		= time_us;
+		_records.push_back( record );
+	}
+	_open = true;
+}
+
+InputReplayer::~InputReplayer()
+{
+}
+
+bool InputReplayer::IsOpen() const
+{
+	return _open;
+}
+
+bool InputReplayer::IsFinished() const
+{
+	return _cursor >= _records.size();
+}
+
+void InputReplayer::GetEvents( uint64_t frame, std::vector<InputEvent> & events )
+{
+	while( _cursor < _records.size() && _records[ _cursor ].frame <= frame ) {
+		events.push_back( _records[ _cursor ].event );
+		++_cursor;
+	}
+}
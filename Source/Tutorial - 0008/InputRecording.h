@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Input.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Input events are stored as the frame they were seen on, microseconds since
+// the recording started, type, code and position. Everything but the type is a
+// variable length integer stored as a delta where possible, so a typical event
+// takes 5 to 8 bytes.
+
+class InputRecorder
+{
+public:
+	InputRecorder( std::string file_path );
+	~InputRecorder();
+
+	bool								IsOpen() const;
+	void								Record( uint64_t frame, uint64_t time_us, const InputEvent & event );
+
+private:
+	void								_WriteVarUInt( uint64_t value );
+
+	std::ofstream						_file;
+	uint64_t							_last_frame						= 0;
+	uint64_t							_last_time_us					= 0;
+};
+
+class InputReplayer
+{
+public:
+	InputReplayer( std::string file_path );
+	~InputReplayer();
+
+	bool								IsOpen() const;
+	bool								IsFinished() const;
+
+	// Appends every event recorded for frame or any frame before it that was not returned yet.
+	void								GetEvents( uint64_t frame, std::vector<InputEvent> & events );
+
+private:
+	struct Record
+	{
+		uint64_t							frame					= 0;
+		uint64_t							time_us					= 0;
+		InputEvent							event;
+	};
+
+	std::vector<Record>					_records;
+	size_t								_cursor							= 0;
+	bool								_open							= false;
+};
@@ -0,0 +1,264 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+// Lets a worker find its own deque, the id tells apart several job systems.
+static std::atomic<uint64_t>	job_system_id_counter( 1 );
+
+struct JobSystemThreadInfo
+{
+	uint64_t		job_system_id	= 0;
+	uint32_t		queue_index		= 0;
+};
+static thread_local JobSystemThreadInfo		job_system_thread_info;
+
+bool Job::IsFinished() const
+{
+	return _unfinished == 0;
+}
+
+JobSystem::JobSystem( uint32_t thread_count )
+{
+	_id						= job_system_id_counter++;
+	_queued_jobs			= 0;
+	_sleeping_workers		= 0;
+	_workers_should_run		= true;
+
+	if( thread_count == 0 ) {
+		thread_count = std::thread::hardware_concurrency();
+	}
+	// The waiting thread helps out, but there is always at least one worker for jobs nobody waits for.
+	uint32_t worker_count = std::max( thread_count, 2u ) - 1;
+
+	_queues.resize( worker_count + 1 );
+	for( auto & queue : _queues ) {
+		queue		= new WorkQueue;
+		queue->size	= 0;
+	}
+	for( uint32_t i=0; i < worker_count; ++i ) {
+		_workers.push_back( std::thread( &JobSystem::_WorkerLoop, this, i + 1 ) );
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock( _sleep_mutex );
+		_workers_should_run = false;
+	}
+	_sleep_condition.notify_all();
+	for( auto & worker : _workers ) {
+		worker.join();
+	}
+	for( auto queue : _queues ) {
+		delete queue;
+	}
+	_queues.clear();
+}
+
+JobHandle JobSystem::CreateJob( std::function<void()> work, const JobHandle & parent )
+{
+	auto job				= std::make_shared<Job>();
+	job->_work				= std::move( work );
+	job->_parent			= parent;
+	job->_unfinished		= 1;
+	job->_dependencies		= 1;
+	if( parent ) {
+		++parent->_unfinished;
+	}
+	return job;
+}
+
+void JobSystem::AddDependency( const JobHandle & job, const JobHandle & dependency )
+{
+	std::lock_guard<std::mutex> lock( dependency->_continuations_mutex );
+	if( dependency->_finished ) return;
+
+	++job->_dependencies;
+	dependency->_continuations.push_back( job );
+}
+
+void JobSystem::Submit( const JobHandle & job )
+{
+	// Drops the reference that was held until submission, the last finished dependency queues the job.
+	if( --job->_dependencies == 0 ) {
+		_Push( job );
+	}
+}
+
+JobHandle JobSystem::Run( std::function<void()> work, const JobHandle & parent )
+{
+	auto job = CreateJob( std::move( work ), parent );
+	Submit( job );
+	return job;
+}
+
+JobHandle JobSystem::ParallelFor( uint32_t count, std::function<void( uint32_t begin, uint32_t end )> function, uint32_t min_grain )
+{
+	auto shared_function	= std::make_shared<std::function<void( uint32_t, uint32_t )>>( std::move( function ) );
+	min_grain				= std::max( min_grain, 1u );
+
+	// The root has no work of its own, it finishes once every range below it has run.
+	auto root = CreateJob( nullptr );
+	if( count > 0 ) {
+		Run( [ this, root, shared_function, count, min_grain ]() {
+			_ParallelForRange( root, shared_function, 0, count, min_grain );
+		}, root );
+	}
+	_Finish( root );
+	return root;
+}
+
+void JobSystem::Wait( const JobHandle & job )
+{
+	while( !job->IsFinished() ) {
+		auto other = _FindJob();
+		if( other ) {
+			_Execute( other );
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+uint32_t JobSystem::GetThreadCount() const
+{
+	return uint32_t( _workers.size() ) + 1;
+}
+
+uint32_t JobSystem::_GetQueueIndex() const
+{
+	auto & info = job_system_thread_info;
+	return info.job_system_id == _id ? info.queue_index : 0;
+}
+
+void JobSystem::_Push( const JobHandle & job )
+{
+	// Counted before it is visible in the deque so the count never drops below zero.
+	++_queued_jobs;
+	auto queue = _queues[ _GetQueueIndex() ];
+	{
+		std::lock_guard<std::mutex> lock( queue->mutex );
+		queue->jobs.push_back( job );
+		++queue->size;
+	}
+
+	if( _sleeping_workers > 0 ) {
+		// Taking the lock makes sure the worker is either waiting already or sees the new job.
+		std::lock_guard<std::mutex> lock( _sleep_mutex );
+		_sleep_condition.notify_one();
+	}
+}
+
+JobHandle JobSystem::_FindJob()
+{
+	if( _queued_jobs == 0 ) return nullptr;
+
+	// Newest job of our own deque first, its data is most likely still in the cache.
+	uint32_t own_index = _GetQueueIndex();
+	{
+		auto queue = _queues[ own_index ];
+		std::lock_guard<std::mutex> lock( queue->mutex );
+		if( !queue->jobs.empty() ) {
+			JobHandle job = std::move( queue->jobs.back() );
+			queue->jobs.pop_back();
+			--queue->size;
+			--_queued_jobs;
+			return job;
+		}
+	}
+
+	// Steal the oldest job of another deque, those tend to be the biggest pieces of work.
+	for( uint32_t i=1; i < _queues.size(); ++i ) {
+		auto queue = _queues[ ( own_index + i ) % _queues.size() ];
+		if( queue->size == 0 ) continue;
+		std::lock_guard<std::mutex> lock( queue->mutex );
+		if( !queue->jobs.empty() ) {
+			JobHandle job = std::move( queue->jobs.front() );
+			queue->jobs.pop_front();
+			--queue->size;
+			--_queued_jobs;
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void JobSystem::_Execute( const JobHandle & job )
+{
+	if( job->_work ) {
+		job->_work();
+		// Release whatever the work captured as soon as possible.
+		job->_work = nullptr;
+	}
+	_Finish( job );
+}
+
+void JobSystem::_Finish( const JobHandle & job )
+{
+	if( --job->_unfinished > 0 ) return;
+
+	std::vector<JobHandle> continuations;
+	{
+		std::lock_guard<std::mutex> lock( job->_continuations_mutex );
+		job->_finished = true;
+		continuations.swap( job->_continuations );
+	}
+	for( auto & continuation : continuations ) {
+		if( --continuation->_dependencies == 0 ) {
+			_Push( continuation );
+		}
+	}
+
+	if( job->_parent ) {
+		JobHandle parent = std::move( job->_parent );
+		_Finish( parent );
+	}
+}
+
+void JobSystem::_ParallelForRange( const JobHandle & parent, const std::shared_ptr<std::function<void( uint32_t, uint32_t )>> & function,
+	uint32_t begin, uint32_t end, uint32_t min_grain )
+{
+	auto own_queue = _queues[ _GetQueueIndex() ];
+	while( begin < end ) {
+		// Only split when there is nothing left in our deque for idle threads to steal.
+		if( end - begin > min_grain && own_queue->size == 0 ) {
+			uint32_t middle = begin + ( end - begin ) / 2;
+			Run( [ this, parent, function, middle, end, min_grain ]() {
+				_ParallelForRange( parent, function, middle, end, min_grain );
+			}, parent );
+			end = middle;
+			continue;
+		}
+		uint32_t piece_end = std::min( begin + min_grain, end );
+		( *function )( begin, piece_end );
+		begin = piece_end;
+	}
+}
+
+void JobSystem::_WorkerLoop( uint32_t queue_index )
+{
+	job_system_thread_info.job_system_id	= _id;
+	job_system_thread_info.queue_index		= queue_index;
+
+	uint32_t idle_rounds = 0;
+	while( _workers_should_run ) {
+		auto job = _FindJob();
+		if( job ) {
+			_Execute( job );
+			idle_rounds = 0;
+			continue;
+		}
+
+		// Spin for a short while before going to sleep, new work often follows quickly.
+		if( ++idle_rounds < 64 ) {
+			std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock( _sleep_mutex );
+		++_sleeping_workers;
+		_sleep_condition.wait( lock, [ this ] { return _queued_jobs > 0 || !_workers_should_run; } );
+		--_sleeping_workers;
+		idle_rounds = 0;
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class JobSystem;
+
+// One unit of work. A job runs once all of its dependencies have finished and it has
+// been submitted, it counts as finished once its work and all of its children are done.
+class Job
+{
+	friend class JobSystem;
+
+public:
+	bool								IsFinished() const;
+
+private:
+	std::function<void()>				_work;
+	std::shared_ptr<Job>				_parent;
+	std::atomic<int32_t>				_unfinished;			// this job plus its unfinished children
+	std::atomic<int32_t>				_dependencies;			// unfinished dependencies, plus one until submitted
+
+	std::mutex							_continuations_mutex;
+	std::vector<std::shared_ptr<Job>>	_continuations;			// jobs that depend on this one
+	bool								_finished				= false;
+};
+
+typedef std::shared_ptr<Job>			JobHandle;
+
+// Work stealing job system. Every worker thread owns a deque, it pushes and pops its own
+// jobs at the back and steals from the front of other deques when it runs out of work.
+// Threads that are not workers share one extra deque. Threads that wait for a job keep
+// running other jobs until it is finished, so waiting from inside a job can not deadlock.
+class JobSystem
+{
+public:
+	// thread_count 0 uses one thread per cpu core, counting the thread that waits for the jobs.
+	JobSystem( uint32_t thread_count = 0 );
+	~JobSystem();
+
+	// Children must be created before the parent finishes, usually from the work of the parent.
+	JobHandle							CreateJob( std::function<void()> work, const JobHandle & parent = nullptr );
+
+	// job will not start before dependency has finished. Must be called before job is submitted.
+	void								AddDependency( const JobHandle & job, const JobHandle & dependency );
+
+	// Queues the job, it runs as soon as its dependencies are finished.
+	void								Submit( const JobHandle & job );
+
+	// CreateJob() and Submit() in one.
+	JobHandle							Run( std::function<void()> work, const JobHandle & parent = nullptr );
+
+	// Calls function for every index in [0, count) in ranges of at least min_grain indices.
+	// Ranges are split lazily, only when the thread that runs them has nothing left for
+	// other threads to steal, so the grain size adapts to how busy the other threads are.
+	JobHandle							ParallelFor( uint32_t count, std::function<void( uint32_t begin, uint32_t end )> function, uint32_t min_grain = 1 );
+
+	// Runs other jobs until job is finished.
+	void								Wait( const JobHandle & job );
+
+	uint32_t							GetThreadCount() const;
+
+private:
+	struct WorkQueue
+	{
+		std::mutex							mutex;
+		std::deque<JobHandle>				jobs;
+		std::atomic<uint32_t>				size;
+	};
+
+	uint32_t							_GetQueueIndex() const;
+	void								_Push( const JobHandle & job );
+	JobHandle							_FindJob();
+	void								_Execute( const JobHandle & job );
+	void								_Finish( const JobHandle & job );
+	void								_ParallelForRange( const JobHandle & parent, const std::shared_ptr<std::function<void( uint32_t, uint32_t )>> & function,
+											uint32_t begin, uint32_t end, uint32_t min_grain );
+	void								_WorkerLoop( uint32_t queue_index );
+
+	uint64_t							_id								= 0;
+
+	std::vector<WorkQueue*>				_queues;						// index 0 is shared by all threads that are not workers
+	std::vector<std::thread>			_workers;
+
+	std::atomic<uint32_t>				_queued_jobs;
+	std::atomic<uint32_t>				_sleeping_workers;
+	std::mutex							_sleep_mutex;
+	std::condition_variable				_sleep_condition;
+	std::atomic<bool>					_workers_should_run;
+};
@@ -0,0 +1,79 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "ParallelCommandRecorder.h"
+#include "CommandPoolManager.h"
+#include "JobSystem.h"
+#include "Renderer.h"
+#include "Shared.h"
+
+
+ParallelCommandRecorder::ParallelCommandRecorder( Renderer * renderer )
+{
+	_renderer		= renderer;
+}
+
+void ParallelCommandRecorder::RecordRenderPass( VkCommandBuffer primary_command_buffer, const VkRenderPassBeginInfo & render_pass_begin_info,
+	uint32_t chunk_count, const RecordChunkFunction & record_chunk, bool end_render_pass )
+{
+	_render_pass		= render_pass_begin_info.renderPass;
+	_framebuffer		= render_pass_begin_info.framebuffer;
+	_subpass			= 0;
+
+	// The contents of the subpass come from secondary command buffers only.
+	vkCmdBeginRenderPass( primary_command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS );
+	_RecordSubpass( primary_command_buffer, chunk_count, record_chunk );
+	if( end_render_pass ) {
+		vkCmdEndRenderPass( primary_command_buffer );
+	}
+}
+
+void ParallelCommandRecorder::RecordNextSubpass( VkCommandBuffer primary_command_buffer, uint32_t chunk_count,
+	const RecordChunkFunction & record_chunk, bool end_render_pass )
+{
+	++_subpass;
+	vkCmdNextSubpass( primary_command_buffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS );
+	_RecordSubpass( primary_command_buffer, chunk_count, record_chunk );
+	if( end_render_pass ) {
+		vkCmdEndRenderPass( primary_command_buffer );
+	}
+}
+
+void ParallelCommandRecorder::_RecordSubpass( VkCommandBuffer primary_command_buffer, uint32_t chunk_count, const RecordChunkFunction & record_chunk )
+{
+	if( chunk_count == 0 ) return;
+
+	// Secondaries continue the render pass of the primary, the framebuffer is optional
+	// but knowing it lets the driver optimize the secondary command buffers.
+	_inheritance_info							= {};
+	_inheritance_info.sType						= VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	_inheritance_info.renderPass				= _render_pass;
+	_inheritance_info.subpass					= _subpass;
+	_inheritance_info.framebuffer				= _framebuffer;
+	_inheritance_info.occlusionQueryEnable		= VK_FALSE;
+
+	_chunk_command_buffers.assign( chunk_count, VK_NULL_HANDLE );
+
+	VkCommandBufferBeginInfo begin_info {};
+	begin_info.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags				= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo		= &_inheritance_info;
+
+	// One secondary command buffer per chunk, recorded by whichever thread runs the chunk.
+	// The calling thread helps recording while it waits.
+	auto command_pool_manager	= _renderer->GetCommandPoolManager();
+	auto job_system				= _renderer->GetJobSystem();
+	auto job = job_system->ParallelFor( chunk_count, [ this, command_pool_manager, &begin_info, &record_chunk ]( uint32_t begin, uint32_t end ) {
+		for( uint32_t chunk=begin; chunk < end; ++chunk ) {
+			auto command_buffer = command_pool_manager->GetCommandBuffer( VK_COMMAND_BUFFER_LEVEL_SECONDARY );
+			ErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+			record_chunk( command_buffer, chunk );
+			ErrorCheck( vkEndCommandBuffer( command_buffer ) );
+			_chunk_command_buffers[ chunk ] = command_buffer;
+		}
+	} );
+	job_system->Wait( job );
+
+	// Chunk order is kept no matter which thread recorded which chunk.
+	vkCmdExecuteCommands( primary_command_buffer, chunk_count, _chunk_command_buffers.data() );
+}
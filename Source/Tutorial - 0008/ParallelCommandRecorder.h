@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <functional>
+
+class Renderer;
+
+// Splits the recording of a render pass into chunks that are recorded in parallel
+// into secondary command buffers, the primary command buffer then only begins the
+// render pass, executes the secondaries in chunk order and ends the render pass.
+// Chunks run as a parallel for on the renderer's job system and command buffers come
+// from the CommandPoolManager, every thread records into its own pool.
+class ParallelCommandRecorder
+{
+public:
+	// Records the draws of one chunk into command_buffer, called from any of the recording threads.
+	typedef std::function<void( VkCommandBuffer command_buffer, uint32_t chunk )>	RecordChunkFunction;
+
+	ParallelCommandRecorder( Renderer * renderer );
+
+	// Begins the render pass in primary_command_buffer, records chunk_count chunks in parallel
+	// and executes them in order. Returns once everything is recorded. Pass end_render_pass
+	// false when more subpasses follow and continue with RecordNextSubpass().
+	void								RecordRenderPass( VkCommandBuffer primary_command_buffer, const VkRenderPassBeginInfo & render_pass_begin_info,
+											uint32_t chunk_count, const RecordChunkFunction & record_chunk, bool end_render_pass = true );
+
+	// Moves to the next subpass of the render pass started by RecordRenderPass() and records it in parallel.
+	void								RecordNextSubpass( VkCommandBuffer primary_command_buffer, uint32_t chunk_count,
+											const RecordChunkFunction & record_chunk, bool end_render_pass = true );
+
+private:
+	void								_RecordSubpass( VkCommandBuffer primary_command_buffer, uint32_t chunk_count, const RecordChunkFunction & record_chunk );
+
+	Renderer						*	_renderer						= nullptr;
+
+	// State of the subpass that is being recorded.
+	VkCommandBufferInheritanceInfo		_inheritance_info				{};
+	std::vector<VkCommandBuffer>		_chunk_command_buffers;
+
+	VkRenderPass						_render_pass					= VK_NULL_HANDLE;
+	VkFramebuffer						_framebuffer					= VK_NULL_HANDLE;
+	uint32_t							_subpass						= 0;
+};
@@ -0,0 +1,162 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "PipelineLayoutCache.h"
+#include "ShaderReflection.h"
+#include "Renderer.h"
+#include "Shared.h"
+
+#include <algorithm>
+#include <assert.h>
+
+PipelineLayoutCache::PipelineLayoutCache( Renderer * renderer )
+{
+	_device		= renderer->GetVulkanDevice();
+}
+
+PipelineLayoutCache::~PipelineLayoutCache()
+{
+	for( auto & layout : _pipeline_layouts ) {
+		vkDestroyPipelineLayout( _device, layout.second, nullptr );
+	}
+	for( auto & layout : _set_layouts ) {
+		vkDestroyDescriptorSetLayout( _device, layout.second, nullptr );
+	}
+	_pipeline_layouts.clear();
+	_set_layouts.clear();
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::GetDescriptorSetLayout( const std::vector<VkDescriptorSetLayoutBinding> & bindings )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return _GetDescriptorSetLayout( bindings );
+}
+
+VkPipelineLayout PipelineLayoutCache::GetPipelineLayout( const std::vector<const ShaderReflection*> & stages, std::vector<VkDescriptorSetLayout> * set_layouts )
+{
+	// Merge the bindings of all stages per set, each stage lists its bindings sorted.
+	std::vector<std::vector<VkDescriptorSetLayoutBinding>> sets;
+	VkPushConstantRange push_constant_range {};
+	for( auto stage : stages ) {
+		for( auto & binding : stage->descriptor_bindings ) {
+			if( binding.set >= sets.size() ) {
+				sets.resize( binding.set + 1 );
+			}
+			auto & set_bindings = sets[ binding.set ];
+			auto existing = std::find_if( set_bindings.begin(), set_bindings.end(), [ &binding ]( const VkDescriptorSetLayoutBinding & b ) {
+				return b.binding == binding.binding;
+			} );
+			if( existing != set_bindings.end() ) {
+				assert( existing->descriptorType == binding.type && "Pipeline layout cache: stages disagree on a descriptor type." );
+				existing->stageFlags		|= stage->stage;
+				continue;
+			}
+			// Runtime arrays need descriptor indexing to be sized, without it they hold one descriptor.
+			VkDescriptorSetLayoutBinding layout_binding {};
+			layout_binding.binding			= binding.binding;
+			layout_binding.descriptorType	= binding.type;
+			layout_binding.descriptorCount	= binding.count ? binding.count : 1;
+			layout_binding.stageFlags		= stage->stage;
+			set_bindings.push_back( layout_binding );
+		}
+
+		// One range for all stages that covers every stage's push constants.
+		auto & range = stage->push_constant_range;
+		if( range.size > 0 ) {
+			if( push_constant_range.size == 0 ) {
+				push_constant_range = range;
+			} else {
+				uint32_t end					= std::max( push_constant_range.offset + push_constant_range.size, range.offset + range.size );
+				push_constant_range.offset		= std::min( push_constant_range.offset, range.offset );
+				push_constant_range.size		= end - push_constant_range.offset;
+			}
+			push_constant_range.stageFlags	|= stage->stage;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	std::vector<VkDescriptorSetLayout> layouts( sets.size() );
+	std::vector<uint64_t> key;
+	key.reserve( sets.size() + 3 );
+	for( size_t i=0; i < sets.size(); ++i ) {
+		std::sort( sets[ i ].begin(), sets[ i ].end(), []( const VkDescriptorSetLayoutBinding & a, const VkDescriptorSetLayoutBinding & b ) {
+			return a.binding < b.binding;
+		} );
+		layouts[ i ] = _GetDescriptorSetLayout( sets[ i ] );
+		key.push_back( (uint64_t)layouts[ i ] );
+	}
+	key.push_back( push_constant_range.stageFlags );
+	key.push_back( push_constant_range.offset );
+	key.push_back( push_constant_range.size );
+
+	if( set_layouts ) {
+		*set_layouts = layouts;
+	}
+
+	auto existing = _pipeline_layouts.find( key );
+	if( existing != _pipeline_layouts.end() ) {
+		return existing->second;
+	}
+
+	VkPipelineLayoutCreateInfo pipeline_layout_create_info {};
+	pipeline_layout_create_info.sType					= VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_create_info.setLayoutCount			= uint32_t( layouts.size() );
+	pipeline_layout_create_info.pSetLayouts				= layouts.data();
+	pipeline_layout_create_info.pushConstantRangeCount	= push_constant_range.size ? 1 : 0;
+	pipeline_layout_create_info.pPushConstantRanges		= &push_constant_range;
+
+	VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+	ErrorCheck( vkCreatePipelineLayout( _device, &pipeline_layout_create_info, nullptr, &pipeline_layout ) );
+	_pipeline_layouts[ key ] = pipeline_layout;
+	return pipeline_layout;
+}
+
+uint32_t PipelineLayoutCache::GetDescriptorSetLayoutCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return uint32_t( _set_layouts.size() );
+}
+
+bool PipelineLayoutCache::ContainsPipelineLayout( VkPipelineLayout layout ) const
+{
+	// Only for tools and logs, a walk over every layout is fine.
+	std::lock_guard<std::mutex> lock( _mutex );
+	for( auto & pipeline_layout : _pipeline_layouts ) {
+		if( pipeline_layout.second == layout ) return true;
+	}
+	return false;
+}
+
+uint32_t PipelineLayoutCache::GetPipelineLayoutCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return uint32_t( _pipeline_layouts.size() );
+}
+
+VkDescriptorSetLayout PipelineLayoutCache::_GetDescriptorSetLayout( const std::vector<VkDescriptorSetLayoutBinding> & bindings )
+{
+	std::vector<uint32_t> key;
+	key.reserve( bindings.size() * 4 );
+	for( auto & binding : bindings ) {
+		assert( binding.pImmutableSamplers == nullptr && "Pipeline layout cache: immutable samplers are not supported." );
+		key.push_back( binding.binding );
+		key.push_back( uint32_t( binding.descriptorType ) );
+		key.push_back( binding.descriptorCount );
+		key.push_back( binding.stageFlags );
+	}
+
+	auto existing = _set_layouts.find( key );
+	if( existing != _set_layouts.end() ) {
+		return existing->second;
+	}
+
+	VkDescriptorSetLayoutCreateInfo set_layout_create_info {};
+	set_layout_create_info.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	set_layout_create_info.bindingCount		= uint32_t( bindings.size() );
+	set_layout_create_info.pBindings		= bindings.data();
+
+	VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+	ErrorCheck( vkCreateDescriptorSetLayout( _device, &set_layout_create_info, nullptr, &set_layout ) );
+	_set_layouts[ key ] = set_layout;
+	return set_layout;
+}
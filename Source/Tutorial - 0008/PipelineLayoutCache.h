@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <map>
+#include <mutex>
+
+class Renderer;
+struct ShaderReflection;
+
+// Creates descriptor set layouts and pipeline layouts from shader reflection and hands out
+// the same Vulkan object for equal layouts, pipelines built from the same interface share
+// their layouts and so stay descriptor set compatible. Layouts live as long as the cache.
+// Thread safe.
+class PipelineLayoutCache
+{
+public:
+	PipelineLayoutCache( Renderer * renderer );
+	~PipelineLayoutCache();
+
+	// Bindings have to be sorted by binding number, immutable samplers are not supported.
+	VkDescriptorSetLayout				GetDescriptorSetLayout( const std::vector<VkDescriptorSetLayoutBinding> & bindings );
+
+	// Layout for a pipeline made of the reflected stages. Bindings and push constants used
+	// by several stages are visible to all of them, sets the shaders skip get an empty
+	// layout. set_layouts receives the descriptor set layouts by set number if not null.
+	VkPipelineLayout					GetPipelineLayout( const std::vector<const ShaderReflection*> & stages, std::vector<VkDescriptorSetLayout> * set_layouts = nullptr );
+
+	// False if the pipeline layout is not from this cache.
+	bool								ContainsPipelineLayout( VkPipelineLayout layout ) const;
+
+	uint32_t							GetDescriptorSetLayoutCount() const;
+	uint32_t							GetPipelineLayoutCount() const;
+
+private:
+	VkDescriptorSetLayout				_GetDescriptorSetLayout( const std::vector<VkDescriptorSetLayoutBinding> & bindings );
+
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	mutable std::mutex					_mutex;
+	std::map<std::vector<uint32_t>, VkDescriptorSetLayout>	_set_layouts;
+	std::map<std::vector<uint64_t>, VkPipelineLayout>		_pipeline_layouts;
+};
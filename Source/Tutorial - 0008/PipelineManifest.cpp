@@ -0,0 +1,292 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "PipelineManifest.h"
+#include "PipelineLayoutCache.h"
+#include "ShaderModuleCache.h"
+#include "ShaderReflection.h"
+#include "Renderer.h"
+#include "Shared.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cctype>
+
+static void WriteAttachment( std::ostream & stream, const RenderPassAttachment & attachment )
+{
+	stream << " " << uint32_t( attachment.format ) << " " << uint32_t( attachment.samples ) << " " << uint32_t( attachment.load_op ) << " "
+		<< uint32_t( attachment.store_op ) << " " << uint32_t( attachment.stencil_load_op ) << " " << uint32_t( attachment.stencil_store_op ) << " "
+		<< uint32_t( attachment.initial_layout ) << " " << uint32_t( attachment.final_layout );
+}
+
+static bool ReadAttachment( std::istream & stream, RenderPassAttachment & attachment )
+{
+	uint32_t values[ 8 ] = {};
+	for( auto & value : values ) {
+		if( !( stream >> value ) ) return false;
+	}
+	attachment.format				= VkFormat( values[ 0 ] );
+	attachment.samples				= VkSampleCountFlagBits( values[ 1 ] );
+	attachment.load_op				= VkAttachmentLoadOp( values[ 2 ] );
+	attachment.store_op				= VkAttachmentStoreOp( values[ 3 ] );
+	attachment.stencil_load_op		= VkAttachmentLoadOp( values[ 4 ] );
+	attachment.stencil_store_op		= VkAttachmentStoreOp( values[ 5 ] );
+	attachment.initial_layout		= VkImageLayout( values[ 6 ] );
+	attachment.final_layout			= VkImageLayout( values[ 7 ] );
+	return true;
+}
+
+static bool IsComputeDescription( const PipelineDescription & description )
+{
+	return description.stages.size() == 1 && description.stages[ 0 ].stage == VK_SHADER_STAGE_COMPUTE_BIT;
+}
+
+bool ReadPipelineManifest( const std::string & file_path, std::vector<PipelineManifestEntry> & entries )
+{
+	std::ifstream file( file_path );
+	if( !file ) return false;
+
+	entries.clear();
+	std::string line;
+	uint32_t line_number = 0;
+	while( std::getline( file, line ) ) {
+		++line_number;
+		std::istringstream stream( line );
+		std::string keyword;
+		if( !( stream >> keyword ) || keyword[ 0 ] == '#' ) continue;
+		if( keyword == "pipeline" ) {
+			entries.push_back( PipelineManifestEntry() );
+			continue;
+		}
+		if( entries.empty() ) {
+			std::cout << file_path << ":" << line_number << ": " << keyword << " before the first pipeline" << std::endl;
+			return false;
+		}
+		auto & entry		= entries.back();
+		auto & description	= entry.description;
+
+		bool read = true;
+		if( keyword == "stage" ) {
+			// stage <stage> <code hash> <entry point> <constant data in hex or -> <constant count> <id offset size>...
+			PipelineShaderStage stage;
+			uint32_t stage_bits = 0, entry_count = 0;
+			uint64_t hash = 0;
+			std::string data;
+			read = !!( stream >> stage_bits >> std::hex >> hash >> std::dec >> stage.entry_point >> data >> entry_count );
+			stage.stage = VkShaderStageFlagBits( stage_bits );
+			read = read && ( data == "-" || data.size() % 2 == 0 );
+			for( size_t i=0; read && data != "-" && i < data.size(); i += 2 ) {
+				auto digits	= data.substr( i, 2 );
+				char * end	= nullptr;
+				auto byte	= std::strtoul( digits.c_str(), &end, 16 );
+				read		= std::isxdigit( (unsigned char)digits[ 0 ] ) && end == digits.c_str() + digits.size();
+				stage.specialization_data.push_back( uint8_t( byte ) );
+			}
+			for( uint32_t i=0; read && i < entry_count; ++i ) {
+				VkSpecializationMapEntry map_entry {};
+				uint32_t size = 0;
+				read = !!( stream >> map_entry.constantID >> map_entry.offset >> size );
+				// The constant has to lie inside the data read above.
+				auto data_size = stage.specialization_data.size();
+				read = read && map_entry.offset <= data_size && size <= data_size - map_entry.offset;
+				map_entry.size = size;
+				stage.specialization_map_entries.push_back( map_entry );
+			}
+			description.stages.push_back( std::move( stage ) );
+			entry.shader_hashes.push_back( hash );
+		} else if( keyword == "render_pass" ) {
+			// render_pass <subpass> <color count> <attachment>... <has depth> [<attachment>], RenderPassAttachment in order
+			uint32_t color_count = 0, has_depth = 0;
+			read = !!( stream >> description.subpass >> color_count );
+			entry.render_pass.color_attachments.resize( read ? color_count : 0 );
+			for( auto & attachment : entry.render_pass.color_attachments ) {
+				read = read && ReadAttachment( stream, attachment );
+			}
+			read = read && !!( stream >> has_depth );
+			entry.render_pass.has_depth_attachment	= has_depth != 0;
+			entry.has_render_pass					= true;
+			if( read && has_depth ) {
+				read = ReadAttachment( stream, entry.render_pass.depth_attachment );
+			}
+		} else if( keyword == "vertex_binding" ) {
+			VkVertexInputBindingDescription binding {};
+			uint32_t input_rate = 0;
+			read = !!( stream >> binding.binding >> binding.stride >> input_rate );
+			binding.inputRate = VkVertexInputRate( input_rate );
+			description.vertex_bindings.push_back( binding );
+		} else if( keyword == "vertex_attribute" ) {
+			VkVertexInputAttributeDescription attribute {};
+			uint32_t format = 0;
+			read = !!( stream >> attribute.location >> attribute.binding >> format >> attribute.offset );
+			attribute.format = VkFormat( format );
+			description.vertex_attributes.push_back( attribute );
+		} else if( keyword == "raster" ) {
+			uint32_t topology = 0, polygon_mode = 0, front_face = 0, samples = 0;
+			read = !!( stream >> topology >> polygon_mode >> description.cull_mode >> front_face >> samples );
+			description.topology		= VkPrimitiveTopology( topology );
+			description.polygon_mode	= VkPolygonMode( polygon_mode );
+			description.front_face		= VkFrontFace( front_face );
+			description.samples			= VkSampleCountFlagBits( samples );
+		} else if( keyword == "depth" ) {
+			uint32_t compare = 0;
+			read = !!( stream >> description.depth_test >> description.depth_write >> compare );
+			description.depth_compare	= VkCompareOp( compare );
+		} else if( keyword == "blend" ) {
+			uint32_t values[ 7 ] = {};
+			VkPipelineColorBlendAttachmentState blend {};
+			read = !!( stream >> blend.blendEnable >> values[ 0 ] >> values[ 1 ] >> values[ 2 ] >> values[ 3 ] >> values[ 4 ] >> values[ 5 ] >> blend.colorWriteMask );
+			blend.srcColorBlendFactor	= VkBlendFactor( values[ 0 ] );
+			blend.dstColorBlendFactor	= VkBlendFactor( values[ 1 ] );
+			blend.colorBlendOp			= VkBlendOp( values[ 2 ] );
+			blend.srcAlphaBlendFactor	= VkBlendFactor( values[ 3 ] );
+			blend.dstAlphaBlendFactor	= VkBlendFactor( values[ 4 ] );
+			blend.alphaBlendOp			= VkBlendOp( values[ 5 ] );
+			description.blend_attachments.push_back( blend );
+		} else if( keyword == "dynamic" ) {
+			uint32_t state = 0;
+			while( stream >> state ) {
+				description.dynamic_states.push_back( VkDynamicState( state ) );
+			}
+		} else {
+			read = false;
+		}
+		if( !read ) {
+			std::cout << file_path << ":" << line_number << ": malformed " << keyword << " line" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool WritePipelineManifest( const std::string & file_path, const std::vector<PipelineManifestEntry> & entries )
+{
+	std::ofstream file( file_path );
+	if( !file ) return false;
+
+	file << "# Pipeline manifest, " << entries.size() << " pipelines" << std::endl;
+	for( auto & entry : entries ) {
+		auto & description = entry.description;
+		file << "pipeline" << std::endl;
+		for( size_t i=0; i < description.stages.size(); ++i ) {
+			auto & stage = description.stages[ i ];
+			file << "stage " << uint32_t( stage.stage ) << " " << std::hex << std::setw( 16 ) << std::setfill( '0' ) << entry.shader_hashes[ i ] << " ";
+			file << stage.entry_point << " ";
+			for( auto byte : stage.specialization_data ) {
+				file << std::setw( 2 ) << uint32_t( byte );
+			}
+			file << std::dec << std::setfill( ' ' ) << ( stage.specialization_data.empty() ? "-" : "" ) << " " << stage.specialization_map_entries.size();
+			for( auto & map_entry : stage.specialization_map_entries ) {
+				file << " " << map_entry.constantID << " " << map_entry.offset << " " << map_entry.size;
+			}
+			file << std::endl;
+		}
+		if( IsComputeDescription( description ) ) continue;
+
+		if( entry.has_render_pass ) {
+			file << "render_pass " << description.subpass << " " << entry.render_pass.color_attachments.size();
+			for( auto & attachment : entry.render_pass.color_attachments ) {
+				WriteAttachment( file, attachment );
+			}
+			file << " " << ( entry.render_pass.has_depth_attachment ? 1 : 0 );
+			if( entry.render_pass.has_depth_attachment ) {
+				WriteAttachment( file, entry.render_pass.depth_attachment );
+			}
+			file << std::endl;
+		}
+		for( auto & binding : description.vertex_bindings ) {
+			file << "vertex_binding " << binding.binding << " " << binding.stride << " " << uint32_t( binding.inputRate ) << std::endl;
+		}
+		for( auto & attribute : description.vertex_attributes ) {
+			file << "vertex_attribute " << attribute.location << " " << attribute.binding << " " << uint32_t( attribute.format ) << " " << attribute.offset << std::endl;
+		}
+		file << "raster " << uint32_t( description.topology ) << " " << uint32_t( description.polygon_mode ) << " " << description.cull_mode << " "
+			<< uint32_t( description.front_face ) << " " << uint32_t( description.samples ) << std::endl;
+		file << "depth " << description.depth_test << " " << description.depth_write << " " << uint32_t( description.depth_compare ) << std::endl;
+		for( auto & blend : description.blend_attachments ) {
+			file << "blend " << blend.blendEnable << " " << uint32_t( blend.srcColorBlendFactor ) << " " << uint32_t( blend.dstColorBlendFactor ) << " "
+				<< uint32_t( blend.colorBlendOp ) << " " << uint32_t( blend.srcAlphaBlendFactor ) << " " << uint32_t( blend.dstAlphaBlendFactor ) << " "
+				<< uint32_t( blend.alphaBlendOp ) << " " << blend.colorWriteMask << std::endl;
+		}
+		if( !description.dynamic_states.empty() ) {
+			file << "dynamic";
+			for( auto state : description.dynamic_states ) {
+				file << " " << uint32_t( state );
+			}
+			file << std::endl;
+		}
+	}
+	return !!file;
+}
+
+bool MakePipelineManifestEntry( Renderer * renderer, const PipelineDescription & description, PipelineManifestEntry & entry )
+{
+	entry					= PipelineManifestEntry();
+	entry.description		= description;
+	for( auto & stage : entry.description.stages ) {
+		uint64_t content_hash = 0;
+		if( !renderer->GetShaderModuleCache()->FindContentHash( stage.module, &content_hash ) ) return false;
+		entry.shader_hashes.push_back( content_hash );
+		stage.module = VK_NULL_HANDLE;
+	}
+	// Only the shaders are stored, the layout is made again from their reflection. A layout
+	// that was not made that way would not match the pipeline the renderer asks for later.
+	if( !renderer->GetPipelineLayoutCache()->ContainsPipelineLayout( description.layout ) ) return false;
+	entry.description.layout = VK_NULL_HANDLE;
+
+	if( description.render_pass != VK_NULL_HANDLE ) {
+		if( !renderer->GetRenderPassCache()->FindSignature( description.render_pass, &entry.render_pass ) ) return false;
+		entry.has_render_pass				= true;
+		entry.description.render_pass		= VK_NULL_HANDLE;
+	}
+	return true;
+}
+
+bool ResolvePipelineManifestEntry( Renderer * renderer, const PipelineManifestEntry & entry, const ShaderCodeLookup & find_code, PipelineDescription & description )
+{
+	description = entry.description;
+	std::vector<ShaderReflection> reflections( entry.shader_hashes.size() );
+	std::vector<const ShaderReflection*> stages;
+	for( size_t i=0; i < entry.shader_hashes.size(); ++i ) {
+		size_t word_count	= 0;
+		auto code			= find_code( entry.shader_hashes[ i ], &word_count );
+		if( !code || !ReflectShader( code, word_count, reflections[ i ] ) ) return false;
+		description.stages[ i ].module = renderer->GetShaderModuleCache()->GetShaderModule( entry.shader_hashes[ i ], code, word_count );
+		stages.push_back( &reflections[ i ] );
+	}
+	description.layout = renderer->GetPipelineLayoutCache()->GetPipelineLayout( stages );
+	if( entry.has_render_pass ) {
+		description.render_pass = renderer->GetRenderPassCache()->GetRenderPass( entry.render_pass );
+	}
+	return true;
+}
+
+uint32_t WritePipelineUsageLog( Renderer * renderer, const std::string & file_path )
+{
+	std::vector<PipelineManifestEntry> entries;
+	for( auto & description : renderer->GetPipelineService()->GetRequestedDescriptions() ) {
+		PipelineManifestEntry entry;
+		if( MakePipelineManifestEntry( renderer, description, entry ) ) {
+			entries.push_back( std::move( entry ) );
+		}
+	}
+	if( !WritePipelineManifest( file_path, entries ) ) return 0;
+	return uint32_t( entries.size() );
+}
+
+uint32_t WarmUpPipelines( Renderer * renderer, const std::string & file_path, const ShaderCodeLookup & find_code )
+{
+	std::vector<PipelineManifestEntry> entries;
+	if( !ReadPipelineManifest( file_path, entries ) ) return 0;
+
+	uint32_t count = 0;
+	for( auto & entry : entries ) {
+		PipelineDescription description;
+		if( ResolvePipelineManifestEntry( renderer, entry, find_code, description ) ) {
+			renderer->GetPipelineService()->Prefetch( description );
+			++count;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Platform.h"
+#include "PipelineService.h"
+#include "RenderPassCache.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+
+class Renderer;
+
+// A pipeline as it is stored in a manifest. Shaders are named by the hash of their code,
+// HashShaderCode(), layouts are made again from shader reflection by the PipelineLayoutCache
+// and graphics pipelines keep the signature of their render pass. A warmed up pipeline is
+// the very one the renderer asks the PipelineService for later as long as the renderer takes
+// its layouts from PipelineLayoutCache::GetPipelineLayout() for the same shaders, pipelines
+// with layouts made by hand can not go into a manifest.
+struct PipelineManifestEntry
+{
+	PipelineDescription					description;					// modules, layout and render pass are not set
+	std::vector<uint64_t>				shader_hashes;					// one per stage
+	bool								has_render_pass			= false;
+	RenderPassSignature					render_pass;
+};
+
+// Finds the SPIR-V of a hash, nullptr if there is none.
+typedef std::function<const uint32_t*( uint64_t content_hash, size_t * word_count )>	ShaderCodeLookup;
+
+// A text file with one pipeline per "pipeline" line and a line per stage and piece of state
+// after it, Vulkan enums are written as numbers. Usage logs and warm-up lists are manifests.
+bool									ReadPipelineManifest( const std::string & file_path, std::vector<PipelineManifestEntry> & entries );
+bool									WritePipelineManifest( const std::string & file_path, const std::vector<PipelineManifestEntry> & entries );
+
+// False if a module, the layout or the render pass did not come from the renderer's caches.
+bool									MakePipelineManifestEntry( Renderer * renderer, const PipelineDescription & description, PipelineManifestEntry & entry );
+
+// Modules, layout and render pass from the renderer's caches, false if a shader can not be found.
+bool									ResolvePipelineManifestEntry( Renderer * renderer, const PipelineManifestEntry & entry, const ShaderCodeLookup & find_code, PipelineDescription & description );
+
+// Writes every pipeline the renderer's PipelineService was asked for, in the order of the
+// first request. Returns how many were written, pipelines with modules, layouts or render
+// passes that are not from the renderer's caches can not be.
+uint32_t								WritePipelineUsageLog( Renderer * renderer, const std::string & file_path );
+
+// Queues the compile of every pipeline in a warm-up list on the PipelineService, with a baked
+// pipeline cache loaded they are ready after a fraction of the compile time. Returns how many.
+uint32_t								WarmUpPipelines( Renderer * renderer, const std::string & file_path, const ShaderCodeLookup & find_code );
@@ -0,0 +1,427 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "PipelineService.h"
+#include "Renderer.h"
+#include "Shared.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+// Same pipeline, same description: stable orders and disabled state reset to defaults.
+static PipelineDescription Canonicalize( const PipelineDescription & description )
+{
+	PipelineDescription canonical;
+	canonical.stages	= description.stages;
+	canonical.layout	= description.layout;
+
+	std::sort( canonical.stages.begin(), canonical.stages.end(), []( const PipelineShaderStage & a, const PipelineShaderStage & b ) {
+		return a.stage < b.stage;
+	} );
+	for( auto & stage : canonical.stages ) {
+		// Constants sorted by id and packed in that order.
+		auto entries = stage.specialization_map_entries;
+		std::sort( entries.begin(), entries.end(), []( const VkSpecializationMapEntry & a, const VkSpecializationMapEntry & b ) {
+			return a.constantID < b.constantID;
+		} );
+		std::vector<uint8_t> data;
+		for( auto & entry : entries ) {
+			if( entry.offset > stage.specialization_data.size() || entry.size > stage.specialization_data.size() - entry.offset ) {
+				assert( 0 && "Pipeline service: specialization constant outside of its data." );
+				std::exit( -1 );
+			}
+			uint32_t offset = uint32_t( data.size() );
+			data.insert( data.end(), stage.specialization_data.begin() + entry.offset, stage.specialization_data.begin() + entry.offset + entry.size );
+			entry.offset = offset;
+		}
+		stage.specialization_map_entries	= std::move( entries );
+		stage.specialization_data			= std::move( data );
+	}
+
+	bool compute = canonical.stages.size() == 1 && canonical.stages[ 0 ].stage == VK_SHADER_STAGE_COMPUTE_BIT;
+	if( compute ) return canonical;
+
+	canonical.render_pass			= description.render_pass;
+	canonical.subpass				= description.subpass;
+	canonical.vertex_bindings		= description.vertex_bindings;
+	canonical.vertex_attributes		= description.vertex_attributes;
+	canonical.topology				= description.topology;
+	canonical.polygon_mode			= description.polygon_mode;
+	canonical.cull_mode				= description.cull_mode;
+	canonical.front_face			= description.front_face;
+	canonical.samples				= description.samples;
+	canonical.depth_test			= description.depth_test;
+	canonical.depth_write			= description.depth_test && description.depth_write;
+	canonical.depth_compare			= description.depth_test ? description.depth_compare : PipelineDescription().depth_compare;
+	canonical.blend_attachments		= description.blend_attachments;
+
+	std::sort( canonical.vertex_bindings.begin(), canonical.vertex_bindings.end(), []( const VkVertexInputBindingDescription & a, const VkVertexInputBindingDescription & b ) {
+		return a.binding < b.binding;
+	} );
+	std::sort( canonical.vertex_attributes.begin(), canonical.vertex_attributes.end(), []( const VkVertexInputAttributeDescription & a, const VkVertexInputAttributeDescription & b ) {
+		return a.location < b.location;
+	} );
+	for( auto & blend : canonical.blend_attachments ) {
+		if( !blend.blendEnable ) {
+			auto color_write_mask	= blend.colorWriteMask;
+			blend					= {};
+			blend.colorWriteMask	= color_write_mask;
+		}
+	}
+	for( auto state : description.dynamic_states ) {
+		if( state != VK_DYNAMIC_STATE_VIEWPORT && state != VK_DYNAMIC_STATE_SCISSOR ) {
+			canonical.dynamic_states.push_back( state );
+		}
+	}
+	std::sort( canonical.dynamic_states.begin(), canonical.dynamic_states.end() );
+	canonical.dynamic_states.erase( std::unique( canonical.dynamic_states.begin(), canonical.dynamic_states.end() ), canonical.dynamic_states.end() );
+	return canonical;
+}
+
+static void AppendHandle( std::vector<uint32_t> & key, uint64_t handle )
+{
+	key.push_back( uint32_t( handle ) );
+	key.push_back( uint32_t( handle >> 32 ) );
+}
+
+// Every field of a canonical description as words, equal keys are equal pipelines.
+static std::vector<uint32_t> MakeKey( const PipelineDescription & description )
+{
+	std::vector<uint32_t> key;
+	key.push_back( uint32_t( description.stages.size() ) );
+	for( auto & stage : description.stages ) {
+		key.push_back( stage.stage );
+		AppendHandle( key, (uint64_t)stage.module );
+		key.push_back( uint32_t( stage.entry_point.size() ) );
+		for( auto character : stage.entry_point ) {
+			key.push_back( uint8_t( character ) );
+		}
+		key.push_back( uint32_t( stage.specialization_map_entries.size() ) );
+		for( auto & entry : stage.specialization_map_entries ) {
+			key.push_back( entry.constantID );
+			key.push_back( entry.offset );
+			key.push_back( uint32_t( entry.size ) );
+		}
+		key.push_back( uint32_t( stage.specialization_data.size() ) );
+		for( auto byte : stage.specialization_data ) {
+			key.push_back( byte );
+		}
+	}
+	AppendHandle( key, (uint64_t)description.layout );
+	AppendHandle( key, (uint64_t)description.render_pass );
+	key.push_back( description.subpass );
+	key.push_back( uint32_t( description.vertex_bindings.size() ) );
+	for( auto & binding : description.vertex_bindings ) {
+		key.push_back( binding.binding );
+		key.push_back( binding.stride );
+		key.push_back( binding.inputRate );
+	}
+	key.push_back( uint32_t( description.vertex_attributes.size() ) );
+	for( auto & attribute : description.vertex_attributes ) {
+		key.push_back( attribute.location );
+		key.push_back( attribute.binding );
+		key.push_back( attribute.format );
+		key.push_back( attribute.offset );
+	}
+	key.push_back( description.topology );
+	key.push_back( description.polygon_mode );
+	key.push_back( description.cull_mode );
+	key.push_back( description.front_face );
+	key.push_back( description.samples );
+	key.push_back( description.depth_test );
+	key.push_back( description.depth_write );
+	key.push_back( description.depth_compare );
+	key.push_back( uint32_t( description.blend_attachments.size() ) );
+	for( auto & blend : description.blend_attachments ) {
+		key.push_back( blend.blendEnable );
+		key.push_back( blend.srcColorBlendFactor );
+		key.push_back( blend.dstColorBlendFactor );
+		key.push_back( blend.colorBlendOp );
+		key.push_back( blend.srcAlphaBlendFactor );
+		key.push_back( blend.dstAlphaBlendFactor );
+		key.push_back( blend.alphaBlendOp );
+		key.push_back( blend.colorWriteMask );
+	}
+	key.push_back( uint32_t( description.dynamic_states.size() ) );
+	for( auto state : description.dynamic_states ) {
+		key.push_back( state );
+	}
+	return key;
+}
+
+VkResult CreatePipeline( Renderer * renderer, const PipelineDescription & description, VkPipeline * pipeline )
+{
+	auto device = renderer->GetVulkanDevice();
+
+	std::vector<VkSpecializationInfo> specialization_infos( description.stages.size() );
+	std::vector<VkPipelineShaderStageCreateInfo> stage_create_infos( description.stages.size() );
+	for( size_t i=0; i < description.stages.size(); ++i ) {
+		auto & stage = description.stages[ i ];
+		specialization_infos[ i ].mapEntryCount		= uint32_t( stage.specialization_map_entries.size() );
+		specialization_infos[ i ].pMapEntries		= stage.specialization_map_entries.data();
+		specialization_infos[ i ].dataSize			= stage.specialization_data.size();
+		specialization_infos[ i ].pData				= stage.specialization_data.data();
+
+		stage_create_infos[ i ].sType				= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stage_create_infos[ i ].stage				= stage.stage;
+		stage_create_infos[ i ].module				= stage.module;
+		stage_create_infos[ i ].pName				= stage.entry_point.c_str();
+		stage_create_infos[ i ].pSpecializationInfo	= stage.specialization_map_entries.empty() ? nullptr : &specialization_infos[ i ];
+	}
+
+	if( description.stages.size() == 1 && description.stages[ 0 ].stage == VK_SHADER_STAGE_COMPUTE_BIT ) {
+		VkComputePipelineCreateInfo pipeline_create_info {};
+		pipeline_create_info.sType		= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeline_create_info.stage		= stage_create_infos[ 0 ];
+		pipeline_create_info.layout		= description.layout;
+		return vkCreateComputePipelines( device, renderer->GetVulkanPipelineCache(), 1, &pipeline_create_info, nullptr, pipeline );
+	}
+
+	VkPipelineVertexInputStateCreateInfo vertex_input_state {};
+	vertex_input_state.sType							= VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertex_input_state.vertexBindingDescriptionCount	= uint32_t( description.vertex_bindings.size() );
+	vertex_input_state.pVertexBindingDescriptions		= description.vertex_bindings.data();
+	vertex_input_state.vertexAttributeDescriptionCount	= uint32_t( description.vertex_attributes.size() );
+	vertex_input_state.pVertexAttributeDescriptions		= description.vertex_attributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly_state {};
+	input_assembly_state.sType			= VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	input_assembly_state.topology		= description.topology;
+
+	VkPipelineViewportStateCreateInfo viewport_state {};
+	viewport_state.sType				= VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport_state.viewportCount		= 1;
+	viewport_state.scissorCount			= 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterization_state {};
+	rasterization_state.sType			= VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterization_state.polygonMode		= description.polygon_mode;
+	rasterization_state.cullMode		= description.cull_mode;
+	rasterization_state.frontFace		= description.front_face;
+	rasterization_state.lineWidth		= 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisample_state {};
+	multisample_state.sType					= VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisample_state.rasterizationSamples	= description.samples;
+
+	VkPipelineDepthStencilStateCreateInfo depth_stencil_state {};
+	depth_stencil_state.sType				= VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depth_stencil_state.depthTestEnable		= description.depth_test;
+	depth_stencil_state.depthWriteEnable	= description.depth_write;
+	depth_stencil_state.depthCompareOp		= description.depth_compare;
+
+	VkPipelineColorBlendStateCreateInfo color_blend_state {};
+	color_blend_state.sType				= VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	color_blend_state.attachmentCount	= uint32_t( description.blend_attachments.size() );
+	color_blend_state.pAttachments		= description.blend_attachments.data();
+
+	std::vector<VkDynamicState> dynamic_states = description.dynamic_states;
+	dynamic_states.push_back( VK_DYNAMIC_STATE_VIEWPORT );
+	dynamic_states.push_back( VK_DYNAMIC_STATE_SCISSOR );
+	VkPipelineDynamicStateCreateInfo dynamic_state {};
+	dynamic_state.sType					= VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state.dynamicStateCount		= uint32_t( dynamic_states.size() );
+	dynamic_state.pDynamicStates		= dynamic_states.data();
+
+	VkGraphicsPipelineCreateInfo pipeline_create_info {};
+	pipeline_create_info.sType					= VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeline_create_info.stageCount				= uint32_t( stage_create_infos.size() );
+	pipeline_create_info.pStages				= stage_create_infos.data();
+	pipeline_create_info.pVertexInputState		= &vertex_input_state;
+	pipeline_create_info.pInputAssemblyState	= &input_assembly_state;
+	pipeline_create_info.pViewportState			= &viewport_state;
+	pipeline_create_info.pRasterizationState	= &rasterization_state;
+	pipeline_create_info.pMultisampleState		= &multisample_state;
+	pipeline_create_info.pDepthStencilState		= &depth_stencil_state;
+	pipeline_create_info.pColorBlendState		= &color_blend_state;
+	pipeline_create_info.pDynamicState			= &dynamic_state;
+	pipeline_create_info.layout					= description.layout;
+	pipeline_create_info.renderPass				= description.render_pass;
+	pipeline_create_info.subpass				= description.subpass;
+	return vkCreateGraphicsPipelines( device, renderer->GetVulkanPipelineCache(), 1, &pipeline_create_info, nullptr, pipeline );
+}
+
+size_t PipelineService::KeyHash::operator()( const std::vector<uint32_t> & key ) const
+{
+	uint64_t hash = 14695981039346656037ull;
+	for( auto word : key ) {
+		hash ^= word;
+		hash *= 1099511628211ull;
+	}
+	return size_t( hash );
+}
+
+PipelineService::PipelineService( Renderer * renderer )
+{
+	_renderer			= renderer;
+	_device				= renderer->GetVulkanDevice();
+	_compile_count		= 0;
+	_coalesced_count	= 0;
+	_fallback_count		= 0;
+	_pending_count		= 0;
+	_failed_count		= 0;
+}
+
+PipelineService::~PipelineService()
+{
+	WaitIdle();
+	for( auto & entry : _entries ) {
+		vkDestroyPipeline( _device, entry.second->pipeline.load(), nullptr );
+		delete entry.second;
+	}
+	_entries.clear();
+}
+
+VkPipeline PipelineService::GetPipeline( const PipelineDescription & description, VkPipeline fallback )
+{
+	auto pipeline = _Request( description )->pipeline.load();
+	if( pipeline != VK_NULL_HANDLE ) return pipeline;
+	++_fallback_count;
+	return fallback;
+}
+
+VkPipeline PipelineService::GetPipelineNow( const PipelineDescription & description, VkResult * result )
+{
+	auto entry = _Request( description );
+	if( entry->result.load() == VK_NOT_READY ) {
+		JobHandle job;
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			job = entry->job;
+		}
+		_renderer->GetJobSystem()->Wait( job );
+	}
+	if( result ) *result = entry->result.load();
+	return entry->pipeline.load();
+}
+
+void PipelineService::Prefetch( const PipelineDescription & description )
+{
+	_Request( description );
+}
+
+bool PipelineService::IsReady( const PipelineDescription & description )
+{
+	auto key = MakeKey( Canonicalize( description ) );
+	std::lock_guard<std::mutex> lock( _mutex );
+	auto existing = _entries.find( key );
+	return existing != _entries.end() && existing->second->pipeline.load() != VK_NULL_HANDLE;
+}
+
+VkResult PipelineService::GetResult( const PipelineDescription & description )
+{
+	auto key = MakeKey( Canonicalize( description ) );
+	std::lock_guard<std::mutex> lock( _mutex );
+	auto existing = _entries.find( key );
+	return existing != _entries.end() ? existing->second->result.load() : VK_NOT_READY;
+}
+
+void PipelineService::WaitIdle()
+{
+	std::vector<JobHandle> jobs;
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		for( auto & entry : _entries ) {
+			if( entry.second->result.load() == VK_NOT_READY && entry.second->job ) {
+				jobs.push_back( entry.second->job );
+			}
+		}
+	}
+	for( auto & job : jobs ) {
+		_renderer->GetJobSystem()->Wait( job );
+	}
+}
+
+std::vector<PipelineDescription> PipelineService::GetRequestedDescriptions() const
+{
+	std::vector<const Entry*> entries;
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		for( auto & entry : _entries ) {
+			auto result = entry.second->result.load();
+			if( result == VK_SUCCESS || result == VK_NOT_READY ) {
+				entries.push_back( entry.second );
+			}
+		}
+	}
+	// Entries live as long as the service, only the map needs the lock.
+	std::sort( entries.begin(), entries.end(), []( const Entry * a, const Entry * b ) {
+		return a->request_index < b->request_index;
+	} );
+	std::vector<PipelineDescription> descriptions;
+	for( auto entry : entries ) {
+		descriptions.push_back( entry->description );
+	}
+	return descriptions;
+}
+
+uint64_t PipelineService::GetCompileCount() const
+{
+	return _compile_count.load();
+}
+
+uint64_t PipelineService::GetCoalescedCount() const
+{
+	return _coalesced_count.load();
+}
+
+uint64_t PipelineService::GetFallbackCount() const
+{
+	return _fallback_count.load();
+}
+
+uint32_t PipelineService::GetPendingCount() const
+{
+	return _pending_count.load();
+}
+
+uint32_t PipelineService::GetFailedCount() const
+{
+	return _failed_count.load();
+}
+
+PipelineService::Entry * PipelineService::_Request( const PipelineDescription & description )
+{
+	// Hashing and canonicalizing happen outside of the lock, only the lookup is inside.
+	auto canonical	= Canonicalize( description );
+	auto key		= MakeKey( canonical );
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	auto existing = _entries.find( key );
+	if( existing != _entries.end() ) {
+		if( existing->second->result.load() == VK_NOT_READY ) {
+			++_coalesced_count;
+		}
+		return existing->second;
+	}
+
+	auto entry			= new Entry;
+	entry->description	= std::move( canonical );
+	entry->pipeline		= VK_NULL_HANDLE;
+	entry->result		= VK_NOT_READY;
+	entry->request_index	= _entries.size();
+	_entries[ key ]		= entry;
+	++_compile_count;
+	++_pending_count;
+	entry->job			= _renderer->GetJobSystem()->Run( [ this, entry ]() {
+		_Compile( entry );
+	} );
+	return entry;
+}
+
+void PipelineService::_Compile( Entry * entry )
+{
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	auto result = CreatePipeline( _renderer, entry->description, &pipeline );
+	if( result != VK_SUCCESS ) {
+		// Stays failed, asking again would only fail again on every frame.
+		std::cout << "Pipeline service: pipeline creation failed with VkResult " << result << ", using the fallback." << std::endl;
+		pipeline = VK_NULL_HANDLE;
+		++_failed_count;
+	}
+	entry->pipeline.store( pipeline );
+	entry->result.store( result );
+	--_pending_count;
+}
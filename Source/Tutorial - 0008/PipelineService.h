@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Platform.h"
+#include "JobSystem.h"
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+class Renderer;
+
+struct PipelineShaderStage
+{
+	VkShaderStageFlagBits				stage					= VK_SHADER_STAGE_COMPUTE_BIT;
+	VkShaderModule						module					= VK_NULL_HANDLE;
+	std::string							entry_point				= "main";
+	std::vector<VkSpecializationMapEntry>	specialization_map_entries;
+	std::vector<uint8_t>				specialization_data;
+};
+
+// Everything that makes a pipeline, compute if the only stage is a compute shader.
+// Viewport and scissor are always dynamic. Descriptions that only differ in the order of
+// stages, vertex inputs, specialization constants or dynamic states, or in state that is
+// disabled, describe the same pipeline.
+struct PipelineDescription
+{
+	std::vector<PipelineShaderStage>	stages;
+	VkPipelineLayout					layout					= VK_NULL_HANDLE;
+
+	// Graphics pipelines only.
+	VkRenderPass						render_pass				= VK_NULL_HANDLE;
+	uint32_t							subpass					= 0;
+	std::vector<VkVertexInputBindingDescription>	vertex_bindings;
+	std::vector<VkVertexInputAttributeDescription>	vertex_attributes;
+	VkPrimitiveTopology					topology				= VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPolygonMode						polygon_mode			= VK_POLYGON_MODE_FILL;
+	VkCullModeFlags						cull_mode				= VK_CULL_MODE_BACK_BIT;
+	VkFrontFace							front_face				= VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	VkSampleCountFlagBits				samples					= VK_SAMPLE_COUNT_1_BIT;
+	bool								depth_test				= false;
+	bool								depth_write				= false;
+	VkCompareOp							depth_compare			= VK_COMPARE_OP_LESS_OR_EQUAL;
+	std::vector<VkPipelineColorBlendAttachmentState>	blend_attachments;		// one per color attachment of the subpass
+	std::vector<VkDynamicState>			dynamic_states;
+};
+
+// Creates the pipeline right away on the calling thread with the renderer's VkPipelineCache.
+VkResult								CreatePipeline( Renderer * renderer, const PipelineDescription & description, VkPipeline * pipeline );
+
+// Creates pipelines on the job system so a new material does not stall the frame. A
+// pipeline that is not compiled yet is queued once, however many times it is asked for,
+// and the caller gets its fallback until the compile has finished. All compiles share
+// the renderer's VkPipelineCache. Pipelines live as long as the service. Thread safe.
+class PipelineService
+{
+public:
+	PipelineService( Renderer * renderer );
+	~PipelineService();
+
+	// The pipeline if it is ready, otherwise fallback. Queues the compile the first time.
+	VkPipeline							GetPipeline( const PipelineDescription & description, VkPipeline fallback = VK_NULL_HANDLE );
+	// Waits for the compile, for loading screens and pipelines that have no fallback.
+	// VK_NULL_HANDLE only if the compile failed, result tells why.
+	VkPipeline							GetPipelineNow( const PipelineDescription & description, VkResult * result = nullptr );
+	// Only queues the compile, for warm-up lists.
+	void								Prefetch( const PipelineDescription & description );
+
+	bool								IsReady( const PipelineDescription & description );
+	// VK_NOT_READY while the compile is queued or running, the error if it failed. A failed
+	// pipeline is not compiled again, its requests get the fallback.
+	VkResult							GetResult( const PipelineDescription & description );
+	void								WaitIdle();
+
+	// Every pipeline asked for so far that did not fail, in the order of the first request, for usage logs.
+	std::vector<PipelineDescription>	GetRequestedDescriptions() const;
+
+	uint64_t							GetCompileCount() const;
+	uint64_t							GetCoalescedCount() const;		// requests that found their compile already queued
+	uint64_t							GetFallbackCount() const;
+	uint32_t							GetPendingCount() const;
+	uint32_t							GetFailedCount() const;
+
+private:
+	struct Entry
+	{
+		PipelineDescription					description;
+		std::atomic<VkPipeline>				pipeline;
+		std::atomic<VkResult>				result;
+		JobHandle							job;
+		uint64_t							request_index			= 0;
+	};
+
+	struct KeyHash
+	{
+		size_t								operator()( const std::vector<uint32_t> & key ) const;
+	};
+
+	Entry							*	_Request( const PipelineDescription & description );
+	void								_Compile( Entry * entry );
+
+	Renderer						*	_renderer						= nullptr;
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	mutable std::mutex					_mutex;
+	std::unordered_map<std::vector<uint32_t>, Entry*, KeyHash>	_entries;
+
+	std::atomic<uint64_t>				_compile_count;
+	std::atomic<uint64_t>				_coalesced_count;
+	std::atomic<uint64_t>				_fallback_count;
+	std::atomic<uint32_t>				_pending_count;
+	std::atomic<uint32_t>				_failed_count;
+};
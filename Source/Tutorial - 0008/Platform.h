@@ -1,5 +1,7 @@
 #pragma once
 
+#include "BUILD_OPTIONS.h"
+
 // Contact me if you're interested about adding platform
 // support in these tutorials, contact me on my youtube channel:
 // https://www.youtube.com/user/Nigo40
@@ -24,6 +26,9 @@
 #define VK_USE_PLATFORM_XCB_KHR 1
 #define PLATFORM_SURFACE_EXTENSION_NAME VK_KHR_XCB_SURFACE_EXTENSION_NAME
 #include <xcb/xcb.h>
+#if BUILD_ENABLE_XCB_SHM_PRESENT
+#include <xcb/shm.h>
+#endif
 
 #else
 // platform not yet supported
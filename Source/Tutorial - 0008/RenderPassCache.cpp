@@ -0,0 +1,242 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "RenderPassCache.h"
+#include "DeletionQueue.h"
+#include "Renderer.h"
+#include "Shared.h"
+
+#include <algorithm>
+
+static void AppendAttachmentKey( std::vector<uint32_t> & key, const RenderPassAttachment & attachment )
+{
+	key.push_back( uint32_t( attachment.format ) );
+	key.push_back( uint32_t( attachment.samples ) );
+	key.push_back( uint32_t( attachment.load_op ) );
+	key.push_back( uint32_t( attachment.store_op ) );
+	key.push_back( uint32_t( attachment.stencil_load_op ) );
+	key.push_back( uint32_t( attachment.stencil_store_op ) );
+	key.push_back( uint32_t( attachment.initial_layout ) );
+	key.push_back( uint32_t( attachment.final_layout ) );
+}
+
+static VkAttachmentDescription MakeAttachmentDescription( const RenderPassAttachment & attachment, VkImageLayout attachment_layout )
+{
+	VkAttachmentDescription description {};
+	description.format				= attachment.format;
+	description.samples				= attachment.samples;
+	description.loadOp				= attachment.load_op;
+	description.storeOp				= attachment.store_op;
+	description.stencilLoadOp		= attachment.stencil_load_op;
+	description.stencilStoreOp		= attachment.stencil_store_op;
+	description.initialLayout		= attachment.initial_layout;
+	description.finalLayout			= attachment.final_layout != VK_IMAGE_LAYOUT_UNDEFINED ? attachment.final_layout : attachment_layout;
+	return description;
+}
+
+RenderPassCache::RenderPassCache( Renderer * renderer )
+{
+	_device			= renderer->GetVulkanDevice();
+}
+
+RenderPassCache::~RenderPassCache()
+{
+	// The owner makes sure the gpu is done with every render pass.
+	for( auto & render_pass : _render_passes ) {
+		vkDestroyRenderPass( _device, render_pass.second, nullptr );
+	}
+	_render_passes.clear();
+	_signatures.clear();
+}
+
+VkRenderPass RenderPassCache::GetRenderPass( const RenderPassSignature & signature )
+{
+	std::vector<uint32_t> key;
+	key.reserve( ( signature.color_attachments.size() + 1 ) * 8 + 2 );
+	key.push_back( uint32_t( signature.color_attachments.size() ) );
+	for( auto & attachment : signature.color_attachments ) {
+		AppendAttachmentKey( key, attachment );
+	}
+	key.push_back( signature.has_depth_attachment ? 1 : 0 );
+	if( signature.has_depth_attachment ) {
+		AppendAttachmentKey( key, signature.depth_attachment );
+	}
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	auto existing = _render_passes.find( key );
+	if( existing != _render_passes.end() ) {
+		return existing->second;
+	}
+
+	std::vector<VkAttachmentDescription> attachments;
+	std::vector<VkAttachmentReference> color_references;
+	for( auto & attachment : signature.color_attachments ) {
+		color_references.push_back( { uint32_t( attachments.size() ), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL } );
+		attachments.push_back( MakeAttachmentDescription( attachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL ) );
+	}
+	VkAttachmentReference depth_reference { uint32_t( attachments.size() ), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+	if( signature.has_depth_attachment ) {
+		attachments.push_back( MakeAttachmentDescription( signature.depth_attachment, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL ) );
+	}
+
+	VkSubpassDescription subpass {};
+	subpass.pipelineBindPoint			= VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount		= uint32_t( color_references.size() );
+	subpass.pColorAttachments			= color_references.data();
+	subpass.pDepthStencilAttachment		= signature.has_depth_attachment ? &depth_reference : nullptr;
+
+	// Attachment writes of the previous frame, or the presentation engine reading the
+	// image, have to finish before the layout transition and the writes of this pass.
+	VkSubpassDependency dependency {};
+	dependency.srcSubpass				= VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass				= 0;
+	dependency.srcStageMask				= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.dstStageMask				= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask			= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dstAccessMask			= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+										  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo render_pass_create_info {};
+	render_pass_create_info.sType				= VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	render_pass_create_info.attachmentCount		= uint32_t( attachments.size() );
+	render_pass_create_info.pAttachments		= attachments.data();
+	render_pass_create_info.subpassCount		= 1;
+	render_pass_create_info.pSubpasses			= &subpass;
+	render_pass_create_info.dependencyCount		= 1;
+	render_pass_create_info.pDependencies		= &dependency;
+
+	VkRenderPass render_pass = VK_NULL_HANDLE;
+	ErrorCheck( vkCreateRenderPass( _device, &render_pass_create_info, nullptr, &render_pass ) );
+	_render_passes[ key ] = render_pass;
+	_signatures.push_back( std::make_pair( render_pass, signature ) );
+	return render_pass;
+}
+
+bool RenderPassCache::FindSignature( VkRenderPass render_pass, RenderPassSignature * signature ) const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	for( auto & entry : _signatures ) {
+		if( entry.first == render_pass ) {
+			*signature = entry.second;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t RenderPassCache::GetRenderPassCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return uint32_t( _render_passes.size() );
+}
+
+FramebufferCache::FramebufferCache( Renderer * renderer )
+{
+	_renderer		= renderer;
+	_device			= renderer->GetVulkanDevice();
+
+	renderer->GetDeletionQueue()->AddDestroyListener( [ this ]( uint64_t handle ) {
+		Evict( handle );
+	} );
+}
+
+FramebufferCache::~FramebufferCache()
+{
+	// The owner makes sure the gpu is done with every framebuffer.
+	for( auto & framebuffer : _framebuffers ) {
+		vkDestroyFramebuffer( _device, framebuffer.second, nullptr );
+	}
+	_framebuffers.clear();
+	_users.clear();
+}
+
+VkFramebuffer FramebufferCache::GetFramebuffer( VkRenderPass render_pass, const std::vector<VkImageView> & attachments, VkExtent2D extent, uint32_t layers )
+{
+	// Render pass, views, width, height and layers.
+	std::vector<uint64_t> key;
+	key.reserve( attachments.size() + 4 );
+	key.push_back( (uint64_t)render_pass );
+	for( auto view : attachments ) {
+		key.push_back( (uint64_t)view );
+	}
+	key.push_back( extent.width );
+	key.push_back( extent.height );
+	key.push_back( layers );
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	auto existing = _framebuffers.find( key );
+	if( existing != _framebuffers.end() ) {
+		return existing->second;
+	}
+
+	VkFramebufferCreateInfo framebuffer_create_info {};
+	framebuffer_create_info.sType				= VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebuffer_create_info.renderPass			= render_pass;
+	framebuffer_create_info.attachmentCount		= uint32_t( attachments.size() );
+	framebuffer_create_info.pAttachments		= attachments.data();
+	framebuffer_create_info.width				= extent.width;
+	framebuffer_create_info.height				= extent.height;
+	framebuffer_create_info.layers				= layers;
+
+	VkFramebuffer framebuffer = VK_NULL_HANDLE;
+	ErrorCheck( vkCreateFramebuffer( _device, &framebuffer_create_info, nullptr, &framebuffer ) );
+	++_create_count;
+
+	_framebuffers[ key ] = framebuffer;
+	for( size_t i=0; i < attachments.size() + 1; ++i ) {
+		auto & keys = _users[ key[ i ] ];
+		// The same view can be attached twice, the framebuffer is listed once.
+		if( keys.empty() || keys.back() != key ) {
+			keys.push_back( key );
+		}
+	}
+	return framebuffer;
+}
+
+void FramebufferCache::Evict( uint64_t handle )
+{
+	std::vector<VkFramebuffer> evicted;
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		auto users = _users.find( handle );
+		if( users == _users.end() ) return;
+
+		auto keys = std::move( users->second );
+		_users.erase( users );
+		for( auto & key : keys ) {
+			auto framebuffer = _framebuffers.find( key );
+			if( framebuffer == _framebuffers.end() ) continue;
+			evicted.push_back( framebuffer->second );
+			_framebuffers.erase( framebuffer );
+
+			// The other handles of the framebuffer stop referring to it.
+			for( size_t i=0; i < key.size() - 3; ++i ) {
+				auto other = _users.find( key[ i ] );
+				if( other == _users.end() ) continue;
+				auto & other_keys = other->second;
+				other_keys.erase( std::remove( other_keys.begin(), other_keys.end(), key ), other_keys.end() );
+				if( other_keys.empty() ) {
+					_users.erase( other );
+				}
+			}
+		}
+	}
+
+	// Outside the lock, the deletion queue calls back into Evict() with the framebuffer,
+	// command buffers recorded with it are dropped by their cache the same way.
+	for( auto framebuffer : evicted ) {
+		_renderer->GetDeletionQueue()->DestroyFramebuffer( framebuffer );
+	}
+}
+
+uint32_t FramebufferCache::GetFramebufferCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return uint32_t( _framebuffers.size() );
+}
+
+uint64_t FramebufferCache::GetCreateCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return _create_count;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+
+class Renderer;
+
+struct RenderPassAttachment
+{
+	VkFormat							format					= VK_FORMAT_UNDEFINED;
+	VkSampleCountFlagBits				samples					= VK_SAMPLE_COUNT_1_BIT;
+	VkAttachmentLoadOp					load_op					= VK_ATTACHMENT_LOAD_OP_CLEAR;
+	VkAttachmentStoreOp					store_op				= VK_ATTACHMENT_STORE_OP_STORE;
+	VkAttachmentLoadOp					stencil_load_op			= VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	VkAttachmentStoreOp					stencil_store_op		= VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	VkImageLayout						initial_layout			= VK_IMAGE_LAYOUT_UNDEFINED;
+	VkImageLayout						final_layout			= VK_IMAGE_LAYOUT_UNDEFINED;	// UNDEFINED picks the attachment layout
+};
+
+// A render pass with a single subpass that writes all color attachments and the depth
+// attachment, if there is one. Its attachments are the color attachments followed by depth.
+struct RenderPassSignature
+{
+	std::vector<RenderPassAttachment>	color_attachments;
+	bool								has_depth_attachment	= false;
+	RenderPassAttachment				depth_attachment;
+};
+
+// Render passes by attachment signature. Equal signatures get the same render pass, they
+// live as long as the cache. Thread safe.
+class RenderPassCache
+{
+public:
+	RenderPassCache( Renderer * renderer );
+	~RenderPassCache();
+
+	VkRenderPass						GetRenderPass( const RenderPassSignature & signature );
+
+	// The signature a render pass was made from, false if the render pass is not from this cache.
+	bool								FindSignature( VkRenderPass render_pass, RenderPassSignature * signature ) const;
+
+	uint32_t							GetRenderPassCount() const;
+
+private:
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	mutable std::mutex					_mutex;
+	std::map<std::vector<uint32_t>, VkRenderPass>	_render_passes;
+	std::vector<std::pair<VkRenderPass, RenderPassSignature>>	_signatures;
+};
+
+// Framebuffers by render pass, attachment views and extent. Handing a view to the renderer's
+// DeletionQueue evicts the framebuffers that use it, for example when the swapchain is
+// recreated, and the framebuffers are destroyed once the frames in flight are done. Thread safe.
+class FramebufferCache
+{
+public:
+	FramebufferCache( Renderer * renderer );
+	~FramebufferCache();
+
+	VkFramebuffer						GetFramebuffer( VkRenderPass render_pass, const std::vector<VkImageView> & attachments, VkExtent2D extent, uint32_t layers = 1 );
+
+	// Framebuffers that use handle, a view or a render pass, are destroyed.
+	void								Evict( uint64_t handle );
+
+	uint32_t							GetFramebufferCount() const;
+	uint64_t							GetCreateCount() const;
+
+private:
+	Renderer						*	_renderer						= nullptr;
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	mutable std::mutex					_mutex;
+	std::map<std::vector<uint64_t>, VkFramebuffer>	_framebuffers;
+	std::unordered_map<uint64_t, std::vector<std::vector<uint64_t>>>	_users;		// handle to the keys of the framebuffers that use it
+	uint64_t							_create_count					= 0;
+};
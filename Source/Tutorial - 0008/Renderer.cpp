@@ -5,25 +5,78 @@
 #include "Renderer.h"
 #include "Shared.h"
 #include "Window.h"
+#include "CommandPoolManager.h"
+#include "JobSystem.h"
+#include "SyncObjectPools.h"
+#include "FenceCompletionService.h"
+#include "SubmitBatcher.h"
+#include "DeletionQueue.h"
+#include "SubmissionThread.h"
+#include "CommandBufferCache.h"
+#include "PipelineLayoutCache.h"
+#include "ShaderModuleCache.h"
+#include "PipelineService.h"
+#include "RenderPassCache.h"
+#include "ShaderHotReload.h"
 
 #include <cstdlib>
 #include <assert.h>
 #include <vector>
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <iterator>
+#include <cstring>
 
-Renderer::Renderer()
+Renderer::Renderer( uint32_t physical_device_index )
 {
 	_SetupLayersAndExtensions();
 	_SetupDebug();
 	_InitInstance();
 	_InitDebug();
-	_InitDevice();
+	_InitDevice( physical_device_index );
+
+	_command_pool_manager		= new CommandPoolManager( _device, _graphics_family_index );
+	_job_system					= new JobSystem();
+	_fence_pool					= new FencePool( _device );
+	_semaphore_pool				= new SemaphorePool( _device );
+	_fence_completion_service	= new FenceCompletionService( _device, _fence_pool );
+	_deletion_queue				= new DeletionQueue( _device );
+	_command_buffer_cache		= new CommandBufferCache( this );
+	_pipeline_layout_cache		= new PipelineLayoutCache( this );
+	_shader_module_cache		= new ShaderModuleCache( _device );
+	_pipeline_service			= new PipelineService( this );
+	_render_pass_cache			= new RenderPassCache( this );
+	_framebuffer_cache			= new FramebufferCache( this );
+	_shader_hot_reload			= new ShaderHotReload( this );
+	_submission_thread			= new SubmissionThread( this );
+	_submit_batcher				= new SubmitBatcher( this );
 }
 
 Renderer::~Renderer()
 {
 	delete _window;
+	// Waits for pipelines still compiling on the job system.
+	delete _pipeline_service;
+	// Waits for shader and pipeline rebuilds, hands its objects to the deletion queue.
+	delete _shader_hot_reload;
+	delete _submit_batcher;
+	delete _submission_thread;
+	// Nothing is submitted past this point, the fence completion service only has to look
+	// at fences that have already signaled.
+	vkQueueWaitIdle( _queue );
+	// Runs the deferred frees of the command buffer cache, the cache goes after it.
+	delete _deletion_queue;
+	delete _command_buffer_cache;
+	delete _pipeline_layout_cache;
+	delete _shader_module_cache;
+	delete _framebuffer_cache;
+	delete _render_pass_cache;
+	delete _fence_completion_service;
+	delete _job_system;
+	delete _semaphore_pool;
+	delete _fence_pool;
+	delete _command_pool_manager;
 
 	_DeInitDevice();
 	_DeInitDebug();
@@ -38,12 +91,63 @@ Window * Renderer::OpenWindow( uint32_t size_x, uint32_t size_y, std::string nam
 
 bool Renderer::Run()
 {
+	auto now = std::chrono::steady_clock::now();
+	if( _fixed_timestep > 0.0 ) {
+		_frame_delta_time		= _fixed_timestep;
+	} else {
+		_frame_delta_time		= _run_count > 0 ? std::chrono::duration<double>( now - _last_run_time ).count() : 0.0;
+	}
+	_last_run_time				= now;
+	_simulation_time			+= _frame_delta_time;
+	++_run_count;
+
+	// Nothing of the next frame is recorded yet, pipelines rebuilt from changed shaders go in now.
+	_shader_hot_reload->Update();
+
 	if( nullptr != _window ) {
 		return _window->Update();
 	}
 	return true;
 }
 
+void Renderer::SetFixedTimestep( double seconds )
+{
+	_fixed_timestep				= seconds;
+}
+
+double Renderer::GetFrameDeltaTime() const
+{
+	return _frame_delta_time;
+}
+
+double Renderer::GetSimulationTime() const
+{
+	return _simulation_time;
+}
+
+void Renderer::SetLowLatencyMode( bool enable, uint32_t max_frames_in_flight )
+{
+	assert( max_frames_in_flight > 0 );
+	_low_latency_mode					= enable;
+	_low_latency_max_frames_in_flight	= max_frames_in_flight;
+}
+
+bool Renderer::IsLowLatencyModeEnabled() const
+{
+	return _low_latency_mode;
+}
+
+void Renderer::SetMaxFramesInFlight( uint32_t max_frames_in_flight )
+{
+	assert( max_frames_in_flight > 0 );
+	_max_frames_in_flight				= max_frames_in_flight;
+}
+
+uint32_t Renderer::GetMaxFramesInFlight() const
+{
+	return _low_latency_mode ? _low_latency_max_frames_in_flight : _max_frames_in_flight;
+}
+
 const VkInstance Renderer::GetVulkanInstance() const
 {
 	return _instance;
@@ -69,11 +173,138 @@ const uint32_t Renderer::GetVulkanGraphicsQueueFamilyIndex() const
 	return _graphics_family_index;
 }
 
+const VkPipelineCache Renderer::GetVulkanPipelineCache() const
+{
+	return _pipeline_cache;
+}
+
+bool Renderer::LoadPipelineCache( const std::string & file_path )
+{
+	std::ifstream file( file_path, std::ios::binary );
+	if( !file ) return false;
+	std::vector<char> data( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+
+	// Header version one: length, version, vendor id, device id and the cache UUID.
+	uint32_t header[ 4 ] {};
+	if( data.size() < sizeof( header ) + VK_UUID_SIZE ) return false;
+	std::memcpy( header, data.data(), sizeof( header ) );
+	if( header[ 1 ] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+		header[ 2 ] != _gpu_properties.vendorID ||
+		header[ 3 ] != _gpu_properties.deviceID ||
+		std::memcmp( data.data() + sizeof( header ), _gpu_properties.pipelineCacheUUID, VK_UUID_SIZE ) != 0 ) {
+		return false;
+	}
+
+	VkPipelineCacheCreateInfo pipeline_cache_create_info {};
+	pipeline_cache_create_info.sType			= VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipeline_cache_create_info.initialDataSize	= data.size();
+	pipeline_cache_create_info.pInitialData		= data.data();
+	VkPipelineCache loaded_cache				= VK_NULL_HANDLE;
+	if( vkCreatePipelineCache( _device, &pipeline_cache_create_info, nullptr, &loaded_cache ) != VK_SUCCESS ) return false;
+	// Merging keeps whatever pipelines were already created into the renderer's cache.
+	auto result = vkMergePipelineCaches( _device, _pipeline_cache, 1, &loaded_cache );
+	vkDestroyPipelineCache( _device, loaded_cache, nullptr );
+	return result == VK_SUCCESS;
+}
+
+bool Renderer::SavePipelineCache( const std::string & file_path ) const
+{
+	size_t size = 0;
+	ErrorCheck( vkGetPipelineCacheData( _device, _pipeline_cache, &size, nullptr ) );
+	std::vector<char> data( size );
+	ErrorCheck( vkGetPipelineCacheData( _device, _pipeline_cache, &size, data.data() ) );
+
+	std::ofstream file( file_path, std::ios::binary );
+	if( !file ) return false;
+	file.write( data.data(), size );
+	return !!file;
+}
+
+CommandPoolManager * Renderer::GetCommandPoolManager() const
+{
+	return _command_pool_manager;
+}
+
+JobSystem * Renderer::GetJobSystem() const
+{
+	return _job_system;
+}
+
+FencePool * Renderer::GetFencePool() const
+{
+	return _fence_pool;
+}
+
+SemaphorePool * Renderer::GetSemaphorePool() const
+{
+	return _semaphore_pool;
+}
+
+FenceCompletionService * Renderer::GetFenceCompletionService() const
+{
+	return _fence_completion_service;
+}
+
+SubmitBatcher * Renderer::GetSubmitBatcher() const
+{
+	return _submit_batcher;
+}
+
+DeletionQueue * Renderer::GetDeletionQueue() const
+{
+	return _deletion_queue;
+}
+
+SubmissionThread * Renderer::GetSubmissionThread() const
+{
+	return _submission_thread;
+}
+
+CommandBufferCache * Renderer::GetCommandBufferCache() const
+{
+	return _command_buffer_cache;
+}
+
+PipelineLayoutCache * Renderer::GetPipelineLayoutCache() const
+{
+	return _pipeline_layout_cache;
+}
+
+ShaderModuleCache * Renderer::GetShaderModuleCache() const
+{
+	return _shader_module_cache;
+}
+
+PipelineService * Renderer::GetPipelineService() const
+{
+	return _pipeline_service;
+}
+
+RenderPassCache * Renderer::GetRenderPassCache() const
+{
+	return _render_pass_cache;
+}
+
+FramebufferCache * Renderer::GetFramebufferCache() const
+{
+	return _framebuffer_cache;
+}
+
+ShaderHotReload * Renderer::GetShaderHotReload() const
+{
+	return _shader_hot_reload;
+}
+
 const VkPhysicalDeviceProperties & Renderer::GetVulkanPhysicalDeviceProperties() const
 {
 	return _gpu_properties;
 }
 
+const VkPhysicalDeviceMemoryProperties & Renderer::GetVulkanPhysicalDeviceMemoryProperties() const
+{
+	return _gpu_memory_properties;
+}
+
 void Renderer::_SetupLayersAndExtensions()
 {
 	_instance_extensions.push_back( VK_KHR_SURFACE_EXTENSION_NAME );
@@ -108,15 +339,20 @@ void Renderer::_DeInitInstance()
 	_instance = nullptr;
 }
 
-void Renderer::_InitDevice()
+void Renderer::_InitDevice( uint32_t physical_device_index )
 {
 	{
 		uint32_t gpu_count = 0;
 		vkEnumeratePhysicalDevices( _instance, &gpu_count, nullptr );
 		std::vector<VkPhysicalDevice> gpu_list( gpu_count );
 		vkEnumeratePhysicalDevices( _instance, &gpu_count, gpu_list.data() );
-		_gpu = gpu_list[ 0 ];
+		if( physical_device_index >= gpu_count ) {
+			assert( 0 && "Vulkan ERROR: Physical device index out of range." );
+			std::exit( -1 );
+		}
+		_gpu = gpu_list[ physical_device_index ];
 		vkGetPhysicalDeviceProperties( _gpu, &_gpu_properties );
+		vkGetPhysicalDeviceMemoryProperties( _gpu, &_gpu_memory_properties );
 	}
 	{
 		uint32_t family_count = 0;
@@ -156,10 +392,16 @@ void Renderer::_InitDevice()
 	ErrorCheck( vkCreateDevice( _gpu, &device_create_info, nullptr, &_device ) );
 
 	vkGetDeviceQueue( _device, _graphics_family_index, 0, &_queue );
+
+	VkPipelineCacheCreateInfo pipeline_cache_create_info {};
+	pipeline_cache_create_info.sType			= VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	ErrorCheck( vkCreatePipelineCache( _device, &pipeline_cache_create_info, nullptr, &_pipeline_cache ) );
 }
 
 void Renderer::_DeInitDevice()
 {
+	vkDestroyPipelineCache( _device, _pipeline_cache, nullptr );
+	_pipeline_cache = VK_NULL_HANDLE;
 	vkDestroyDevice( _device, nullptr );
 	_device = nullptr;
 }
@@ -4,25 +4,77 @@
 
 #include <vector>
 #include <string>
+#include <chrono>
 
 class Window;
+class CommandPoolManager;
+class JobSystem;
+class FencePool;
+class SemaphorePool;
+class FenceCompletionService;
+class SubmitBatcher;
+class DeletionQueue;
+class SubmissionThread;
+class CommandBufferCache;
+class PipelineLayoutCache;
+class ShaderModuleCache;
+class PipelineService;
+class RenderPassCache;
+class FramebufferCache;
+class ShaderHotReload;
 
 class Renderer
 {
 public:
-	Renderer();
+	// Runs on the physical device with this index in vkEnumeratePhysicalDevices() order.
+	Renderer( uint32_t physical_device_index = 0 );
 	~Renderer();
 
 	Window								*	OpenWindow( uint32_t size_x, uint32_t size_y, std::string name );
 
 	bool									Run();
 
+	// With a fixed timestep every Run() advances the simulation time by the same amount
+	// instead of the measured wall clock time, zero goes back to real time.
+	void									SetFixedTimestep( double seconds );
+	double									GetFrameDeltaTime() const;
+	double									GetSimulationTime() const;
+
+	// Low latency mode limits the frames in flight to a smaller maximum and makes the
+	// window wait for the oldest frame to finish before input is sampled for the next one.
+	void									SetLowLatencyMode( bool enable, uint32_t max_frames_in_flight = 1 );
+	bool									IsLowLatencyModeEnabled() const;
+	void									SetMaxFramesInFlight( uint32_t max_frames_in_flight );
+	uint32_t								GetMaxFramesInFlight() const;
+
 	const VkInstance						GetVulkanInstance()	const;
 	const VkPhysicalDevice					GetVulkanPhysicalDevice() const;
 	const VkDevice							GetVulkanDevice() const;
 	const VkQueue							GetVulkanQueue() const;
 	const uint32_t							GetVulkanGraphicsQueueFamilyIndex() const;
+	// Shared by every pipeline the renderer creates.
+	const VkPipelineCache					GetVulkanPipelineCache() const;
+	// Merges a saved pipeline cache into the renderer's. False if the file can not be read
+	// or was saved on another device or driver, the driver would ignore it then anyway.
+	bool									LoadPipelineCache( const std::string & file_path );
+	bool									SavePipelineCache( const std::string & file_path ) const;
+	CommandPoolManager					*	GetCommandPoolManager() const;
+	JobSystem							*	GetJobSystem() const;
+	FencePool							*	GetFencePool() const;
+	SemaphorePool						*	GetSemaphorePool() const;
+	FenceCompletionService				*	GetFenceCompletionService() const;
+	SubmitBatcher						*	GetSubmitBatcher() const;
+	DeletionQueue						*	GetDeletionQueue() const;
+	SubmissionThread					*	GetSubmissionThread() const;
+	CommandBufferCache					*	GetCommandBufferCache() const;
+	PipelineLayoutCache					*	GetPipelineLayoutCache() const;
+	ShaderModuleCache					*	GetShaderModuleCache() const;
+	PipelineService						*	GetPipelineService() const;
+	RenderPassCache						*	GetRenderPassCache() const;
+	FramebufferCache					*	GetFramebufferCache() const;
+	ShaderHotReload						*	GetShaderHotReload() const;
 	const VkPhysicalDeviceProperties	&	GetVulkanPhysicalDeviceProperties() const;
+	const VkPhysicalDeviceMemoryProperties	&	GetVulkanPhysicalDeviceMemoryProperties() const;
 
 private:
 	void _SetupLayersAndExtensions();
@@ -30,7 +82,7 @@ private:
 	void _InitInstance();
 	void _DeInitInstance();
 
-	void _InitDevice();
+	void _InitDevice( uint32_t physical_device_index );
 	void _DeInitDevice();
 
 	void _SetupDebug();
@@ -41,11 +93,38 @@ private:
 	VkPhysicalDevice						_gpu							= VK_NULL_HANDLE;
 	VkDevice								_device							= VK_NULL_HANDLE;
 	VkQueue									_queue							= VK_NULL_HANDLE;
+	VkPipelineCache							_pipeline_cache					= VK_NULL_HANDLE;
 	VkPhysicalDeviceProperties				_gpu_properties					= {};
+	VkPhysicalDeviceMemoryProperties		_gpu_memory_properties			= {};
 
 	uint32_t								_graphics_family_index			= 0;
 
 	Window								*	_window							= nullptr;
+	CommandPoolManager					*	_command_pool_manager			= nullptr;
+	JobSystem							*	_job_system						= nullptr;
+	FencePool							*	_fence_pool						= nullptr;
+	SemaphorePool						*	_semaphore_pool					= nullptr;
+	FenceCompletionService				*	_fence_completion_service		= nullptr;
+	SubmitBatcher						*	_submit_batcher					= nullptr;
+	DeletionQueue						*	_deletion_queue					= nullptr;
+	SubmissionThread					*	_submission_thread				= nullptr;
+	CommandBufferCache					*	_command_buffer_cache			= nullptr;
+	PipelineLayoutCache					*	_pipeline_layout_cache			= nullptr;
+	ShaderModuleCache					*	_shader_module_cache			= nullptr;
+	PipelineService						*	_pipeline_service				= nullptr;
+	RenderPassCache						*	_render_pass_cache				= nullptr;
+	FramebufferCache					*	_framebuffer_cache				= nullptr;
+	ShaderHotReload						*	_shader_hot_reload				= nullptr;
+
+	double									_fixed_timestep					= 0.0;
+	double									_frame_delta_time				= 0.0;
+	double									_simulation_time				= 0.0;
+	uint64_t								_run_count						= 0;
+	std::chrono::steady_clock::time_point	_last_run_time;
+
+	bool									_low_latency_mode				= false;
+	uint32_t								_max_frames_in_flight			= 2;
+	uint32_t								_low_latency_max_frames_in_flight	= 1;
 
 	std::vector<const char*>				_instance_layers;
 	std::vector<const char*>				_instance_extensions;
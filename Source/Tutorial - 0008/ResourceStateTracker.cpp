@@ -0,0 +1,340 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "ResourceStateTracker.h"
+
+#include <assert.h>
+#include <algorithm>
+
+static const VkAccessFlags resource_state_tracker_write_access =
+	VK_ACCESS_SHADER_WRITE_BIT |
+	VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_TRANSFER_WRITE_BIT |
+	VK_ACCESS_HOST_WRITE_BIT |
+	VK_ACCESS_MEMORY_WRITE_BIT;
+
+void ResourceStateTracker::RegisterImage( VkImage image, VkImageAspectFlags aspect, uint32_t mip_levels, uint32_t array_layers,
+	VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access )
+{
+	AccessState initial;
+	initial.layout			= layout;
+	initial.write_stages	= stage;
+	initial.write_access	= access & resource_state_tracker_write_access;
+
+	auto & image_state			= _images[ image ];
+	image_state.aspect			= aspect;
+	image_state.mip_levels		= mip_levels;
+	image_state.array_layers	= array_layers;
+	image_state.pending			= false;
+	image_state.subresources.assign( size_t( mip_levels ) * array_layers, initial );
+}
+
+void ResourceStateTracker::RegisterBuffer( VkBuffer buffer, VkDeviceSize size, VkPipelineStageFlags stage, VkAccessFlags access )
+{
+	BufferRange range;
+	range.offset				= 0;
+	range.size					= size;
+	range.state.write_stages	= stage;
+	range.state.write_access	= access & resource_state_tracker_write_access;
+
+	auto & buffer_state			= _buffers[ buffer ];
+	buffer_state.pending		= false;
+	buffer_state.ranges.assign( 1, range );
+}
+
+void ResourceStateTracker::ForgetImage( VkImage image )
+{
+	_images.erase( image );
+}
+
+void ResourceStateTracker::ForgetBuffer( VkBuffer buffer )
+{
+	_buffers.erase( buffer );
+}
+
+void ResourceStateTracker::UseImage( VkImage image, const VkImageSubresourceRange & range, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access )
+{
+	auto found = _images.find( image );
+	if( found == _images.end() ) {
+		assert( 0 && "Resource state tracker: image is not registered." );
+		return;
+	}
+	auto & image_state = found->second;
+	++_use_count;
+
+	uint32_t level_count = range.levelCount == VK_REMAINING_MIP_LEVELS ? image_state.mip_levels - range.baseMipLevel : range.levelCount;
+	uint32_t layer_count = range.layerCount == VK_REMAINING_ARRAY_LAYERS ? image_state.array_layers - range.baseArrayLayer : range.layerCount;
+	for( uint32_t mip=range.baseMipLevel; mip < range.baseMipLevel + level_count; ++mip ) {
+		for( uint32_t layer=range.baseArrayLayer; layer < range.baseArrayLayer + layer_count; ++layer ) {
+			if( _Use( image_state.subresources[ size_t( mip ) * image_state.array_layers + layer ], layout, stage, access ) ) {
+				image_state.pending = true;
+			}
+		}
+	}
+}
+
+void ResourceStateTracker::UseImage( VkImage image, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access )
+{
+	VkImageSubresourceRange range {};
+	range.levelCount	= VK_REMAINING_MIP_LEVELS;
+	range.layerCount	= VK_REMAINING_ARRAY_LAYERS;
+	UseImage( image, range, layout, stage, access );
+}
+
+void ResourceStateTracker::UseBuffer( VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkPipelineStageFlags stage, VkAccessFlags access )
+{
+	auto found = _buffers.find( buffer );
+	if( found == _buffers.end() ) {
+		assert( 0 && "Resource state tracker: buffer is not registered." );
+		return;
+	}
+	auto & buffer_state = found->second;
+	++_use_count;
+
+	auto buffer_size = buffer_state.ranges.back().offset + buffer_state.ranges.back().size;
+	if( size == VK_WHOLE_SIZE ) {
+		size = buffer_size - offset;
+	}
+	// Ranges are split at the edges of the use, so every range is either fully inside or outside of it.
+	_SplitBufferRange( buffer_state, offset );
+	_SplitBufferRange( buffer_state, offset + size );
+	for( auto & buffer_range : buffer_state.ranges ) {
+		if( buffer_range.offset < offset || buffer_range.offset >= offset + size ) continue;
+		if( _Use( buffer_range.state, VK_IMAGE_LAYOUT_UNDEFINED, stage, access ) ) {
+			buffer_state.pending = true;
+		}
+	}
+}
+
+VkImageLayout ResourceStateTracker::GetImageLayout( VkImage image, uint32_t mip_level, uint32_t array_layer ) const
+{
+	auto found = _images.find( image );
+	if( found == _images.end() ) return VK_IMAGE_LAYOUT_UNDEFINED;
+	return found->second.subresources[ size_t( mip_level ) * found->second.array_layers + array_layer ].layout;
+}
+
+void ResourceStateTracker::Flush( VkCommandBuffer command_buffer )
+{
+	if( _pending_dst_stages == 0 ) return;
+
+	for( auto & image : _images ) {
+		auto & image_state = image.second;
+		if( !image_state.pending ) continue;
+		image_state.pending = false;
+
+		size_t first_barrier = _image_barriers.size();
+		for( uint32_t mip=0; mip < image_state.mip_levels; ++mip ) {
+			for( uint32_t layer=0; layer < image_state.array_layers; ++layer ) {
+				auto & state = image_state.subresources[ size_t( mip ) * image_state.array_layers + layer ];
+				if( !state.pending ) continue;
+				state.pending = false;
+				if( !state.pending_memory ) continue;
+
+				// Neighbouring layers, and then neighbouring mip levels with the same layers, share one barrier.
+				if( _image_barriers.size() > first_barrier ) {
+					auto & previous = _image_barriers.back();
+					if( previous.oldLayout == state.pending_old_layout && previous.newLayout == state.layout &&
+						previous.srcAccessMask == state.pending_src_access && previous.dstAccessMask == state.pending_dst_access ) {
+						auto & previous_range = previous.subresourceRange;
+						if( previous_range.baseMipLevel == mip && previous_range.levelCount == 1 &&
+							previous_range.baseArrayLayer + previous_range.layerCount == layer ) {
+							++previous_range.layerCount;
+							continue;
+						}
+					}
+				}
+				VkImageMemoryBarrier barrier {};
+				barrier.sType							= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.srcAccessMask					= state.pending_src_access;
+				barrier.dstAccessMask					= state.pending_dst_access;
+				barrier.oldLayout						= state.pending_old_layout;
+				barrier.newLayout						= state.layout;
+				barrier.srcQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex				= VK_QUEUE_FAMILY_IGNORED;
+				barrier.image							= image.first;
+				barrier.subresourceRange.aspectMask		= image_state.aspect;
+				barrier.subresourceRange.baseMipLevel	= mip;
+				barrier.subresourceRange.levelCount		= 1;
+				barrier.subresourceRange.baseArrayLayer	= layer;
+				barrier.subresourceRange.layerCount		= 1;
+				_image_barriers.push_back( barrier );
+			}
+		}
+
+		// Merge the per mip barriers of identical layer ranges.
+		size_t merged = first_barrier;
+		for( size_t i=first_barrier; i < _image_barriers.size(); ++i ) {
+			if( i > first_barrier ) {
+				auto & previous			= _image_barriers[ merged - 1 ];
+				auto & current			= _image_barriers[ i ];
+				auto & previous_range	= previous.subresourceRange;
+				auto & current_range	= current.subresourceRange;
+				if( previous.oldLayout == current.oldLayout && previous.newLayout == current.newLayout &&
+					previous.srcAccessMask == current.srcAccessMask && previous.dstAccessMask == current.dstAccessMask &&
+					previous_range.baseArrayLayer == current_range.baseArrayLayer && previous_range.layerCount == current_range.layerCount &&
+					previous_range.baseMipLevel + previous_range.levelCount == current_range.baseMipLevel ) {
+					previous_range.levelCount += current_range.levelCount;
+					continue;
+				}
+			}
+			_image_barriers[ merged++ ] = _image_barriers[ i ];
+		}
+		_image_barriers.resize( merged );
+	}
+
+	for( auto & buffer : _buffers ) {
+		auto & buffer_state = buffer.second;
+		if( !buffer_state.pending ) continue;
+		buffer_state.pending = false;
+
+		size_t first_barrier = _buffer_barriers.size();
+		for( auto & buffer_range : buffer_state.ranges ) {
+			auto & state = buffer_range.state;
+			if( !state.pending ) continue;
+			state.pending = false;
+			if( !state.pending_memory ) continue;
+
+			if( _buffer_barriers.size() > first_barrier ) {
+				auto & previous = _buffer_barriers.back();
+				if( previous.srcAccessMask == state.pending_src_access && previous.dstAccessMask == state.pending_dst_access &&
+					previous.offset + previous.size == buffer_range.offset ) {
+					previous.size += buffer_range.size;
+					continue;
+				}
+			}
+			VkBufferMemoryBarrier barrier {};
+			barrier.sType					= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask			= state.pending_src_access;
+			barrier.dstAccessMask			= state.pending_dst_access;
+			barrier.srcQueueFamilyIndex		= VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex		= VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer					= buffer.first;
+			barrier.offset					= buffer_range.offset;
+			barrier.size					= buffer_range.size;
+			_buffer_barriers.push_back( barrier );
+		}
+
+		// Join neighbouring ranges that ended up in the same state again, keeps the range list short.
+		size_t merged = 0;
+		for( size_t i=1; i < buffer_state.ranges.size(); ++i ) {
+			auto & previous		= buffer_state.ranges[ merged ].state;
+			auto & current		= buffer_state.ranges[ i ].state;
+			if( previous.write_stages == current.write_stages && previous.write_access == current.write_access &&
+				previous.read_stages == current.read_stages &&
+				previous.visible_stages == current.visible_stages && previous.visible_access == current.visible_access ) {
+				buffer_state.ranges[ merged ].size += buffer_state.ranges[ i ].size;
+				continue;
+			}
+			buffer_state.ranges[ ++merged ] = buffer_state.ranges[ i ];
+		}
+		buffer_state.ranges.resize( merged + 1 );
+	}
+
+	vkCmdPipelineBarrier( command_buffer,
+		_pending_src_stages ? _pending_src_stages : VkPipelineStageFlags( VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT ),
+		_pending_dst_stages,
+		0,
+		0, nullptr,
+		uint32_t( _buffer_barriers.size() ), _buffer_barriers.data(),
+		uint32_t( _image_barriers.size() ), _image_barriers.data() );
+
+	_barrier_count			+= _buffer_barriers.size() + _image_barriers.size();
+	++_pipeline_barrier_count;
+
+	_image_barriers.clear();
+	_buffer_barriers.clear();
+	_pending_src_stages		= 0;
+	_pending_dst_stages		= 0;
+}
+
+uint64_t ResourceStateTracker::GetUseCount() const
+{
+	return _use_count;
+}
+
+uint64_t ResourceStateTracker::GetBarrierCount() const
+{
+	return _barrier_count;
+}
+
+uint64_t ResourceStateTracker::GetPipelineBarrierCount() const
+{
+	return _pipeline_barrier_count;
+}
+
+bool ResourceStateTracker::_Use( AccessState & state, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access )
+{
+	bool layout_change		= layout != state.layout;
+	bool write				= layout_change || ( access & resource_state_tracker_write_access ) != 0;
+
+	if( state.pending ) {
+		// Another read of the same flush joins the barrier that is already pending.
+		if( !write ) {
+			state.pending_dst_access	|= access;
+			state.read_stages			|= stage;
+			state.visible_stages		|= stage;
+			state.visible_access		|= access;
+			_pending_dst_stages			|= stage;
+			return true;
+		}
+		assert( 0 && "Resource state tracker: conflicting uses of the same subresource, call Flush() between them." );
+	}
+
+	if( write ) {
+		// Write after write needs the previous write to be available, write after read only needs the reads to be done.
+		VkPipelineStageFlags src_stages = state.write_stages | state.read_stages;
+		bool needs_barrier = src_stages != 0 || layout_change;
+		if( needs_barrier ) {
+			state.pending				= true;
+			state.pending_memory		= layout_change || state.write_access != 0;
+			state.pending_old_layout	= state.layout;
+			state.pending_src_access	= state.write_access;
+			state.pending_dst_access	= access;
+			_pending_src_stages			|= src_stages;
+			_pending_dst_stages			|= stage;
+		}
+		// A layout transition is visible to the accesses of its barrier.
+		state.layout				= layout;
+		state.write_stages			= stage;
+		state.write_access			= access & resource_state_tracker_write_access;
+		state.read_stages			= 0;
+		state.visible_stages		= layout_change ? stage : 0;
+		state.visible_access		= layout_change ? access : 0;
+		return needs_barrier;
+	}
+
+	// Read after write, nothing to do if the write is already visible to this stage and access.
+	if( state.write_stages == 0 ||
+		( ( state.visible_stages & stage ) == stage && ( state.visible_access & access ) == access ) ) {
+		state.read_stages			|= stage;
+		return false;
+	}
+	state.pending				= true;
+	state.pending_memory		= state.write_access != 0;
+	state.pending_old_layout	= state.layout;
+	state.pending_src_access	= state.write_access;
+	state.pending_dst_access	= access;
+	_pending_src_stages			|= state.write_stages;
+	_pending_dst_stages			|= stage;
+	state.read_stages			|= stage;
+	state.visible_stages		|= stage;
+	state.visible_access		|= access;
+	return true;
+}
+
+void ResourceStateTracker::_SplitBufferRange( BufferState & buffer, VkDeviceSize offset )
+{
+	for( size_t i=0; i < buffer.ranges.size(); ++i ) {
+		auto & range = buffer.ranges[ i ];
+		if( offset <= range.offset ) return;
+		if( offset < range.offset + range.size ) {
+			BufferRange second	= range;
+			second.offset		= offset;
+			second.size			= range.offset + range.size - offset;
+			range.size			= offset - range.offset;
+			buffer.ranges.insert( buffer.ranges.begin() + i + 1, second );
+			return;
+		}
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <unordered_map>
+
+// Remembers the layout, and the pipeline stages and accesses that last touched every
+// mip level and array layer of an image and every range of a buffer. Each declared use
+// computes the smallest barrier that makes it safe, uses that are already safe cost
+// nothing. Pending barriers are recorded together in a single vkCmdPipelineBarrier.
+//
+// Declare all uses of a command, call Flush() and then record the command.
+class ResourceStateTracker
+{
+public:
+	// stage and access describe how the resource was used last, for example the stage a
+	// swapchain image acquire semaphore is waited on with no access.
+	void								RegisterImage( VkImage image, VkImageAspectFlags aspect, uint32_t mip_levels, uint32_t array_layers,
+											VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED, VkPipelineStageFlags stage = 0, VkAccessFlags access = 0 );
+	void								RegisterBuffer( VkBuffer buffer, VkDeviceSize size, VkPipelineStageFlags stage = 0, VkAccessFlags access = 0 );
+	void								ForgetImage( VkImage image );
+	void								ForgetBuffer( VkBuffer buffer );
+
+	void								UseImage( VkImage image, const VkImageSubresourceRange & range, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access );
+	void								UseImage( VkImage image, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access );
+	void								UseBuffer( VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkPipelineStageFlags stage, VkAccessFlags access );
+
+	VkImageLayout						GetImageLayout( VkImage image, uint32_t mip_level = 0, uint32_t array_layer = 0 ) const;
+
+	// Records every pending barrier in one vkCmdPipelineBarrier, nothing if no barrier is needed.
+	void								Flush( VkCommandBuffer command_buffer );
+
+	uint64_t							GetUseCount() const;
+	uint64_t							GetBarrierCount() const;				// image and buffer barriers
+	uint64_t							GetPipelineBarrierCount() const;		// vkCmdPipelineBarrier calls
+
+private:
+	struct AccessState
+	{
+		VkImageLayout						layout					= VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags				write_stages			= 0;		// last write, or layout transition
+		VkAccessFlags						write_access			= 0;
+		VkPipelineStageFlags				read_stages				= 0;		// reads since the last write
+		VkPipelineStageFlags				visible_stages			= 0;		// the last write is visible to these
+		VkAccessFlags						visible_access			= 0;
+
+		bool								pending					= false;
+		bool								pending_memory			= false;	// needs a memory barrier, not just an execution dependency
+		VkImageLayout						pending_old_layout		= VK_IMAGE_LAYOUT_UNDEFINED;
+		VkAccessFlags						pending_src_access		= 0;
+		VkAccessFlags						pending_dst_access		= 0;
+	};
+
+	struct ImageState
+	{
+		VkImageAspectFlags					aspect					= 0;
+		uint32_t							mip_levels				= 0;
+		uint32_t							array_layers			= 0;
+		std::vector<AccessState>			subresources;						// mip_level * array_layers + array_layer
+		bool								pending					= false;
+	};
+
+	struct BufferRange
+	{
+		VkDeviceSize						offset					= 0;
+		VkDeviceSize						size					= 0;
+		AccessState							state;
+	};
+
+	struct BufferState
+	{
+		std::vector<BufferRange>			ranges;								// sorted and covering the whole buffer
+		bool								pending					= false;
+	};
+
+	bool								_Use( AccessState & state, VkImageLayout layout, VkPipelineStageFlags stage, VkAccessFlags access );
+	void								_SplitBufferRange( BufferState & buffer, VkDeviceSize offset );
+
+	std::unordered_map<VkImage, ImageState>		_images;
+	std::unordered_map<VkBuffer, BufferState>	_buffers;
+
+	VkPipelineStageFlags				_pending_src_stages				= 0;
+	VkPipelineStageFlags				_pending_dst_stages				= 0;
+	std::vector<VkImageMemoryBarrier>	_image_barriers;
+	std::vector<VkBufferMemoryBarrier>	_buffer_barriers;
+
+	uint64_t							_use_count						= 0;
+	uint64_t							_barrier_count					= 0;
+	uint64_t							_pipeline_barrier_count			= 0;
+};
@@ -0,0 +1,444 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "ShaderHotReload.h"
+#include "ShaderModuleCache.h"
+#include "PipelineLayoutCache.h"
+#include "DeletionQueue.h"
+#include "Renderer.h"
+#include "Shared.h"
+
+#include <assert.h>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <sys/stat.h>
+
+#if defined( __linux )
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+static std::string ReplaceAll( std::string text, const std::string & pattern, const std::string & replacement )
+{
+	for( size_t position = text.find( pattern ); position != std::string::npos; position = text.find( pattern, position + replacement.size() ) ) {
+		text.replace( position, pattern.size(), replacement );
+	}
+	return text;
+}
+
+// Changes when the file is written, modification times only count seconds so the size goes in too.
+static int64_t GetFileStamp( const std::string & file_name )
+{
+	struct stat status {};
+	if( stat( file_name.c_str(), &status ) != 0 ) return 0;
+	return int64_t( status.st_mtime ) * 1000003 + int64_t( status.st_size );
+}
+
+ShaderHotReload::ShaderHotReload( Renderer * renderer )
+{
+	_renderer			= renderer;
+	_device				= renderer->GetVulkanDevice();
+	_last_poll_time		= std::chrono::steady_clock::now();
+	_reload_count		= 0;
+	_failed_count		= 0;
+	_build_thread		= std::thread( &ShaderHotReload::_BuildLoop, this );
+}
+
+ShaderHotReload::~ShaderHotReload()
+{
+	// The build thread finishes the builds that are queued before it returns.
+	{
+		std::lock_guard<std::mutex> lock( _build_mutex );
+		_build_should_run = false;
+	}
+	_build_condition.notify_all();
+	_build_thread.join();
+
+	auto job_system = _renderer->GetJobSystem();
+	for( auto & pipeline : _pipelines ) {
+		if( pipeline.job ) job_system->Wait( pipeline.job );
+	}
+
+	// Frames in flight may still use the pipelines, the modules follow their last reference.
+	auto deletion_queue = _renderer->GetDeletionQueue();
+	for( auto & pipeline : _pipelines ) {
+		if( pipeline.build && pipeline.build->pipeline != VK_NULL_HANDLE ) {
+			deletion_queue->DestroyPipeline( pipeline.build->pipeline );
+		}
+		deletion_queue->DestroyPipeline( pipeline.pipeline );
+	}
+	_pipelines.clear();
+	_shaders.clear();
+
+#if defined( __linux )
+	if( _inotify >= 0 ) {
+		close( _inotify );
+	}
+#endif
+}
+
+uint32_t ShaderHotReload::AddShader( const std::string & spirv_file, const std::string & source_file, const std::string & compile_command )
+{
+	Shader shader;
+	shader.spirv_file		= spirv_file;
+	shader.source_file		= source_file;
+	shader.compile_command	= compile_command;
+
+	// A SPIR-V file left from an earlier run is used as it is, the compiler only runs if there is none.
+	std::string error;
+	shader.module = _LoadModule( spirv_file, source_file, std::string(), nullptr, error );
+	if( !shader.module && !compile_command.empty() ) {
+		error.clear();
+		shader.module = _LoadModule( spirv_file, source_file, compile_command, nullptr, error );
+	}
+	if( !shader.module ) {
+		_Report( spirv_file, error );
+		return UINT32_MAX;
+	}
+	_Watch( shader );
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	_shaders.push_back( std::move( shader ) );
+	return uint32_t( _shaders.size() - 1 );
+}
+
+uint32_t ShaderHotReload::AddPipeline( const PipelineDescription & description, const std::vector<uint32_t> & shaders )
+{
+	assert( shaders.size() == description.stages.size() && "Shader hot reload: one shader per pipeline stage." );
+
+	PipelineBuild build;
+	for( auto shader : shaders ) {
+		assert( shader < _shaders.size() && "Shader hot reload: unknown shader." );
+		build.modules.push_back( _shaders[ shader ].module );
+	}
+	_BuildPipeline( description, build );
+	if( build.pipeline == VK_NULL_HANDLE ) {
+		_Report( _shaders[ shaders[ 0 ] ].spirv_file, build.error );
+		return UINT32_MAX;
+	}
+
+	Pipeline pipeline;
+	pipeline.description	= description;
+	pipeline.shaders		= shaders;
+	pipeline.pipeline		= build.pipeline;
+	pipeline.layout			= build.layout;
+
+	uint32_t index = uint32_t( _pipelines.size() );
+	for( auto shader : shaders ) {
+		_shaders[ shader ].pipelines.push_back( index );
+	}
+	std::lock_guard<std::mutex> lock( _mutex );
+	_pipelines.push_back( std::move( pipeline ) );
+	return index;
+}
+
+VkPipeline ShaderHotReload::GetPipeline( uint32_t pipeline ) const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	assert( pipeline < _pipelines.size() && "Shader hot reload: unknown pipeline." );
+	return _pipelines[ pipeline ].pipeline;
+}
+
+VkPipelineLayout ShaderHotReload::GetPipelineLayout( uint32_t pipeline ) const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	assert( pipeline < _pipelines.size() && "Shader hot reload: unknown pipeline." );
+	return _pipelines[ pipeline ].layout;
+}
+
+std::string ShaderHotReload::GetShaderError( uint32_t shader ) const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	assert( shader < _shaders.size() && "Shader hot reload: unknown shader." );
+	return _shaders[ shader ].error;
+}
+
+void ShaderHotReload::Update()
+{
+	if( _shaders.empty() ) return;
+	_ReadChanges();
+
+	auto job_system		= _renderer->GetJobSystem();
+	auto deletion_queue	= _renderer->GetDeletionQueue();
+
+	for( auto & shader : _shaders ) {
+		// A new version makes every pipeline that uses the shader out of date.
+		if( shader.build && _IsFinished( *shader.build ) ) {
+			auto build = std::move( shader.build );
+			shader.build = nullptr;
+			if( build->module ) {
+				shader.module = std::move( build->module );
+				for( auto pipeline : shader.pipelines ) {
+					_pipelines[ pipeline ].changed = true;
+				}
+			} else if( !build->error.empty() ) {
+				++_failed_count;
+				_Report( shader.watch_file, build->error );
+			}
+			std::lock_guard<std::mutex> lock( _mutex );
+			shader.error = build->error;
+		}
+
+		// One build per shader at a time, changes while it runs start the next one.
+		if( shader.changed && !shader.build ) {
+			shader.changed			= false;
+			auto build				= std::make_shared<ShaderBuild>();
+			build->spirv_file		= shader.spirv_file;
+			build->source_file		= shader.source_file;
+			build->compile_command	= shader.compile_command;
+			build->previous			= shader.module;
+			shader.build			= build;
+			{
+				std::lock_guard<std::mutex> lock( _build_mutex );
+				_build_queue.push_back( build );
+			}
+			_build_condition.notify_all();
+		}
+	}
+
+	for( auto & pipeline : _pipelines ) {
+		if( pipeline.job && pipeline.job->IsFinished() ) {
+			auto build = std::move( pipeline.build );
+			pipeline.job = nullptr;
+			if( build->pipeline != VK_NULL_HANDLE ) {
+				deletion_queue->DestroyPipeline( pipeline.pipeline );
+				std::lock_guard<std::mutex> lock( _mutex );
+				pipeline.pipeline	= build->pipeline;
+				pipeline.layout		= build->layout;
+				++_reload_count;
+			} else {
+				++_failed_count;
+				_Report( _shaders[ pipeline.shaders[ 0 ] ].watch_file, build->error );
+			}
+		}
+
+		// The build gets the current version of every stage, the modules stay until it is done.
+		if( pipeline.changed && !pipeline.job ) {
+			pipeline.changed	= false;
+			auto build			= std::make_shared<PipelineBuild>();
+			for( auto shader : pipeline.shaders ) {
+				build->modules.push_back( _shaders[ shader ].module );
+			}
+			auto description	= pipeline.description;
+			pipeline.build		= build;
+			pipeline.job		= job_system->Run( [ this, build, description ]() {
+				_BuildPipeline( description, *build );
+			} );
+		}
+	}
+}
+
+void ShaderHotReload::WaitIdle()
+{
+	auto job_system = _renderer->GetJobSystem();
+	_last_poll_time = std::chrono::steady_clock::time_point();
+
+	// A finished shader starts its pipelines in the next Update(), so this takes a few rounds.
+	for( ;; ) {
+		Update();
+		bool running = false;
+		for( auto & shader : _shaders ) {
+			if( shader.build ) {
+				_WaitForBuild( *shader.build );
+				running = true;
+			}
+		}
+		for( auto & pipeline : _pipelines ) {
+			if( pipeline.job ) {
+				job_system->Wait( pipeline.job );
+				running = true;
+			}
+		}
+		if( !running ) break;
+	}
+}
+
+uint64_t ShaderHotReload::GetReloadCount() const
+{
+	return _reload_count.load();
+}
+
+uint64_t ShaderHotReload::GetFailedCount() const
+{
+	return _failed_count.load();
+}
+
+void ShaderHotReload::_BuildLoop()
+{
+	for( ;; ) {
+		std::shared_ptr<ShaderBuild> build;
+		{
+			std::unique_lock<std::mutex> lock( _build_mutex );
+			_build_condition.wait( lock, [ this ] { return !_build_queue.empty() || !_build_should_run; } );
+			if( _build_queue.empty() ) return;
+			build = std::move( _build_queue.front() );
+			_build_queue.pop_front();
+		}
+
+		// Runs the compiler if there is a compile command, the thread waits for it.
+		build->module = _LoadModule( build->spirv_file, build->source_file, build->compile_command, build->previous.get(), build->error );
+		build->previous.reset();
+		{
+			std::lock_guard<std::mutex> lock( _build_mutex );
+			build->finished = true;
+		}
+		_build_condition.notify_all();
+	}
+}
+
+bool ShaderHotReload::_IsFinished( const ShaderBuild & build )
+{
+	std::lock_guard<std::mutex> lock( _build_mutex );
+	return build.finished;
+}
+
+void ShaderHotReload::_WaitForBuild( const ShaderBuild & build )
+{
+	std::unique_lock<std::mutex> lock( _build_mutex );
+	_build_condition.wait( lock, [ &build ] { return build.finished; } );
+}
+
+std::shared_ptr<const ShaderHotReload::Module> ShaderHotReload::_LoadModule( const std::string & spirv_file, const std::string & source_file, const std::string & compile_command,
+	const Module * previous, std::string & error )
+{
+	if( !compile_command.empty() ) {
+		auto command = ReplaceAll( ReplaceAll( compile_command, "{source}", source_file ), "{spirv}", spirv_file );
+		if( std::system( command.c_str() ) != 0 ) {
+			error = "the compile command failed: " + command;
+			return nullptr;
+		}
+	}
+
+	std::ifstream file( spirv_file, std::ios::binary );
+	if( !file ) {
+		error = "the file can not be read";
+		return nullptr;
+	}
+	std::vector<char> bytes( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+	std::vector<uint32_t> code( bytes.size() / sizeof( uint32_t ) );
+	if( !code.empty() ) {
+		std::memcpy( code.data(), bytes.data(), code.size() * sizeof( uint32_t ) );
+	}
+
+	// Saving without changes, or a source change that compiles to the same code, rebuilds nothing.
+	auto content_hash = HashShaderCode( code.data(), code.size() );
+	if( previous && previous->content_hash == content_hash ) {
+		return nullptr;
+	}
+
+	std::unique_ptr<Module> module( new Module );
+	module->content_hash = content_hash;
+	if( bytes.empty() || bytes.size() % sizeof( uint32_t ) || !ReflectShader( code.data(), code.size(), module->reflection ) ) {
+		error = "not a valid SPIR-V module";
+		return nullptr;
+	}
+	if( previous && previous->reflection.stage != module->reflection.stage ) {
+		error = "the new version is a shader of another stage";
+		return nullptr;
+	}
+
+	VkShaderModuleCreateInfo shader_module_create_info {};
+	shader_module_create_info.sType		= VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shader_module_create_info.codeSize	= code.size() * sizeof( uint32_t );
+	shader_module_create_info.pCode		= code.data();
+	if( vkCreateShaderModule( _device, &shader_module_create_info, nullptr, &module->module ) != VK_SUCCESS ) {
+		error = "vkCreateShaderModule failed";
+		return nullptr;
+	}
+
+	auto deletion_queue = _renderer->GetDeletionQueue();
+	return std::shared_ptr<const Module>( module.release(), [ deletion_queue ]( const Module * released ) {
+		deletion_queue->DestroyShaderModule( released->module );
+		delete released;
+	} );
+}
+
+void ShaderHotReload::_BuildPipeline( const PipelineDescription & description, PipelineBuild & build )
+{
+	// Layouts live as long as the cache, a shader that goes back to its old bindings gets its old layout.
+	std::vector<const ShaderReflection*> reflections;
+	for( auto & module : build.modules ) {
+		reflections.push_back( &module->reflection );
+	}
+	auto built		= description;
+	built.layout	= _renderer->GetPipelineLayoutCache()->GetPipelineLayout( reflections );
+	for( size_t i=0; i < built.stages.size(); ++i ) {
+		built.stages[ i ].stage			= build.modules[ i ]->reflection.stage;
+		built.stages[ i ].module		= build.modules[ i ]->module;
+		built.stages[ i ].entry_point	= build.modules[ i ]->reflection.entry_point;
+	}
+
+	if( CreatePipeline( _renderer, built, &build.pipeline ) != VK_SUCCESS ) {
+		build.pipeline	= VK_NULL_HANDLE;
+		build.error		= "the pipeline could not be created";
+	}
+	build.layout = built.layout;
+	build.modules.clear();
+}
+
+void ShaderHotReload::_Watch( Shader & shader )
+{
+	shader.watch_file	= shader.compile_command.empty() ? shader.spirv_file : shader.source_file;
+	shader.file_stamp	= GetFileStamp( shader.watch_file );
+	auto slash			= shader.watch_file.find_last_of( "/\\" );
+	shader.watch_name	= slash == std::string::npos ? shader.watch_file : shader.watch_file.substr( slash + 1 );
+
+#if defined( __linux )
+	if( _inotify < 0 && _shaders.empty() ) {
+		_inotify = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	}
+	if( _inotify < 0 ) return;
+
+	// Editors often save by writing another file and renaming it over the old one, so the
+	// directory is watched rather than the file. Watching a directory twice gives the same descriptor.
+	auto directory = slash == std::string::npos ? std::string( "." ) : slash == 0 ? std::string( "/" ) : shader.watch_file.substr( 0, slash );
+	shader.watch = inotify_add_watch( _inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO );
+	if( shader.watch < 0 ) {
+		_Report( shader.watch_file, "the directory can not be watched" );
+	}
+#endif
+}
+
+void ShaderHotReload::_ReadChanges()
+{
+#if defined( __linux )
+	if( _inotify >= 0 ) {
+		alignas( struct inotify_event ) char buffer[ 4096 ];
+		for( ;; ) {
+			auto size = read( _inotify, buffer, sizeof( buffer ) );
+			if( size <= 0 ) break;
+			for( ssize_t offset=0; offset < size; ) {
+				auto event = (const struct inotify_event*)( buffer + offset );
+				offset += sizeof( struct inotify_event ) + event->len;
+				if( event->len == 0 ) continue;
+				for( auto & shader : _shaders ) {
+					if( shader.watch == event->wd && shader.watch_name == event->name ) {
+						shader.changed = true;
+					}
+				}
+			}
+		}
+	}
+#endif
+
+	// Files without an inotify watch are polled.
+	auto now = std::chrono::steady_clock::now();
+	if( now - _last_poll_time < std::chrono::milliseconds( 250 ) ) return;
+	_last_poll_time = now;
+	for( auto & shader : _shaders ) {
+		if( shader.watch >= 0 ) continue;
+		auto file_stamp = GetFileStamp( shader.watch_file );
+		if( file_stamp != shader.file_stamp ) {
+			shader.file_stamp	= file_stamp;
+			shader.changed		= true;
+		}
+	}
+}
+
+void ShaderHotReload::_Report( const std::string & file_name, const std::string & error )
+{
+	std::cout << "Shader hot reload: " << file_name << ": " << error << std::endl;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "Platform.h"
+#include "JobSystem.h"
+#include "PipelineService.h"
+#include "ShaderReflection.h"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <atomic>
+#include <chrono>
+
+class Renderer;
+
+// Rebuilds shader modules and the pipelines made from them when their files change on disk,
+// while the application keeps running. On linux the directories of the files are watched
+// with inotify, elsewhere the modification times are polled a few times a second.
+//
+// A changed file is loaded, or first compiled by an external compiler, on a build thread of
+// its own, one shader at a time. The compiler can take seconds and blocks that thread, not
+// the workers of the job system that frames run on. Only the pipelines that use the shader
+// are rebuilt, on the job system, and swapped in by Update() at the next frame boundary
+// after they are done. The pipelines and modules they
+// replace go to the renderer's DeletionQueue, frames in flight keep using them and nothing
+// waits for the device to go idle. A shader that fails to compile or load keeps its last
+// working version and the error is printed.
+//
+// Add*(), Update() and WaitIdle() are called from one thread, the getters from any thread.
+class ShaderHotReload
+{
+public:
+	ShaderHotReload( Renderer * renderer );
+
+	// Waits for the rebuilds that are still running.
+	~ShaderHotReload();
+
+	// UINT32_MAX if spirv_file is not a valid module. With a compile command the source file
+	// is watched instead and every change runs the command before spirv_file is loaded again.
+	// {source} and {spirv} in the command are replaced by the file names, for example:
+	// glslangValidator -V {source} -o {spirv}
+	uint32_t							AddShader( const std::string & spirv_file, const std::string & source_file = std::string(), const std::string & compile_command = std::string() );
+
+	// The modules and the layout of the description come from the shaders, one shader per
+	// stage in the order of the stages. The first pipeline is created before this returns.
+	uint32_t							AddPipeline( const PipelineDescription & description, const std::vector<uint32_t> & shaders );
+
+	// The layout changes with the pipeline when a new version of a shader changes its bindings.
+	VkPipeline							GetPipeline( uint32_t pipeline ) const;
+	VkPipelineLayout					GetPipelineLayout( uint32_t pipeline ) const;
+	// Empty if the last version of the shader loaded fine.
+	std::string							GetShaderError( uint32_t shader ) const;
+
+	// Call at the frame boundary before recording. Picks up changed files, starts their
+	// rebuilds and swaps in the pipelines that have finished, never waits for a rebuild.
+	void								Update();
+
+	// Waits for every rebuild of the files changed so far and swaps the results in.
+	void								WaitIdle();
+
+	uint64_t							GetReloadCount() const;			// pipelines swapped in
+	uint64_t							GetFailedCount() const;			// shader versions that did not load
+
+private:
+	// A loaded version of a shader, handed to the deletion queue once nothing refers to it.
+	struct Module
+	{
+		VkShaderModule						module					= VK_NULL_HANDLE;
+		uint64_t							content_hash			= 0;
+		ShaderReflection					reflection;
+	};
+
+	// Inputs and results of a build, only touched by the build thread until it has finished.
+	struct ShaderBuild
+	{
+		std::string							spirv_file;
+		std::string							source_file;
+		std::string							compile_command;
+		std::shared_ptr<const Module>		previous;
+
+		std::shared_ptr<const Module>		module;
+		std::string							error;
+		bool								finished				= false;	// guarded by _build_mutex
+	};
+
+	// Results of a job, only touched by the job until it has finished.
+
+	struct PipelineBuild
+	{
+		std::vector<std::shared_ptr<const Module>>	modules;		// kept until the pipeline is created
+		VkPipeline							pipeline				= VK_NULL_HANDLE;
+		VkPipelineLayout					layout					= VK_NULL_HANDLE;
+		std::string							error;
+	};
+
+	struct Shader
+	{
+		std::string							spirv_file;
+		std::string							source_file;
+		std::string							compile_command;
+		std::string							watch_file;						// the source with a compile command, otherwise the SPIR-V
+		std::string							watch_name;						// without the directory
+		int									watch					= -1;		// inotify watch descriptor of the directory
+		int64_t								file_stamp				= 0;		// modification time and size when polling
+
+		std::shared_ptr<const Module>		module;
+		std::vector<uint32_t>				pipelines;
+		std::string							error;
+
+		bool								changed					= false;	// again since the running build started
+		std::shared_ptr<ShaderBuild>		build;								// running while not null
+	};
+
+	struct Pipeline
+	{
+		PipelineDescription					description;
+		std::vector<uint32_t>				shaders;
+		VkPipeline							pipeline				= VK_NULL_HANDLE;
+		VkPipelineLayout					layout					= VK_NULL_HANDLE;
+
+		bool								changed					= false;
+		JobHandle							job;
+		std::shared_ptr<PipelineBuild>		build;
+	};
+
+	// Null with an empty error if the code is the same as previous.
+	std::shared_ptr<const Module>		_LoadModule( const std::string & spirv_file, const std::string & source_file, const std::string & compile_command,
+											const Module * previous, std::string & error );
+	void								_BuildPipeline( const PipelineDescription & description, PipelineBuild & build );
+	void								_BuildLoop();
+	bool								_IsFinished( const ShaderBuild & build );
+	void								_WaitForBuild( const ShaderBuild & build );
+	void								_Watch( Shader & shader );
+	void								_ReadChanges();
+	void								_Report( const std::string & file_name, const std::string & error );
+
+	Renderer						*	_renderer						= nullptr;
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	mutable std::mutex					_mutex;							// guards what the getters read
+	std::vector<Shader>					_shaders;
+	std::vector<Pipeline>				_pipelines;
+
+	int									_inotify						= -1;		// shaders without a watch descriptor are polled
+	std::chrono::steady_clock::time_point	_last_poll_time;
+
+	std::thread							_build_thread;
+	std::mutex							_build_mutex;
+	std::condition_variable				_build_condition;				// new builds and finished builds
+	std::deque<std::shared_ptr<ShaderBuild>>	_build_queue;
+	bool								_build_should_run				= true;
+
+	std::atomic<uint64_t>				_reload_count;
+	std::atomic<uint64_t>				_failed_count;
+};
@@ -0,0 +1,88 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "ShaderModuleCache.h"
+#include "Shared.h"
+
+#include <algorithm>
+
+uint64_t HashShaderCode( const uint32_t * code, size_t word_count )
+{
+	// FNV-1a over whole words, SPIR-V is a stream of words and this is 4 times fewer steps than bytes.
+	uint64_t hash = 14695981039346656037ull;
+	for( size_t i=0; i < word_count; ++i ) {
+		hash ^= code[ i ];
+		hash *= 1099511628211ull;
+	}
+	hash ^= word_count;
+	hash *= 1099511628211ull;
+	return hash;
+}
+
+ShaderModuleCache::ShaderModuleCache( VkDevice device )
+{
+	_device		= device;
+}
+
+ShaderModuleCache::~ShaderModuleCache()
+{
+	for( auto & entry : _modules ) {
+		vkDestroyShaderModule( _device, entry.second.module, nullptr );
+	}
+	_modules.clear();
+}
+
+VkShaderModule ShaderModuleCache::GetShaderModule( const uint32_t * code, size_t word_count )
+{
+	return GetShaderModule( HashShaderCode( code, word_count ), code, word_count );
+}
+
+VkShaderModule ShaderModuleCache::GetShaderModule( uint64_t content_hash, const uint32_t * code, size_t word_count )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	++_request_count;
+	auto existing = _modules.equal_range( content_hash );
+	for( auto entry = existing.first; entry != existing.second; ++entry ) {
+		auto & entry_code = entry->second.code;
+		if( entry_code.size() == word_count && std::equal( entry_code.begin(), entry_code.end(), code ) ) {
+			return entry->second.module;
+		}
+	}
+
+	VkShaderModuleCreateInfo shader_module_create_info {};
+	shader_module_create_info.sType		= VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shader_module_create_info.codeSize	= word_count * sizeof( uint32_t );
+	shader_module_create_info.pCode		= code;
+
+	Entry entry;
+	entry.code.assign( code, code + word_count );
+	ErrorCheck( vkCreateShaderModule( _device, &shader_module_create_info, nullptr, &entry.module ) );
+	auto module = entry.module;
+	_modules.insert( std::make_pair( content_hash, std::move( entry ) ) );
+	return module;
+}
+
+bool ShaderModuleCache::FindContentHash( VkShaderModule module, uint64_t * content_hash ) const
+{
+	// Only for tools and logs, a walk over every module is fine.
+	std::lock_guard<std::mutex> lock( _mutex );
+	for( auto & entry : _modules ) {
+		if( entry.second.module == module ) {
+			*content_hash = entry.first;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t ShaderModuleCache::GetModuleCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return uint32_t( _modules.size() );
+}
+
+uint64_t ShaderModuleCache::GetRequestCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return _request_count;
+}
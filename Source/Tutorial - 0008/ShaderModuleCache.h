@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+// 64 bit hash of SPIR-V code, shader packs store it next to every shader.
+uint64_t								HashShaderCode( const uint32_t * code, size_t word_count );
+
+// Shader modules by the hash of their code. Every pipeline, material or shader pack that
+// asks for the same code gets the same VkShaderModule, created the first time it is asked
+// for and destroyed with the cache. The code is kept and compared on a hash hit, shaders
+// whose hashes collide get modules of their own. Thread safe.
+class ShaderModuleCache
+{
+public:
+	ShaderModuleCache( VkDevice device );
+	~ShaderModuleCache();
+
+	VkShaderModule						GetShaderModule( const uint32_t * code, size_t word_count );
+	// Skips hashing the code when the hash is already known, for example from a shader pack.
+	VkShaderModule						GetShaderModule( uint64_t content_hash, const uint32_t * code, size_t word_count );
+
+	// The hash of the code a module was made from, false if the module is not from this cache.
+	bool								FindContentHash( VkShaderModule module, uint64_t * content_hash ) const;
+
+	uint32_t							GetModuleCount() const;
+	uint64_t							GetRequestCount() const;
+
+private:
+	struct Entry
+	{
+		VkShaderModule						module					= VK_NULL_HANDLE;
+		std::vector<uint32_t>				code;
+	};
+
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	mutable std::mutex					_mutex;
+	std::unordered_multimap<uint64_t, Entry>	_modules;				// more than one per hash only on a collision
+	uint64_t							_request_count					= 0;
+};
@@ -0,0 +1,246 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "ShaderPack.h"
+#include "ShaderModuleCache.h"
+#include "Renderer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <unordered_map>
+
+#if VK_USE_PLATFORM_XCB_KHR
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char		SHADER_PACK_MAGIC[ 4 ]		= { 'V', 'K', 'S', 'P' };
+static const uint32_t	SHADER_PACK_VERSION			= 1;
+
+struct ShaderPackHeader
+{
+	char								magic[ 4 ];
+	uint32_t							version;
+	uint32_t							entry_count;
+	uint32_t							reserved;
+};
+
+struct ShaderPack::Entry
+{
+	uint64_t							name_hash;
+	uint64_t							content_hash;
+	uint32_t							name_offset;		// from the start of the file
+	uint32_t							name_length;
+	uint32_t							code_offset;		// from the start of the file, 4 byte aligned
+	uint32_t							code_size;			// in bytes
+};
+
+static uint64_t HashName( const char * name, size_t length )
+{
+	uint64_t hash = 14695981039346656037ull;
+	for( size_t i=0; i < length; ++i ) {
+		hash ^= uint8_t( name[ i ] );
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+ShaderPack::ShaderPack( Renderer * renderer )
+{
+	_renderer		= renderer;
+}
+
+ShaderPack::~ShaderPack()
+{
+	Close();
+}
+
+bool ShaderPack::Open( const std::string & file_path )
+{
+	Close();
+
+	// The mapping outlives the file handles, they are closed right away.
+#if VK_USE_PLATFORM_WIN32_KHR
+	HANDLE file = CreateFileA( file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if( file == INVALID_HANDLE_VALUE ) return false;
+	LARGE_INTEGER file_size {};
+	GetFileSizeEx( file, &file_size );
+	HANDLE mapping = file_size.QuadPart > 0 ? CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr ) : NULL;
+	if( mapping ) {
+		_data	= (const uint8_t*)MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+		_size	= _data ? size_t( file_size.QuadPart ) : 0;
+		CloseHandle( mapping );
+	}
+	CloseHandle( file );
+#elif VK_USE_PLATFORM_XCB_KHR
+	int file = open( file_path.c_str(), O_RDONLY );
+	if( file < 0 ) return false;
+	struct stat file_stat {};
+	if( fstat( file, &file_stat ) == 0 && file_stat.st_size > 0 ) {
+		void * data = mmap( nullptr, size_t( file_stat.st_size ), PROT_READ, MAP_PRIVATE, file, 0 );
+		if( data != MAP_FAILED ) {
+			_data	= (const uint8_t*)data;
+			_size	= size_t( file_stat.st_size );
+		}
+	}
+	close( file );
+#endif
+	if( !_data ) return false;
+
+	// Everything the index points at has to be inside the file.
+	auto header = (const ShaderPackHeader*)_data;
+	bool valid = _size >= sizeof( ShaderPackHeader ) &&
+		std::memcmp( header->magic, SHADER_PACK_MAGIC, sizeof( SHADER_PACK_MAGIC ) ) == 0 &&
+		header->version == SHADER_PACK_VERSION &&
+		header->entry_count <= ( _size - sizeof( ShaderPackHeader ) ) / sizeof( Entry );
+	if( valid ) {
+		_entries		= (const Entry*)( _data + sizeof( ShaderPackHeader ) );
+		_entry_count	= header->entry_count;
+		for( uint32_t i=0; i < _entry_count && valid; ++i ) {
+			auto & entry = _entries[ i ];
+			valid = uint64_t( entry.name_offset ) + entry.name_length <= _size &&
+				uint64_t( entry.code_offset ) + entry.code_size <= _size &&
+				entry.code_offset % sizeof( uint32_t ) == 0 && entry.code_size % sizeof( uint32_t ) == 0 &&
+				( i == 0 || _entries[ i - 1 ].name_hash <= entry.name_hash );
+		}
+	}
+	if( !valid ) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void ShaderPack::Close()
+{
+	if( _data ) {
+#if VK_USE_PLATFORM_WIN32_KHR
+		UnmapViewOfFile( _data );
+#elif VK_USE_PLATFORM_XCB_KHR
+		munmap( (void*)_data, _size );
+#endif
+	}
+	_data			= nullptr;
+	_size			= 0;
+	_entries		= nullptr;
+	_entry_count	= 0;
+}
+
+bool ShaderPack::IsOpen() const
+{
+	return _data != nullptr;
+}
+
+const uint32_t * ShaderPack::GetCode( const std::string & name, size_t * word_count, uint64_t * content_hash ) const
+{
+	auto entry = _Find( name );
+	if( !entry ) return nullptr;
+	if( word_count )	*word_count		= entry->code_size / sizeof( uint32_t );
+	if( content_hash )	*content_hash	= entry->content_hash;
+	return (const uint32_t*)( _data + entry->code_offset );
+}
+
+VkShaderModule ShaderPack::GetShaderModule( const std::string & name )
+{
+	auto entry = _Find( name );
+	if( !entry ) return VK_NULL_HANDLE;
+	return _renderer->GetShaderModuleCache()->GetShaderModule( entry->content_hash,
+		(const uint32_t*)( _data + entry->code_offset ), entry->code_size / sizeof( uint32_t ) );
+}
+
+uint32_t ShaderPack::GetShaderCount() const
+{
+	return _entry_count;
+}
+
+std::vector<std::string> ShaderPack::GetShaderNames() const
+{
+	std::vector<std::string> names;
+	names.reserve( _entry_count );
+	for( uint32_t i=0; i < _entry_count; ++i ) {
+		names.push_back( std::string( (const char*)_data + _entries[ i ].name_offset, _entries[ i ].name_length ) );
+	}
+	return names;
+}
+
+bool ShaderPack::Write( const std::string & file_path, const std::vector<std::pair<std::string, std::vector<uint32_t>>> & shaders )
+{
+	// Index first, then the names, then the code of every distinct shader.
+	std::vector<Entry> entries( shaders.size() );
+	std::vector<size_t> order( shaders.size() );
+	for( size_t i=0; i < shaders.size(); ++i ) {
+		auto & name		= shaders[ i ].first;
+		auto & code		= shaders[ i ].second;
+		entries[ i ].name_hash		= HashName( name.data(), name.size() );
+		entries[ i ].content_hash	= HashShaderCode( code.data(), code.size() );
+		entries[ i ].name_length	= uint32_t( name.size() );
+		entries[ i ].code_size		= uint32_t( code.size() * sizeof( uint32_t ) );
+		order[ i ]					= i;
+	}
+	std::sort( order.begin(), order.end(), [ &entries ]( size_t a, size_t b ) {
+		return entries[ a ].name_hash < entries[ b ].name_hash;
+	} );
+
+	uint64_t offset = sizeof( ShaderPackHeader ) + entries.size() * sizeof( Entry );
+	for( auto & entry : entries ) {
+		entry.name_offset	= uint32_t( offset );
+		offset				+= entry.name_length;
+	}
+	uint32_t padding_size	= uint32_t( ( 4 - offset % 4 ) % 4 );
+	offset					+= padding_size;
+
+	// Equal code is written once and shared by every name that uses it.
+	std::unordered_map<uint64_t, size_t> written;
+	std::vector<size_t> code_order;
+	for( size_t i=0; i < entries.size(); ++i ) {
+		auto same = written.find( entries[ i ].content_hash );
+		if( same != written.end() && shaders[ same->second ].second == shaders[ i ].second ) {
+			entries[ i ].code_offset	= entries[ same->second ].code_offset;
+			continue;
+		}
+		entries[ i ].code_offset	= uint32_t( offset );
+		offset						+= entries[ i ].code_size;
+		written[ entries[ i ].content_hash ] = i;
+		code_order.push_back( i );
+	}
+	if( offset > UINT32_MAX ) return false;
+
+	std::ofstream file( file_path, std::ios::binary | std::ios::trunc );
+	if( !file.is_open() ) return false;
+
+	ShaderPackHeader header {};
+	std::memcpy( header.magic, SHADER_PACK_MAGIC, sizeof( SHADER_PACK_MAGIC ) );
+	header.version		= SHADER_PACK_VERSION;
+	header.entry_count	= uint32_t( entries.size() );
+	file.write( (const char*)&header, sizeof( header ) );
+	for( auto i : order ) {
+		file.write( (const char*)&entries[ i ], sizeof( Entry ) );
+	}
+	for( auto & shader : shaders ) {
+		file.write( shader.first.data(), shader.first.size() );
+	}
+	static const char padding[ 4 ] = {};
+	file.write( padding, padding_size );
+	for( auto i : code_order ) {
+		file.write( (const char*)shaders[ i ].second.data(), entries[ i ].code_size );
+	}
+	return file.good();
+}
+
+const ShaderPack::Entry * ShaderPack::_Find( const std::string & name ) const
+{
+	uint64_t name_hash = HashName( name.data(), name.size() );
+	auto entry = std::lower_bound( _entries, _entries + _entry_count, name_hash, []( const Entry & e, uint64_t hash ) {
+		return e.name_hash < hash;
+	} );
+	// Names with the same hash are next to each other.
+	for( ; entry != _entries + _entry_count && entry->name_hash == name_hash; ++entry ) {
+		if( entry->name_length == name.size() && std::memcmp( _data + entry->name_offset, name.data(), name.size() ) == 0 ) {
+			return entry;
+		}
+	}
+	return nullptr;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <string>
+
+class Renderer;
+
+// All SPIR-V of the application in one file, memory mapped when opened. The file starts
+// with an index sorted by the hash of the shader names, every entry holds the hash of its
+// code and where the code is in the file. Shaders with the same code are stored once.
+// Modules are created on first use through the renderer's ShaderModuleCache, so equal
+// code from different packs or materials ends up as one VkShaderModule.
+class ShaderPack
+{
+public:
+	ShaderPack( Renderer * renderer );
+	~ShaderPack();
+
+	bool								Open( const std::string & file_path );
+	void								Close();
+	bool								IsOpen() const;
+
+	// Code of name inside the mapped file, nullptr if the pack has no such shader.
+	const uint32_t					*	GetCode( const std::string & name, size_t * word_count, uint64_t * content_hash = nullptr ) const;
+
+	// VK_NULL_HANDLE if the pack has no such shader.
+	VkShaderModule						GetShaderModule( const std::string & name );
+
+	uint32_t							GetShaderCount() const;
+	std::vector<std::string>			GetShaderNames() const;
+
+	// Builds a pack file out of named SPIR-V modules.
+	static bool							Write( const std::string & file_path, const std::vector<std::pair<std::string, std::vector<uint32_t>>> & shaders );
+
+private:
+	struct Entry;
+
+	const Entry						*	_Find( const std::string & name ) const;
+
+	Renderer						*	_renderer						= nullptr;
+
+	const uint8_t					*	_data							= nullptr;
+	size_t								_size							= 0;
+	const Entry						*	_entries						= nullptr;
+	uint32_t							_entry_count					= 0;
+};
@@ -0,0 +1,502 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "ShaderReflection.h"
+
+#include <vulkan/spirv.hpp>
+
+#include <algorithm>
+
+namespace {
+
+// SPIR-V 1.3 storage class of storage buffers, newer than the headers.
+const uint32_t StorageClassStorageBuffer		= 12;
+
+// What the walk keeps about every id, types point back at their instruction.
+struct IdInfo
+{
+	uint32_t							opcode					= 0;
+	uint32_t							offset					= 0;		// first word of the instruction that defines the id
+	uint32_t							name_offset				= 0;		// first word of the OpName string
+	uint32_t							set						= UINT32_MAX;
+	uint32_t							binding					= UINT32_MAX;
+	uint32_t							location				= UINT32_MAX;
+	uint32_t							spec_id					= UINT32_MAX;
+	uint32_t							builtin					= UINT32_MAX;
+	uint32_t							array_stride			= 0;
+	bool								block					= false;
+	bool								buffer_block			= false;
+};
+
+struct MemberInfo
+{
+	uint32_t							id						= 0;
+	uint32_t							member					= 0;
+	uint32_t							offset					= UINT32_MAX;
+	uint32_t							matrix_stride			= 0;
+};
+
+// Shortest valid form of the instructions whose operands are read, shorter ones are rejected.
+uint32_t MinimumWordCount( uint32_t opcode )
+{
+	switch( opcode ) {
+	case spv::OpTypeInt:				return 4;
+	case spv::OpTypeFloat:				return 3;
+	case spv::OpTypeVector:				return 4;
+	case spv::OpTypeMatrix:				return 4;
+	case spv::OpTypeImage:				return 9;
+	case spv::OpTypeSampledImage:		return 3;
+	case spv::OpTypeArray:				return 4;
+	case spv::OpTypeRuntimeArray:		return 3;
+	case spv::OpTypePointer:			return 4;
+	case spv::OpConstant:				return 4;
+	case spv::OpSpecConstant:			return 4;
+	default:							return 2;
+	}
+}
+
+struct ReflectionScratch
+{
+	std::vector<IdInfo>					ids;
+	std::vector<MemberInfo>				members;
+};
+
+class Reflector
+{
+public:
+	Reflector( const uint32_t * code, size_t word_count, ReflectionScratch & scratch, ShaderReflection & reflection ) :
+		_code( code ), _word_count( word_count ), _ids( scratch.ids ), _members( scratch.members ), _reflection( reflection )
+	{
+	}
+
+	bool								Reflect();
+
+private:
+	std::string							_ReadString( uint32_t offset, uint32_t end ) const;
+	std::string							_Name( uint32_t id ) const;
+	bool								_ValidId( uint32_t id ) const;
+	MemberInfo						&	_Member( uint32_t id, uint32_t member );
+	const MemberInfo				*	_FindMember( uint32_t id, uint32_t member ) const;
+	uint32_t							_ConstantValue( uint32_t id ) const;
+	uint32_t							_TypeSize( uint32_t type, uint32_t matrix_stride, uint32_t depth = 0 ) const;
+	VkFormat							_VertexFormat( uint32_t type ) const;
+	void								_Decorate( IdInfo & info, uint32_t decoration, const uint32_t * literals, uint32_t literal_count );
+	void								_AddSpecializationConstant( uint32_t id );
+	void								_AddWorkgroupSize( uint32_t id );
+	void								_AddVariable( uint32_t result_type, uint32_t id, uint32_t storage_class );
+
+	const uint32_t					*	_code;
+	size_t								_word_count;
+	std::vector<IdInfo>				&	_ids;
+	std::vector<MemberInfo>			&	_members;
+	ShaderReflection				&	_reflection;
+	uint32_t							_entry_point			= UINT32_MAX;
+};
+
+bool Reflector::Reflect()
+{
+	if( _word_count < 5 || _code[ 0 ] != spv::MagicNumber ) return false;
+
+	uint32_t bound = _code[ 3 ];
+	if( bound == 0 || bound > ( 1u << 22 ) ) return false;
+	_ids.assign( bound, IdInfo() );
+	_members.clear();
+
+	size_t position = 5;
+	while( position < _word_count ) {
+		uint32_t opcode		= _code[ position ] & spv::OpCodeMask;
+		uint32_t count		= _code[ position ] >> spv::WordCountShift;
+		if( count == 0 || position + count > _word_count ) return false;
+		const uint32_t * operands	= _code + position + 1;
+		uint32_t end				= uint32_t( position + count );
+
+		switch( opcode ) {
+		case spv::OpEntryPoint:
+			if( _entry_point == UINT32_MAX && count >= 4 ) {
+				_entry_point = operands[ 1 ];
+				switch( operands[ 0 ] ) {
+				case spv::ExecutionModelVertex:						_reflection.stage = VK_SHADER_STAGE_VERTEX_BIT; break;
+				case spv::ExecutionModelTessellationControl:		_reflection.stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT; break;
+				case spv::ExecutionModelTessellationEvaluation:		_reflection.stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT; break;
+				case spv::ExecutionModelGeometry:					_reflection.stage = VK_SHADER_STAGE_GEOMETRY_BIT; break;
+				case spv::ExecutionModelFragment:					_reflection.stage = VK_SHADER_STAGE_FRAGMENT_BIT; break;
+				case spv::ExecutionModelGLCompute:					_reflection.stage = VK_SHADER_STAGE_COMPUTE_BIT; break;
+				default:											return false;
+				}
+				_reflection.entry_point = _ReadString( uint32_t( position + 3 ), end );
+			}
+			break;
+		case spv::OpExecutionMode:
+			if( count >= 6 && operands[ 0 ] == _entry_point && operands[ 1 ] == spv::ExecutionModeLocalSize ) {
+				_reflection.workgroup_size[ 0 ]	= operands[ 2 ];
+				_reflection.workgroup_size[ 1 ]	= operands[ 3 ];
+				_reflection.workgroup_size[ 2 ]	= operands[ 4 ];
+			}
+			break;
+		case spv::OpName:
+			if( count >= 3 && _ValidId( operands[ 0 ] ) ) {
+				_ids[ operands[ 0 ] ].name_offset = uint32_t( position + 2 );
+			}
+			break;
+		case spv::OpDecorate:
+			if( count >= 3 && _ValidId( operands[ 0 ] ) ) {
+				_Decorate( _ids[ operands[ 0 ] ], operands[ 1 ], operands + 2, count - 3 );
+			}
+			break;
+		case spv::OpMemberDecorate:
+			if( count >= 5 && _ValidId( operands[ 0 ] ) ) {
+				auto & member = _Member( operands[ 0 ], operands[ 1 ] );
+				if( operands[ 2 ] == spv::DecorationOffset )			member.offset			= operands[ 3 ];
+				if( operands[ 2 ] == spv::DecorationMatrixStride )		member.matrix_stride	= operands[ 3 ];
+			}
+			break;
+		case spv::OpGroupDecorate:
+			// Decoration groups are decorated before they are applied, copy what the group got.
+			for( uint32_t i=1; i < count - 1; ++i ) {
+				if( !_ValidId( operands[ 0 ] ) || !_ValidId( operands[ i ] ) ) return false;
+				auto & group	= _ids[ operands[ 0 ] ];
+				auto & target	= _ids[ operands[ i ] ];
+				if( group.set != UINT32_MAX )			target.set				= group.set;
+				if( group.binding != UINT32_MAX )		target.binding			= group.binding;
+				if( group.location != UINT32_MAX )		target.location			= group.location;
+				if( group.builtin != UINT32_MAX )		target.builtin			= group.builtin;
+				if( group.array_stride )				target.array_stride		= group.array_stride;
+				target.block			|= group.block;
+				target.buffer_block		|= group.buffer_block;
+			}
+			break;
+		case spv::OpTypeVoid:
+		case spv::OpTypeBool:
+		case spv::OpTypeInt:
+		case spv::OpTypeFloat:
+		case spv::OpTypeVector:
+		case spv::OpTypeMatrix:
+		case spv::OpTypeImage:
+		case spv::OpTypeSampler:
+		case spv::OpTypeSampledImage:
+		case spv::OpTypeArray:
+		case spv::OpTypeRuntimeArray:
+		case spv::OpTypeStruct:
+		case spv::OpTypePointer:
+			if( count < MinimumWordCount( opcode ) || !_ValidId( operands[ 0 ] ) ) return false;
+			_ids[ operands[ 0 ] ].opcode	= opcode;
+			_ids[ operands[ 0 ] ].offset	= uint32_t( position );
+			break;
+		case spv::OpConstantTrue:
+		case spv::OpConstantFalse:
+		case spv::OpConstant:
+		case spv::OpConstantComposite:
+		case spv::OpSpecConstantTrue:
+		case spv::OpSpecConstantFalse:
+		case spv::OpSpecConstant:
+		case spv::OpSpecConstantComposite:
+			if( count < 3 || count < MinimumWordCount( opcode ) || !_ValidId( operands[ 1 ] ) ) return false;
+			_ids[ operands[ 1 ] ].opcode	= opcode;
+			_ids[ operands[ 1 ] ].offset	= uint32_t( position );
+			if( opcode == spv::OpSpecConstantTrue || opcode == spv::OpSpecConstantFalse || opcode == spv::OpSpecConstant ) {
+				_AddSpecializationConstant( operands[ 1 ] );
+			}
+			if( ( opcode == spv::OpConstantComposite || opcode == spv::OpSpecConstantComposite ) && _ids[ operands[ 1 ] ].builtin == spv::BuiltInWorkgroupSize ) {
+				_AddWorkgroupSize( operands[ 1 ] );
+			}
+			break;
+		case spv::OpVariable:
+			if( count < 4 || !_ValidId( operands[ 0 ] ) || !_ValidId( operands[ 1 ] ) ) return false;
+			_AddVariable( operands[ 0 ], operands[ 1 ], operands[ 2 ] );
+			break;
+		case spv::OpFunction:
+			// Only function bodies follow, everything global has been seen.
+			position = _word_count;
+			continue;
+		default:
+			break;
+		}
+		position += count;
+	}
+	if( _entry_point == UINT32_MAX ) return false;
+
+	std::sort( _reflection.descriptor_bindings.begin(), _reflection.descriptor_bindings.end(), []( const ShaderDescriptorBinding & a, const ShaderDescriptorBinding & b ) {
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	} );
+	std::sort( _reflection.vertex_inputs.begin(), _reflection.vertex_inputs.end(), []( const ShaderVertexInput & a, const ShaderVertexInput & b ) {
+		return a.location < b.location;
+	} );
+	return true;
+}
+
+std::string Reflector::_ReadString( uint32_t offset, uint32_t end ) const
+{
+	auto begin		= reinterpret_cast<const char*>( _code + offset );
+	auto max_length	= size_t( end - offset ) * sizeof( uint32_t );
+	size_t length	= 0;
+	while( length < max_length && begin[ length ] != '\0' ) {
+		++length;
+	}
+	return std::string( begin, length );
+}
+
+std::string Reflector::_Name( uint32_t id ) const
+{
+	auto offset = _ids[ id ].name_offset;
+	if( offset == 0 ) return std::string();
+	return _ReadString( offset, ( offset - 2 ) + ( _code[ offset - 2 ] >> spv::WordCountShift ) );
+}
+
+bool Reflector::_ValidId( uint32_t id ) const
+{
+	return id < _ids.size();
+}
+
+MemberInfo & Reflector::_Member( uint32_t id, uint32_t member )
+{
+	for( auto & info : _members ) {
+		if( info.id == id && info.member == member ) return info;
+	}
+	MemberInfo info;
+	info.id			= id;
+	info.member		= member;
+	_members.push_back( info );
+	return _members.back();
+}
+
+const MemberInfo * Reflector::_FindMember( uint32_t id, uint32_t member ) const
+{
+	for( auto & info : _members ) {
+		if( info.id == id && info.member == member ) return &info;
+	}
+	return nullptr;
+}
+
+uint32_t Reflector::_ConstantValue( uint32_t id ) const
+{
+	if( !_ValidId( id ) ) return 0;
+	auto & info = _ids[ id ];
+	switch( info.opcode ) {
+	case spv::OpConstant:
+	case spv::OpSpecConstant:
+		return _code[ info.offset + 3 ];
+	case spv::OpConstantTrue:
+	case spv::OpSpecConstantTrue:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+uint32_t Reflector::_TypeSize( uint32_t type, uint32_t matrix_stride, uint32_t depth ) const
+{
+	// Types are declared before use and cannot nest themselves, the depth limit only guards broken modules.
+	if( !_ValidId( type ) || depth > 32 ) return 0;
+	auto & info				= _ids[ type ];
+	const uint32_t * words	= _code + info.offset;
+	switch( info.opcode ) {
+	case spv::OpTypeBool:
+		return 4;
+	case spv::OpTypeInt:
+	case spv::OpTypeFloat:
+		return words[ 2 ] / 8;
+	case spv::OpTypeVector:
+		return words[ 3 ] * _TypeSize( words[ 2 ], 0, depth + 1 );
+	case spv::OpTypeMatrix:
+		return words[ 3 ] * ( matrix_stride ? matrix_stride : _TypeSize( words[ 2 ], 0, depth + 1 ) );
+	case spv::OpTypeArray:
+	{
+		uint32_t length = _ConstantValue( words[ 3 ] );
+		return length * ( info.array_stride ? info.array_stride : _TypeSize( words[ 2 ], matrix_stride, depth + 1 ) );
+	}
+	case spv::OpTypeStruct:
+	{
+		// Members are laid out by their offset decorations, the size ends with the last one.
+		uint32_t member_count	= ( words[ 0 ] >> spv::WordCountShift ) - 2;
+		uint32_t size			= 0;
+		uint32_t next_offset	= 0;
+		for( uint32_t m=0; m < member_count; ++m ) {
+			auto member			= _FindMember( type, m );
+			uint32_t offset		= member && member->offset != UINT32_MAX ? member->offset : next_offset;
+			next_offset			= offset + _TypeSize( words[ 2 + m ], member ? member->matrix_stride : 0, depth + 1 );
+			size				= std::max( size, next_offset );
+		}
+		return size;
+	}
+	default:
+		return 0;		// runtime arrays and opaque types
+	}
+}
+
+VkFormat Reflector::_VertexFormat( uint32_t type ) const
+{
+	if( !_ValidId( type ) ) return VK_FORMAT_UNDEFINED;
+	auto & info				= _ids[ type ];
+	const uint32_t * words	= _code + info.offset;
+	uint32_t components		= 1;
+	if( info.opcode == spv::OpTypeVector ) {
+		components		= words[ 3 ];
+		if( !_ValidId( words[ 2 ] ) ) return VK_FORMAT_UNDEFINED;
+		words			= _code + _ids[ words[ 2 ] ].offset;
+	}
+	uint32_t component_opcode = words[ 0 ] & spv::OpCodeMask;
+	if( components < 1 || components > 4 ) return VK_FORMAT_UNDEFINED;
+
+	static const VkFormat float_formats[ 4 ]	= { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+	static const VkFormat double_formats[ 4 ]	= { VK_FORMAT_R64_SFLOAT, VK_FORMAT_R64G64_SFLOAT, VK_FORMAT_R64G64B64_SFLOAT, VK_FORMAT_R64G64B64A64_SFLOAT };
+	static const VkFormat int_formats[ 4 ]		= { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+	static const VkFormat uint_formats[ 4 ]		= { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+	if( component_opcode == spv::OpTypeFloat ) {
+		if( words[ 2 ] == 32 ) return float_formats[ components - 1 ];
+		if( words[ 2 ] == 64 ) return double_formats[ components - 1 ];
+	} else if( component_opcode == spv::OpTypeInt && words[ 2 ] == 32 ) {
+		return words[ 3 ] ? int_formats[ components - 1 ] : uint_formats[ components - 1 ];
+	}
+	return VK_FORMAT_UNDEFINED;
+}
+
+void Reflector::_Decorate( IdInfo & info, uint32_t decoration, const uint32_t * literals, uint32_t literal_count )
+{
+	uint32_t literal = literal_count > 0 ? literals[ 0 ] : 0;
+	switch( decoration ) {
+	case spv::DecorationDescriptorSet:		info.set			= literal; break;
+	case spv::DecorationBinding:			info.binding		= literal; break;
+	case spv::DecorationLocation:			info.location		= literal; break;
+	case spv::DecorationSpecId:				info.spec_id		= literal; break;
+	case spv::DecorationBuiltIn:			info.builtin		= literal; break;
+	case spv::DecorationArrayStride:		info.array_stride	= literal; break;
+	case spv::DecorationBlock:				info.block			= true; break;
+	case spv::DecorationBufferBlock:		info.buffer_block	= true; break;
+	default:								break;
+	}
+}
+
+void Reflector::_AddSpecializationConstant( uint32_t id )
+{
+	auto & info = _ids[ id ];
+	if( info.spec_id == UINT32_MAX ) return;		// only used inside OpSpecConstantOp
+
+	ShaderSpecializationConstant constant;
+	constant.constant_id		= info.spec_id;
+	constant.size				= _TypeSize( _code[ info.offset + 1 ], 0 );
+	constant.default_value		= _ConstantValue( id );
+	constant.name				= _Name( id );
+	_reflection.specialization_constants.push_back( std::move( constant ) );
+}
+
+void Reflector::_AddWorkgroupSize( uint32_t id )
+{
+	// The WorkgroupSize built-in wins over the LocalSize execution mode.
+	auto & info = _ids[ id ];
+	uint32_t component_count = ( _code[ info.offset ] >> spv::WordCountShift ) - 3;
+	for( uint32_t i=0; i < 3 && i < component_count; ++i ) {
+		uint32_t component = _code[ info.offset + 3 + i ];
+		if( !_ValidId( component ) ) continue;
+		_reflection.workgroup_size[ i ]					= _ConstantValue( component );
+		_reflection.workgroup_size_constant_ids[ i ]	= _ids[ component ].spec_id;
+	}
+}
+
+void Reflector::_AddVariable( uint32_t result_type, uint32_t id, uint32_t storage_class )
+{
+	auto & pointer = _ids[ result_type ];
+	if( pointer.opcode != spv::OpTypePointer ) return;
+	uint32_t type = _code[ pointer.offset + 3 ];
+	if( !_ValidId( type ) ) return;
+	auto & variable = _ids[ id ];
+
+	switch( storage_class ) {
+	case spv::StorageClassUniformConstant:
+	case spv::StorageClassUniform:
+	case StorageClassStorageBuffer:
+	{
+		if( variable.binding == UINT32_MAX ) return;
+
+		ShaderDescriptorBinding binding;
+		binding.set			= variable.set == UINT32_MAX ? 0 : variable.set;
+		binding.binding		= variable.binding;
+		binding.name		= _Name( id );
+
+		// Arrays of descriptors, runtime arrays have no count.
+		for( uint32_t depth=0; _ids[ type ].opcode == spv::OpTypeArray || _ids[ type ].opcode == spv::OpTypeRuntimeArray; ++depth ) {
+			if( depth > 32 ) return;
+			const uint32_t * words = _code + _ids[ type ].offset;
+			binding.count	*= _ids[ type ].opcode == spv::OpTypeArray ? _ConstantValue( words[ 3 ] ) : 0;
+			type			= words[ 2 ];
+			if( !_ValidId( type ) ) return;
+		}
+
+		auto & info				= _ids[ type ];
+		const uint32_t * words	= _code + info.offset;
+		switch( info.opcode ) {
+		case spv::OpTypeStruct:
+			// Storage buffers are BufferBlock in Uniform before SPIR-V 1.3, Block in StorageBuffer after.
+			if( info.buffer_block || storage_class == StorageClassStorageBuffer )	binding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			else if( info.block )		binding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			break;
+		case spv::OpTypeSampler:
+			binding.type = VK_DESCRIPTOR_TYPE_SAMPLER;
+			break;
+		case spv::OpTypeSampledImage:
+			binding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			break;
+		case spv::OpTypeImage:
+		{
+			// OpTypeImage result sampled_type dim depth arrayed ms sampled format, sampled 2 is a storage image.
+			uint32_t dim		= words[ 3 ];
+			uint32_t sampled	= words[ 7 ];
+			if( dim == spv::DimBuffer ) {
+				binding.type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			} else if( dim == spv::DimSubpassData ) {
+				binding.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			} else {
+				binding.type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+		if( binding.type != VK_DESCRIPTOR_TYPE_MAX_ENUM ) {
+			_reflection.descriptor_bindings.push_back( std::move( binding ) );
+		}
+		break;
+	}
+	case spv::StorageClassPushConstant:
+	{
+		if( _ids[ type ].opcode != spv::OpTypeStruct ) return;
+		uint32_t member_count	= ( _code[ _ids[ type ].offset ] >> spv::WordCountShift ) - 2;
+		uint32_t offset			= UINT32_MAX;
+		for( uint32_t m=0; m < member_count; ++m ) {
+			auto member = _FindMember( type, m );
+			offset = std::min( offset, member && member->offset != UINT32_MAX ? member->offset : 0 );
+		}
+		uint32_t size = _TypeSize( type, 0 );
+		if( size == 0 ) return;
+		_reflection.push_constant_range.stageFlags	= _reflection.stage;
+		_reflection.push_constant_range.offset		= offset;
+		_reflection.push_constant_range.size		= size - offset;
+		break;
+	}
+	case spv::StorageClassInput:
+	{
+		if( _reflection.stage != VK_SHADER_STAGE_VERTEX_BIT ) return;
+		if( variable.builtin != UINT32_MAX || variable.location == UINT32_MAX ) return;
+
+		ShaderVertexInput input;
+		input.location		= variable.location;
+		input.format		= _VertexFormat( type );
+		input.name			= _Name( id );
+		_reflection.vertex_inputs.push_back( std::move( input ) );
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+}
+
+bool ReflectShader( const uint32_t * code, size_t word_count, ShaderReflection & reflection )
+{
+	thread_local ReflectionScratch scratch;
+
+	reflection = ShaderReflection();
+	Reflector reflector( code, word_count, scratch, reflection );
+	return reflector.Reflect();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <string>
+
+struct ShaderDescriptorBinding
+{
+	uint32_t							set						= 0;
+	uint32_t							binding					= 0;
+	VkDescriptorType					type					= VK_DESCRIPTOR_TYPE_MAX_ENUM;
+	uint32_t							count					= 1;		// 0 for runtime sized arrays
+	std::string							name;
+};
+
+struct ShaderVertexInput
+{
+	uint32_t							location				= 0;
+	VkFormat							format					= VK_FORMAT_UNDEFINED;
+	std::string							name;
+};
+
+struct ShaderSpecializationConstant
+{
+	uint32_t							constant_id				= 0;
+	uint32_t							size					= 0;		// bytes, bool constants are 4 bytes like VkBool32
+	uint32_t							default_value			= 0;		// bit pattern of the default, the low 32 bits for 64 bit types
+	std::string							name;
+};
+
+// Everything a pipeline needs to know about a shader module.
+struct ShaderReflection
+{
+	VkShaderStageFlagBits				stage					= VkShaderStageFlagBits( 0 );
+	std::string							entry_point;
+	std::vector<ShaderDescriptorBinding>		descriptor_bindings;		// sorted by set and binding
+	VkPushConstantRange					push_constant_range		= {};		// size 0 if there are no push constants
+	std::vector<ShaderVertexInput>		vertex_inputs;						// vertex shaders only, sorted by location
+	std::vector<ShaderSpecializationConstant>	specialization_constants;
+	uint32_t							workgroup_size[ 3 ]		= { 0, 0, 0 };
+	uint32_t							workgroup_size_constant_ids[ 3 ]	= { UINT32_MAX, UINT32_MAX, UINT32_MAX };	// specialization constant that overrides each size
+};
+
+// Reflects the first entry point of a SPIR-V module in a single walk over its instructions.
+// SPIR-V declares decorations before types and types before the variables that use them,
+// so every variable is resolved as soon as it is met. The per id scratch is kept per
+// thread and reused, reflecting a module does not allocate apart from the results.
+// Returns false if the module is not valid SPIR-V.
+bool									ReflectShader( const uint32_t * code, size_t word_count, ShaderReflection & reflection );
@@ -0,0 +1,152 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "ShaderVariantManager.h"
+#include "ShaderModuleCache.h"
+#include "PipelineLayoutCache.h"
+#include "Renderer.h"
+#include "Shared.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+ShaderVariantManager::ShaderVariantManager( Renderer * renderer )
+{
+	_renderer		= renderer;
+	_device			= renderer->GetVulkanDevice();
+}
+
+ShaderVariantManager::~ShaderVariantManager()
+{
+	// Modules and layouts belong to the renderer's caches, only the pipelines are ours.
+	for( auto & shader : _shaders ) {
+		for( auto & variant : shader.second.variants ) {
+			vkDestroyPipeline( _device, variant.second, nullptr );
+		}
+	}
+	_shaders.clear();
+}
+
+bool ShaderVariantManager::AddShader( const std::string & name, const uint32_t * code, size_t word_count )
+{
+	Shader shader;
+	if( !ReflectShader( code, word_count, shader.reflection ) ) return false;
+	shader.module	= _renderer->GetShaderModuleCache()->GetShaderModule( code, word_count );
+	shader.layout	= _renderer->GetPipelineLayoutCache()->GetPipelineLayout( { &shader.reflection } );
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	assert( _shaders.find( name ) == _shaders.end() && "Shader variant manager: shader added twice." );
+	_shaders[ name ] = std::move( shader );
+	return true;
+}
+
+const ShaderReflection * ShaderVariantManager::GetReflection( const std::string & name ) const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	auto shader = _shaders.find( name );
+	return shader != _shaders.end() ? &shader->second.reflection : nullptr;
+}
+
+VkPipeline ShaderVariantManager::GetPipeline( const std::string & name, const SpecializationValues & values, const CreateFunction & create )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	auto found = _shaders.find( name );
+	assert( found != _shaders.end() && "Shader variant manager: unknown shader." );
+	auto & shader		= found->second;
+	auto & constants	= shader.reflection.specialization_constants;
+	++shader.request_count;
+
+	// Two words per constant, whether it is set and its value. 32 bit constants that are
+	// not set are keyed by their default, it is known exactly, 64 bit defaults are not.
+	std::vector<uint64_t> key( constants.size() * 2, 0 );
+	for( size_t i=0; i < constants.size(); ++i ) {
+		if( constants[ i ].size <= sizeof( uint32_t ) ) {
+			key[ i * 2 ]		= 1;
+			key[ i * 2 + 1 ]	= constants[ i ].default_value;
+		}
+	}
+	for( auto & value : values ) {
+		auto constant = std::find_if( constants.begin(), constants.end(), [ &value ]( const ShaderSpecializationConstant & c ) {
+			return c.constant_id == value.first;
+		} );
+		assert( constant != constants.end() && "Shader variant manager: the shader has no such specialization constant." );
+		size_t i			= size_t( constant - constants.begin() );
+		key[ i * 2 ]		= 1;
+		key[ i * 2 + 1 ]	= constant->size <= sizeof( uint32_t ) ? uint64_t( uint32_t( value.second ) ) : value.second;
+	}
+
+	auto existing = shader.variants.find( key );
+	if( existing != shader.variants.end() ) {
+		return existing->second;
+	}
+
+	std::vector<VkSpecializationMapEntry> map_entries;
+	std::vector<uint8_t> data;
+	for( size_t i=0; i < constants.size(); ++i ) {
+		if( !key[ i * 2 ] ) continue;
+		VkSpecializationMapEntry map_entry {};
+		map_entry.constantID	= constants[ i ].constant_id;
+		map_entry.offset		= uint32_t( data.size() );
+		map_entry.size			= constants[ i ].size;
+		map_entries.push_back( map_entry );
+		data.resize( data.size() + constants[ i ].size );
+		// Little endian, the low bytes of the value are the constant.
+		std::memcpy( data.data() + map_entry.offset, &key[ i * 2 + 1 ], constants[ i ].size );
+	}
+
+	VkSpecializationInfo specialization_info {};
+	specialization_info.mapEntryCount	= uint32_t( map_entries.size() );
+	specialization_info.pMapEntries		= map_entries.data();
+	specialization_info.dataSize		= data.size();
+	specialization_info.pData			= data.data();
+
+	auto pipeline = create( shader.module, shader.layout, &specialization_info );
+	shader.variants[ key ] = pipeline;
+	return pipeline;
+}
+
+VkPipeline ShaderVariantManager::GetComputePipeline( const std::string & name, const SpecializationValues & values )
+{
+	return GetPipeline( name, values, [ this, &name ]( VkShaderModule module, VkPipelineLayout layout, const VkSpecializationInfo * specialization_info ) {
+		// Called under the lock, the shader is there and stays.
+		auto & reflection = _shaders.find( name )->second.reflection;
+		assert( reflection.stage == VK_SHADER_STAGE_COMPUTE_BIT && "Shader variant manager: not a compute shader." );
+
+		VkComputePipelineCreateInfo pipeline_create_info {};
+		pipeline_create_info.sType						= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeline_create_info.stage.sType				= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipeline_create_info.stage.stage				= VK_SHADER_STAGE_COMPUTE_BIT;
+		pipeline_create_info.stage.module				= module;
+		pipeline_create_info.stage.pName				= reflection.entry_point.c_str();
+		pipeline_create_info.stage.pSpecializationInfo	= specialization_info;
+		pipeline_create_info.layout						= layout;
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		ErrorCheck( vkCreateComputePipelines( _device, _renderer->GetVulkanPipelineCache(), 1, &pipeline_create_info, nullptr, &pipeline ) );
+		return pipeline;
+	} );
+}
+
+std::vector<ShaderVariantManager::ShaderReport> ShaderVariantManager::GetReport() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	std::vector<ShaderReport> report;
+	for( auto & entry : _shaders ) {
+		auto & shader = entry.second;
+		ShaderReport shader_report;
+		shader_report.name				= entry.first;
+		shader_report.variant_count		= uint32_t( shader.variants.size() );
+		shader_report.request_count		= shader.request_count;
+		for( size_t i=0; i < shader.reflection.specialization_constants.size(); ++i ) {
+			std::set<std::pair<uint64_t, uint64_t>> distinct;
+			for( auto & variant : shader.variants ) {
+				distinct.insert( std::make_pair( variant.first[ i * 2 ], variant.first[ i * 2 + 1 ] ) );
+			}
+			shader_report.distinct_values.push_back( std::make_pair( shader.reflection.specialization_constants[ i ].constant_id, uint32_t( distinct.size() ) ) );
+		}
+		report.push_back( std::move( shader_report ) );
+	}
+	return report;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Platform.h"
+#include "ShaderReflection.h"
+
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <functional>
+
+class Renderer;
+
+// One SPIR-V module per shader instead of a permutation per feature combination. The
+// specialization constants of a shader are found by reflection, every combination of
+// values asked for becomes a pipeline that is created once and cached by its values.
+// Constants left out keep the default of the shader, so asking for the default explicitly
+// gives the same pipeline. Pipelines are destroyed with the manager. Thread safe, the
+// lock is held while a pipeline is created.
+class ShaderVariantManager
+{
+public:
+	// Constant id and value, bool constants take VK_TRUE or VK_FALSE.
+	typedef std::vector<std::pair<uint32_t, uint64_t>>		SpecializationValues;
+
+	// Creates the pipeline of a variant for pipelines with more state than a compute pipeline.
+	typedef std::function<VkPipeline( VkShaderModule module, VkPipelineLayout layout, const VkSpecializationInfo * specialization_info )>	CreateFunction;
+
+	struct ShaderReport
+	{
+		std::string							name;
+		uint32_t							variant_count			= 0;
+		uint64_t							request_count			= 0;
+		// Constant id and how many different values the variants use, a constant that
+		// always has the same value can be baked into the shader.
+		std::vector<std::pair<uint32_t, uint32_t>>	distinct_values;
+	};
+
+	ShaderVariantManager( Renderer * renderer );
+	~ShaderVariantManager();
+
+	// False if the module cannot be reflected.
+	bool								AddShader( const std::string & name, const uint32_t * code, size_t word_count );
+	const ShaderReflection			*	GetReflection( const std::string & name ) const;
+
+	VkPipeline							GetPipeline( const std::string & name, const SpecializationValues & values, const CreateFunction & create );
+	VkPipeline							GetComputePipeline( const std::string & name, const SpecializationValues & values );
+
+	std::vector<ShaderReport>			GetReport() const;
+
+private:
+	struct Shader
+	{
+		ShaderReflection					reflection;
+		VkShaderModule						module					= VK_NULL_HANDLE;
+		VkPipelineLayout					layout					= VK_NULL_HANDLE;
+		std::map<std::vector<uint64_t>, VkPipeline>	variants;
+		uint64_t							request_count			= 0;
+	};
+
+	Renderer						*	_renderer						= nullptr;
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	mutable std::mutex					_mutex;
+	std::map<std::string, Shader>		_shaders;
+};
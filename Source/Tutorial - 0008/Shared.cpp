@@ -2,6 +2,18 @@
 #include "BUILD_OPTIONS.h"
 #include "Shared.h"
 
+uint32_t FindMemoryTypeIndex( const VkPhysicalDeviceMemoryProperties * gpu_memory_properties, uint32_t memory_type_bits, VkMemoryPropertyFlags required_properties )
+{
+	for( uint32_t i=0; i < gpu_memory_properties->memoryTypeCount; ++i ) {
+		if( memory_type_bits & ( 1u << i ) ) {
+			if( ( gpu_memory_properties->memoryTypes[ i ].propertyFlags & required_properties ) == required_properties ) {
+				return i;
+			}
+		}
+	}
+	return UINT32_MAX;
+}
+
 #if BUILD_ENABLE_VULKAN_RUNTIME_DEBUG
 
 void ErrorCheck( VkResult result )
@@ -6,3 +6,6 @@
 #include <assert.h>
 
 void ErrorCheck( VkResult result );
+
+// Returns UINT32_MAX if none of the memory types allowed by memory_type_bits has all the required properties.
+uint32_t FindMemoryTypeIndex( const VkPhysicalDeviceMemoryProperties * gpu_memory_properties, uint32_t memory_type_bits, VkMemoryPropertyFlags required_properties );
@@ -0,0 +1,456 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "SpirvCompactor.h"
+
+#include <vulkan/spirv.hpp>
+
+// Operands of every instruction as a string of kinds, one character per operand:
+// T result type id, R result id, i id, l literal word, s literal string,
+// * the previous kind repeats until the end of the instruction,
+// m optional image operands mask followed by ids, w OpSwitch literal and label pairs,
+// p OpGroupMemberDecorate id and literal pairs, x OpSpecConstantOp operation and operands.
+// Operands past the end of an instruction are optional ones that are not there.
+static const char * OperandKinds( uint32_t opcode )
+{
+	switch( opcode ) {
+	case spv::OpNop:								return "";
+	case spv::OpUndef:								return "TR";
+	case spv::OpSourceContinued:					return "s";
+	case spv::OpSource:								return "llis";
+	case spv::OpSourceExtension:					return "s";
+	case spv::OpName:								return "is";
+	case spv::OpMemberName:							return "ils";
+	case spv::OpString:								return "Rs";
+	case spv::OpLine:								return "ill";
+	case spv::OpNoLine:								return "";
+	case spv::OpExtension:							return "s";
+	case spv::OpExtInstImport:						return "Rs";
+	case spv::OpExtInst:							return "TRili*";
+	case spv::OpMemoryModel:						return "ll";
+	case spv::OpEntryPoint:							return "lisi*";
+	case spv::OpExecutionMode:						return "il*";
+	case spv::OpCapability:							return "l";
+
+	case spv::OpTypeVoid:
+	case spv::OpTypeBool:
+	case spv::OpTypeSampler:
+	case spv::OpTypeEvent:
+	case spv::OpTypeDeviceEvent:
+	case spv::OpTypeReserveId:
+	case spv::OpTypeQueue:
+	case spv::OpDecorationGroup:
+	case spv::OpLabel:								return "R";
+	case spv::OpTypeInt:							return "Rll";
+	case spv::OpTypeFloat:
+	case spv::OpTypePipe:							return "Rl";
+	case spv::OpTypeVector:
+	case spv::OpTypeMatrix:							return "Ril";
+	case spv::OpTypeImage:							return "Ril*";
+	case spv::OpTypeSampledImage:
+	case spv::OpTypeRuntimeArray:					return "Ri";
+	case spv::OpTypeArray:							return "Rii";
+	case spv::OpTypeStruct:
+	case spv::OpTypeFunction:						return "Ri*";
+	case spv::OpTypeOpaque:							return "Rs";
+	case spv::OpTypePointer:						return "Rli";
+	case spv::OpTypeForwardPointer:					return "il";
+
+	case spv::OpConstantTrue:
+	case spv::OpConstantFalse:
+	case spv::OpConstantNull:
+	case spv::OpSpecConstantTrue:
+	case spv::OpSpecConstantFalse:
+	case spv::OpFunctionParameter:					return "TR";
+	case spv::OpConstant:
+	case spv::OpSpecConstant:						return "TRl*";
+	case spv::OpConstantComposite:
+	case spv::OpSpecConstantComposite:
+	case spv::OpCompositeConstruct:
+	case spv::OpPhi:								return "TRi*";
+	case spv::OpConstantSampler:					return "TRlll";
+	case spv::OpSpecConstantOp:						return "TRx";
+
+	case spv::OpFunction:							return "TRli";
+	case spv::OpFunctionEnd:						return "";
+	case spv::OpFunctionCall:						return "TRii*";
+
+	case spv::OpVariable:							return "TRli*";
+	case spv::OpImageTexelPointer:					return "TRiii";
+	case spv::OpLoad:								return "TRil*";
+	case spv::OpStore:
+	case spv::OpCopyMemory:							return "iil*";
+	case spv::OpCopyMemorySized:					return "iiil*";
+	case spv::OpAccessChain:
+	case spv::OpInBoundsAccessChain:				return "TRii*";
+	case spv::OpPtrAccessChain:
+	case spv::OpInBoundsPtrAccessChain:				return "TRiii*";
+	case spv::OpArrayLength:						return "TRil";
+	case spv::OpGenericPtrMemSemantics:				return "TRi";
+
+	case spv::OpDecorate:							return "il*";
+	case spv::OpMemberDecorate:						return "ill*";
+	case spv::OpGroupDecorate:						return "ii*";
+	case spv::OpGroupMemberDecorate:				return "ip";
+
+	case spv::OpVectorExtractDynamic:				return "TRii";
+	case spv::OpVectorInsertDynamic:				return "TRiii";
+	case spv::OpVectorShuffle:						return "TRiil*";
+	case spv::OpCompositeExtract:					return "TRil*";
+	case spv::OpCompositeInsert:					return "TRiil*";
+
+	case spv::OpSampledImage:						return "TRii";
+	case spv::OpImageSampleImplicitLod:
+	case spv::OpImageSampleExplicitLod:
+	case spv::OpImageSampleProjImplicitLod:
+	case spv::OpImageSampleProjExplicitLod:
+	case spv::OpImageFetch:
+	case spv::OpImageRead:
+	case spv::OpImageSparseSampleImplicitLod:
+	case spv::OpImageSparseSampleExplicitLod:
+	case spv::OpImageSparseSampleProjImplicitLod:
+	case spv::OpImageSparseSampleProjExplicitLod:
+	case spv::OpImageSparseFetch:
+	case spv::OpImageSparseRead:					return "TRiim";
+	case spv::OpImageSampleDrefImplicitLod:
+	case spv::OpImageSampleDrefExplicitLod:
+	case spv::OpImageSampleProjDrefImplicitLod:
+	case spv::OpImageSampleProjDrefExplicitLod:
+	case spv::OpImageGather:
+	case spv::OpImageDrefGather:
+	case spv::OpImageSparseSampleDrefImplicitLod:
+	case spv::OpImageSparseSampleDrefExplicitLod:
+	case spv::OpImageSparseSampleProjDrefImplicitLod:
+	case spv::OpImageSparseSampleProjDrefExplicitLod:
+	case spv::OpImageSparseGather:
+	case spv::OpImageSparseDrefGather:				return "TRiiim";
+	case spv::OpImageWrite:							return "iiim";
+
+	case spv::OpGenericCastToPtrExplicit:			return "TRil";
+
+	// Unary operations.
+	case spv::OpCopyObject:
+	case spv::OpTranspose:
+	case spv::OpImage:
+	case spv::OpImageQueryFormat:
+	case spv::OpImageQueryOrder:
+	case spv::OpImageQuerySize:
+	case spv::OpImageQueryLevels:
+	case spv::OpImageQuerySamples:
+	case spv::OpImageSparseTexelsResident:
+	case spv::OpConvertFToU:
+	case spv::OpConvertFToS:
+	case spv::OpConvertSToF:
+	case spv::OpConvertUToF:
+	case spv::OpUConvert:
+	case spv::OpSConvert:
+	case spv::OpFConvert:
+	case spv::OpQuantizeToF16:
+	case spv::OpConvertPtrToU:
+	case spv::OpSatConvertSToU:
+	case spv::OpSatConvertUToS:
+	case spv::OpConvertUToPtr:
+	case spv::OpPtrCastToGeneric:
+	case spv::OpGenericCastToPtr:
+	case spv::OpBitcast:
+	case spv::OpSNegate:
+	case spv::OpFNegate:
+	case spv::OpAny:
+	case spv::OpAll:
+	case spv::OpIsNan:
+	case spv::OpIsInf:
+	case spv::OpIsFinite:
+	case spv::OpIsNormal:
+	case spv::OpSignBitSet:
+	case spv::OpLogicalNot:
+	case spv::OpNot:
+	case spv::OpBitReverse:
+	case spv::OpBitCount:
+	case spv::OpDPdx:
+	case spv::OpDPdy:
+	case spv::OpFwidth:
+	case spv::OpDPdxFine:
+	case spv::OpDPdyFine:
+	case spv::OpFwidthFine:
+	case spv::OpDPdxCoarse:
+	case spv::OpDPdyCoarse:
+	case spv::OpFwidthCoarse:						return "TRi";
+
+	// Binary operations.
+	case spv::OpImageQuerySizeLod:
+	case spv::OpImageQueryLod:
+	case spv::OpIAdd:
+	case spv::OpFAdd:
+	case spv::OpISub:
+	case spv::OpFSub:
+	case spv::OpIMul:
+	case spv::OpFMul:
+	case spv::OpUDiv:
+	case spv::OpSDiv:
+	case spv::OpFDiv:
+	case spv::OpUMod:
+	case spv::OpSRem:
+	case spv::OpSMod:
+	case spv::OpFRem:
+	case spv::OpFMod:
+	case spv::OpVectorTimesScalar:
+	case spv::OpMatrixTimesScalar:
+	case spv::OpVectorTimesMatrix:
+	case spv::OpMatrixTimesVector:
+	case spv::OpMatrixTimesMatrix:
+	case spv::OpOuterProduct:
+	case spv::OpDot:
+	case spv::OpIAddCarry:
+	case spv::OpISubBorrow:
+	case spv::OpUMulExtended:
+	case spv::OpSMulExtended:
+	case spv::OpLessOrGreater:
+	case spv::OpOrdered:
+	case spv::OpUnordered:
+	case spv::OpLogicalEqual:
+	case spv::OpLogicalNotEqual:
+	case spv::OpLogicalOr:
+	case spv::OpLogicalAnd:
+	case spv::OpIEqual:
+	case spv::OpINotEqual:
+	case spv::OpUGreaterThan:
+	case spv::OpSGreaterThan:
+	case spv::OpUGreaterThanEqual:
+	case spv::OpSGreaterThanEqual:
+	case spv::OpULessThan:
+	case spv::OpSLessThan:
+	case spv::OpULessThanEqual:
+	case spv::OpSLessThanEqual:
+	case spv::OpFOrdEqual:
+	case spv::OpFUnordEqual:
+	case spv::OpFOrdNotEqual:
+	case spv::OpFUnordNotEqual:
+	case spv::OpFOrdLessThan:
+	case spv::OpFUnordLessThan:
+	case spv::OpFOrdGreaterThan:
+	case spv::OpFUnordGreaterThan:
+	case spv::OpFOrdLessThanEqual:
+	case spv::OpFUnordLessThanEqual:
+	case spv::OpFOrdGreaterThanEqual:
+	case spv::OpFUnordGreaterThanEqual:
+	case spv::OpShiftRightLogical:
+	case spv::OpShiftRightArithmetic:
+	case spv::OpShiftLeftLogical:
+	case spv::OpBitwiseOr:
+	case spv::OpBitwiseXor:
+	case spv::OpBitwiseAnd:
+	case spv::OpGroupAll:
+	case spv::OpGroupAny:							return "TRii";
+
+	case spv::OpSelect:
+	case spv::OpBitFieldSExtract:
+	case spv::OpBitFieldUExtract:
+	case spv::OpGroupBroadcast:						return "TRiii";
+	case spv::OpBitFieldInsert:						return "TRiiii";
+
+	case spv::OpEmitVertex:
+	case spv::OpEndPrimitive:
+	case spv::OpKill:
+	case spv::OpReturn:
+	case spv::OpUnreachable:						return "";
+	case spv::OpEmitStreamVertex:
+	case spv::OpEndStreamPrimitive:
+	case spv::OpBranch:
+	case spv::OpReturnValue:						return "i";
+	case spv::OpControlBarrier:						return "iii";
+	case spv::OpMemoryBarrier:						return "ii";
+
+	case spv::OpAtomicLoad:
+	case spv::OpAtomicIIncrement:
+	case spv::OpAtomicIDecrement:
+	case spv::OpAtomicFlagTestAndSet:				return "TRiii";
+	case spv::OpAtomicStore:						return "iiii";
+	case spv::OpAtomicExchange:
+	case spv::OpAtomicIAdd:
+	case spv::OpAtomicISub:
+	case spv::OpAtomicSMin:
+	case spv::OpAtomicUMin:
+	case spv::OpAtomicSMax:
+	case spv::OpAtomicUMax:
+	case spv::OpAtomicAnd:
+	case spv::OpAtomicOr:
+	case spv::OpAtomicXor:							return "TRiiii";
+	case spv::OpAtomicCompareExchange:
+	case spv::OpAtomicCompareExchangeWeak:			return "TRiiiiii";
+	case spv::OpAtomicFlagClear:					return "iii";
+
+	case spv::OpLoopMerge:							return "iil*";
+	case spv::OpSelectionMerge:						return "il";
+	case spv::OpBranchConditional:					return "iiil*";
+	case spv::OpSwitch:								return "iiw";
+	case spv::OpLifetimeStart:
+	case spv::OpLifetimeStop:						return "il";
+
+	case spv::OpGroupAsyncCopy:						return "TRiiiiii";
+	case spv::OpGroupWaitEvents:					return "iii";
+	case spv::OpGroupIAdd:
+	case spv::OpGroupFAdd:
+	case spv::OpGroupFMin:
+	case spv::OpGroupUMin:
+	case spv::OpGroupSMin:
+	case spv::OpGroupFMax:
+	case spv::OpGroupUMax:
+	case spv::OpGroupSMax:							return "TRili";
+
+	default:										return nullptr;		// pipes, device enqueue and anything newer
+	}
+}
+
+static bool IsDebugInstruction( uint32_t opcode )
+{
+	switch( opcode ) {
+	case spv::OpSourceContinued:
+	case spv::OpSource:
+	case spv::OpSourceExtension:
+	case spv::OpName:
+	case spv::OpMemberName:
+	case spv::OpString:
+	case spv::OpLine:
+	case spv::OpNoLine:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool StripAndCompactSpirv( const uint32_t * code, size_t word_count, std::vector<uint32_t> & compacted )
+{
+	compacted.clear();
+	if( word_count < 5 || code[ 0 ] != spv::MagicNumber ) return false;
+	uint32_t bound = code[ 3 ];
+	if( bound == 0 || bound > ( 1u << 22 ) ) return false;
+
+	// New ids are handed out in order of first appearance, definition or use.
+	std::vector<uint32_t> remap( bound, 0 );
+	std::vector<uint32_t> result_types( bound, 0 );
+	std::vector<uint32_t> int_widths( bound, 0 );
+	uint32_t next_id = 1;
+
+	compacted.reserve( word_count );
+	compacted.insert( compacted.end(), code, code + 5 );
+
+	bool valid = true;
+	auto remap_id = [ & ]( uint32_t id ) -> uint32_t {
+		if( id == 0 || id >= bound ) {
+			valid = false;
+			return 0;
+		}
+		if( remap[ id ] == 0 ) {
+			remap[ id ] = next_id++;
+		}
+		return remap[ id ];
+	};
+
+	size_t position = 5;
+	while( position < word_count && valid ) {
+		uint32_t opcode		= code[ position ] & spv::OpCodeMask;
+		uint32_t count		= code[ position ] >> spv::WordCountShift;
+		if( count == 0 || position + count > word_count ) break;
+		auto kinds = OperandKinds( opcode );
+		if( !kinds ) break;
+		if( IsDebugInstruction( opcode ) ) {
+			position += count;
+			continue;
+		}
+
+		size_t end		= position + count;
+		size_t word		= position + 1;
+		uint32_t type	= 0;
+		compacted.push_back( code[ position ] );
+		for( const char * kind = kinds; *kind && word < end && valid; kind += kind[ 1 ] == '*' ? 2 : 1 ) {
+			bool repeat = kind[ 1 ] == '*';
+			do {
+				switch( *kind ) {
+				case 'T':
+					type = code[ word ];
+					compacted.push_back( remap_id( code[ word++ ] ) );
+					break;
+				case 'R':
+					if( code[ word ] < bound ) {
+						result_types[ code[ word ] ]		= type;
+						if( opcode == spv::OpTypeInt && count >= 3 ) {
+							int_widths[ code[ word ] ]		= code[ word + 1 ];
+						}
+					}
+					compacted.push_back( remap_id( code[ word++ ] ) );
+					break;
+				case 'i':
+					compacted.push_back( remap_id( code[ word++ ] ) );
+					break;
+				case 'l':
+					compacted.push_back( code[ word++ ] );
+					break;
+				case 's':
+					// Null terminated and padded to whole words.
+					while( word < end ) {
+						uint32_t characters = code[ word ];
+						compacted.push_back( code[ word++ ] );
+						if( ( characters & 0xFF000000u ) == 0 || ( characters & 0x00FF0000u ) == 0 ||
+							( characters & 0x0000FF00u ) == 0 || ( characters & 0x000000FFu ) == 0 ) break;
+					}
+					break;
+				case 'm':
+					compacted.push_back( code[ word++ ] );
+					while( word < end ) {
+						compacted.push_back( remap_id( code[ word++ ] ) );
+					}
+					break;
+				case 'w':
+				{
+					// Case literals are as wide as the selector, 64 bit selectors take two words.
+					uint32_t selector		= code[ position + 1 ];
+					uint32_t width			= selector < bound && result_types[ selector ] < bound ? int_widths[ result_types[ selector ] ] : 0;
+					uint32_t literal_words	= width > 32 ? 2 : 1;
+					while( word + literal_words < end ) {
+						for( uint32_t i=0; i < literal_words; ++i ) {
+							compacted.push_back( code[ word++ ] );
+						}
+						compacted.push_back( remap_id( code[ word++ ] ) );
+					}
+					if( word != end ) valid = false;
+					break;
+				}
+				case 'p':
+					while( word + 1 < end ) {
+						compacted.push_back( remap_id( code[ word++ ] ) );
+						compacted.push_back( code[ word++ ] );
+					}
+					if( word != end ) valid = false;
+					break;
+				case 'x':
+				{
+					// Composite extracts, inserts and shuffles carry literal indices after their ids.
+					uint32_t operation	= code[ word ];
+					uint32_t id_count	= UINT32_MAX;
+					if( operation == spv::OpCompositeExtract )		id_count = 1;
+					if( operation == spv::OpCompositeInsert )		id_count = 2;
+					if( operation == spv::OpVectorShuffle )			id_count = 2;
+					compacted.push_back( code[ word++ ] );
+					for( uint32_t i=0; word < end; ++i ) {
+						compacted.push_back( i < id_count ? remap_id( code[ word ] ) : code[ word ] );
+						++word;
+					}
+					break;
+				}
+				default:
+					valid = false;
+					break;
+				}
+			} while( repeat && word < end && valid );
+		}
+		// Operands the kinds do not describe would be copied without remapping.
+		if( word != end ) valid = false;
+		position = end;
+	}
+	if( position != word_count || !valid ) {
+		compacted.clear();
+		return false;
+	}
+	compacted[ 3 ] = next_id;
+	return true;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+
+// Removes the debug instructions of a SPIR-V module, OpSource*, OpName, OpMemberName,
+// OpString, OpLine and OpNoLine, and renumbers the remaining ids densely in the order they
+// appear so the module's bound is as small as possible. Drivers parse fewer words and size
+// their per id tables by the bound. Names of reflected bindings are lost.
+// Returns false and leaves compacted empty if the module is not valid SPIR-V or uses
+// instructions the pass does not know the operands of, the kernel only pipe and enqueue
+// instructions. Running the pass on its own output returns the same words.
+bool									StripAndCompactSpirv( const uint32_t * code, size_t word_count, std::vector<uint32_t> & compacted );
@@ -0,0 +1,334 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "SubmissionThread.h"
+#include "Renderer.h"
+#include "Shared.h"
+
+#include <assert.h>
+
+static float MillisecondsSince( std::chrono::steady_clock::time_point begin )
+{
+	return std::chrono::duration<float, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+}
+
+SubmissionThread::Ring::Ring( uint32_t capacity )
+{
+	assert( capacity > 0 && ( capacity & ( capacity - 1 ) ) == 0 && "Submission thread: ring capacity has to be a power of two." );
+	_cells		= new Cell[ capacity ];
+	_mask		= capacity - 1;
+	for( uint32_t i=0; i < capacity; ++i ) {
+		_cells[ i ].sequence.store( i, std::memory_order_relaxed );
+		_cells[ i ].work	= nullptr;
+	}
+	_push_position.store( 0, std::memory_order_relaxed );
+	_pop_position.store( 0, std::memory_order_relaxed );
+}
+
+SubmissionThread::Ring::~Ring()
+{
+	delete[] _cells;
+}
+
+bool SubmissionThread::Ring::Push( Work * work )
+{
+	auto position = _push_position.load( std::memory_order_relaxed );
+	Cell * cell = nullptr;
+	while( true ) {
+		cell				= &_cells[ position & _mask ];
+		auto sequence		= cell->sequence.load( std::memory_order_acquire );
+		auto difference		= int64_t( sequence ) - int64_t( position );
+		if( difference == 0 ) {
+			// The cell is free for this position, claim it.
+			if( _push_position.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) ) break;
+		} else if( difference < 0 ) {
+			return false;		// full
+		} else {
+			position = _push_position.load( std::memory_order_relaxed );
+		}
+	}
+	cell->work = work;
+	cell->sequence.store( position + 1, std::memory_order_release );
+	return true;
+}
+
+bool SubmissionThread::Ring::Pop( Work *& work )
+{
+	auto position = _pop_position.load( std::memory_order_relaxed );
+	Cell * cell = nullptr;
+	while( true ) {
+		cell				= &_cells[ position & _mask ];
+		auto sequence		= cell->sequence.load( std::memory_order_acquire );
+		auto difference		= int64_t( sequence ) - int64_t( position + 1 );
+		if( difference == 0 ) {
+			if( _pop_position.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) ) break;
+		} else if( difference < 0 ) {
+			return false;		// empty
+		} else {
+			position = _pop_position.load( std::memory_order_relaxed );
+		}
+	}
+	work = cell->work;
+	// Free for the push one lap later.
+	cell->sequence.store( position + _mask + 1, std::memory_order_release );
+	return true;
+}
+
+SubmissionThread::SubmissionThread( Renderer * renderer ) :
+	_free_ring( _work_count ),
+	_work_ring( _work_count )
+{
+	_renderer		= renderer;
+	_queue			= renderer->GetVulkanQueue();
+
+	_stop			= false;
+	_sleeping		= false;
+	_queued_count	= 0;
+	_executed_count	= 0;
+	_present_result	= VK_SUCCESS;
+
+	_works.resize( _work_count );
+	for( auto & work : _works ) {
+		work = new Work;
+		_free_ring.Push( work );
+	}
+}
+
+SubmissionThread::~SubmissionThread()
+{
+	SetEnabled( false );
+	for( auto work : _works ) {
+		delete work;
+	}
+	_works.clear();
+}
+
+void SubmissionThread::SetEnabled( bool enable )
+{
+	if( enable == _enabled ) return;
+	if( enable ) {
+		_Start();
+	} else {
+		Drain();
+		_Stop();
+	}
+	_enabled = enable;
+}
+
+bool SubmissionThread::IsEnabled() const
+{
+	return _enabled;
+}
+
+void SubmissionThread::Submit( std::vector<QueueSubmission> && submissions, VkFence fence )
+{
+	if( !_enabled ) {
+		Work work;
+		work.type			= WorkType::SUBMIT;
+		work.submissions	= std::move( submissions );
+		work.fence			= fence;
+		std::lock_guard<std::mutex> lock( _queue_mutex );
+		_Execute( work );
+		return;
+	}
+	auto work			= _AcquireWork();
+	work->type			= WorkType::SUBMIT;
+	work->submissions	= std::move( submissions );
+	work->fence			= fence;
+	_Queue( work );
+}
+
+VkResult SubmissionThread::Present( VkSwapchainKHR swapchain, uint32_t image_index, VkSemaphore wait_semaphore )
+{
+	if( !_enabled ) {
+		Work work;
+		work.type				= WorkType::PRESENT;
+		work.swapchain			= swapchain;
+		work.image_index		= image_index;
+		work.wait_semaphore		= wait_semaphore;
+		std::lock_guard<std::mutex> lock( _queue_mutex );
+		_Execute( work );
+		return VkResult( _present_result.exchange( VK_SUCCESS ) );
+	}
+	auto work				= _AcquireWork();
+	work->type				= WorkType::PRESENT;
+	work->swapchain			= swapchain;
+	work->image_index		= image_index;
+	work->wait_semaphore	= wait_semaphore;
+	_Queue( work );
+	return VkResult( _present_result.exchange( VK_SUCCESS ) );
+}
+
+void SubmissionThread::EndFrame( uint64_t frame )
+{
+	if( !_enabled ) {
+		Work work;
+		work.type			= WorkType::END_FRAME;
+		work.frame			= frame;
+		work.queue_time		= std::chrono::steady_clock::now();
+		std::lock_guard<std::mutex> lock( _queue_mutex );
+		_Execute( work );
+		return;
+	}
+	auto work			= _AcquireWork();
+	work->type			= WorkType::END_FRAME;
+	work->frame			= frame;
+	_Queue( work );
+}
+
+SubmissionTimings SubmissionThread::GetLastFrameTimings() const
+{
+	std::lock_guard<std::mutex> lock( _timings_mutex );
+	return _last_frame_timings;
+}
+
+void SubmissionThread::Drain()
+{
+	if( !_enabled ) return;
+	auto target = _queued_count.load();
+	std::unique_lock<std::mutex> lock( _wake_mutex );
+	_drain_condition.wait( lock, [ this, target ]() { return _executed_count.load() >= target; } );
+}
+
+void SubmissionThread::WaitIdle()
+{
+	Drain();
+	std::lock_guard<std::mutex> lock( _queue_mutex );
+	ErrorCheck( vkQueueWaitIdle( _queue ) );
+}
+
+std::unique_lock<std::mutex> SubmissionThread::LockQueue()
+{
+	return std::unique_lock<std::mutex>( _queue_mutex );
+}
+
+SubmissionThread::Work * SubmissionThread::_AcquireWork()
+{
+	// Only runs dry if the thread is far behind, it returns works as it goes.
+	Work * work = nullptr;
+	while( !_free_ring.Pop( work ) ) {
+		std::this_thread::yield();
+	}
+	return work;
+}
+
+void SubmissionThread::_Queue( Work * work )
+{
+	work->queue_time = std::chrono::steady_clock::now();
+	while( !_work_ring.Push( work ) ) {
+		std::this_thread::yield();
+	}
+	// Counted after the push, a thread that sees the count finds the work in the ring.
+	_queued_count.fetch_add( 1 );
+	if( _sleeping.load() ) {
+		std::lock_guard<std::mutex> lock( _wake_mutex );
+		_wake_condition.notify_one();
+	}
+}
+
+void SubmissionThread::_Execute( Work & work )
+{
+	switch( work.type ) {
+	case WorkType::SUBMIT:
+	{
+		auto begin = std::chrono::steady_clock::now();
+		_submit_infos.resize( work.submissions.size() );
+		for( size_t i=0; i < work.submissions.size(); ++i ) {
+			auto & submission	= work.submissions[ i ];
+			auto & submit_info	= _submit_infos[ i ];
+			submit_info							= {};
+			submit_info.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submit_info.waitSemaphoreCount		= uint32_t( submission.wait_semaphores.size() );
+			submit_info.pWaitSemaphores			= submission.wait_semaphores.data();
+			submit_info.pWaitDstStageMask		= submission.wait_stages.data();
+			submit_info.commandBufferCount		= uint32_t( submission.command_buffers.size() );
+			submit_info.pCommandBuffers			= submission.command_buffers.data();
+			submit_info.signalSemaphoreCount	= uint32_t( submission.signal_semaphores.size() );
+			submit_info.pSignalSemaphores		= submission.signal_semaphores.data();
+		}
+		ErrorCheck( vkQueueSubmit( _queue, uint32_t( _submit_infos.size() ), _submit_infos.data(), work.fence ) );
+		work.submissions.clear();
+		_frame_submit_ms += MillisecondsSince( begin );
+		break;
+	}
+	case WorkType::PRESENT:
+	{
+		auto begin = std::chrono::steady_clock::now();
+		VkPresentInfoKHR present_info {};
+		present_info.sType					= VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		present_info.waitSemaphoreCount		= 1;
+		present_info.pWaitSemaphores		= &work.wait_semaphore;
+		present_info.swapchainCount			= 1;
+		present_info.pSwapchains			= &work.swapchain;
+		present_info.pImageIndices			= &work.image_index;
+		auto result = vkQueuePresentKHR( _queue, &present_info );
+		_frame_present_ms += MillisecondsSince( begin );
+
+		// Keep the first result that needs attention until the window picks it up.
+		if( result != VK_SUCCESS ) {
+			int32_t expected = VK_SUCCESS;
+			_present_result.compare_exchange_strong( expected, result );
+		}
+		break;
+	}
+	case WorkType::END_FRAME:
+	{
+		std::lock_guard<std::mutex> lock( _timings_mutex );
+		_last_frame_timings.frame			= work.frame;
+		_last_frame_timings.submit_ms		= _frame_submit_ms;
+		_last_frame_timings.present_ms		= _frame_present_ms;
+		_last_frame_timings.queued_ms		= MillisecondsSince( work.queue_time );
+		_frame_submit_ms					= 0.0f;
+		_frame_present_ms					= 0.0f;
+		break;
+	}
+	default:
+		assert( 0 && "Submission thread: unknown work type." );
+		break;
+	}
+}
+
+void SubmissionThread::_Run()
+{
+	while( true ) {
+		Work * work = nullptr;
+		if( !_work_ring.Pop( work ) ) {
+			std::unique_lock<std::mutex> lock( _wake_mutex );
+			_sleeping.store( true );
+			_wake_condition.wait( lock, [ this ]() { return _stop.load() || _queued_count.load() > _executed_count.load(); } );
+			_sleeping.store( false );
+			if( _stop.load() && _queued_count.load() == _executed_count.load() ) break;
+			continue;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock( _queue_mutex );
+			_Execute( *work );
+		}
+		while( !_free_ring.Push( work ) ) {
+			std::this_thread::yield();
+		}
+
+		_executed_count.fetch_add( 1 );
+		{
+			std::lock_guard<std::mutex> lock( _wake_mutex );
+		}
+		_drain_condition.notify_all();
+	}
+}
+
+void SubmissionThread::_Start()
+{
+	_stop		= false;
+	_thread		= std::thread( &SubmissionThread::_Run, this );
+}
+
+void SubmissionThread::_Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock( _wake_mutex );
+		_stop = true;
+	}
+	_wake_condition.notify_one();
+	_thread.join();
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+class Renderer;
+
+// One batch element of a vkQueueSubmit with the arrays it points to.
+struct QueueSubmission
+{
+	std::vector<VkSemaphore>			wait_semaphores;
+	std::vector<VkPipelineStageFlags>	wait_stages;
+	std::vector<VkCommandBuffer>		command_buffers;
+	std::vector<VkSemaphore>			signal_semaphores;
+};
+
+// Time the queue calls of one frame took on the thread that made them.
+struct SubmissionTimings
+{
+	uint64_t							frame					= 0;
+	float								submit_ms				= 0.0f;		// all vkQueueSubmit calls of the frame
+	float								present_ms				= 0.0f;		// vkQueuePresentKHR
+	float								queued_ms				= 0.0f;		// from EndFrame() until the thread got to it
+};
+
+// Owns every vkQueueSubmit and vkQueuePresentKHR on the renderer's queue. When enabled
+// the calls are handed to a dedicated thread through a lock-free ring, the recording
+// thread can start on the next frame while the driver does its submission work or
+// blocks in present. When disabled the calls are made right away on the calling thread.
+//
+// Queues and swapchains need external synchronization, anything else that uses them,
+// vkAcquireNextImageKHR or vkQueueWaitIdle, goes through LockQueue() or WaitIdle().
+class SubmissionThread
+{
+public:
+	SubmissionThread( Renderer * renderer );
+	~SubmissionThread();
+
+	// Switching waits for everything queued so far to be handed to the driver.
+	void								SetEnabled( bool enable );
+	bool								IsEnabled() const;
+
+	// One vkQueueSubmit, a fence is submitted even without submissions.
+	void								Submit( std::vector<QueueSubmission> && submissions, VkFence fence );
+
+	// With the thread enabled the result is the first error or VK_SUBOPTIMAL_KHR of an earlier
+	// present that was not yet returned, the present itself is reported by a later call.
+	VkResult							Present( VkSwapchainKHR swapchain, uint32_t image_index, VkSemaphore wait_semaphore );
+
+	// Closes the timings of the frame, reported by GetLastFrameTimings() once the thread got to it.
+	void								EndFrame( uint64_t frame );
+	SubmissionTimings					GetLastFrameTimings() const;
+
+	// Waits until everything queued so far has been handed to the driver.
+	void								Drain();
+
+	// Drain() and vkQueueWaitIdle().
+	void								WaitIdle();
+
+	// Host synchronization for the queue and the swapchains with the submission thread.
+	std::unique_lock<std::mutex>		LockQueue();
+
+private:
+	enum class WorkType
+	{
+		SUBMIT,
+		PRESENT,
+		END_FRAME,
+	};
+
+	struct Work
+	{
+		WorkType							type					= WorkType::SUBMIT;
+		std::vector<QueueSubmission>		submissions;
+		VkFence								fence					= VK_NULL_HANDLE;
+		VkSwapchainKHR						swapchain				= VK_NULL_HANDLE;
+		uint32_t							image_index				= 0;
+		VkSemaphore							wait_semaphore			= VK_NULL_HANDLE;
+		uint64_t							frame					= 0;
+		std::chrono::steady_clock::time_point	queue_time;
+	};
+
+	// Bounded multi producer, multi consumer ring of work pointers, every cell carries
+	// a sequence number that tells producers and consumers whose turn it is.
+	class Ring
+	{
+	public:
+		Ring( uint32_t capacity );
+		~Ring();
+		bool								Push( Work * work );
+		bool								Pop( Work *& work );
+
+	private:
+		struct Cell
+		{
+			std::atomic<uint64_t>				sequence;
+			Work							*	work;
+		};
+		Cell							*	_cells					= nullptr;
+		uint64_t							_mask					= 0;
+		std::atomic<uint64_t>				_push_position;
+		std::atomic<uint64_t>				_pop_position;
+	};
+
+	Work							*	_AcquireWork();
+	void								_Queue( Work * work );
+	void								_Execute( Work & work );
+	void								_Run();
+	void								_Start();
+	void								_Stop();
+
+	static const uint32_t				_work_count						= 64;
+
+	Renderer						*	_renderer						= nullptr;
+	VkQueue								_queue							= VK_NULL_HANDLE;
+
+	std::mutex							_queue_mutex;
+	std::vector<VkSubmitInfo>			_submit_infos;					// scratch, used under _queue_mutex
+
+	std::vector<Work*>					_works;
+	Ring								_free_ring;
+	Ring								_work_ring;
+
+	std::thread							_thread;
+	bool								_enabled						= false;
+	std::atomic<bool>					_stop;
+	std::atomic<bool>					_sleeping;
+	std::atomic<uint64_t>				_queued_count;
+	std::atomic<uint64_t>				_executed_count;
+	std::mutex							_wake_mutex;
+	std::condition_variable				_wake_condition;
+	std::condition_variable				_drain_condition;
+
+	std::atomic<int32_t>				_present_result;
+	float								_frame_submit_ms				= 0.0f;		// used under _queue_mutex
+	float								_frame_present_ms				= 0.0f;
+	mutable std::mutex					_timings_mutex;
+	SubmissionTimings					_last_frame_timings;
+};
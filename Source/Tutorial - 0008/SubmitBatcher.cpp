@@ -0,0 +1,138 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "SubmitBatcher.h"
+#include "Renderer.h"
+#include "Shared.h"
+#include "CommandBufferCache.h"
+
+#include <unordered_map>
+#include <string>
+#include <algorithm>
+
+SubmitBatcher::SubmitBatcher( Renderer * renderer )
+{
+	_renderer		= renderer;
+	_device			= renderer->GetVulkanDevice();
+}
+
+SubmitBatcher::~SubmitBatcher()
+{
+	Flush();
+}
+
+void SubmitBatcher::Submit( const VkSubmitInfo & submit_info, VkFence fence )
+{
+	QueueSubmission pending;
+	pending.wait_semaphores.assign( submit_info.pWaitSemaphores, submit_info.pWaitSemaphores + submit_info.waitSemaphoreCount );
+	pending.wait_stages.assign( submit_info.pWaitDstStageMask, submit_info.pWaitDstStageMask + submit_info.waitSemaphoreCount );
+	pending.command_buffers.assign( submit_info.pCommandBuffers, submit_info.pCommandBuffers + submit_info.commandBufferCount );
+	pending.signal_semaphores.assign( submit_info.pSignalSemaphores, submit_info.pSignalSemaphores + submit_info.signalSemaphoreCount );
+
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_pending.push_back( std::move( pending ) );
+		++_frame_statistics.requested_submits;
+	}
+	if( fence != VK_NULL_HANDLE ) {
+		Flush( fence );
+	}
+}
+
+void SubmitBatcher::Flush( VkFence fence )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	if( _pending.empty() && fence == VK_NULL_HANDLE ) return;
+
+	// Which pending submission signals a semaphore, a binary semaphore has one signal per wait.
+	std::unordered_map<VkSemaphore, size_t> signaled_by;
+	for( size_t i=0; i < _pending.size(); ++i ) {
+		for( auto semaphore : _pending[ i ].signal_semaphores ) {
+			signaled_by[ semaphore ] = i;
+		}
+	}
+
+	// Waits on semaphores that are signaled earlier in the same flush become barriers.
+	std::vector<VkPipelineStageFlags> barrier_stages( _pending.size(), 0 );
+	for( size_t i=0; i < _pending.size(); ++i ) {
+		auto & pending = _pending[ i ];
+		for( size_t w=0; w < pending.wait_semaphores.size(); ) {
+			auto signal = signaled_by.find( pending.wait_semaphores[ w ] );
+			if( signal == signaled_by.end() || signal->second >= i ) {
+				++w;
+				continue;
+			}
+			auto & signaler = _pending[ signal->second ];
+			if( signaler.command_buffers.empty() && !signaler.wait_semaphores.empty() ) {
+				// Only forwards other waits, those would have to move here. Keep it.
+				++w;
+				continue;
+			}
+			signaler.signal_semaphores.erase( std::find( signaler.signal_semaphores.begin(), signaler.signal_semaphores.end(), signal->first ) );
+			signaled_by.erase( signal );
+
+			// Even a signal from a submission without any work covers everything submitted before
+			// it on the queue, earlier flushes included, the barrier keeps that dependency.
+			barrier_stages[ i ]	|= pending.wait_stages[ w ];
+			pending.wait_semaphores.erase( pending.wait_semaphores.begin() + w );
+			pending.wait_stages.erase( pending.wait_stages.begin() + w );
+			++_frame_statistics.elided_semaphores;
+		}
+	}
+
+	// Build the submit infos, a submission without waits joins the previous one if that has no signals.
+	std::vector<QueueSubmission> merged;
+	for( size_t i=0; i < _pending.size(); ++i ) {
+		auto & pending = _pending[ i ];
+		if( barrier_stages[ i ] ) {
+			pending.command_buffers.insert( pending.command_buffers.begin(), _GetBarrierCommandBuffer( barrier_stages[ i ] ) );
+		}
+		if( pending.wait_semaphores.empty() && pending.command_buffers.empty() && pending.signal_semaphores.empty() ) continue;
+
+		if( !merged.empty() && pending.wait_semaphores.empty() && merged.back().signal_semaphores.empty() ) {
+			auto & previous = merged.back();
+			previous.command_buffers.insert( previous.command_buffers.end(), pending.command_buffers.begin(), pending.command_buffers.end() );
+			previous.signal_semaphores	= std::move( pending.signal_semaphores );
+		} else {
+			merged.push_back( std::move( pending ) );
+		}
+	}
+	_pending.clear();
+	if( merged.empty() && fence == VK_NULL_HANDLE ) return;
+
+	_renderer->GetSubmissionThread()->Submit( std::move( merged ), fence );
+	++_frame_statistics.queue_submits;
+}
+
+void SubmitBatcher::EndFrame()
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	_last_frame_statistics	= _frame_statistics;
+	_frame_statistics		= {};
+}
+
+SubmitStatistics SubmitBatcher::GetLastFrameStatistics() const
+{
+	return _last_frame_statistics;
+}
+
+VkCommandBuffer SubmitBatcher::_GetBarrierCommandBuffer( VkPipelineStageFlags destination_stages )
+{
+	// Recorded once per destination stage mask, the barrier references no objects and is never invalidated.
+	auto name = "submit batcher barrier " + std::to_string( destination_stages );
+	return _renderer->GetCommandBufferCache()->Get( name, {}, [ destination_stages ]( VkCommandBuffer command_buffer ) {
+		// Same guarantees as the semaphore wait it replaces: everything submitted earlier
+		// finishes and its writes become visible before the destination stages run.
+		VkMemoryBarrier barrier {};
+		barrier.sType			= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask	= VK_ACCESS_MEMORY_WRITE_BIT;
+		barrier.dstAccessMask	= VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		vkCmdPipelineBarrier( command_buffer,
+			VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			destination_stages,
+			0,
+			1, &barrier,
+			0, nullptr,
+			0, nullptr );
+	} );
+}
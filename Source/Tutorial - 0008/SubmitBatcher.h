@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Platform.h"
+#include "SubmissionThread.h"
+
+#include <vector>
+#include <mutex>
+
+class Renderer;
+
+// Number of submissions that were asked for and the vkQueueSubmit calls they ended up in.
+struct SubmitStatistics
+{
+	uint32_t							requested_submits		= 0;
+	uint32_t							queue_submits			= 0;
+	uint32_t							elided_semaphores		= 0;
+};
+
+// Queue front end that collects submissions and hands them to the SubmissionThread as a
+// single vkQueueSubmit at flush points. A semaphore that is signaled and waited on inside the
+// same flush only orders work on this queue, it is dropped and replaced with a
+// full pipeline barrier from the CommandBufferCache at the start of the waiting submission.
+// Consecutive submissions without waits and signals in between are merged.
+class SubmitBatcher
+{
+public:
+	SubmitBatcher( Renderer * renderer );
+	~SubmitBatcher();
+
+	// Copies the submission, the arrays it points to can be reused right away.
+	// A fence ends the batch, the submission is flushed together with everything before it.
+	void								Submit( const VkSubmitInfo & submit_info, VkFence fence = VK_NULL_HANDLE );
+
+	// Submits everything that was collected in one vkQueueSubmit, fence is signaled once all of it is done.
+	void								Flush( VkFence fence = VK_NULL_HANDLE );
+
+	// Closes the statistics of the current frame.
+	void								EndFrame();
+	SubmitStatistics					GetLastFrameStatistics() const;
+
+private:
+	VkCommandBuffer						_GetBarrierCommandBuffer( VkPipelineStageFlags destination_stages );
+
+	Renderer						*	_renderer						= nullptr;
+	VkDevice							_device							= VK_NULL_HANDLE;
+
+	std::mutex							_mutex;
+	std::vector<QueueSubmission>		_pending;
+
+	SubmitStatistics					_frame_statistics;
+	SubmitStatistics					_last_frame_statistics;
+};
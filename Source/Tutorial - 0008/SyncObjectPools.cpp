@@ -0,0 +1,94 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "SyncObjectPools.h"
+#include "Shared.h"
+
+FencePool::FencePool( VkDevice device )
+{
+	_device		= device;
+}
+
+FencePool::~FencePool()
+{
+	for( auto fence : _free ) {
+		vkDestroyFence( _device, fence, nullptr );
+	}
+	_free.clear();
+}
+
+VkFence FencePool::Acquire()
+{
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		if( !_free.empty() ) {
+			auto fence = _free.back();
+			_free.pop_back();
+			return fence;
+		}
+		++_created_count;
+	}
+
+	VkFence fence = VK_NULL_HANDLE;
+	VkFenceCreateInfo fence_create_info {};
+	fence_create_info.sType		= VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	ErrorCheck( vkCreateFence( _device, &fence_create_info, nullptr, &fence ) );
+	return fence;
+}
+
+void FencePool::Release( VkFence fence )
+{
+	ErrorCheck( vkResetFences( _device, 1, &fence ) );
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	_free.push_back( fence );
+}
+
+uint32_t FencePool::GetCreatedCount() const
+{
+	return _created_count;
+}
+
+SemaphorePool::SemaphorePool( VkDevice device )
+{
+	_device		= device;
+}
+
+SemaphorePool::~SemaphorePool()
+{
+	for( auto semaphore : _free ) {
+		vkDestroySemaphore( _device, semaphore, nullptr );
+	}
+	_free.clear();
+}
+
+VkSemaphore SemaphorePool::Acquire()
+{
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		if( !_free.empty() ) {
+			auto semaphore = _free.back();
+			_free.pop_back();
+			return semaphore;
+		}
+		++_created_count;
+	}
+
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	VkSemaphoreCreateInfo semaphore_create_info {};
+	semaphore_create_info.sType		= VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	ErrorCheck( vkCreateSemaphore( _device, &semaphore_create_info, nullptr, &semaphore ) );
+	return semaphore;
+}
+
+void SemaphorePool::Release( VkSemaphore semaphore )
+{
+	// A binary semaphore is unsignaled again once its wait has completed, nothing to reset.
+	std::lock_guard<std::mutex> lock( _mutex );
+	_free.push_back( semaphore );
+}
+
+uint32_t SemaphorePool::GetCreatedCount() const
+{
+	return _created_count;
+}
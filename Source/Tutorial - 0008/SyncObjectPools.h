@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <vector>
+#include <mutex>
+
+// Recycles fences instead of creating and destroying one for every submit.
+// Acquired fences are always unsignaled. Thread safe.
+class FencePool
+{
+public:
+	FencePool( VkDevice device );
+	~FencePool();
+
+	VkFence								Acquire();
+
+	// The fence must not be used by a pending submission anymore, it is reset here.
+	void								Release( VkFence fence );
+
+	uint32_t							GetCreatedCount() const;
+
+private:
+	VkDevice							_device							= VK_NULL_HANDLE;
+	std::mutex							_mutex;
+	std::vector<VkFence>				_free;
+	uint32_t							_created_count					= 0;
+};
+
+// Recycles binary semaphores. Thread safe.
+class SemaphorePool
+{
+public:
+	SemaphorePool( VkDevice device );
+	~SemaphorePool();
+
+	VkSemaphore							Acquire();
+
+	// Only release a semaphore once the wait on it has completed, for example from
+	// a FenceCompletionService callback of the submit that waited on it.
+	void								Release( VkSemaphore semaphore );
+
+	uint32_t							GetCreatedCount() const;
+
+private:
+	VkDevice							_device							= VK_NULL_HANDLE;
+	std::mutex							_mutex;
+	std::vector<VkSemaphore>			_free;
+	uint32_t							_created_count					= 0;
+};
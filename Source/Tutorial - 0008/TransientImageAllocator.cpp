@@ -0,0 +1,229 @@
+#include "BUILD_OPTIONS.h"
+#include "Platform.h"
+
+#include "TransientImageAllocator.h"
+#include "Renderer.h"
+#include "DeletionQueue.h"
+#include "Shared.h"
+
+#include <assert.h>
+#include <algorithm>
+
+static VkDeviceSize AlignUp( VkDeviceSize value, VkDeviceSize alignment )
+{
+	return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+TransientImageAllocator::TransientImageAllocator( Renderer * renderer )
+{
+	_renderer		= renderer;
+	_device			= renderer->GetVulkanDevice();
+
+	auto & memory_properties = renderer->GetVulkanPhysicalDeviceMemoryProperties();
+	for( uint32_t i=0; i < memory_properties.memoryTypeCount; ++i ) {
+		if( memory_properties.memoryTypes[ i ].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT ) {
+			_has_lazy_memory = true;
+		}
+	}
+}
+
+TransientImageAllocator::~TransientImageAllocator()
+{
+	if( _current_valid ) {
+		_DestroyPlacement( _current );
+	}
+}
+
+void TransientImageAllocator::Allocate( const std::vector<Request> & requests, std::vector<Allocation> & allocations )
+{
+	if( !_current_valid || !_SameRequests( _current.requests, requests ) ) {
+		if( _current_valid ) {
+			_DestroyPlacement( _current );
+		}
+		_current = Placement();
+		_BuildPlacement( requests, _current );
+		_current_valid = true;
+	}
+
+	allocations.resize( requests.size() );
+	for( size_t i=0; i < requests.size(); ++i ) {
+		allocations[ i ] = _current.images[ i ].allocation;
+	}
+}
+
+VkDeviceSize TransientImageAllocator::GetAllocatedSize() const
+{
+	return _allocated_size;
+}
+
+VkDeviceSize TransientImageAllocator::GetRequestedSize() const
+{
+	return _requested_size;
+}
+
+uint32_t TransientImageAllocator::GetLazilyAllocatedImageCount() const
+{
+	return _lazy_image_count;
+}
+
+void TransientImageAllocator::_BuildPlacement( const std::vector<Request> & requests, Placement & placement )
+{
+	auto & memory_properties = _renderer->GetVulkanPhysicalDeviceMemoryProperties();
+
+	placement.requests	= requests;
+	placement.images.resize( requests.size() );
+	_allocated_size		= 0;
+	_requested_size		= 0;
+	_lazy_image_count	= 0;
+
+	// Create the images first, their memory requirements decide the memory type and placement.
+	std::vector<VkMemoryRequirements>	requirements( requests.size() );
+	std::vector<uint32_t>				memory_types( requests.size() );
+	for( size_t i=0; i < requests.size(); ++i ) {
+		auto & request	= requests[ i ];
+		bool lazy		= request.transient_attachment && _has_lazy_memory;
+
+		VkImageCreateInfo image_create_info {};
+		image_create_info.sType				= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_create_info.imageType			= VK_IMAGE_TYPE_2D;
+		image_create_info.format			= request.desc.format;
+		image_create_info.extent			= { request.desc.width, request.desc.height, 1 };
+		image_create_info.mipLevels			= request.desc.mip_levels;
+		image_create_info.arrayLayers		= request.desc.array_layers;
+		image_create_info.samples			= request.desc.samples;
+		image_create_info.tiling			= VK_IMAGE_TILING_OPTIMAL;
+		image_create_info.usage				= request.usage | ( request.transient_attachment ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0 );
+		image_create_info.sharingMode		= VK_SHARING_MODE_EXCLUSIVE;
+		image_create_info.initialLayout		= VK_IMAGE_LAYOUT_UNDEFINED;
+		ErrorCheck( vkCreateImage( _device, &image_create_info, nullptr, &placement.images[ i ].allocation.image ) );
+
+		vkGetImageMemoryRequirements( _device, placement.images[ i ].allocation.image, &requirements[ i ] );
+		uint32_t memory_type = UINT32_MAX;
+		if( lazy ) {
+			memory_type = FindMemoryTypeIndex( &memory_properties, requirements[ i ].memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT );
+		}
+		if( memory_type == UINT32_MAX ) {
+			memory_type = FindMemoryTypeIndex( &memory_properties, requirements[ i ].memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+		}
+		if( memory_type == UINT32_MAX ) {
+			assert( 0 && "Vulkan ERROR: No device local memory for transient image." );
+			std::exit( -1 );
+		}
+		memory_types[ i ]	= memory_type;
+		_requested_size		+= requirements[ i ].size;
+		if( memory_properties.memoryTypes[ memory_type ].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT ) {
+			++_lazy_image_count;
+		}
+	}
+
+	// Largest images first, each goes to the lowest offset that does not overlap an image
+	// of the same memory type that is alive at the same time.
+	std::vector<uint32_t> order( requests.size() );
+	for( uint32_t i=0; i < order.size(); ++i ) {
+		order[ i ] = i;
+	}
+	std::stable_sort( order.begin(), order.end(), [ & ]( uint32_t a, uint32_t b ) { return requirements[ a ].size > requirements[ b ].size; } );
+
+	std::vector<uint32_t>		block_memory_types;
+	std::vector<VkDeviceSize>	block_sizes;
+	std::vector<uint32_t>		placed;
+	for( auto i : order ) {
+		auto & request		= requests[ i ];
+		auto & image		= placement.images[ i ];
+		auto alignment		= requirements[ i ].alignment;
+		image.size			= requirements[ i ].size;
+
+		auto block = std::find( block_memory_types.begin(), block_memory_types.end(), memory_types[ i ] );
+		if( block == block_memory_types.end() ) {
+			block_memory_types.push_back( memory_types[ i ] );
+			block_sizes.push_back( 0 );
+			block = block_memory_types.end() - 1;
+		}
+		image.memory_block = uint32_t( block - block_memory_types.begin() );
+
+		// Candidate offsets are the start of the block and the end of every image placed in it.
+		std::vector<VkDeviceSize> candidates( 1, 0 );
+		for( auto p : placed ) {
+			if( placement.images[ p ].memory_block == image.memory_block ) {
+				candidates.push_back( AlignUp( placement.images[ p ].offset + placement.images[ p ].size, alignment ) );
+			}
+		}
+		std::sort( candidates.begin(), candidates.end() );
+
+		for( auto offset : candidates ) {
+			bool fits = true;
+			for( auto p : placed ) {
+				auto & other			= placement.images[ p ];
+				auto & other_request	= requests[ p ];
+				if( other.memory_block != image.memory_block ) continue;
+				bool lifetimes_overlap	= request.first_pass <= other_request.last_pass && other_request.first_pass <= request.last_pass;
+				bool memory_overlaps	= offset < other.offset + other.size && other.offset < offset + image.size;
+				if( lifetimes_overlap && memory_overlaps ) {
+					fits = false;
+					break;
+				}
+			}
+			if( fits ) {
+				image.offset = offset;
+				break;
+			}
+		}
+		block_sizes[ image.memory_block ] = std::max( block_sizes[ image.memory_block ], image.offset + image.size );
+		placed.push_back( i );
+	}
+
+	placement.memory_blocks.resize( block_memory_types.size() );
+	for( size_t b=0; b < block_memory_types.size(); ++b ) {
+		VkMemoryAllocateInfo memory_allocate_info {};
+		memory_allocate_info.sType				= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memory_allocate_info.allocationSize		= block_sizes[ b ];
+		memory_allocate_info.memoryTypeIndex	= block_memory_types[ b ];
+		ErrorCheck( vkAllocateMemory( _device, &memory_allocate_info, nullptr, &placement.memory_blocks[ b ] ) );
+		_allocated_size += block_sizes[ b ];
+	}
+
+	for( size_t i=0; i < requests.size(); ++i ) {
+		auto & request		= requests[ i ];
+		auto & image		= placement.images[ i ];
+		ErrorCheck( vkBindImageMemory( _device, image.allocation.image, placement.memory_blocks[ image.memory_block ], image.offset ) );
+
+		VkImageViewCreateInfo image_view_create_info {};
+		image_view_create_info.sType							= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		image_view_create_info.image							= image.allocation.image;
+		image_view_create_info.viewType							= request.desc.array_layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+		image_view_create_info.format							= request.desc.format;
+		image_view_create_info.subresourceRange.aspectMask		= request.desc.aspect;
+		image_view_create_info.subresourceRange.levelCount		= request.desc.mip_levels;
+		image_view_create_info.subresourceRange.layerCount		= request.desc.array_layers;
+		ErrorCheck( vkCreateImageView( _device, &image_view_create_info, nullptr, &image.allocation.view ) );
+	}
+}
+
+void TransientImageAllocator::_DestroyPlacement( Placement & placement )
+{
+	// Frames in flight may still use the images.
+	auto deletion_queue = _renderer->GetDeletionQueue();
+	for( auto & image : placement.images ) {
+		deletion_queue->DestroyImageView( image.allocation.view );
+		deletion_queue->DestroyImage( image.allocation.image );
+	}
+	for( auto memory : placement.memory_blocks ) {
+		deletion_queue->FreeMemory( memory );
+	}
+	placement.images.clear();
+	placement.memory_blocks.clear();
+}
+
+bool TransientImageAllocator::_SameRequests( const std::vector<Request> & a, const std::vector<Request> & b ) const
+{
+	if( a.size() != b.size() ) return false;
+	for( size_t i=0; i < a.size(); ++i ) {
+		auto & x = a[ i ].desc;
+		auto & y = b[ i ].desc;
+		if( x.width != y.width || x.height != y.height || x.format != y.format || x.aspect != y.aspect ||
+			x.mip_levels != y.mip_levels || x.array_layers != y.array_layers || x.samples != y.samples ) return false;
+		if( a[ i ].usage != b[ i ].usage || a[ i ].first_pass != b[ i ].first_pass || a[ i ].last_pass != b[ i ].last_pass ||
+			a[ i ].transient_attachment != b[ i ].transient_attachment ) return false;
+	}
+	return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Platform.h"
+#include "FrameGraph.h"
+
+#include <vector>
+
+class Renderer;
+
+// Places the transient images of a frame in as little memory as possible. Images whose
+// lifetimes, in passes of the frame, do not overlap share the same memory. Images that
+// only live inside a single pass as attachments are created as transient attachments in
+// lazily allocated memory when the device has it, on tiled gpus they never leave tile memory.
+//
+// Frames usually look the same, the placement and the images of the previous frame are
+// reused as long as the requests do not change. Replaced images go to the renderer's
+// DeletionQueue.
+class TransientImageAllocator
+{
+public:
+	struct Request
+	{
+		FrameGraphImageDesc					desc;
+		VkImageUsageFlags					usage					= 0;
+		uint32_t							first_pass				= 0;		// batch of the frame graph schedule
+		uint32_t							last_pass				= 0;
+		bool								transient_attachment	= false;	// contents never leave the pass
+	};
+
+	struct Allocation
+	{
+		VkImage								image					= VK_NULL_HANDLE;
+		VkImageView							view					= VK_NULL_HANDLE;
+	};
+
+	TransientImageAllocator( Renderer * renderer );
+	~TransientImageAllocator();
+
+	// Call once per frame, allocations come back in the order of the requests.
+	void								Allocate( const std::vector<Request> & requests, std::vector<Allocation> & allocations );
+
+	VkDeviceSize						GetAllocatedSize() const;		// memory of the current placement
+	VkDeviceSize						GetRequestedSize() const;		// what it would take without aliasing
+	uint32_t							GetLazilyAllocatedImageCount() const;
+
+private:
+	struct PlacedImage
+	{
+		Allocation							allocation;
+		uint32_t							memory_block			= 0;
+		VkDeviceSize						offset					= 0;
+		VkDeviceSize						size					= 0;
+	};
+
+	struct Placement
+	{
+		std::vector<Request>				requests;
+		std::vector<PlacedImage>			images;
+		std::vector<VkDeviceMemory>			memory_blocks;
+	};
+
+	void								_BuildPlacement( const std::vector<Request> & requests, Placement & placement );
+	void								_DestroyPlacement( Placement & placement );
+	bool								_SameRequests( const std::vector<Request> & a, const std::vector<Request> & b ) const;
+
+	Renderer						*	_renderer						= nullptr;
+	VkDevice							_device							= VK_NULL_HANDLE;
+	bool								_has_lazy_memory				= false;
+
+	Placement							_current;
+	bool								_current_valid					= false;
+
+	VkDeviceSize						_allocated_size					= 0;
+	VkDeviceSize						_requested_size					= 0;
+	uint32_t							_lazy_image_count				= 0;
+};
@@ -2,8 +2,16 @@
 #include "Window.h"
 #include "Renderer.h"
 #include "Shared.h"
+#include "CommandPoolManager.h"
+#include "SubmitBatcher.h"
+#include "DeletionQueue.h"
+#include "SubmissionThread.h"
+#include "CommandBufferCache.h"
+#include "SyncObjectPools.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <cmath>
 
 Window::Window( Renderer * renderer, uint32_t size_x, uint32_t size_y, std::string name )
 {
@@ -16,11 +24,23 @@ Window::Window( Renderer * renderer, uint32_t size_x, uint32_t size_y, std::stri
 	_InitSurface();
 	_InitSwapchain();
 	_InitSwapchainImages();
+	_InitFrameSync();
 }
 
 Window::~Window()
 {
+	_renderer->GetSubmissionThread()->WaitIdle();
+
+	if( _present_path == PresentPath::XCB_SHM ) {
+		_DeInitOffscreenFrames();
+		_DeInitOSSoftwarePresent();
+	}
+	StopInputRecordingAndReplay();
+
+	_DeInitFrameSync();
 	_DeInitSwapchainImages();
+	// Retired swapchains and views have to go before the surface, the queue is idle.
+	_renderer->GetDeletionQueue()->Flush();
 	_DeInitSwapchain();
 	_DeInitSurface();
 	_DeInitOSWindow();
@@ -32,12 +52,374 @@ void Window::Close()
 	_window_should_run		= false;
 }
 
+static float MillisecondsBetween( std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end )
+{
+	return std::chrono::duration<float, std::milli>( end - begin ).count();
+}
+
 bool Window::Update()
 {
+	// In low latency mode input is sampled only after the oldest frame in flight has
+	// finished, so the frame recorded next starts with the freshest possible input.
+	if( _renderer->IsLowLatencyModeEnabled() ) {
+		_WaitForFrameSlot();
+	}
+
 	_UpdateOSWindow();
+
+	if( _input_replayer ) {
+		_input_replay_events.clear();
+		_input_replayer->GetEvents( _frame_number, _input_replay_events );
+		for( auto & event : _input_replay_events ) {
+			_ApplyInputEvent( event );
+		}
+	}
+
+	_input_snapshot					= _input_state;
+	_input_snapshot.sample_time		= std::chrono::steady_clock::now();
+	_input_snapshot.frame			= _frame_number;
 	return _window_should_run;
 }
 
+void Window::BeginRender()
+{
+	_WaitForFrameSlot();
+
+	// The swapchain path finds out about a new window size from an out of date swapchain.
+	if( _surface_resized ) {
+		_surface_resized = false;
+		if( _present_path == PresentPath::XCB_SHM ) {
+			_RecreateSwapchain();
+		}
+	}
+
+	auto device = _renderer->GetVulkanDevice();
+	if( _present_path == PresentPath::XCB_SHM ) {
+		// The offscreen image of this slot is free now, signal the semaphore the rendering waits on right away.
+		// Batched with the rendering and the readback, the semaphore never reaches the driver.
+		VkSubmitInfo submit_info {};
+		submit_info.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.signalSemaphoreCount	= 1;
+		submit_info.pSignalSemaphores		= &_image_available_semaphores[ _frame_slot ];
+		_renderer->GetSubmitBatcher()->Submit( submit_info );
+	} else {
+		auto submission_thread = _renderer->GetSubmissionThread();
+		while( true ) {
+			// The submission thread may still have to present the image the acquire would wait for,
+			// only block once it has caught up. The swapchain is shared with its presents.
+			VkResult result = VK_NOT_READY;
+			if( submission_thread->IsEnabled() ) {
+				auto lock = submission_thread->LockQueue();
+				result = vkAcquireNextImageKHR( device, _swapchain, 0, _image_available_semaphores[ _frame_slot ], VK_NULL_HANDLE, &_active_swapchain_image_id );
+			}
+			if( result == VK_NOT_READY || result == VK_TIMEOUT ) {
+				submission_thread->Drain();
+				auto lock = submission_thread->LockQueue();
+				result = vkAcquireNextImageKHR( device, _swapchain, UINT64_MAX, _image_available_semaphores[ _frame_slot ], VK_NULL_HANDLE, &_active_swapchain_image_id );
+			}
+			if( result == VK_ERROR_OUT_OF_DATE_KHR ) {
+				_RecreateSwapchain();
+				continue;
+			}
+			ErrorCheck( result );
+			break;
+		}
+	}
+	ErrorCheck( vkResetFences( device, 1, &_frame_fences[ _frame_slot ] ) );
+
+	auto & timing					= _frame_timings[ _frame_slot ];
+	timing.frame					= _frame_number;
+	timing.input_sample_time		= _input_snapshot.sample_time;
+	timing.begin_time				= std::chrono::steady_clock::now();
+}
+
+void Window::EndRender()
+{
+	auto submit_batcher		= _renderer->GetSubmitBatcher();
+	auto submission_thread	= _renderer->GetSubmissionThread();
+
+	if( _present_path == PresentPath::XCB_SHM ) {
+		// Copy to the readback buffer once rendering is done, the copy signals the frame fence
+		// and the pixels are handed to the X server when the fence is seen signaled.
+		auto & offscreen = _offscreen_frames[ _frame_slot ];
+		VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+		VkSubmitInfo submit_info {};
+		submit_info.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.waitSemaphoreCount		= 1;
+		submit_info.pWaitSemaphores			= &_render_complete_semaphores[ _frame_slot ];
+		submit_info.pWaitDstStageMask		= &wait_stage;
+		submit_info.commandBufferCount		= 1;
+		submit_info.pCommandBuffers			= &offscreen.readback_command_buffer;
+		submit_batcher->Submit( submit_info, _frame_fences[ _frame_slot ] );
+
+		offscreen.frame			= _frame_number;
+		offscreen.pending		= true;
+	}
+
+	// Everything of this frame has to be on the queue before it is presented.
+	submit_batcher->Flush();
+	submit_batcher->EndFrame();
+
+	VkResult result = VK_SUCCESS;
+	if( _present_path == PresentPath::WSI ) {
+		// With the submission thread enabled this is the result of an earlier present.
+		result = submission_thread->Present( _swapchain, _active_swapchain_image_id, _render_complete_semaphores[ _frame_slot ] );
+	}
+	submission_thread->EndFrame( _frame_number );
+
+	auto & timing					= _frame_timings[ _frame_slot ];
+	timing.present_time				= std::chrono::steady_clock::now();
+	timing.pending					= true;
+
+	++_frame_number;
+	_frame_slot_ready				= false;
+
+	if( _present_path == PresentPath::XCB_SHM ) {
+		_PresentCompletedOffscreenFrames();
+	} else if( result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ) {
+		_RecreateSwapchain();
+	} else {
+		ErrorCheck( result );
+	}
+}
+
+bool Window::SetPresentPath( PresentPath path )
+{
+	if( _present_path == path ) return true;
+
+	_renderer->GetSubmissionThread()->WaitIdle();
+	if( _present_path == PresentPath::XCB_SHM ) {
+		_PresentCompletedOffscreenFrames();
+		_DeInitOffscreenFrames();
+		_DeInitOSSoftwarePresent();
+	}
+	_present_path			= PresentPath::WSI;
+
+	if( path == PresentPath::XCB_SHM ) {
+		if( !_InitOSSoftwarePresent() ) {
+			return false;
+		}
+		_InitOffscreenFrames();
+		_present_path		= path;
+	}
+	return true;
+}
+
+PresentPath Window::GetPresentPath() const
+{
+	return _present_path;
+}
+
+VkImage Window::GetActiveImage() const
+{
+	if( _present_path == PresentPath::XCB_SHM ) {
+		return _offscreen_frames[ _frame_slot ].image;
+	}
+	return _swapchain_images[ _active_swapchain_image_id ];
+}
+
+VkImageLayout Window::GetActiveImagePresentLayout() const
+{
+	if( _present_path == PresentPath::XCB_SHM ) {
+		return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	}
+	return VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+VkFormat Window::GetActiveImageFormat() const
+{
+	if( _present_path == PresentPath::XCB_SHM ) {
+		return _offscreen_format;
+	}
+	return _surface_format.format;
+}
+
+bool Window::IsActiveImageTransferSource() const
+{
+	if( _present_path == PresentPath::XCB_SHM ) {
+		return true;
+	}
+	return ( _swapchain_image_usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT ) != 0;
+}
+
+VkExtent2D Window::GetSurfaceSize() const
+{
+	return { _surface_size_x, _surface_size_y };
+}
+
+uint32_t Window::GetActiveImageIndex() const
+{
+	return _active_swapchain_image_id;
+}
+
+uint32_t Window::GetFrameSlot() const
+{
+	return _frame_slot;
+}
+
+uint64_t Window::GetFrameNumber() const
+{
+	return _frame_number;
+}
+
+VkSemaphore Window::GetImageAvailableSemaphore() const
+{
+	return _image_available_semaphores[ _frame_slot ];
+}
+
+VkSemaphore Window::GetRenderCompleteSemaphore() const
+{
+	return _render_complete_semaphores[ _frame_slot ];
+}
+
+VkFence Window::GetFrameFence() const
+{
+	if( _present_path == PresentPath::XCB_SHM ) {
+		return VK_NULL_HANDLE;
+	}
+	return _frame_fences[ _frame_slot ];
+}
+
+void Window::PushInputEvent( const InputEvent & event )
+{
+	// Live input is ignored during a replay, except for closing the window.
+	if( _input_replayer && event.type != InputEventType::WINDOW_CLOSE ) return;
+
+	if( _input_recorder ) {
+		auto time_us = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - _input_recording_start ).count();
+		_input_recorder->Record( _frame_number, uint64_t( time_us ), event );
+	}
+	_ApplyInputEvent( event );
+}
+
+bool Window::StartInputRecording( std::string file_path )
+{
+	StopInputRecordingAndReplay();
+	_input_recorder				= new InputRecorder( file_path );
+	_input_recording_start		= std::chrono::steady_clock::now();
+	if( !_input_recorder->IsOpen() ) {
+		StopInputRecordingAndReplay();
+		return false;
+	}
+	return true;
+}
+
+bool Window::StartInputReplay( std::string file_path )
+{
+	StopInputRecordingAndReplay();
+	_input_replayer				= new InputReplayer( file_path );
+	if( !_input_replayer->IsOpen() ) {
+		StopInputRecordingAndReplay();
+		return false;
+	}
+	// Start from the same state the recording started from.
+	_input_state				= InputSnapshot();
+	return true;
+}
+
+void Window::StopInputRecordingAndReplay()
+{
+	delete _input_recorder;
+	delete _input_replayer;
+	_input_recorder				= nullptr;
+	_input_replayer				= nullptr;
+}
+
+bool Window::IsReplayingInput() const
+{
+	return _input_replayer != nullptr;
+}
+
+void Window::_ApplyInputEvent( const InputEvent & event )
+{
+	switch( event.type ) {
+	case InputEventType::WINDOW_CLOSE:
+		Close();
+		return;
+	case InputEventType::KEY_DOWN:
+		_input_state.keys.set( event.code & 0xFF );
+		return;
+	case InputEventType::KEY_UP:
+		_input_state.keys.reset( event.code & 0xFF );
+		return;
+	case InputEventType::MOUSE_BUTTON_DOWN:
+		_input_state.mouse_buttons |= ( 1u << ( event.code & 31 ) );
+		break;
+	case InputEventType::MOUSE_BUTTON_UP:
+		_input_state.mouse_buttons &= ~( 1u << ( event.code & 31 ) );
+		break;
+	case InputEventType::MOUSE_MOVE:
+	default:
+		break;
+	}
+	_input_state.mouse_x			= event.x;
+	_input_state.mouse_y			= event.y;
+}
+
+const InputSnapshot & Window::GetInputSnapshot() const
+{
+	return _input_snapshot;
+}
+
+const FrameLatency & Window::GetLastFrameLatency() const
+{
+	return _last_frame_latency;
+}
+
+void Window::SetPresentPolicy( PresentPolicy policy )
+{
+	if( _present_policy == policy ) return;
+	_present_policy		= policy;
+	_RecreateSwapchain();
+}
+
+PresentPolicy Window::GetPresentPolicy() const
+{
+	return _present_policy;
+}
+
+VkPresentModeKHR Window::GetPresentMode() const
+{
+	return _present_mode;
+}
+
+uint32_t Window::GetSwapchainImageCount() const
+{
+	return _swapchain_image_count;
+}
+
+void Window::SetSwapchainImageCountAutoTune( bool enable )
+{
+	if( _auto_tune_image_count == enable ) return;
+	_auto_tune_image_count		= enable;
+	_auto_tune_samples			= 0;
+	_auto_tune_cpu_ms_sum		= 0.0f;
+	_auto_tune_gpu_ms_sum		= 0.0f;
+	_auto_tune_frame_ms_sum		= 0.0f;
+	_auto_tune_frame_ms_sq_sum	= 0.0f;
+	_RecreateSwapchain();
+}
+
+void Window::ReportFrameTimes( float cpu_ms, float gpu_ms )
+{
+	if( !_auto_tune_image_count ) return;
+
+	float frame_ms = std::max( cpu_ms, gpu_ms );
+	_auto_tune_cpu_ms_sum		+= cpu_ms;
+	_auto_tune_gpu_ms_sum		+= gpu_ms;
+	_auto_tune_frame_ms_sum		+= frame_ms;
+	_auto_tune_frame_ms_sq_sum	+= frame_ms * frame_ms;
+	if( ++_auto_tune_samples >= _auto_tune_sample_count ) {
+		_AutoTuneSwapchainImageCount();
+		_auto_tune_samples			= 0;
+		_auto_tune_cpu_ms_sum		= 0.0f;
+		_auto_tune_gpu_ms_sum		= 0.0f;
+		_auto_tune_frame_ms_sum		= 0.0f;
+		_auto_tune_frame_ms_sq_sum	= 0.0f;
+	}
+}
+
 void Window::_InitSurface()
 {
 	_InitOSSurface();
@@ -73,6 +455,13 @@ void Window::_InitSurface()
 			_surface_format				= formats[ 0 ];
 		}
 	}
+
+	{
+		uint32_t present_mode_count = 0;
+		ErrorCheck( vkGetPhysicalDeviceSurfacePresentModesKHR( gpu, _surface, &present_mode_count, nullptr ) );
+		_surface_present_modes.resize( present_mode_count );
+		ErrorCheck( vkGetPhysicalDeviceSurfacePresentModesKHR( gpu, _surface, &present_mode_count, _surface_present_modes.data() ) );
+	}
 }
 
 void Window::_DeInitSurface()
@@ -82,30 +471,8 @@ void Window::_DeInitSurface()
 
 void Window::_InitSwapchain()
 {
-//	This code is old and the fixed one is below
-//	if( _swapchain_image_count > _surface_capabilities.maxImageCount ) _swapchain_image_count = _surface_capabilities.maxImageCount;
-//	if( _swapchain_image_count < _surface_capabilities.minImageCount + 1 ) _swapchain_image_count = _surface_capabilities.minImageCount + 1;
-
-	// The code above will work just fine in our tutorials and likely on every possible implementation of vulkan as well
-	// so this change isn't that important. Just to be absolutely sure we don't go over or below the given limits we should check this a
-	// little bit different though. maxImageCount can actually be zero in which case the amount of swapchain images do not have an
-	// upper limit other than available memory. It's also possible that the swapchain image amount is locked to a certain
-	// value on certain systems. The code below takes into consideration both of these possibilities.
-	if( _swapchain_image_count < _surface_capabilities.minImageCount + 1 ) _swapchain_image_count = _surface_capabilities.minImageCount + 1;
-	if( _surface_capabilities.maxImageCount > 0 ) {
-		if( _swapchain_image_count > _surface_capabilities.maxImageCount ) _swapchain_image_count = _surface_capabilities.maxImageCount;
-	}
-
-	VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
-	{
-		uint32_t present_mode_count = 0;
-		ErrorCheck( vkGetPhysicalDeviceSurfacePresentModesKHR( _renderer->GetVulkanPhysicalDevice(), _surface, &present_mode_count, nullptr ) );
-		std::vector<VkPresentModeKHR> present_mode_list( present_mode_count );
-		ErrorCheck( vkGetPhysicalDeviceSurfacePresentModesKHR( _renderer->GetVulkanPhysicalDevice(), _surface, &present_mode_count, present_mode_list.data() ) );
-		for( auto m : present_mode_list ) {
-			if( m == VK_PRESENT_MODE_MAILBOX_KHR ) present_mode = m;
-		}
-	}
+	_present_mode			= _SelectPresentMode();
+	_swapchain_image_count	= _SelectSwapchainImageCount();
 
 	VkSwapchainCreateInfoKHR swapchain_create_info {};
 	swapchain_create_info.sType						= VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -116,15 +483,18 @@ void Window::_InitSwapchain()
 	swapchain_create_info.imageExtent.width			= _surface_size_x;
 	swapchain_create_info.imageExtent.height		= _surface_size_y;
 	swapchain_create_info.imageArrayLayers			= 1;
-	swapchain_create_info.imageUsage				= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	// transfer usage lets the images be cleared and captured when the surface allows it
+	_swapchain_image_usage							= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+		( _surface_capabilities.supportedUsageFlags & ( VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT ) );
+	swapchain_create_info.imageUsage				= _swapchain_image_usage;
 	swapchain_create_info.imageSharingMode			= VK_SHARING_MODE_EXCLUSIVE;
 	swapchain_create_info.queueFamilyIndexCount		= 0;
 	swapchain_create_info.pQueueFamilyIndices		= nullptr;
 	swapchain_create_info.preTransform				= VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
 	swapchain_create_info.compositeAlpha			= VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	swapchain_create_info.presentMode				= present_mode;
+	swapchain_create_info.presentMode				= _present_mode;
 	swapchain_create_info.clipped					= VK_TRUE;
-	swapchain_create_info.oldSwapchain				= VK_NULL_HANDLE;
+	swapchain_create_info.oldSwapchain				= _swapchain;
 
 	ErrorCheck( vkCreateSwapchainKHR( _renderer->GetVulkanDevice(), &swapchain_create_info, nullptr, &_swapchain ) );
 
@@ -134,6 +504,7 @@ void Window::_InitSwapchain()
 void Window::_DeInitSwapchain()
 {
 	vkDestroySwapchainKHR( _renderer->GetVulkanDevice(), _swapchain, nullptr );
+	_swapchain = VK_NULL_HANDLE;
 }
 
 void Window::_InitSwapchainImages()
@@ -165,7 +536,432 @@ void Window::_InitSwapchainImages()
 
 void Window::_DeInitSwapchainImages()
 {
+	// Frames in flight may still use the views. The images go with the swapchain,
+	// command buffers recorded with them are dropped here.
 	for( auto view : _swapchain_image_views ) {
-		vkDestroyImageView( _renderer->GetVulkanDevice(), view, nullptr );
+		_renderer->GetDeletionQueue()->DestroyImageView( view );
+	}
+	for( auto image : _swapchain_images ) {
+		_renderer->GetCommandBufferCache()->Invalidate( CommandBufferCache::Handle( image ) );
+	}
+	_swapchain_image_views.clear();
+	_swapchain_images.clear();
+}
+
+void Window::_RecreateSwapchain()
+{
+	// The old image views and swapchain might still be in use by frames in flight,
+	// they are destroyed once those frames have finished. Presents to the old swapchain
+	// have to be made before it is retired.
+	auto submission_thread = _renderer->GetSubmissionThread();
+
+	// Image count limits and the current extent can change after the surface was created.
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR( _renderer->GetVulkanPhysicalDevice(), _surface, &_surface_capabilities );
+	bool resized = _surface_capabilities.currentExtent.width < UINT32_MAX &&
+		( _surface_capabilities.currentExtent.width != _surface_size_x || _surface_capabilities.currentExtent.height != _surface_size_y );
+
+	// Offscreen images, readback buffers and shared memory segments have the size of the
+	// surface, frames still in flight are put on screen at the old size before they go.
+	bool resize_offscreen = resized && _present_path == PresentPath::XCB_SHM;
+	if( resize_offscreen ) {
+		_FinishOffscreenFrames();
+		_DeInitOffscreenFrames();
+		_DeInitOSSoftwarePresent();
+	}
+	if( resized ) {
+		_surface_size_x			= _surface_capabilities.currentExtent.width;
+		_surface_size_y			= _surface_capabilities.currentExtent.height;
+	}
+
+	{
+		submission_thread->Drain();
+		auto lock = submission_thread->LockQueue();
+
+		_DeInitSwapchainImages();
+
+		// _InitSwapchain() hands the current swapchain over as the old swapchain
+		// so the presentation engine can reuse its resources.
+		VkSwapchainKHR old_swapchain = _swapchain;
+		_InitSwapchain();
+		_renderer->GetDeletionQueue()->DestroySwapchain( old_swapchain );
+
+		_InitSwapchainImages();
+	}
+
+	if( resize_offscreen ) {
+		if( _InitOSSoftwarePresent() ) {
+			_InitOffscreenFrames();
+		} else {
+			std::cout << "MIT-SHM present could not follow the new window size, presenting through the swapchain.\n";
+			_present_path		= PresentPath::WSI;
+		}
+	}
+}
+
+VkPresentModeKHR Window::_SelectPresentMode() const
+{
+	// Preference order per policy, FIFO is the only mode that is guaranteed to exist.
+	std::vector<VkPresentModeKHR> preferred;
+	switch( _present_policy ) {
+	case PresentPolicy::LOWEST_LATENCY:
+		// Fifo relaxed queues frames just like fifo whenever they are on time, that is a
+		// frame of latency for nothing, so it is no better than plain fifo here.
+		preferred = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+		break;
+	case PresentPolicy::MAX_THROUGHPUT:
+		// Late frames go out right away with fifo relaxed instead of waiting a whole refresh.
+		preferred = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		break;
+	case PresentPolicy::TEAR_FREE:
+		preferred = { VK_PRESENT_MODE_MAILBOX_KHR };
+		break;
+	case PresentPolicy::POWER_SAVING:
+	default:
+		break;
+	}
+	for( auto p : preferred ) {
+		if( std::find( _surface_present_modes.begin(), _surface_present_modes.end(), p ) != _surface_present_modes.end() ) {
+			return p;
+		}
+	}
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+uint32_t Window::_SelectSwapchainImageCount() const
+{
+	uint32_t extra_images = 0;
+	if( _auto_tune_image_count ) {
+		extra_images = _auto_tune_extra_images;
+	} else {
+		switch( _present_policy ) {
+		case PresentPolicy::LOWEST_LATENCY:
+		case PresentPolicy::POWER_SAVING:
+			extra_images = 0;
+			break;
+		case PresentPolicy::TEAR_FREE:
+			extra_images = 1;
+			break;
+		case PresentPolicy::MAX_THROUGHPUT:
+			extra_images = 2;
+			break;
+		default:
+			break;
+		}
+	}
+
+	// maxImageCount can actually be zero in which case the amount of swapchain images do not have an
+	// upper limit other than available memory. It's also possible that the swapchain image amount is locked to a certain
+	// value on certain systems. The code below takes into consideration both of these possibilities.
+	uint32_t image_count = std::max( _surface_capabilities.minImageCount + extra_images, 2u );
+	if( _surface_capabilities.maxImageCount > 0 ) {
+		if( image_count > _surface_capabilities.maxImageCount ) image_count = _surface_capabilities.maxImageCount;
+	}
+	return image_count;
+}
+
+void Window::_AutoTuneSwapchainImageCount()
+{
+	float samples		= float( _auto_tune_samples );
+	float cpu_ms		= _auto_tune_cpu_ms_sum / samples;
+	float gpu_ms		= _auto_tune_gpu_ms_sum / samples;
+	float frame_ms		= _auto_tune_frame_ms_sum / samples;
+	float variance		= std::max( _auto_tune_frame_ms_sq_sum / samples - frame_ms * frame_ms, 0.0f );
+	if( frame_ms <= 0.0f ) return;
+
+	// If the cpu and gpu both take a good part of the frame they need one queued
+	// frame between them to run in parallel instead of taking turns.
+	uint32_t extra_images = 0;
+	if( cpu_ms + gpu_ms > frame_ms * 1.25f ) {
+		extra_images += 1;
+	}
+	// Mailbox needs a spare image to replace, otherwise it behaves like fifo.
+	if( _present_mode == VK_PRESENT_MODE_MAILBOX_KHR ) {
+		extra_images += 1;
+	}
+	// Frame time spikes drain the queue, one more image hides them at the cost of latency.
+	if( _present_policy == PresentPolicy::MAX_THROUGHPUT && std::sqrt( variance ) > frame_ms * 0.2f ) {
+		extra_images += 1;
+	}
+
+	// Only change when two measurement windows in a row agree, recreating
+	// the swapchain back and forth would cost more than it gains.
+	if( extra_images != _auto_tune_pending_extra_images ) {
+		_auto_tune_pending_extra_images		= extra_images;
+		return;
+	}
+	if( extra_images != _auto_tune_extra_images ) {
+		_auto_tune_extra_images				= extra_images;
+		if( _SelectSwapchainImageCount() != _swapchain_image_count ) {
+			_RecreateSwapchain();
+		}
+	}
+}
+
+void Window::_InitFrameSync()
+{
+	auto device			= _renderer->GetVulkanDevice();
+	auto frame_count	= _renderer->GetMaxFramesInFlight();
+
+	_frame_fences.resize( frame_count );
+	_image_available_semaphores.resize( frame_count );
+	_render_complete_semaphores.resize( frame_count );
+	_frame_timings.clear();
+	_frame_timings.resize( frame_count );
+
+	for( uint32_t i=0; i < frame_count; ++i ) {
+		// Fences start signaled so the first wait on every frame slot returns right away.
+		VkFenceCreateInfo fence_create_info {};
+		fence_create_info.sType			= VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fence_create_info.flags			= VK_FENCE_CREATE_SIGNALED_BIT;
+		ErrorCheck( vkCreateFence( device, &fence_create_info, nullptr, &_frame_fences[ i ] ) );
+
+		// Semaphores come from the pool, changing the amount of frames in flight reuses them.
+		_image_available_semaphores[ i ]	= _renderer->GetSemaphorePool()->Acquire();
+		_render_complete_semaphores[ i ]	= _renderer->GetSemaphorePool()->Acquire();
+	}
+	_frame_slot_ready	= false;
+}
+
+void Window::_DeInitFrameSync()
+{
+	auto device			= _renderer->GetVulkanDevice();
+	for( auto fence : _frame_fences ) {
+		vkDestroyFence( device, fence, nullptr );
+	}
+	// Only called with the queue idle, every wait on the semaphores has completed.
+	for( auto semaphore : _image_available_semaphores ) {
+		_renderer->GetSemaphorePool()->Release( semaphore );
+	}
+	for( auto semaphore : _render_complete_semaphores ) {
+		_renderer->GetSemaphorePool()->Release( semaphore );
+	}
+	_frame_fences.clear();
+	_image_available_semaphores.clear();
+	_render_complete_semaphores.clear();
+}
+
+void Window::_WaitForFrameSlot()
+{
+	if( _frame_slot_ready ) return;
+
+	auto device = _renderer->GetVulkanDevice();
+
+	// The amount of frames in flight was changed, rebuild the synchronization objects.
+	if( _frame_fences.size() != _renderer->GetMaxFramesInFlight() ) {
+		_renderer->GetSubmissionThread()->WaitIdle();
+		if( _present_path == PresentPath::XCB_SHM ) {
+			_PresentCompletedOffscreenFrames();
+			_DeInitOffscreenFrames();
+		}
+		_DeInitFrameSync();
+		_InitFrameSync();
+		if( _present_path == PresentPath::XCB_SHM ) {
+			_InitOffscreenFrames();
+		}
+	}
+
+	_frame_slot = uint32_t( _frame_number % _frame_fences.size() );
+	ErrorCheck( vkWaitForFences( device, 1, &_frame_fences[ _frame_slot ], VK_TRUE, UINT64_MAX ) );
+	auto complete_time = std::chrono::steady_clock::now();
+
+	// Everything recorded for the previous use of this slot has executed, recycle its command buffers.
+	_renderer->GetCommandPoolManager()->BeginFrame( _frame_slot );
+
+	// Frames finish in submission order, the one that last used this slot and every frame before it are done.
+	auto slot_count = uint64_t( _frame_fences.size() );
+	_renderer->GetDeletionQueue()->BeginFrame( _frame_number, _frame_number >= slot_count ? _frame_number - slot_count + 1 : 0 );
+
+	// The frame that last used this slot is now finished on the gpu.
+	auto & timing = _frame_timings[ _frame_slot ];
+	if( timing.pending ) {
+		timing.pending								= false;
+		_last_frame_latency.frame					= timing.frame;
+		_last_frame_latency.input_to_present_ms		= MillisecondsBetween( timing.input_sample_time, timing.present_time );
+		_last_frame_latency.input_to_complete_ms	= MillisecondsBetween( timing.input_sample_time, complete_time );
+		_last_frame_latency.cpu_ms					= MillisecondsBetween( timing.begin_time, timing.present_time );
+		_last_frame_latency.gpu_ms					= MillisecondsBetween( timing.present_time, complete_time );
+		ReportFrameTimes( _last_frame_latency.cpu_ms, _last_frame_latency.gpu_ms );
+	}
+	if( _present_path == PresentPath::XCB_SHM ) {
+		_PresentCompletedOffscreenFrames();
+	}
+	_frame_slot_ready = true;
+}
+
+void Window::_InitOffscreenFrames()
+{
+	auto device					= _renderer->GetVulkanDevice();
+	auto & memory_properties	= _renderer->GetVulkanPhysicalDeviceMemoryProperties();
+
+	// X11 32 bit pixels are B, G, R, X in memory, rendering in the same layout lets the readback be copied as is.
+	_offscreen_format			= VK_FORMAT_B8G8R8A8_UNORM;
+	if( _surface_format.format == VK_FORMAT_B8G8R8A8_SRGB ) {
+		_offscreen_format		= VK_FORMAT_B8G8R8A8_SRGB;
+	}
+	VkDeviceSize readback_size	= VkDeviceSize( _surface_size_x ) * _surface_size_y * 4;
+
+	// Command buffers never change once recorded so they don't need to be resettable.
+	VkCommandPoolCreateInfo pool_create_info {};
+	pool_create_info.sType				= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_create_info.queueFamilyIndex	= _renderer->GetVulkanGraphicsQueueFamilyIndex();
+	ErrorCheck( vkCreateCommandPool( device, &pool_create_info, nullptr, &_offscreen_command_pool ) );
+
+	_offscreen_frames.resize( _frame_fences.size() );
+	for( auto & offscreen : _offscreen_frames ) {
+		{
+			VkImageCreateInfo image_create_info {};
+			image_create_info.sType				= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			image_create_info.imageType			= VK_IMAGE_TYPE_2D;
+			image_create_info.format			= _offscreen_format;
+			image_create_info.extent.width		= _surface_size_x;
+			image_create_info.extent.height		= _surface_size_y;
+			image_create_info.extent.depth		= 1;
+			image_create_info.mipLevels			= 1;
+			image_create_info.arrayLayers		= 1;
+			image_create_info.samples			= VK_SAMPLE_COUNT_1_BIT;
+			image_create_info.tiling			= VK_IMAGE_TILING_OPTIMAL;
+			image_create_info.usage				= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			image_create_info.sharingMode		= VK_SHARING_MODE_EXCLUSIVE;
+			image_create_info.initialLayout		= VK_IMAGE_LAYOUT_UNDEFINED;
+			ErrorCheck( vkCreateImage( device, &image_create_info, nullptr, &offscreen.image ) );
+
+			VkMemoryRequirements memory_requirements {};
+			vkGetImageMemoryRequirements( device, offscreen.image, &memory_requirements );
+			auto memory_type_index = FindMemoryTypeIndex( &memory_properties, memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+			if( memory_type_index == UINT32_MAX ) {
+				memory_type_index = FindMemoryTypeIndex( &memory_properties, memory_requirements.memoryTypeBits, 0 );
+			}
+
+			VkMemoryAllocateInfo memory_allocate_info {};
+			memory_allocate_info.sType				= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			memory_allocate_info.allocationSize		= memory_requirements.size;
+			memory_allocate_info.memoryTypeIndex	= memory_type_index;
+			ErrorCheck( vkAllocateMemory( device, &memory_allocate_info, nullptr, &offscreen.image_memory ) );
+			ErrorCheck( vkBindImageMemory( device, offscreen.image, offscreen.image_memory, 0 ) );
+		}
+		{
+			VkBufferCreateInfo buffer_create_info {};
+			buffer_create_info.sType			= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			buffer_create_info.size				= readback_size;
+			buffer_create_info.usage			= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			buffer_create_info.sharingMode		= VK_SHARING_MODE_EXCLUSIVE;
+			ErrorCheck( vkCreateBuffer( device, &buffer_create_info, nullptr, &offscreen.readback_buffer ) );
+
+			// Cached memory makes the cpu side copy a lot faster, uncached reads are very slow.
+			VkMemoryRequirements memory_requirements {};
+			vkGetBufferMemoryRequirements( device, offscreen.readback_buffer, &memory_requirements );
+			auto memory_type_index = FindMemoryTypeIndex( &memory_properties, memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT );
+			if( memory_type_index == UINT32_MAX ) {
+				memory_type_index = FindMemoryTypeIndex( &memory_properties, memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+			}
+			if( memory_type_index == UINT32_MAX ) {
+				assert( 0 && "Vulkan ERROR: No host visible memory for readback." );
+				std::exit( -1 );
+			}
+			_offscreen_readback_coherent = ( memory_properties.memoryTypes[ memory_type_index ].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ) != 0;
+
+			VkMemoryAllocateInfo memory_allocate_info {};
+			memory_allocate_info.sType				= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			memory_allocate_info.allocationSize		= memory_requirements.size;
+			memory_allocate_info.memoryTypeIndex	= memory_type_index;
+			ErrorCheck( vkAllocateMemory( device, &memory_allocate_info, nullptr, &offscreen.readback_memory ) );
+			ErrorCheck( vkBindBufferMemory( device, offscreen.readback_buffer, offscreen.readback_memory, 0 ) );
+			ErrorCheck( vkMapMemory( device, offscreen.readback_memory, 0, VK_WHOLE_SIZE, 0, &offscreen.readback_data ) );
+		}
+		{
+			VkCommandBufferAllocateInfo command_buffer_allocate_info {};
+			command_buffer_allocate_info.sType					= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			command_buffer_allocate_info.commandPool			= _offscreen_command_pool;
+			command_buffer_allocate_info.commandBufferCount		= 1;
+			command_buffer_allocate_info.level					= VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			ErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_allocate_info, &offscreen.readback_command_buffer ) );
+
+			VkCommandBufferBeginInfo begin_info {};
+			begin_info.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			ErrorCheck( vkBeginCommandBuffer( offscreen.readback_command_buffer, &begin_info ) );
+
+			// The rendering already moved the image to GetActiveImagePresentLayout() and the
+			// semaphore wait on render complete makes its writes visible to this copy.
+			VkBufferImageCopy region {};
+			region.imageSubresource.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.layerCount		= 1;
+			region.imageExtent.width				= _surface_size_x;
+			region.imageExtent.height				= _surface_size_y;
+			region.imageExtent.depth				= 1;
+			vkCmdCopyImageToBuffer( offscreen.readback_command_buffer, offscreen.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, offscreen.readback_buffer, 1, &region );
+
+			VkBufferMemoryBarrier barrier {};
+			barrier.sType					= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask			= VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask			= VK_ACCESS_HOST_READ_BIT;
+			barrier.srcQueueFamilyIndex		= VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex		= VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer					= offscreen.readback_buffer;
+			barrier.size					= VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier( offscreen.readback_command_buffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_HOST_BIT,
+				0,
+				0, nullptr,
+				1, &barrier,
+				0, nullptr );
+
+			ErrorCheck( vkEndCommandBuffer( offscreen.readback_command_buffer ) );
+		}
+	}
+}
+
+void Window::_DeInitOffscreenFrames()
+{
+	auto device = _renderer->GetVulkanDevice();
+	for( auto & offscreen : _offscreen_frames ) {
+		vkDestroyImage( device, offscreen.image, nullptr );
+		vkFreeMemory( device, offscreen.image_memory, nullptr );
+		vkDestroyBuffer( device, offscreen.readback_buffer, nullptr );
+		vkFreeMemory( device, offscreen.readback_memory, nullptr );
+	}
+	_offscreen_frames.clear();
+	vkDestroyCommandPool( device, _offscreen_command_pool, nullptr );
+	_offscreen_command_pool = VK_NULL_HANDLE;
+}
+
+void Window::_FinishOffscreenFrames()
+{
+	// Every pending frame has been submitted once the submission thread is idle, so its fence will signal.
+	auto device = _renderer->GetVulkanDevice();
+	_renderer->GetSubmissionThread()->WaitIdle();
+	for( uint32_t i=0; i < _offscreen_frames.size(); ++i ) {
+		if( _offscreen_frames[ i ].pending ) {
+			ErrorCheck( vkWaitForFences( device, 1, &_frame_fences[ i ], VK_TRUE, UINT64_MAX ) );
+		}
+	}
+	_PresentCompletedOffscreenFrames();
+}
+
+void Window::_PresentCompletedOffscreenFrames()
+{
+	auto device = _renderer->GetVulkanDevice();
+
+	// Frames have to reach the screen in order, stop at the first one the gpu is still working on.
+	while( true ) {
+		uint32_t oldest = UINT32_MAX;
+		for( uint32_t i=0; i < _offscreen_frames.size(); ++i ) {
+			if( _offscreen_frames[ i ].pending && ( oldest == UINT32_MAX || _offscreen_frames[ i ].frame < _offscreen_frames[ oldest ].frame ) ) {
+				oldest = i;
+			}
+		}
+		if( oldest == UINT32_MAX ) return;
+		if( vkGetFenceStatus( device, _frame_fences[ oldest ] ) != VK_SUCCESS ) return;
+
+		auto & offscreen = _offscreen_frames[ oldest ];
+		if( !_offscreen_readback_coherent ) {
+			VkMappedMemoryRange range {};
+			range.sType			= VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			range.memory		= offscreen.readback_memory;
+			range.size			= VK_WHOLE_SIZE;
+			ErrorCheck( vkInvalidateMappedMemoryRanges( device, 1, &range ) );
+		}
+		_OSSoftwarePresent( offscreen.readback_data );
+		offscreen.pending	= false;
 	}
 }
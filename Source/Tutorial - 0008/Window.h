@@ -1,12 +1,41 @@
 #pragma once
 
 #include "Platform.h"
+#include "Input.h"
+#include "InputRecording.h"
 
 #include <vector>
 #include <string>
 
 class Renderer;
 
+// What the swapchain should be optimized for, present mode and image
+// count are picked from what the surface supports based on this.
+enum class PresentPolicy
+{
+	LOWEST_LATENCY,					// immediate > mailbox > fifo, as few images as possible
+	MAX_THROUGHPUT,					// immediate > mailbox > fifo relaxed > fifo, extra images to absorb spikes
+	POWER_SAVING,					// fifo, vsync caps the frame rate so the gpu can idle
+	TEAR_FREE,						// mailbox > fifo, never tears
+};
+
+// How finished frames reach the screen.
+enum class PresentPath
+{
+	WSI,							// swapchain and vkQueuePresentKHR()
+	XCB_SHM,						// offscreen image, read back and put into an X11 shared memory segment
+};
+
+// Latency of a finished frame, measured from the moment its input was sampled.
+struct FrameLatency
+{
+	uint64_t							frame							= 0;
+	float								input_to_present_ms				= 0.0f;		// until vkQueuePresentKHR() was called
+	float								input_to_complete_ms			= 0.0f;		// until the frame fence was seen signaled, estimated input to present latency
+	float								cpu_ms							= 0.0f;		// BeginRender() to EndRender()
+	float								gpu_ms							= 0.0f;		// EndRender() until the frame fence was seen signaled
+};
+
 class Window
 {
 public:
@@ -16,6 +45,57 @@ public:
 	void Close();
 	bool Update();
 
+	// BeginRender() acquires the next swapchain image and EndRender() presents it. Work
+	// submitted in between must wait on GetImageAvailableSemaphore() and signal both
+	// GetRenderCompleteSemaphore() and GetFrameFence().
+	void								BeginRender();
+	void								EndRender();
+
+	// Software rasterizers present faster by skipping the WSI, returns false if
+	// the path is not available on this platform or X server.
+	bool								SetPresentPath( PresentPath path );
+	PresentPath							GetPresentPath() const;
+
+	// GetFrameFence() is VK_NULL_HANDLE on the XCB_SHM path, the window signals it
+	// itself, and the active image must end up in GetActiveImagePresentLayout().
+	VkImage								GetActiveImage() const;
+	VkImageLayout						GetActiveImagePresentLayout() const;
+	VkFormat							GetActiveImageFormat() const;
+	// False if the active image can not be copied from, not every surface allows
+	// transfer source swapchain images.
+	bool								IsActiveImageTransferSource() const;
+	VkExtent2D							GetSurfaceSize() const;
+	uint32_t							GetActiveImageIndex() const;
+	uint32_t							GetFrameSlot() const;
+	uint64_t							GetFrameNumber() const;
+	VkSemaphore							GetImageAvailableSemaphore() const;
+	VkSemaphore							GetRenderCompleteSemaphore() const;
+	VkFence								GetFrameFence() const;
+
+	void								PushInputEvent( const InputEvent & event );
+
+	// Records every input event to a file, or replays one in place of the live input. Replayed
+	// events are applied on the same frame number they were recorded on so that together with
+	// Renderer::SetFixedTimestep() a benchmark run repeats exactly.
+	bool								StartInputRecording( std::string file_path );
+	bool								StartInputReplay( std::string file_path );
+	void								StopInputRecordingAndReplay();
+	bool								IsReplayingInput() const;
+	const InputSnapshot				&	GetInputSnapshot() const;
+	const FrameLatency				&	GetLastFrameLatency() const;
+
+	// Changing the policy at runtime only recreates the swapchain,
+	// the OS window and the surface are kept as they are.
+	void								SetPresentPolicy( PresentPolicy policy );
+	PresentPolicy						GetPresentPolicy() const;
+	VkPresentModeKHR					GetPresentMode() const;
+	uint32_t							GetSwapchainImageCount() const;
+
+	// When enabled the swapchain image count follows the frame times
+	// given to ReportFrameTimes() instead of the fixed per policy count.
+	void								SetSwapchainImageCountAutoTune( bool enable );
+	void								ReportFrameTimes( float cpu_ms, float gpu_ms );
+
 private:
 	void								_InitOSWindow();
 	void								_DeInitOSWindow();
@@ -31,6 +111,26 @@ private:
 	void								_InitSwapchainImages();
 	void								_DeInitSwapchainImages();
 
+	void								_RecreateSwapchain();
+	VkPresentModeKHR					_SelectPresentMode() const;
+	uint32_t							_SelectSwapchainImageCount() const;
+	void								_AutoTuneSwapchainImageCount();
+
+	void								_ApplyInputEvent( const InputEvent & event );
+
+	void								_InitFrameSync();
+	void								_DeInitFrameSync();
+	void								_WaitForFrameSlot();
+
+	void								_InitOffscreenFrames();
+	void								_DeInitOffscreenFrames();
+	void								_PresentCompletedOffscreenFrames();
+	void								_FinishOffscreenFrames();
+
+	bool								_InitOSSoftwarePresent();
+	void								_DeInitOSSoftwarePresent();
+	void								_OSSoftwarePresent( const void * pixels );
+
 	Renderer						*	_renderer						= nullptr;
 
 	VkSurfaceKHR						_surface						= VK_NULL_HANDLE;
@@ -40,12 +140,76 @@ private:
 	uint32_t							_surface_size_y					= 512;
 	std::string							_window_name;
 	uint32_t							_swapchain_image_count			= 2;
+	VkImageUsageFlags					_swapchain_image_usage			= 0;
 
 	std::vector<VkImage>				_swapchain_images;
 	std::vector<VkImageView>			_swapchain_image_views;
 
 	VkSurfaceFormatKHR					_surface_format					= {};
 	VkSurfaceCapabilitiesKHR			_surface_capabilities			= {};
+	std::vector<VkPresentModeKHR>		_surface_present_modes;
+
+	PresentPolicy						_present_policy					= PresentPolicy::TEAR_FREE;
+	VkPresentModeKHR					_present_mode					= VK_PRESENT_MODE_FIFO_KHR;
+
+	static const uint32_t				_auto_tune_sample_count			= 60;
+	bool								_auto_tune_image_count			= false;
+	uint32_t							_auto_tune_extra_images			= 1;
+	uint32_t							_auto_tune_pending_extra_images	= 1;
+	uint32_t							_auto_tune_samples				= 0;
+	float								_auto_tune_cpu_ms_sum			= 0.0f;
+	float								_auto_tune_gpu_ms_sum			= 0.0f;
+	float								_auto_tune_frame_ms_sum			= 0.0f;
+	float								_auto_tune_frame_ms_sq_sum		= 0.0f;
+
+	struct FrameTiming
+	{
+		uint64_t								frame					= 0;
+		bool									pending					= false;
+		std::chrono::steady_clock::time_point	input_sample_time;
+		std::chrono::steady_clock::time_point	begin_time;
+		std::chrono::steady_clock::time_point	present_time;
+	};
+
+	std::vector<VkFence>				_frame_fences;
+	std::vector<VkSemaphore>			_image_available_semaphores;
+	std::vector<VkSemaphore>			_render_complete_semaphores;
+	std::vector<FrameTiming>			_frame_timings;
+	uint64_t							_frame_number					= 0;
+	uint32_t							_frame_slot						= 0;
+	bool								_frame_slot_ready				= false;
+	uint32_t							_active_swapchain_image_id		= UINT32_MAX;
+
+	// Offscreen render target and readback buffer per frame slot for the XCB_SHM path.
+	struct OffscreenFrame
+	{
+		VkImage								image					= VK_NULL_HANDLE;
+		VkDeviceMemory						image_memory			= VK_NULL_HANDLE;
+		VkBuffer							readback_buffer			= VK_NULL_HANDLE;
+		VkDeviceMemory						readback_memory			= VK_NULL_HANDLE;
+		void							*	readback_data			= nullptr;
+		VkCommandBuffer						readback_command_buffer	= VK_NULL_HANDLE;
+		uint64_t							frame					= 0;
+		bool								pending					= false;
+	};
+
+	PresentPath							_present_path					= PresentPath::WSI;
+	VkFormat							_offscreen_format				= VK_FORMAT_B8G8R8A8_UNORM;
+	VkCommandPool						_offscreen_command_pool			= VK_NULL_HANDLE;
+	bool								_offscreen_readback_coherent	= true;
+	std::vector<OffscreenFrame>			_offscreen_frames;
+	// Set by the OS window when its size changed, only the XCB_SHM path has no
+	// out of date swapchain to find out by itself.
+	bool								_surface_resized				= false;
+
+	InputRecorder					*	_input_recorder					= nullptr;
+	InputReplayer					*	_input_replayer					= nullptr;
+	std::vector<InputEvent>				_input_replay_events;
+	std::chrono::steady_clock::time_point	_input_recording_start;
+
+	InputSnapshot						_input_state;
+	InputSnapshot						_input_snapshot;
+	FrameLatency						_last_frame_latency;
 
 	bool								_window_should_run				= true;
 
@@ -59,5 +223,22 @@ private:
 	xcb_screen_t					*	_xcb_screen						= nullptr;
 	xcb_window_t						_xcb_window						= 0;
 	xcb_intern_atom_reply_t			*	_xcb_atom_window_reply			= nullptr;
+
+	void								_HandleXcbEvent( xcb_generic_event_t * event );
+
+#if BUILD_ENABLE_XCB_SHM_PRESENT
+	// Two segments so the next frame can be written while the server still reads the previous one.
+	struct XcbShmSegment
+	{
+		xcb_shm_seg_t						segment					= 0;
+		int									id						= -1;
+		uint8_t							*	data					= nullptr;
+		bool								busy					= false;
+	};
+	XcbShmSegment						_xcb_shm_segments[ 2 ];
+	uint32_t							_xcb_shm_next_segment			= 0;
+	uint8_t								_xcb_shm_completion_event		= 0;
+	xcb_gcontext_t						_xcb_gc							= 0;
+#endif
 #endif
 };
@@ -17,10 +17,39 @@ LRESULT CALLBACK WindowsEventHandler( HWND hWnd, UINT uMsg, WPARAM wParam, LPARA
 	Window * window = reinterpret_cast<Window*>(
 		GetWindowLongPtrW( hWnd, GWLP_USERDATA ) );
 
+	InputEvent input {};
+	input.x		= (short)LOWORD( lParam );
+	input.y		= (short)HIWORD( lParam );
+
 	switch( uMsg ) {
 	case WM_CLOSE:
-		window->Close();
+		input.type	= InputEventType::WINDOW_CLOSE;
+		window->PushInputEvent( input );
 		return 0;
+	case WM_KEYDOWN:
+	case WM_KEYUP:
+		input.type	= uMsg == WM_KEYDOWN ? InputEventType::KEY_DOWN : InputEventType::KEY_UP;
+		input.code	= uint32_t( wParam );
+		window->PushInputEvent( input );
+		break;
+	case WM_LBUTTONDOWN:
+	case WM_RBUTTONDOWN:
+	case WM_MBUTTONDOWN:
+		input.type	= InputEventType::MOUSE_BUTTON_DOWN;
+		input.code	= uMsg == WM_LBUTTONDOWN ? 1 : uMsg == WM_MBUTTONDOWN ? 2 : 3;
+		window->PushInputEvent( input );
+		break;
+	case WM_LBUTTONUP:
+	case WM_RBUTTONUP:
+	case WM_MBUTTONUP:
+		input.type	= InputEventType::MOUSE_BUTTON_UP;
+		input.code	= uMsg == WM_LBUTTONUP ? 1 : uMsg == WM_MBUTTONUP ? 2 : 3;
+		window->PushInputEvent( input );
+		break;
+	case WM_MOUSEMOVE:
+		input.type	= InputEventType::MOUSE_MOVE;
+		window->PushInputEvent( input );
+		break;
 	case WM_SIZE:
 		// we get here if the window has changed size, we should rebuild most
 		// of our window resources before rendering to this window again.
@@ -103,8 +132,9 @@ void Window::_DeInitOSWindow()
 
 void Window::_UpdateOSWindow()
 {
+	// drain every pending message so the input snapshot taken after this is up to date
 	MSG msg;
-	if( PeekMessage( &msg, _win32_window, 0, 0, PM_REMOVE ) ) {
+	while( PeekMessage( &msg, _win32_window, 0, 0, PM_REMOVE ) ) {
 		TranslateMessage( &msg );
 		DispatchMessage( &msg );
 	}
@@ -119,4 +149,18 @@ void Window::_InitOSSurface()
 	vkCreateWin32SurfaceKHR( _renderer->GetVulkanInstance(), &create_info, nullptr, &_surface );
 }
 
+// MIT-SHM presentation is X11 only.
+bool Window::_InitOSSoftwarePresent()
+{
+	return false;
+}
+
+void Window::_DeInitOSSoftwarePresent()
+{
+}
+
+void Window::_OSSoftwarePresent( const void * )
+{
+}
+
 #endif
@@ -8,9 +8,15 @@
 
 #include <assert.h>
 #include <iostream>
+#include <cstring>
 
 #if VK_USE_PLATFORM_XCB_KHR
 
+#if BUILD_ENABLE_XCB_SHM_PRESENT
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
 void Window::_InitOSWindow()
 {
 	// create connection to X11 server
@@ -43,7 +49,10 @@ void Window::_InitOSWindow()
 
 	value_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
 	value_list[ 0 ] = _xcb_screen->black_pixel;
-	value_list[ 1 ] = XCB_EVENT_MASK_KEY_RELEASE | XCB_EVENT_MASK_EXPOSURE;
+	value_list[ 1 ] = XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE |
+		XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE |
+		XCB_EVENT_MASK_POINTER_MOTION | XCB_EVENT_MASK_EXPOSURE |
+		XCB_EVENT_MASK_STRUCTURE_NOTIFY;
 
 	xcb_create_window( _xcb_connection, XCB_COPY_FROM_PARENT, _xcb_window,
 		_xcb_screen->root, dimensions.offset.x, dimensions.offset.y,
@@ -95,23 +104,77 @@ void Window::_DeInitOSWindow()
 
 void Window::_UpdateOSWindow()
 {
-	auto event = xcb_poll_for_event( _xcb_connection );
-
-	// if there is no event, event will be NULL
-	// need to check for event == NULL to prevent segfault
-	if( !event )
-		return;
+	// drain every pending event so the input snapshot taken after this is up to date,
+	// when there are no more events xcb_poll_for_event returns NULL
+	xcb_generic_event_t * event = nullptr;
+	while( ( event = xcb_poll_for_event( _xcb_connection ) ) ) {
+		_HandleXcbEvent( event );
+		free( event );
+	}
+}
 
+void Window::_HandleXcbEvent( xcb_generic_event_t * event )
+{
+	InputEvent input {};
 	switch( event->response_type & ~0x80 ) {
 	case XCB_CLIENT_MESSAGE:
 		if( ( (xcb_client_message_event_t*)event )->data.data32[ 0 ] == _xcb_atom_window_reply->atom ) {
-			Close();
+			input.type		= InputEventType::WINDOW_CLOSE;
+			PushInputEvent( input );
+		}
+		break;
+	case XCB_KEY_PRESS:
+	case XCB_KEY_RELEASE:
+	{
+		auto key_event	= (xcb_key_press_event_t*)event;
+		input.type		= ( event->response_type & ~0x80 ) == XCB_KEY_PRESS ? InputEventType::KEY_DOWN : InputEventType::KEY_UP;
+		input.code		= key_event->detail;
+		input.x			= key_event->event_x;
+		input.y			= key_event->event_y;
+		PushInputEvent( input );
+		break;
+	}
+	case XCB_BUTTON_PRESS:
+	case XCB_BUTTON_RELEASE:
+	{
+		auto button_event	= (xcb_button_press_event_t*)event;
+		input.type			= ( event->response_type & ~0x80 ) == XCB_BUTTON_PRESS ? InputEventType::MOUSE_BUTTON_DOWN : InputEventType::MOUSE_BUTTON_UP;
+		input.code			= button_event->detail;
+		input.x				= button_event->event_x;
+		input.y				= button_event->event_y;
+		PushInputEvent( input );
+		break;
+	}
+	case XCB_MOTION_NOTIFY:
+	{
+		auto motion_event	= (xcb_motion_notify_event_t*)event;
+		input.type			= InputEventType::MOUSE_MOVE;
+		input.x				= motion_event->event_x;
+		input.y				= motion_event->event_y;
+		PushInputEvent( input );
+		break;
+	}
+	case XCB_CONFIGURE_NOTIFY:
+	{
+		auto configure_event = (xcb_configure_notify_event_t*)event;
+		if( configure_event->width != _surface_size_x || configure_event->height != _surface_size_y ) {
+			_surface_resized = true;
 		}
 		break;
+	}
 	default:
+#if BUILD_ENABLE_XCB_SHM_PRESENT
+		if( _xcb_shm_completion_event != 0 && ( event->response_type & ~0x80 ) == _xcb_shm_completion_event ) {
+			auto completion = (xcb_shm_completion_event_t*)event;
+			for( auto & segment : _xcb_shm_segments ) {
+				if( segment.segment == completion->shmseg ) {
+					segment.busy = false;
+				}
+			}
+		}
+#endif
 		break;
 	}
-	free( event );
 }
 
 void Window::_InitOSSurface()
@@ -123,4 +186,127 @@ void Window::_InitOSSurface()
     ErrorCheck( vkCreateXcbSurfaceKHR( _renderer->GetVulkanInstance(), &create_info, nullptr, &_surface ) );
 }
 
+#if BUILD_ENABLE_XCB_SHM_PRESENT
+
+bool Window::_InitOSSoftwarePresent()
+{
+	auto version_reply = xcb_shm_query_version_reply( _xcb_connection, xcb_shm_query_version( _xcb_connection ), nullptr );
+	if( !version_reply ) {
+		std::cout << "X server has no MIT-SHM extension.\n";
+		return false;
+	}
+	free( version_reply );
+
+	// Pixels are handed over as they are read back, the screen has to use 32 bits per pixel.
+	if( _xcb_screen->root_depth != 24 && _xcb_screen->root_depth != 32 ) {
+		std::cout << "MIT-SHM present needs a 24 or 32 bit screen.\n";
+		return false;
+	}
+
+	_xcb_shm_completion_event	= xcb_get_extension_data( _xcb_connection, &xcb_shm_id )->first_event + XCB_SHM_COMPLETION;
+	_xcb_shm_next_segment		= 0;
+
+	size_t segment_size			= size_t( _surface_size_x ) * _surface_size_y * 4;
+	for( auto & segment : _xcb_shm_segments ) {
+		segment.id		= shmget( IPC_PRIVATE, segment_size, IPC_CREAT | 0600 );
+		if( segment.id < 0 ) {
+			_DeInitOSSoftwarePresent();
+			return false;
+		}
+		void * data		= shmat( segment.id, nullptr, 0 );
+		segment.data	= data == (void*)-1 ? nullptr : (uint8_t*)data;
+
+		xcb_generic_error_t * error = nullptr;
+		if( segment.data ) {
+			segment.segment	= xcb_generate_id( _xcb_connection );
+			error			= xcb_request_check( _xcb_connection, xcb_shm_attach_checked( _xcb_connection, segment.segment, segment.id, 1 ) );
+		}
+		// Marked for removal right away, the segment goes away once both we and the server have detached.
+		shmctl( segment.id, IPC_RMID, nullptr );
+		if( !segment.data || error ) {
+			free( error );
+			segment.segment	= 0;
+			_DeInitOSSoftwarePresent();
+			return false;
+		}
+		segment.busy	= false;
+	}
+
+	_xcb_gc = xcb_generate_id( _xcb_connection );
+	xcb_create_gc( _xcb_connection, _xcb_gc, _xcb_window, 0, nullptr );
+	return true;
+}
+
+void Window::_DeInitOSSoftwarePresent()
+{
+	// Round trip so the server is done with every put image request before the memory goes away.
+	free( xcb_get_input_focus_reply( _xcb_connection, xcb_get_input_focus( _xcb_connection ), nullptr ) );
+
+	for( auto & segment : _xcb_shm_segments ) {
+		if( segment.segment ) {
+			xcb_shm_detach( _xcb_connection, segment.segment );
+		}
+		if( segment.data ) {
+			shmdt( segment.data );
+		}
+		segment		= XcbShmSegment();
+	}
+	if( _xcb_gc ) {
+		xcb_free_gc( _xcb_connection, _xcb_gc );
+		_xcb_gc		= 0;
+	}
+	xcb_flush( _xcb_connection );
+	_xcb_shm_completion_event	= 0;
+}
+
+void Window::_OSSoftwarePresent( const void * pixels )
+{
+	auto & segment = _xcb_shm_segments[ _xcb_shm_next_segment ];
+
+	// Wait until the server is done reading this segment, it was used two frames ago.
+	while( segment.busy ) {
+		auto event = xcb_wait_for_event( _xcb_connection );
+		if( !event ) {
+			// connection is gone, nobody is reading the segment anymore
+			segment.busy = false;
+			break;
+		}
+		_HandleXcbEvent( event );
+		free( event );
+	}
+
+	// Readback is already in the X11 pixel layout, this is the only cpu side copy.
+	std::memcpy( segment.data, pixels, size_t( _surface_size_x ) * _surface_size_y * 4 );
+
+	xcb_shm_put_image( _xcb_connection, _xcb_window, _xcb_gc,
+		uint16_t( _surface_size_x ), uint16_t( _surface_size_y ),	// total size of the image in the segment
+		0, 0,														// source position
+		uint16_t( _surface_size_x ), uint16_t( _surface_size_y ),	// source size
+		0, 0,														// destination position
+		_xcb_screen->root_depth, XCB_IMAGE_FORMAT_Z_PIXMAP,
+		1,															// send a completion event so we know when the segment is free again
+		segment.segment, 0 );
+	xcb_flush( _xcb_connection );
+
+	segment.busy			= true;
+	_xcb_shm_next_segment	= ( _xcb_shm_next_segment + 1 ) % 2;
+}
+
+#else
+
+bool Window::_InitOSSoftwarePresent()
+{
+	return false;
+}
+
+void Window::_DeInitOSSoftwarePresent()
+{
+}
+
+void Window::_OSSoftwarePresent( const void * )
+{
+}
+
+#endif // BUILD_ENABLE_XCB_SHM_PRESENT
+
 #endif
@@ -1,15 +1,1556 @@
 
 #include "Renderer.h"
+#include "Window.h"
+#include "Shared.h"
+#include "FrameCapture.h"
+#include "CommandPoolManager.h"
+#include "SubmitBatcher.h"
+#include "FrameGraph.h"
+#include "SubmissionThread.h"
+#include "ShaderReflection.h"
+#include "PipelineLayoutCache.h"
+#include "ShaderPack.h"
+#include "ShaderModuleCache.h"
+#include "SpirvCompactor.h"
+#include "ShaderVariantManager.h"
+#include "PipelineService.h"
+#include "RenderPassCache.h"
+#include "DeletionQueue.h"
+#include "CpuComputeExecutor.h"
+#include "JobSystem.h"
+#include "ShaderHotReload.h"
+#include "ParallelCommandRecorder.h"
+#include "CommandBufferCache.h"
+#include "PipelineManifest.h"
 
-int main()
+#include <vector>
+#include <chrono>
+#include <string>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <unordered_map>
+#include <map>
+#include <memory>
+
+// Clears the active image to a color that follows the mouse.
+void RenderFrame( Renderer & r, Window * w, FrameGraph & graph, FrameCapture * capture = nullptr )
+{
+	w->BeginRender();
+
+	// Recycled from this thread's pool for the frame slot, the pool was reset in BeginRender().
+	auto command_buffer = r.GetCommandPoolManager()->GetCommandBuffer();
+
+	VkCommandBufferBeginInfo begin_info {};
+	begin_info.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags				= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	ErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+
+	// The acquire semaphore is waited on at the transfer stage, the old contents are discarded.
+	FrameGraphImageDesc image_desc;
+	image_desc.width		= w->GetSurfaceSize().width;
+	image_desc.height		= w->GetSurfaceSize().height;
+	image_desc.format		= w->GetActiveImageFormat();
+
+	graph.Reset();
+	auto target = graph.ImportImage( "swapchain", w->GetActiveImage(), VK_NULL_HANDLE, image_desc,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TRANSFER_BIT, w->GetActiveImagePresentLayout() );
+
+	auto & input = w->GetInputSnapshot();
+	VkClearColorValue clear_color {};
+	clear_color.float32[ 0 ]	= float( input.mouse_x % 800 ) / 800.0f;
+	clear_color.float32[ 1 ]	= float( input.mouse_y % 600 ) / 600.0f;
+	clear_color.float32[ 2 ]	= input.mouse_buttons ? 1.0f : 0.25f + 0.25f * float( std::sin( r.GetSimulationTime() ) );
+	clear_color.float32[ 3 ]	= 1.0f;
+
+	graph.AddPass( "clear", FrameGraphQueue::GRAPHICS, [ target, clear_color ]( VkCommandBuffer pass_command_buffer, const FrameGraph & pass_graph ) {
+		VkImageSubresourceRange clear_range {};
+		clear_range.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+		clear_range.levelCount		= 1;
+		clear_range.layerCount		= 1;
+		vkCmdClearColorImage( pass_command_buffer, pass_graph.GetImage( target ), pass_graph.GetLayout( target ), &clear_color, 1, &clear_range );
+	} ).Write( target, FrameGraphUsage::TRANSFER_DST );
+
+	// The graph leaves the image in its present layout, presentation engine or readback copy.
+	graph.Compile();
+	graph.Execute( command_buffer );
+
+	// The surface may stop allowing copies from its images when the swapchain is made again.
+	if( capture && w->IsActiveImageTransferSource() ) {
+		capture->Capture( command_buffer, w->GetActiveImage(), w->GetSurfaceSize(), w->GetActiveImagePresentLayout(), w->GetFrameNumber() );
+	}
+
+	ErrorCheck( vkEndCommandBuffer( command_buffer ) );
+
+	VkSemaphore				wait_semaphore		= w->GetImageAvailableSemaphore();
+	VkSemaphore				signal_semaphore	= w->GetRenderCompleteSemaphore();
+	VkPipelineStageFlags	wait_stage			= VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	VkSubmitInfo submit_info {};
+	submit_info.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.waitSemaphoreCount		= 1;
+	submit_info.pWaitSemaphores			= &wait_semaphore;
+	submit_info.pWaitDstStageMask		= &wait_stage;
+	submit_info.commandBufferCount		= 1;
+	submit_info.pCommandBuffers			= &command_buffer;
+	submit_info.signalSemaphoreCount	= 1;
+	submit_info.pSignalSemaphores		= &signal_semaphore;
+	r.GetSubmitBatcher()->Submit( submit_info, w->GetFrameFence() );
+
+	w->EndRender();
+
+	if( capture ) {
+		capture->Update();
+	}
+}
+
+// Frames per second of the given present path with a non blocking present mode.
+void RunPresentBenchmark( Renderer & r, Window * w, FrameGraph & graph, PresentPath path, const char * name )
+{
+	const uint32_t frame_count = 1000;
+	if( !w->SetPresentPath( path ) ) {
+		std::cout << name << ": not available" << std::endl;
+		return;
+	}
+	auto begin = std::chrono::steady_clock::now();
+	for( uint32_t i=0; i < frame_count && r.Run(); ++i ) {
+		RenderFrame( r, w, graph );
+	}
+	r.GetSubmissionThread()->WaitIdle();
+	auto seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+	auto submits = r.GetSubmitBatcher()->GetLastFrameStatistics();
+	auto timings = r.GetSubmissionThread()->GetLastFrameTimings();
+	std::cout << name << ": " << frame_count / seconds << " frames/sec, "
+		<< submits.requested_submits << " submits per frame batched into " << submits.queue_submits
+		<< ", " << submits.elided_semaphores << " semaphores elided, "
+		<< timings.submit_ms << " ms submit, " << timings.present_ms << " ms present, "
+		<< w->GetLastFrameLatency().input_to_complete_ms << " ms input to complete" << std::endl;
+}
+
+// Empty if the file is missing or is not made of whole words.
+std::vector<uint32_t> LoadSpirv( const std::string & file_name )
+{
+	std::ifstream file( file_name, std::ios::binary );
+	std::vector<char> bytes( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+	if( bytes.empty() || bytes.size() % sizeof( uint32_t ) ) {
+		std::cout << file_name << ": not a SPIR-V module" << std::endl;
+		return std::vector<uint32_t>();
+	}
+	std::vector<uint32_t> code( bytes.size() / sizeof( uint32_t ) );
+	std::memcpy( code.data(), bytes.data(), bytes.size() );
+	return code;
+}
+
+// Hand assembled modules for the reflection benchmark when no .spv files are given.
+// A compute shader with uniform and storage buffers, a storage image, an array of combined
+// image samplers, push constants and a specialized workgroup size, and a vertex shader
+// with three vertex inputs, a uniform buffer and push constants.
+static const uint32_t reflection_benchmark_compute[] = {
+	0x07230203, 0x00010000, 0x00000000, 0x00000022, 0x00000000, 0x00020011, 0x00000001, 0x0003000e,
+	0x00000000, 0x00000001, 0x0005000f, 0x00000005, 0x00000001, 0x6e69616d, 0x00000000, 0x00060010,
+	0x00000001, 0x00000011, 0x00000040, 0x00000001, 0x00000001, 0x00040005, 0x0000000a, 0x6e656373,
+	0x00000065, 0x00050005, 0x0000000e, 0x74726170, 0x656c6369, 0x00000073, 0x00060005, 0x00000011,
+	0x7074756f, 0x695f7475, 0x6567616d, 0x00000000, 0x00050005, 0x00000017, 0x74786574, 0x73657275,
+	0x00000000, 0x00040005, 0x0000001a, 0x68737570, 0x00000000, 0x00060005, 0x0000001b, 0x756f7267,
+	0x69735f70, 0x785f657a, 0x00000000, 0x00060005, 0x00000020, 0x5f657375, 0x74786574, 0x73657275,
+	0x00000000, 0x00030047, 0x00000008, 0x00000002, 0x00050048, 0x00000008, 0x00000000, 0x00000023,
+	0x00000000, 0x00040048, 0x00000008, 0x00000000, 0x00000005, 0x00050048, 0x00000008, 0x00000000,
+	0x00000007, 0x00000010, 0x00040047, 0x0000000a, 0x00000022, 0x00000000, 0x00040047, 0x0000000a,
+	0x00000021, 0x00000000, 0x00040047, 0x0000000b, 0x00000006, 0x00000010, 0x00030047, 0x0000000c,
+	0x00000003, 0x00050048, 0x0000000c, 0x00000000, 0x00000023, 0x00000000, 0x00040047, 0x0000000e,
+	0x00000022, 0x00000000, 0x00040047, 0x0000000e, 0x00000021, 0x00000001, 0x00040047, 0x00000011,
+	0x00000022, 0x00000001, 0x00040047, 0x00000011, 0x00000021, 0x00000000, 0x00040047, 0x00000017,
+	0x00000022, 0x00000001, 0x00040047, 0x00000017, 0x00000021, 0x00000001, 0x00030047, 0x00000018,
+	0x00000002, 0x00050048, 0x00000018, 0x00000000, 0x00000023, 0x00000010, 0x00040048, 0x00000018,
+	0x00000000, 0x00000005, 0x00050048, 0x00000018, 0x00000000, 0x00000007, 0x00000010, 0x00050048,
+	0x00000018, 0x00000001, 0x00000023, 0x00000050, 0x00040047, 0x0000001b, 0x00000001, 0x00000000,
+	0x00040047, 0x00000020, 0x00000001, 0x00000001, 0x00040047, 0x0000001d, 0x0000000b, 0x00000019,
+	0x00020013, 0x00000002, 0x00030021, 0x00000003, 0x00000002, 0x00030016, 0x00000004, 0x00000020,
+	0x00040015, 0x00000005, 0x00000020, 0x00000000, 0x00040017, 0x00000006, 0x00000004, 0x00000004,
+	0x00040018, 0x00000007, 0x00000006, 0x00000004, 0x0003001e, 0x00000008, 0x00000007, 0x00040020,
+	0x00000009, 0x00000002, 0x00000008, 0x0004003b, 0x00000009, 0x0000000a, 0x00000002, 0x0003001d,
+	0x0000000b, 0x00000006, 0x0003001e, 0x0000000c, 0x0000000b, 0x00040020, 0x0000000d, 0x00000002,
+	0x0000000c, 0x0004003b, 0x0000000d, 0x0000000e, 0x00000002, 0x00090019, 0x0000000f, 0x00000004,
+	0x00000001, 0x00000000, 0x00000000, 0x00000000, 0x00000002, 0x00000001, 0x00040020, 0x00000010,
+	0x00000000, 0x0000000f, 0x0004003b, 0x00000010, 0x00000011, 0x00000000, 0x00090019, 0x00000012,
+	0x00000004, 0x00000001, 0x00000000, 0x00000000, 0x00000000, 0x00000001, 0x00000000, 0x0003001b,
+	0x00000013, 0x00000012, 0x0004002b, 0x00000005, 0x00000014, 0x00000004, 0x0004001c, 0x00000015,
+	0x00000013, 0x00000014, 0x00040020, 0x00000016, 0x00000000, 0x00000015, 0x0004003b, 0x00000016,
+	0x00000017, 0x00000000, 0x0004001e, 0x00000018, 0x00000007, 0x00000006, 0x00040020, 0x00000019,
+	0x00000009, 0x00000018, 0x0004003b, 0x00000019, 0x0000001a, 0x00000009, 0x00040032, 0x00000005,
+	0x0000001b, 0x00000040, 0x0004002b, 0x00000005, 0x0000001c, 0x00000001, 0x00040017, 0x0000001e,
+	0x00000005, 0x00000003, 0x00060033, 0x0000001e, 0x0000001d, 0x0000001b, 0x0000001c, 0x0000001c,
+	0x00020014, 0x0000001f, 0x00030030, 0x0000001f, 0x00000020, 0x00050036, 0x00000002, 0x00000001,
+	0x00000000, 0x00000003, 0x000200f8, 0x00000021, 0x000100fd, 0x00010038,
+};
+
+static const uint32_t reflection_benchmark_vertex[] = {
+	0x07230203, 0x00010000, 0x00000000, 0x0000001a, 0x00000000, 0x00020011, 0x00000001, 0x0003000e,
+	0x00000000, 0x00000001, 0x0009000f, 0x00000000, 0x00000001, 0x6e69616d, 0x00000000, 0x0000000f,
+	0x00000010, 0x00000011, 0x00000012, 0x00050005, 0x0000000f, 0x705f6e69, 0x7469736f, 0x006e6f69,
+	0x00040005, 0x00000010, 0x755f6e69, 0x00000076, 0x00050005, 0x00000011, 0x6a5f6e69, 0x746e696f,
+	0x00000073, 0x00040005, 0x00000015, 0x6e656373, 0x00000065, 0x00040047, 0x0000000f, 0x0000001e,
+	0x00000000, 0x00040047, 0x00000010, 0x0000001e, 0x00000001, 0x00040047, 0x00000011, 0x0000001e,
+	0x00000002, 0x00040047, 0x00000012, 0x0000000b, 0x00000000, 0x00030047, 0x00000013, 0x00000002,
+	0x00050048, 0x00000013, 0x00000000, 0x00000023, 0x00000000, 0x00040048, 0x00000013, 0x00000000,
+	0x00000005, 0x00050048, 0x00000013, 0x00000000, 0x00000007, 0x00000010, 0x00040047, 0x00000015,
+	0x00000022, 0x00000000, 0x00040047, 0x00000015, 0x00000021, 0x00000000, 0x00030047, 0x00000016,
+	0x00000002, 0x00050048, 0x00000016, 0x00000000, 0x00000023, 0x00000050, 0x00020013, 0x00000002,
+	0x00030021, 0x00000003, 0x00000002, 0x00030016, 0x00000004, 0x00000020, 0x00040015, 0x00000005,
+	0x00000020, 0x00000000, 0x00040017, 0x00000006, 0x00000004, 0x00000002, 0x00040017, 0x00000007,
+	0x00000004, 0x00000003, 0x00040017, 0x00000008, 0x00000004, 0x00000004, 0x00040017, 0x00000009,
+	0x00000005, 0x00000004, 0x00040018, 0x0000000a, 0x00000008, 0x00000004, 0x00040020, 0x0000000b,
+	0x00000001, 0x00000007, 0x00040020, 0x0000000c, 0x00000001, 0x00000006, 0x00040020, 0x0000000d,
+	0x00000001, 0x00000009, 0x00040020, 0x0000000e, 0x00000003, 0x00000008, 0x0004003b, 0x0000000b,
+	0x0000000f, 0x00000001, 0x0004003b, 0x0000000c, 0x00000010, 0x00000001, 0x0004003b, 0x0000000d,
+	0x00000011, 0x00000001, 0x0004003b, 0x0000000e, 0x00000012, 0x00000003, 0x0003001e, 0x00000013,
+	0x0000000a, 0x00040020, 0x00000014, 0x00000002, 0x00000013, 0x0004003b, 0x00000014, 0x00000015,
+	0x00000002, 0x0003001e, 0x00000016, 0x00000008, 0x00040020, 0x00000017, 0x00000009, 0x00000016,
+	0x0004003b, 0x00000017, 0x00000018, 0x00000009, 0x00050036, 0x00000002, 0x00000001, 0x00000000,
+	0x00000003, 0x000200f8, 0x00000019, 0x000100fd, 0x00010038,
+};
+
+// The given files or the built in modules if there are none.
+std::vector<std::vector<uint32_t>> LoadBenchmarkModules( const std::vector<std::string> & files )
+{
+	std::vector<std::vector<uint32_t>> modules;
+	for( auto & file_name : files ) {
+		modules.push_back( LoadSpirv( file_name ) );
+		if( modules.back().empty() ) {
+			modules.pop_back();
+		}
+	}
+	if( files.empty() ) {
+		modules.push_back( std::vector<uint32_t>( std::begin( reflection_benchmark_compute ), std::end( reflection_benchmark_compute ) ) );
+		modules.push_back( std::vector<uint32_t>( std::begin( reflection_benchmark_vertex ), std::end( reflection_benchmark_vertex ) ) );
+	}
+	return modules;
+}
+
+// Reflects every module over and over like loading a large shader library and builds the
+// pipeline layouts, equal interfaces have to end up with the same Vulkan objects.
+void RunReflectionBenchmark( Renderer & r, const std::vector<std::string> & files )
+{
+	auto modules = LoadBenchmarkModules( files );
+	if( modules.empty() ) return;
+
+	const uint32_t shader_count = 10000;
+	ShaderReflection reflection;
+	uint32_t failed = 0;
+	auto begin = std::chrono::steady_clock::now();
+	for( uint32_t i=0; i < shader_count; ++i ) {
+		auto & module = modules[ i % modules.size() ];
+		failed += ReflectShader( module.data(), module.size(), reflection ) ? 0 : 1;
+	}
+	auto reflect_seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+
+	begin = std::chrono::steady_clock::now();
+	auto cache = r.GetPipelineLayoutCache();
+	for( uint32_t i=0; i < shader_count; ++i ) {
+		auto & module = modules[ i % modules.size() ];
+		if( ReflectShader( module.data(), module.size(), reflection ) ) {
+			cache->GetPipelineLayout( { &reflection } );
+		}
+	}
+	auto layout_seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - begin ).count();
+
+	std::cout << "Reflection: " << shader_count << " shaders from " << modules.size() << " modules, "
+		<< reflect_seconds * 1000000.0 / shader_count << " us per shader, " << failed << " failed" << std::endl;
+	std::cout << "Layouts: " << layout_seconds * 1000000.0 / shader_count << " us per shader with layouts, "
+		<< cache->GetDescriptorSetLayoutCount() << " descriptor set layouts, "
+		<< cache->GetPipelineLayoutCount() << " pipeline layouts" << std::endl;
+}
+
+// The parts of a reflection that stripping must not change, names are gone after it.
+bool SameShaderInterface( const ShaderReflection & a, const ShaderReflection & b )
+{
+	if( a.stage != b.stage || a.entry_point != b.entry_point ) return false;
+	if( a.descriptor_bindings.size() != b.descriptor_bindings.size() ) return false;
+	for( size_t i=0; i < a.descriptor_bindings.size(); ++i ) {
+		auto & x = a.descriptor_bindings[ i ];
+		auto & y = b.descriptor_bindings[ i ];
+		if( x.set != y.set || x.binding != y.binding || x.type != y.type || x.count != y.count ) return false;
+	}
+	if( a.vertex_inputs.size() != b.vertex_inputs.size() ) return false;
+	for( size_t i=0; i < a.vertex_inputs.size(); ++i ) {
+		if( a.vertex_inputs[ i ].location != b.vertex_inputs[ i ].location || a.vertex_inputs[ i ].format != b.vertex_inputs[ i ].format ) return false;
+	}
+	if( a.specialization_constants.size() != b.specialization_constants.size() ) return false;
+	for( size_t i=0; i < a.specialization_constants.size(); ++i ) {
+		auto & x = a.specialization_constants[ i ];
+		auto & y = b.specialization_constants[ i ];
+		if( x.constant_id != y.constant_id || x.size != y.size || x.default_value != y.default_value ) return false;
+	}
+	return a.push_constant_range.stageFlags == b.push_constant_range.stageFlags &&
+		a.push_constant_range.offset == b.push_constant_range.offset &&
+		a.push_constant_range.size == b.push_constant_range.size &&
+		std::equal( a.workgroup_size, a.workgroup_size + 3, b.workgroup_size ) &&
+		std::equal( a.workgroup_size_constant_ids, a.workgroup_size_constant_ids + 3, b.workgroup_size_constant_ids );
+}
+
+// Milliseconds to create and destroy the module count times.
+double TimeShaderModuleCreation( Renderer & r, const std::vector<uint32_t> & code, uint32_t count )
+{
+	VkShaderModuleCreateInfo shader_module_create_info {};
+	shader_module_create_info.sType		= VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shader_module_create_info.codeSize	= code.size() * sizeof( uint32_t );
+	shader_module_create_info.pCode		= code.data();
+
+	auto begin = std::chrono::steady_clock::now();
+	for( uint32_t i=0; i < count; ++i ) {
+		VkShaderModule module = VK_NULL_HANDLE;
+		ErrorCheck( vkCreateShaderModule( r.GetVulkanDevice(), &shader_module_create_info, nullptr, &module ) );
+		vkDestroyShaderModule( r.GetVulkanDevice(), module, nullptr );
+	}
+	return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+}
+
+// Strips and compacts every module, checks the round trip and compares size and module creation time.
+void RunStripBenchmark( Renderer & r, const std::vector<std::string> & files )
+{
+	const uint32_t create_count = 1000;
+	auto modules = LoadBenchmarkModules( files );
+	for( size_t i=0; i < modules.size(); ++i ) {
+		auto & module = modules[ i ];
+		std::string name = files.empty() ? ( i == 0 ? "built in compute" : "built in vertex" ) : files[ i ];
+
+		// Valid means the interface survives and a second pass changes nothing.
+		std::vector<uint32_t> compacted, compacted_again;
+		ShaderReflection original_reflection, compacted_reflection;
+		bool valid = StripAndCompactSpirv( module.data(), module.size(), compacted ) &&
+			StripAndCompactSpirv( compacted.data(), compacted.size(), compacted_again ) && compacted_again == compacted &&
+			ReflectShader( module.data(), module.size(), original_reflection ) &&
+			ReflectShader( compacted.data(), compacted.size(), compacted_reflection ) &&
+			SameShaderInterface( original_reflection, compacted_reflection );
+		if( !valid ) {
+			std::cout << name << ": round trip failed" << std::endl;
+			continue;
+		}
+
+		auto original_ms	= TimeShaderModuleCreation( r, module, create_count );
+		auto compacted_ms	= TimeShaderModuleCreation( r, compacted, create_count );
+		std::cout << name << ": " << module.size() * 4 << " -> " << compacted.size() * 4 << " bytes, bound "
+			<< module[ 3 ] << " -> " << compacted[ 3 ] << ", vkCreateShaderModule "
+			<< original_ms * 1000.0 / create_count << " -> " << compacted_ms * 1000.0 / create_count << " us" << std::endl;
+	}
+}
+
+// Asks for the variants of the built in compute shader like materials would, many times
+// the same few combinations, and reports how many pipelines that came down to.
+void RunVariantBenchmark( Renderer & r )
+{
+	ShaderVariantManager variants( &r );
+	variants.AddShader( "built in compute", reflection_benchmark_compute, sizeof( reflection_benchmark_compute ) / sizeof( uint32_t ) );
+
+	// Constant 0 is the workgroup size, constant 1 a bool that stays at its default.
+	const uint32_t request_count = 10000;
+	const uint64_t group_sizes[ 4 ] = { 32, 64, 128, 256 };
+	auto begin = std::chrono::steady_clock::now();
+	for( uint32_t i=0; i < request_count; ++i ) {
+		ShaderVariantManager::SpecializationValues values;
+		values.push_back( std::make_pair( 0u, group_sizes[ i % 4 ] ) );
+		if( i % 3 == 0 ) {
+			values.push_back( std::make_pair( 1u, uint64_t( VK_TRUE ) ) );
+		}
+		variants.GetComputePipeline( "built in compute", values );
+	}
+	auto ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+
+	std::cout << "Variants: " << request_count << " requests in " << ms << " ms" << std::endl;
+	for( auto & shader : variants.GetReport() ) {
+		std::cout << shader.name << ": " << shader.request_count << " requests, " << shader.variant_count << " pipelines";
+		for( auto & constant : shader.distinct_values ) {
+			std::cout << ", constant " << constant.first << " has " << constant.second << " values";
+		}
+		std::cout << std::endl;
+	}
+}
+
+// New materials showing up while frames are running: every few frames a pipeline that was
+// never seen is asked for, together with the ones that were. Compares the worst time a
+// frame spends getting its pipelines with the service and with blocking creation.
+void RunPipelineServiceBenchmark( Renderer & r )
+{
+	const uint32_t frame_count = 300;
+	auto code			= reflection_benchmark_compute;
+	size_t word_count	= sizeof( reflection_benchmark_compute ) / sizeof( uint32_t );
+	ShaderReflection reflection;
+	ReflectShader( code, word_count, reflection );
+
+	PipelineDescription description;
+	description.stages.resize( 1 );
+	description.stages[ 0 ].stage		= VK_SHADER_STAGE_COMPUTE_BIT;
+	description.stages[ 0 ].module		= r.GetShaderModuleCache()->GetShaderModule( code, word_count );
+	description.layout					= r.GetPipelineLayoutCache()->GetPipelineLayout( { &reflection } );
+
+	// The workgroup size is the material, constant 0.
+	VkSpecializationMapEntry map_entry {};
+	map_entry.constantID	= 0;
+	map_entry.size			= sizeof( uint32_t );
+	description.stages[ 0 ].specialization_map_entries.push_back( map_entry );
+	description.stages[ 0 ].specialization_data.resize( sizeof( uint32_t ) );
+	auto set_group_size = [ &description ]( uint32_t group_size ) {
+		std::memcpy( description.stages[ 0 ].specialization_data.data(), &group_size, sizeof( group_size ) );
+	};
+
+	auto service = r.GetPipelineService();
+	set_group_size( 1 );
+	VkResult fallback_result = VK_SUCCESS;
+	auto fallback = service->GetPipelineNow( description, &fallback_result );
+	if( fallback_result != VK_SUCCESS ) {
+		std::cout << "Pipeline service: the fallback pipeline could not be created" << std::endl;
+		return;
+	}
+
+	for( uint32_t blocking=0; blocking < 2; ++blocking ) {
+		double worst_ms = 0.0;
+		for( uint32_t frame=0; frame < frame_count; ++frame ) {
+			auto begin = std::chrono::steady_clock::now();
+			uint32_t material_count = frame / 10 + 1;
+			for( uint32_t material=0; material < material_count; ++material ) {
+				// Different sizes for both runs so neither finds the other's pipelines.
+				set_group_size( 2 + material * 2 + blocking );
+				if( blocking ) {
+					service->GetPipelineNow( description );
+				} else {
+					service->GetPipeline( description, fallback );
+				}
+			}
+			worst_ms = std::max( worst_ms, std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count() );
+		}
+		service->WaitIdle();
+		std::cout << ( blocking ? "Blocking" : "Pipeline service" ) << ": worst frame " << worst_ms << " ms getting pipelines" << std::endl;
+	}
+	std::cout << service->GetCompileCount() << " compiles, " << service->GetCoalescedCount() << " requests coalesced, "
+		<< service->GetFallbackCount() << " fallbacks used" << std::endl;
+}
+
+// Render pass and framebuffer made every frame against the caches, then the framebuffer
+// of a view that goes to the deletion queue has to leave the cache with it.
+void RunRenderPassCacheBenchmark( Renderer & r, Window * w )
+{
+	const uint32_t frame_count = 1000;
+	auto device = r.GetVulkanDevice();
+	auto extent = w->GetSurfaceSize();
+
+	VkImageViewCreateInfo image_view_create_info {};
+	image_view_create_info.sType							= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	image_view_create_info.image							= w->GetActiveImage();
+	image_view_create_info.viewType							= VK_IMAGE_VIEW_TYPE_2D;
+	image_view_create_info.format							= w->GetActiveImageFormat();
+	image_view_create_info.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+	image_view_create_info.subresourceRange.levelCount		= 1;
+	image_view_create_info.subresourceRange.layerCount		= 1;
+	VkImageView view = VK_NULL_HANDLE;
+	ErrorCheck( vkCreateImageView( device, &image_view_create_info, nullptr, &view ) );
+
+	RenderPassSignature signature;
+	signature.color_attachments.resize( 1 );
+	signature.color_attachments[ 0 ].format			= w->GetActiveImageFormat();
+	signature.color_attachments[ 0 ].final_layout	= VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkFramebufferCreateInfo framebuffer_create_info {};
+	framebuffer_create_info.sType				= VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebuffer_create_info.attachmentCount		= 1;
+	framebuffer_create_info.pAttachments		= &view;
+	framebuffer_create_info.width				= extent.width;
+	framebuffer_create_info.height				= extent.height;
+	framebuffer_create_info.layers				= 1;
+
+	auto begin = std::chrono::steady_clock::now();
+	for( uint32_t frame=0; frame < frame_count; ++frame ) {
+		// A cache of its own every frame destroys its render pass at the end of the frame.
+		RenderPassCache render_passes( &r );
+		framebuffer_create_info.renderPass = render_passes.GetRenderPass( signature );
+		VkFramebuffer framebuffer = VK_NULL_HANDLE;
+		ErrorCheck( vkCreateFramebuffer( device, &framebuffer_create_info, nullptr, &framebuffer ) );
+		vkDestroyFramebuffer( device, framebuffer, nullptr );
+	}
+	auto create_us = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - begin ).count() / frame_count;
+
+	auto framebuffers = r.GetFramebufferCache();
+	begin = std::chrono::steady_clock::now();
+	for( uint32_t frame=0; frame < frame_count; ++frame ) {
+		auto render_pass = r.GetRenderPassCache()->GetRenderPass( signature );
+		framebuffers->GetFramebuffer( render_pass, { view }, extent );
+	}
+	auto cached_us = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - begin ).count() / frame_count;
+
+	auto cached_count = framebuffers->GetFramebufferCount();
+	r.GetDeletionQueue()->DestroyImageView( view );
+	auto evicted = cached_count - framebuffers->GetFramebufferCount();
+
+	std::cout << "Created every frame: " << create_us << " us, cached: " << cached_us << " us per frame, "
+		<< r.GetRenderPassCache()->GetRenderPassCount() << " render passes, " << framebuffers->GetCreateCount()
+		<< " framebuffers created, " << evicted << " evicted with their view" << std::endl;
+}
+
+// Records the same render pass of many small clears, standing in for draws, on one thread and
+// split into chunks recorded in parallel into secondary command buffers. Reports the cpu time
+// spent recording per frame.
+void RunParallelRecordingBenchmark( Renderer & r, Window * w )
+{
+	const uint32_t frame_count = 200, clear_count = 20000, cell_size = 16;
+	auto device			= r.GetVulkanDevice();
+	auto chunk_count	= r.GetJobSystem()->GetThreadCount() * 4;
+
+	// Views of the window images are made the first time an image comes up.
+	std::map<VkImage, VkImageView> views;
+	auto get_view = [ &views, device, w ]( VkImage image ) {
+		auto & view = views[ image ];
+		if( view == VK_NULL_HANDLE ) {
+			VkImageViewCreateInfo image_view_create_info {};
+			image_view_create_info.sType							= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			image_view_create_info.image							= image;
+			image_view_create_info.viewType							= VK_IMAGE_VIEW_TYPE_2D;
+			image_view_create_info.format							= w->GetActiveImageFormat();
+			image_view_create_info.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+			image_view_create_info.subresourceRange.levelCount		= 1;
+			image_view_create_info.subresourceRange.layerCount		= 1;
+			ErrorCheck( vkCreateImageView( device, &image_view_create_info, nullptr, &view ) );
+		}
+		return view;
+	};
+
+	ParallelCommandRecorder recorder( &r );
+	for( uint32_t parallel=0; parallel < 2; ++parallel ) {
+		double record_ms		= 0.0;
+		uint32_t chunks			= parallel ? chunk_count : 1;
+		uint32_t frame			= 0;
+		for( ; frame < frame_count && r.Run(); ++frame ) {
+			w->BeginRender();
+			auto extent				= w->GetSurfaceSize();
+			auto command_buffer		= r.GetCommandPoolManager()->GetCommandBuffer();
+
+			RenderPassSignature signature;
+			signature.color_attachments.resize( 1 );
+			signature.color_attachments[ 0 ].format			= w->GetActiveImageFormat();
+			signature.color_attachments[ 0 ].final_layout	= w->GetActiveImagePresentLayout();
+			auto render_pass = r.GetRenderPassCache()->GetRenderPass( signature );
+
+			VkClearValue clear_value {};
+			VkRenderPassBeginInfo render_pass_begin_info {};
+			render_pass_begin_info.sType				= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			render_pass_begin_info.renderPass			= render_pass;
+			render_pass_begin_info.framebuffer			= r.GetFramebufferCache()->GetFramebuffer( render_pass, { get_view( w->GetActiveImage() ) }, extent );
+			render_pass_begin_info.renderArea.extent	= extent;
+			render_pass_begin_info.clearValueCount		= 1;
+			render_pass_begin_info.pClearValues			= &clear_value;
+
+			// Every clear is a cell of a grid that wraps around the window.
+			uint32_t columns	= std::max( extent.width / cell_size, 1u );
+			uint32_t rows		= std::max( extent.height / cell_size, 1u );
+			uint32_t chunk_size	= ( clear_count + chunks - 1 ) / chunks;
+			auto record_chunk = [ columns, rows, chunk_size, frame, clear_count, cell_size ]( VkCommandBuffer chunk_command_buffer, uint32_t chunk ) {
+				VkClearAttachment clear {};
+				clear.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+				clear.colorAttachment	= 0;
+				VkClearRect rect {};
+				rect.rect.extent		= { cell_size, cell_size };
+				rect.layerCount			= 1;
+				for( uint32_t i=chunk * chunk_size; i < std::min( ( chunk + 1 ) * chunk_size, clear_count ); ++i ) {
+					uint32_t cell					= ( i + frame ) % ( columns * rows );
+					rect.rect.offset				= { int32_t( cell % columns * cell_size ), int32_t( cell / columns % rows * cell_size ) };
+					clear.clearValue.color.float32[ 0 ]	= float( i % 256 ) / 255.0f;
+					clear.clearValue.color.float32[ 1 ]	= float( chunk % 8 ) / 7.0f;
+					clear.clearValue.color.float32[ 3 ]	= 1.0f;
+					vkCmdClearAttachments( chunk_command_buffer, 1, &clear, 1, &rect );
+				}
+			};
+
+			VkCommandBufferBeginInfo begin_info {};
+			begin_info.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.flags				= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			auto begin = std::chrono::steady_clock::now();
+			ErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+			recorder.RecordRenderPass( command_buffer, render_pass_begin_info, chunks, record_chunk );
+			ErrorCheck( vkEndCommandBuffer( command_buffer ) );
+			record_ms += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+
+			// The render pass moves the image out of the undefined layout, nothing may touch it before the acquire.
+			VkSemaphore				wait_semaphore		= w->GetImageAvailableSemaphore();
+			VkSemaphore				signal_semaphore	= w->GetRenderCompleteSemaphore();
+			VkPipelineStageFlags	wait_stage			= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			VkSubmitInfo submit_info {};
+			submit_info.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submit_info.waitSemaphoreCount		= 1;
+			submit_info.pWaitSemaphores			= &wait_semaphore;
+			submit_info.pWaitDstStageMask		= &wait_stage;
+			submit_info.commandBufferCount		= 1;
+			submit_info.pCommandBuffers			= &command_buffer;
+			submit_info.signalSemaphoreCount	= 1;
+			submit_info.pSignalSemaphores		= &signal_semaphore;
+			r.GetSubmitBatcher()->Submit( submit_info, w->GetFrameFence() );
+			w->EndRender();
+		}
+		std::cout << ( parallel ? "Parallel recording: " : "Single thread recording: " ) << clear_count << " clears in " << chunks
+			<< ( chunks == 1 ? " chunk, " : " chunks, " ) << record_ms / std::max( frame, 1u ) << " ms per frame" << std::endl;
+	}
+
+	r.GetSubmissionThread()->WaitIdle();
+	for( auto & view : views ) {
+		r.GetDeletionQueue()->DestroyImageView( view.second );
+	}
+}
+
+// A static background layer of many small clears, recorded into a secondary command buffer
+// every frame against taken from the CommandBufferCache. The cache records it once per window
+// image and again only when the swapchain is made again. Reports the cpu time per frame.
+void RunCommandBufferCacheBenchmark( Renderer & r, Window * w )
+{
+	const uint32_t frame_count = 200, clear_count = 20000, cell_size = 16;
+	auto device		= r.GetVulkanDevice();
+	auto cache		= r.GetCommandBufferCache();
+
+	std::map<VkImage, VkImageView> views;
+	auto get_view = [ &views, device, w ]( VkImage image ) {
+		auto & view = views[ image ];
+		if( view == VK_NULL_HANDLE ) {
+			VkImageViewCreateInfo image_view_create_info {};
+			image_view_create_info.sType							= VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			image_view_create_info.image							= image;
+			image_view_create_info.viewType							= VK_IMAGE_VIEW_TYPE_2D;
+			image_view_create_info.format							= w->GetActiveImageFormat();
+			image_view_create_info.subresourceRange.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+			image_view_create_info.subresourceRange.levelCount		= 1;
+			image_view_create_info.subresourceRange.layerCount		= 1;
+			ErrorCheck( vkCreateImageView( device, &image_view_create_info, nullptr, &view ) );
+		}
+		return view;
+	};
+
+	for( uint32_t cached=0; cached < 2; ++cached ) {
+		double record_ms		= 0.0;
+		uint32_t frame			= 0;
+		auto record_count		= cache->GetRecordCount();
+		for( ; frame < frame_count && r.Run(); ++frame ) {
+			w->BeginRender();
+			auto extent				= w->GetSurfaceSize();
+			auto image				= w->GetActiveImage();
+			auto view				= get_view( image );
+			auto command_buffer		= r.GetCommandPoolManager()->GetCommandBuffer();
+
+			RenderPassSignature signature;
+			signature.color_attachments.resize( 1 );
+			signature.color_attachments[ 0 ].format			= w->GetActiveImageFormat();
+			signature.color_attachments[ 0 ].final_layout	= w->GetActiveImagePresentLayout();
+			auto render_pass = r.GetRenderPassCache()->GetRenderPass( signature );
+
+			VkClearValue clear_value {};
+			VkRenderPassBeginInfo render_pass_begin_info {};
+			render_pass_begin_info.sType				= VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			render_pass_begin_info.renderPass			= render_pass;
+			render_pass_begin_info.framebuffer			= r.GetFramebufferCache()->GetFramebuffer( render_pass, { view }, extent );
+			render_pass_begin_info.renderArea.extent	= extent;
+			render_pass_begin_info.clearValueCount		= 1;
+			render_pass_begin_info.pClearValues			= &clear_value;
+
+			// The same grid every frame, only the window size changes it.
+			uint32_t columns	= std::max( extent.width / cell_size, 1u );
+			uint32_t rows		= std::max( extent.height / cell_size, 1u );
+			auto record_layer = [ columns, rows, clear_count, cell_size ]( VkCommandBuffer layer_command_buffer ) {
+				VkClearAttachment clear {};
+				clear.aspectMask		= VK_IMAGE_ASPECT_COLOR_BIT;
+				clear.colorAttachment	= 0;
+				VkClearRect rect {};
+				rect.rect.extent		= { cell_size, cell_size };
+				rect.layerCount			= 1;
+				for( uint32_t i=0; i < clear_count; ++i ) {
+					uint32_t cell					= i % ( columns * rows );
+					rect.rect.offset				= { int32_t( cell % columns * cell_size ), int32_t( cell / columns % rows * cell_size ) };
+					clear.clearValue.color.float32[ 2 ]	= float( i % 256 ) / 255.0f;
+					clear.clearValue.color.float32[ 3 ]	= 1.0f;
+					vkCmdClearAttachments( layer_command_buffer, 1, &clear, 1, &rect );
+				}
+			};
+
+			VkCommandBufferInheritanceInfo inheritance_info {};
+			inheritance_info.sType			= VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritance_info.renderPass		= render_pass;
+			inheritance_info.framebuffer	= render_pass_begin_info.framebuffer;
+
+			VkCommandBufferBeginInfo begin_info {};
+			begin_info.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.flags				= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			auto begin = std::chrono::steady_clock::now();
+			VkCommandBuffer layer_command_buffer = VK_NULL_HANDLE;
+			if( cached ) {
+				// One per window image, the view is a dependency so destroying it drops the recording.
+				layer_command_buffer = cache->Get( "static background " + std::to_string( CommandBufferCache::Handle( image ) ),
+					{ CommandBufferCache::Handle( view ), columns, rows }, record_layer, VK_COMMAND_BUFFER_LEVEL_SECONDARY, &inheritance_info );
+			} else {
+				VkCommandBufferBeginInfo layer_begin_info {};
+				layer_begin_info.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+				layer_begin_info.flags				= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+				layer_begin_info.pInheritanceInfo	= &inheritance_info;
+				layer_command_buffer = r.GetCommandPoolManager()->GetCommandBuffer( VK_COMMAND_BUFFER_LEVEL_SECONDARY );
+				ErrorCheck( vkBeginCommandBuffer( layer_command_buffer, &layer_begin_info ) );
+				record_layer( layer_command_buffer );
+				ErrorCheck( vkEndCommandBuffer( layer_command_buffer ) );
+			}
+			ErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+			vkCmdBeginRenderPass( command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS );
+			vkCmdExecuteCommands( command_buffer, 1, &layer_command_buffer );
+			vkCmdEndRenderPass( command_buffer );
+			ErrorCheck( vkEndCommandBuffer( command_buffer ) );
+			record_ms += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+
+			VkSemaphore				wait_semaphore		= w->GetImageAvailableSemaphore();
+			VkSemaphore				signal_semaphore	= w->GetRenderCompleteSemaphore();
+			VkPipelineStageFlags	wait_stage			= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			VkSubmitInfo submit_info {};
+			submit_info.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submit_info.waitSemaphoreCount		= 1;
+			submit_info.pWaitSemaphores			= &wait_semaphore;
+			submit_info.pWaitDstStageMask		= &wait_stage;
+			submit_info.commandBufferCount		= 1;
+			submit_info.pCommandBuffers			= &command_buffer;
+			submit_info.signalSemaphoreCount	= 1;
+			submit_info.pSignalSemaphores		= &signal_semaphore;
+			r.GetSubmitBatcher()->Submit( submit_info, w->GetFrameFence() );
+			w->EndRender();
+		}
+		std::cout << ( cached ? "Cached static layer: " : "Recorded static layer: " ) << clear_count << " clears, "
+			<< record_ms / std::max( frame, 1u ) << " ms per frame";
+		if( cached ) {
+			std::cout << ", recorded " << cache->GetRecordCount() - record_count << " times in " << frame << " frames";
+		}
+		std::cout << std::endl;
+	}
+
+	r.GetSubmissionThread()->WaitIdle();
+	for( auto & view : views ) {
+		r.GetDeletionQueue()->DestroyImageView( view.second );
+	}
+}
+
+// A compute shader file is rewritten every few frames while frames keep running, between the
+// built in module and its stripped version so every write is new code. Reports the worst frame
+// and how long a change took to show up, against stopping the frame for a blocking rebuild.
+void RunShaderHotReloadBenchmark( Renderer & r, Window * w, FrameGraph & graph )
+{
+	const uint32_t frame_count = 600, reload_interval = 30, blocking_count = 10;
+	const std::string file_name = "hot_reload_benchmark.spv";
+	std::vector<uint32_t> versions[ 2 ];
+	versions[ 0 ].assign( reflection_benchmark_compute, reflection_benchmark_compute + sizeof( reflection_benchmark_compute ) / sizeof( uint32_t ) );
+	StripAndCompactSpirv( versions[ 0 ].data(), versions[ 0 ].size(), versions[ 1 ] );
+	auto write = [ &file_name ]( const std::vector<uint32_t> & code ) {
+		std::ofstream file( file_name, std::ios::binary | std::ios::trunc );
+		file.write( (const char*)code.data(), code.size() * sizeof( uint32_t ) );
+	};
+	write( versions[ 0 ] );
+
+	auto hot_reload	= r.GetShaderHotReload();
+	auto shader		= hot_reload->AddShader( file_name );
+	if( shader == UINT32_MAX ) return;
+	PipelineDescription description;
+	description.stages.resize( 1 );
+	auto pipeline	= hot_reload->AddPipeline( description, { shader } );
+	if( pipeline == UINT32_MAX ) return;
+
+	auto current = hot_reload->GetPipeline( pipeline );
+	std::chrono::steady_clock::time_point write_time;
+	double worst_frame_ms = 0.0, latency_ms = 0.0;
+	uint32_t write_count = 0, swap_count = 0;
+	for( uint32_t frame=0; frame < frame_count; ++frame ) {
+		// The editor saves between two frames.
+		if( frame % reload_interval == reload_interval / 2 ) {
+			write( versions[ ++write_count % 2 ] );
+			write_time = std::chrono::steady_clock::now();
+		}
+		auto begin = std::chrono::steady_clock::now();
+		if( !r.Run() ) break;
+		if( hot_reload->GetPipeline( pipeline ) != current ) {
+			current		= hot_reload->GetPipeline( pipeline );
+			latency_ms	+= std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - write_time ).count();
+			++swap_count;
+		}
+		RenderFrame( r, w, graph );
+		worst_frame_ms = std::max( worst_frame_ms, std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count() );
+	}
+
+	// What a change costs when the frame stops for it: the queue goes idle and everything is built right away.
+	auto device = r.GetVulkanDevice();
+	auto begin = std::chrono::steady_clock::now();
+	for( uint32_t i=0; i < blocking_count; ++i ) {
+		r.GetSubmissionThread()->WaitIdle();
+		auto code = LoadSpirv( file_name );
+		ShaderReflection reflection;
+		ReflectShader( code.data(), code.size(), reflection );
+
+		VkShaderModuleCreateInfo shader_module_create_info {};
+		shader_module_create_info.sType		= VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		shader_module_create_info.codeSize	= code.size() * sizeof( uint32_t );
+		shader_module_create_info.pCode		= code.data();
+		PipelineDescription blocking = description;
+		ErrorCheck( vkCreateShaderModule( device, &shader_module_create_info, nullptr, &blocking.stages[ 0 ].module ) );
+		blocking.layout = r.GetPipelineLayoutCache()->GetPipelineLayout( { &reflection } );
+		VkPipeline blocking_pipeline = VK_NULL_HANDLE;
+		ErrorCheck( CreatePipeline( &r, blocking, &blocking_pipeline ) );
+		vkDestroyPipeline( device, blocking_pipeline, nullptr );
+		vkDestroyShaderModule( device, blocking.stages[ 0 ].module, nullptr );
+	}
+	auto blocking_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count() / blocking_count;
+
+	// A broken save keeps the last working pipeline.
+	write( std::vector<uint32_t>( versions[ 0 ].begin(), versions[ 0 ].begin() + 3 ) );
+	hot_reload->WaitIdle();
+	bool kept = hot_reload->GetPipeline( pipeline ) == current && !hot_reload->GetShaderError( shader ).empty();
+	std::remove( file_name.c_str() );
+
+	std::cout << "Hot reload: " << write_count << " changes, " << swap_count << " pipelines swapped in after "
+		<< ( swap_count ? latency_ms / swap_count : 0.0 ) << " ms on average, worst frame " << worst_frame_ms << " ms" << std::endl;
+	std::cout << "Blocking rebuild: " << blocking_ms << " ms stall per change" << std::endl;
+	std::cout << "Broken file " << ( kept ? "kept" : "did not keep" ) << " the last pipeline, " << hot_reload->GetFailedCount() << " failed loads" << std::endl;
+}
+
+// Maps a shader pack and creates the module of every shader in it, shaders with the same
+// code share their module.
+void RunShaderPackBenchmark( Renderer & r, const std::string & pack_file )
+{
+	ShaderPack pack( &r );
+	auto begin = std::chrono::steady_clock::now();
+	if( !pack.Open( pack_file ) ) {
+		std::cout << pack_file << ": not a shader pack" << std::endl;
+		return;
+	}
+	auto open_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+
+	auto names = pack.GetShaderNames();
+	begin = std::chrono::steady_clock::now();
+	for( auto & name : names ) {
+		pack.GetShaderModule( name );
+	}
+	auto create_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+
+	std::cout << "Shader pack: " << names.size() << " shaders, opened in " << open_ms << " ms, modules created in "
+		<< create_ms << " ms, " << r.GetShaderModuleCache()->GetModuleCount() << " distinct modules" << std::endl;
+}
+
+// Hand assembled image kernels for the cpu compute benchmark, each reads packed RGBA8 pixels
+// from binding 0 and writes binding 1, workgroups of 8x8 or 256 invocations.
+//
+// Tonemap, push constants { uint width, height; float exposure; }:
+//     vec3 c = unpackUnorm4x8( source[ i ] ).rgb * exposure;
+//     target[ i ] = packUnorm4x8( vec4( pow( c / ( c + 1.0 ), vec3( 0.45454545 ) ), alpha ) );
+// Blur, a 3x3 box filter with clamped edges, push constants { uint width, height; }.
+// Histogram, push constants { uint count; }, 256 shared bins of the luminance:
+//     atomicAdd( bins[ min( uint( fma( dot( rgb, vec3( 0.2126, 0.7152, 0.0722 ) ), 255.0, 0.5 ) ), 255 ) ], 1 );
+//     barrier(); atomicAdd( target[ local_index ], bins[ local_index ] );
+static const uint32_t cpu_compute_benchmark_tonemap[] = {
+	0x07230203, 0x00010000, 0x00000000, 0x0000003f, 0x00000000, 0x00020011, 0x00000001, 0x0006000b,
+	0x00000001, 0x4c534c47, 0x6474732e, 0x3035342e, 0x00000000, 0x0003000e, 0x00000000, 0x00000001,
+	0x0006000f, 0x00000005, 0x00000002, 0x6e69616d, 0x00000000, 0x00000003, 0x00060010, 0x00000002,
+	0x00000011, 0x00000008, 0x00000008, 0x00000001, 0x00040047, 0x00000003, 0x0000000b, 0x0000001c,
+	0x00040047, 0x00000004, 0x00000006, 0x00000004, 0x00050048, 0x00000005, 0x00000000, 0x00000023,
+	0x00000000, 0x00040048, 0x00000005, 0x00000000, 0x00000018, 0x00030047, 0x00000005, 0x00000003,
+	0x00040047, 0x00000006, 0x00000022, 0x00000000, 0x00040047, 0x00000006, 0x00000021, 0x00000000,
+	0x00050048, 0x00000007, 0x00000000, 0x00000023, 0x00000000, 0x00040048, 0x00000007, 0x00000000,
+	0x00000019, 0x00030047, 0x00000007, 0x00000003, 0x00040047, 0x00000008, 0x00000022, 0x00000000,
+	0x00040047, 0x00000008, 0x00000021, 0x00000001, 0x00050048, 0x00000009, 0x00000000, 0x00000023,
+	0x00000000, 0x00050048, 0x00000009, 0x00000001, 0x00000023, 0x00000004, 0x00050048, 0x00000009,
+	0x00000002, 0x00000023, 0x00000008, 0x00030047, 0x00000009, 0x00000002, 0x00020013, 0x0000000a,
+	0x00030021, 0x0000000b, 0x0000000a, 0x00040015, 0x0000000c, 0x00000020, 0x00000000, 0x00040015,
+	0x0000000d, 0x00000020, 0x00000001, 0x00030016, 0x0000000e, 0x00000020, 0x00020014, 0x0000000f,
+	0x00040017, 0x00000010, 0x0000000c, 0x00000003, 0x00040017, 0x00000011, 0x0000000e, 0x00000003,
+	0x00040017, 0x00000012, 0x0000000e, 0x00000004, 0x00040020, 0x00000013, 0x00000001, 0x00000010,
+	0x0004003b, 0x00000013, 0x00000003, 0x00000001, 0x0003001d, 0x00000004, 0x0000000c, 0x0003001e,
+	0x00000005, 0x00000004, 0x0003001e, 0x00000007, 0x00000004, 0x00040020, 0x00000014, 0x00000002,
+	0x00000005, 0x00040020, 0x00000015, 0x00000002, 0x00000007, 0x0004003b, 0x00000014, 0x00000006,
+	0x00000002, 0x0004003b, 0x00000015, 0x00000008, 0x00000002, 0x0005001e, 0x00000009, 0x0000000c,
+	0x0000000c, 0x0000000e, 0x00040020, 0x00000016, 0x00000009, 0x00000009, 0x0004003b, 0x00000016,
+	0x00000017, 0x00000009, 0x00040020, 0x00000018, 0x00000009, 0x0000000c, 0x00040020, 0x00000019,
+	0x00000009, 0x0000000e, 0x00040020, 0x0000001a, 0x00000002, 0x0000000c, 0x0004002b, 0x0000000d,
+	0x0000001b, 0x00000000, 0x0004002b, 0x0000000d, 0x0000001c, 0x00000001, 0x0004002b, 0x0000000d,
+	0x0000001d, 0x00000002, 0x0004002b, 0x0000000e, 0x0000001e, 0x3f800000, 0x0004002b, 0x0000000e,
+	0x0000001f, 0x3ee8ba2e, 0x0006002c, 0x00000011, 0x00000020, 0x0000001e, 0x0000001e, 0x0000001e,
+	0x0006002c, 0x00000011, 0x00000021, 0x0000001f, 0x0000001f, 0x0000001f, 0x00050036, 0x0000000a,
+	0x00000002, 0x00000000, 0x0000000b, 0x000200f8, 0x00000022, 0x0004003d, 0x00000010, 0x00000023,
+	0x00000003, 0x00050051, 0x0000000c, 0x00000024, 0x00000023, 0x00000000, 0x00050051, 0x0000000c,
+	0x00000025, 0x00000023, 0x00000001, 0x00050041, 0x00000018, 0x00000026, 0x00000017, 0x0000001b,
+	0x0004003d, 0x0000000c, 0x00000027, 0x00000026, 0x00050041, 0x00000018, 0x00000028, 0x00000017,
+	0x0000001c, 0x0004003d, 0x0000000c, 0x00000029, 0x00000028, 0x000500ae, 0x0000000f, 0x0000002a,
+	0x00000024, 0x00000027, 0x000500ae, 0x0000000f, 0x0000002b, 0x00000025, 0x00000029, 0x000500a6,
+	0x0000000f, 0x0000002c, 0x0000002a, 0x0000002b, 0x000300f7, 0x0000002d, 0x00000000, 0x000400fa,
+	0x0000002c, 0x0000002e, 0x0000002d, 0x000200f8, 0x0000002e, 0x000100fd, 0x000200f8, 0x0000002d,
+	0x00050084, 0x0000000c, 0x0000002f, 0x00000025, 0x00000027, 0x00050080, 0x0000000c, 0x00000030,
+	0x0000002f, 0x00000024, 0x00060041, 0x0000001a, 0x00000031, 0x00000006, 0x0000001b, 0x00000030,
+	0x0004003d, 0x0000000c, 0x00000032, 0x00000031, 0x0006000c, 0x00000012, 0x00000033, 0x00000001,
+	0x00000040, 0x00000032, 0x0008004f, 0x00000011, 0x00000034, 0x00000033, 0x00000033, 0x00000000,
+	0x00000001, 0x00000002, 0x00050041, 0x00000019, 0x00000035, 0x00000017, 0x0000001d, 0x0004003d,
+	0x0000000e, 0x00000036, 0x00000035, 0x0005008e, 0x00000011, 0x00000037, 0x00000034, 0x00000036,
+	0x00050081, 0x00000011, 0x00000038, 0x00000037, 0x00000020, 0x00050088, 0x00000011, 0x00000039,
+	0x00000037, 0x00000038, 0x0007000c, 0x00000011, 0x0000003a, 0x00000001, 0x0000001a, 0x00000039,
+	0x00000021, 0x00050051, 0x0000000e, 0x0000003b, 0x00000033, 0x00000003, 0x00050050, 0x00000012,
+	0x0000003c, 0x0000003a, 0x0000003b, 0x0006000c, 0x0000000c, 0x0000003d, 0x00000001, 0x00000037,
+	0x0000003c, 0x00060041, 0x0000001a, 0x0000003e, 0x00000008, 0x0000001b, 0x00000030, 0x0003003e,
+	0x0000003e, 0x0000003d, 0x000100fd, 0x00010038,
+};
+
+static const uint32_t cpu_compute_benchmark_blur[] = {
+	0x07230203, 0x00010000, 0x00000000, 0x0000005d, 0x00000000, 0x00020011, 0x00000001, 0x0006000b,
+	0x00000001, 0x4c534c47, 0x6474732e, 0x3035342e, 0x00000000, 0x0003000e, 0x00000000, 0x00000001,
+	0x0006000f, 0x00000005, 0x00000002, 0x6e69616d, 0x00000000, 0x00000003, 0x00060010, 0x00000002,
+	0x00000011, 0x00000008, 0x00000008, 0x00000001, 0x00040047, 0x00000003, 0x0000000b, 0x0000001c,
+	0x00040047, 0x00000004, 0x00000006, 0x00000004, 0x00050048, 0x00000005, 0x00000000, 0x00000023,
+	0x00000000, 0x00030047, 0x00000005, 0x00000003, 0x00040047, 0x00000006, 0x00000022, 0x00000000,
+	0x00040047, 0x00000006, 0x00000021, 0x00000000, 0x00050048, 0x00000007, 0x00000000, 0x00000023,
+	0x00000000, 0x00030047, 0x00000007, 0x00000003, 0x00040047, 0x00000008, 0x00000022, 0x00000000,
+	0x00040047, 0x00000008, 0x00000021, 0x00000001, 0x00050048, 0x00000009, 0x00000000, 0x00000023,
+	0x00000000, 0x00050048, 0x00000009, 0x00000001, 0x00000023, 0x00000004, 0x00030047, 0x00000009,
+	0x00000002, 0x00020013, 0x0000000a, 0x00030021, 0x0000000b, 0x0000000a, 0x00040015, 0x0000000c,
+	0x00000020, 0x00000000, 0x00040015, 0x0000000d, 0x00000020, 0x00000001, 0x00030016, 0x0000000e,
+	0x00000020, 0x00020014, 0x0000000f, 0x00040017, 0x00000010, 0x0000000d, 0x00000002, 0x00040017,
+	0x00000011, 0x0000000c, 0x00000003, 0x00040017, 0x00000012, 0x0000000e, 0x00000004, 0x00040020,
+	0x00000013, 0x00000001, 0x00000011, 0x0004003b, 0x00000013, 0x00000003, 0x00000001, 0x0003001d,
+	0x00000004, 0x0000000c, 0x0003001e, 0x00000005, 0x00000004, 0x0003001e, 0x00000007, 0x00000004,
+	0x00040020, 0x00000014, 0x00000002, 0x00000005, 0x00040020, 0x00000015, 0x00000002, 0x00000007,
+	0x0004003b, 0x00000014, 0x00000006, 0x00000002, 0x0004003b, 0x00000015, 0x00000008, 0x00000002,
+	0x0004001e, 0x00000009, 0x0000000c, 0x0000000c, 0x00040020, 0x00000016, 0x00000009, 0x00000009,
+	0x0004003b, 0x00000016, 0x00000017, 0x00000009, 0x00040020, 0x00000018, 0x00000009, 0x0000000c,
+	0x00040020, 0x00000019, 0x00000002, 0x0000000c, 0x00040020, 0x0000001a, 0x00000007, 0x0000000d,
+	0x00040020, 0x0000001b, 0x00000007, 0x00000012, 0x0004002b, 0x0000000d, 0x0000001c, 0x00000000,
+	0x0004002b, 0x0000000d, 0x0000001d, 0x00000001, 0x0004002b, 0x0000000d, 0x0000001e, 0xffffffff,
+	0x0004002b, 0x0000000e, 0x0000001f, 0x00000000, 0x0004002b, 0x0000000e, 0x00000020, 0x41100000,
+	0x0005002c, 0x00000010, 0x00000021, 0x0000001c, 0x0000001c, 0x0005002c, 0x00000010, 0x00000022,
+	0x0000001d, 0x0000001d, 0x0007002c, 0x00000012, 0x00000023, 0x0000001f, 0x0000001f, 0x0000001f,
+	0x0000001f, 0x0007002c, 0x00000012, 0x00000024, 0x00000020, 0x00000020, 0x00000020, 0x00000020,
+	0x00050036, 0x0000000a, 0x00000002, 0x00000000, 0x0000000b, 0x000200f8, 0x00000025, 0x0004003b,
+	0x0000001a, 0x00000026, 0x00000007, 0x0005003b, 0x0000001b, 0x00000027, 0x00000007, 0x00000023,
+	0x0004003d, 0x00000011, 0x00000028, 0x00000003, 0x00050051, 0x0000000c, 0x00000029, 0x00000028,
+	0x00000000, 0x00050051, 0x0000000c, 0x0000002a, 0x00000028, 0x00000001, 0x0004007c, 0x0000000d,
+	0x0000002b, 0x00000029, 0x0004007c, 0x0000000d, 0x0000002c, 0x0000002a, 0x00050050, 0x00000010,
+	0x0000002d, 0x0000002b, 0x0000002c, 0x00050041, 0x00000018, 0x0000002e, 0x00000017, 0x0000001c,
+	0x0004003d, 0x0000000c, 0x0000002f, 0x0000002e, 0x0004007c, 0x0000000d, 0x00000030, 0x0000002f,
+	0x00050041, 0x00000018, 0x00000031, 0x00000017, 0x0000001d, 0x0004003d, 0x0000000c, 0x00000032,
+	0x00000031, 0x0004007c, 0x0000000d, 0x00000033, 0x00000032, 0x000500af, 0x0000000f, 0x00000034,
+	0x0000002b, 0x00000030, 0x000500af, 0x0000000f, 0x00000035, 0x0000002c, 0x00000033, 0x000500a6,
+	0x0000000f, 0x00000036, 0x00000034, 0x00000035, 0x000300f7, 0x00000037, 0x00000000, 0x000400fa,
+	0x00000036, 0x00000038, 0x00000037, 0x000200f8, 0x00000038, 0x000100fd, 0x000200f8, 0x00000037,
+	0x00050050, 0x00000010, 0x00000039, 0x00000030, 0x00000033, 0x00050082, 0x00000010, 0x0000003a,
+	0x00000039, 0x00000022, 0x0003003e, 0x00000026, 0x0000001e, 0x000200f9, 0x0000003b, 0x000200f8,
+	0x0000003b, 0x000400f6, 0x0000003c, 0x0000003d, 0x00000000, 0x000200f9, 0x0000003e, 0x000200f8,
+	0x0000003e, 0x0004003d, 0x0000000d, 0x0000003f, 0x00000026, 0x000500b3, 0x0000000f, 0x00000040,
+	0x0000003f, 0x0000001d, 0x000400fa, 0x00000040, 0x00000041, 0x0000003c, 0x000200f8, 0x00000041,
+	0x000200f9, 0x00000042, 0x000200f8, 0x00000042, 0x000700f5, 0x0000000d, 0x00000043, 0x0000001e,
+	0x00000041, 0x00000044, 0x00000045, 0x000400f6, 0x00000046, 0x00000045, 0x00000000, 0x000500b3,
+	0x0000000f, 0x00000047, 0x00000043, 0x0000001d, 0x000400fa, 0x00000047, 0x00000048, 0x00000046,
+	0x000200f8, 0x00000048, 0x00050050, 0x00000010, 0x00000049, 0x00000043, 0x0000003f, 0x00050080,
+	0x00000010, 0x0000004a, 0x0000002d, 0x00000049, 0x0008000c, 0x00000010, 0x0000004b, 0x00000001,
+	0x0000002d, 0x0000004a, 0x00000021, 0x0000003a, 0x00050051, 0x0000000d, 0x0000004c, 0x0000004b,
+	0x00000000, 0x00050051, 0x0000000d, 0x0000004d, 0x0000004b, 0x00000001, 0x00050084, 0x0000000d,
+	0x0000004e, 0x0000004d, 0x00000030, 0x00050080, 0x0000000d, 0x0000004f, 0x0000004e, 0x0000004c,
+	0x00060041, 0x00000019, 0x00000050, 0x00000006, 0x0000001c, 0x0000004f, 0x0004003d, 0x0000000c,
+	0x00000051, 0x00000050, 0x0006000c, 0x00000012, 0x00000052, 0x00000001, 0x00000040, 0x00000051,
+	0x0004003d, 0x00000012, 0x00000053, 0x00000027, 0x00050081, 0x00000012, 0x00000054, 0x00000053,
+	0x00000052, 0x0003003e, 0x00000027, 0x00000054, 0x000200f9, 0x00000045, 0x000200f8, 0x00000045,
+	0x00050080, 0x0000000d, 0x00000044, 0x00000043, 0x0000001d, 0x000200f9, 0x00000042, 0x000200f8,
+	0x00000046, 0x000200f9, 0x0000003d, 0x000200f8, 0x0000003d, 0x0004003d, 0x0000000d, 0x00000055,
+	0x00000026, 0x00050080, 0x0000000d, 0x00000056, 0x00000055, 0x0000001d, 0x0003003e, 0x00000026,
+	0x00000056, 0x000200f9, 0x0000003b, 0x000200f8, 0x0000003c, 0x0004003d, 0x00000012, 0x00000057,
+	0x00000027, 0x00050088, 0x00000012, 0x00000058, 0x00000057, 0x00000024, 0x0006000c, 0x0000000c,
+	0x00000059, 0x00000001, 0x00000037, 0x00000058, 0x00050084, 0x0000000d, 0x0000005a, 0x0000002c,
+	0x00000030, 0x00050080, 0x0000000d, 0x0000005b, 0x0000005a, 0x0000002b, 0x00060041, 0x00000019,
+	0x0000005c, 0x00000008, 0x0000001c, 0x0000005b, 0x0003003e, 0x0000005c, 0x00000059, 0x000100fd,
+	0x00010038,
+};
+
+static const uint32_t cpu_compute_benchmark_histogram[] = {
+	0x07230203, 0x00010000, 0x00000000, 0x00000046, 0x00000000, 0x00020011, 0x00000001, 0x0006000b,
+	0x00000001, 0x4c534c47, 0x6474732e, 0x3035342e, 0x00000000, 0x0003000e, 0x00000000, 0x00000001,
+	0x0007000f, 0x00000005, 0x00000002, 0x6e69616d, 0x00000000, 0x00000003, 0x00000004, 0x00060010,
+	0x00000002, 0x00000011, 0x00000100, 0x00000001, 0x00000001, 0x00040047, 0x00000003, 0x0000000b,
+	0x0000001c, 0x00040047, 0x00000004, 0x0000000b, 0x0000001d, 0x00040047, 0x00000005, 0x00000006,
+	0x00000004, 0x00040047, 0x00000006, 0x00000006, 0x00000004, 0x00050048, 0x00000007, 0x00000000,
+	0x00000023, 0x00000000, 0x00030047, 0x00000007, 0x00000003, 0x00040047, 0x00000008, 0x00000022,
+	0x00000000, 0x00040047, 0x00000008, 0x00000021, 0x00000000, 0x00050048, 0x00000009, 0x00000000,
+	0x00000023, 0x00000000, 0x00030047, 0x00000009, 0x00000003, 0x00040047, 0x0000000a, 0x00000022,
+	0x00000000, 0x00040047, 0x0000000a, 0x00000021, 0x00000001, 0x00050048, 0x0000000b, 0x00000000,
+	0x00000023, 0x00000000, 0x00030047, 0x0000000b, 0x00000002, 0x00020013, 0x0000000c, 0x00030021,
+	0x0000000d, 0x0000000c, 0x00040015, 0x0000000e, 0x00000020, 0x00000000, 0x00040015, 0x0000000f,
+	0x00000020, 0x00000001, 0x00030016, 0x00000010, 0x00000020, 0x00020014, 0x00000011, 0x00040017,
+	0x00000012, 0x0000000e, 0x00000003, 0x00040017, 0x00000013, 0x00000010, 0x00000003, 0x00040017,
+	0x00000014, 0x00000010, 0x00000004, 0x00040020, 0x00000015, 0x00000001, 0x00000012, 0x00040020,
+	0x00000016, 0x00000001, 0x0000000e, 0x0004003b, 0x00000015, 0x00000003, 0x00000001, 0x0004003b,
+	0x00000016, 0x00000004, 0x00000001, 0x0004002b, 0x0000000e, 0x00000017, 0x00000100, 0x0004002b,
+	0x0000000e, 0x00000018, 0x000000ff, 0x0004002b, 0x0000000e, 0x00000019, 0x00000000, 0x0004002b,
+	0x0000000e, 0x0000001a, 0x00000001, 0x0004002b, 0x0000000e, 0x0000001b, 0x00000002, 0x0004002b,
+	0x0000000e, 0x0000001c, 0x00000108, 0x0004002b, 0x0000000e, 0x0000001d, 0x00000048, 0x0003001d,
+	0x00000005, 0x0000000e, 0x0004001c, 0x00000006, 0x0000000e, 0x00000017, 0x0003001e, 0x00000007,
+	0x00000005, 0x0003001e, 0x00000009, 0x00000006, 0x00040020, 0x0000001e, 0x00000002, 0x00000007,
+	0x00040020, 0x0000001f, 0x00000002, 0x00000009, 0x0004003b, 0x0000001e, 0x00000008, 0x00000002,
+	0x0004003b, 0x0000001f, 0x0000000a, 0x00000002, 0x0003001e, 0x0000000b, 0x0000000e, 0x00040020,
+	0x00000020, 0x00000009, 0x0000000b, 0x0004003b, 0x00000020, 0x00000021, 0x00000009, 0x00040020,
+	0x00000022, 0x00000009, 0x0000000e, 0x00040020, 0x00000023, 0x00000002, 0x0000000e, 0x00040020,
+	0x00000024, 0x00000004, 0x00000006, 0x00040020, 0x00000025, 0x00000004, 0x0000000e, 0x0004003b,
+	0x00000024, 0x00000026, 0x00000004, 0x0004002b, 0x0000000f, 0x00000027, 0x00000000, 0x0004002b,
+	0x00000010, 0x00000028, 0x3e59b3d0, 0x0004002b, 0x00000010, 0x00000029, 0x3f371759, 0x0004002b,
+	0x00000010, 0x0000002a, 0x3d93dd98, 0x0004002b, 0x00000010, 0x0000002b, 0x437f0000, 0x0004002b,
+	0x00000010, 0x0000002c, 0x3f000000, 0x0006002c, 0x00000013, 0x0000002d, 0x00000028, 0x00000029,
+	0x0000002a, 0x00050036, 0x0000000c, 0x00000002, 0x00000000, 0x0000000d, 0x000200f8, 0x0000002e,
+	0x0004003d, 0x0000000e, 0x0000002f, 0x00000004, 0x00050041, 0x00000025, 0x00000030, 0x00000026,
+	0x0000002f, 0x0003003e, 0x00000030, 0x00000019, 0x000400e0, 0x0000001b, 0x0000001b, 0x0000001c,
+	0x0004003d, 0x00000012, 0x00000031, 0x00000003, 0x00050051, 0x0000000e, 0x00000032, 0x00000031,
+	0x00000000, 0x00050041, 0x00000022, 0x00000033, 0x00000021, 0x00000027, 0x0004003d, 0x0000000e,
+	0x00000034, 0x00000033, 0x000500b0, 0x00000011, 0x00000035, 0x00000032, 0x00000034, 0x000300f7,
+	0x00000036, 0x00000000, 0x000400fa, 0x00000035, 0x00000037, 0x00000036, 0x000200f8, 0x00000037,
+	0x00060041, 0x00000023, 0x00000038, 0x00000008, 0x00000027, 0x00000032, 0x0004003d, 0x0000000e,
+	0x00000039, 0x00000038, 0x0006000c, 0x00000014, 0x0000003a, 0x00000001, 0x00000040, 0x00000039,
+	0x0008004f, 0x00000013, 0x0000003b, 0x0000003a, 0x0000003a, 0x00000000, 0x00000001, 0x00000002,
+	0x00050094, 0x00000010, 0x0000003c, 0x0000003b, 0x0000002d, 0x0008000c, 0x00000010, 0x0000003d,
+	0x00000001, 0x00000032, 0x0000003c, 0x0000002b, 0x0000002c, 0x0004006d, 0x0000000e, 0x0000003e,
+	0x0000003d, 0x0007000c, 0x0000000e, 0x0000003f, 0x00000001, 0x00000026, 0x0000003e, 0x00000018,
+	0x00050041, 0x00000025, 0x00000040, 0x00000026, 0x0000003f, 0x000700ea, 0x0000000e, 0x00000041,
+	0x00000040, 0x0000001b, 0x00000019, 0x0000001a, 0x000200f9, 0x00000036, 0x000200f8, 0x00000036,
+	0x000400e0, 0x0000001b, 0x0000001b, 0x0000001c, 0x00050041, 0x00000025, 0x00000042, 0x00000026,
+	0x0000002f, 0x0004003d, 0x0000000e, 0x00000043, 0x00000042, 0x00060041, 0x00000023, 0x00000044,
+	0x0000000a, 0x00000027, 0x0000002f, 0x000700ea, 0x0000000e, 0x00000045, 0x00000044, 0x0000001a,
+	0x00000019, 0x00000043, 0x000100fd, 0x00010038,
+};
+
+// One kernel of the cpu compute benchmark.
+struct ComputeBenchmarkKernel
+{
+	const char						*	name					= nullptr;
+	const uint32_t					*	code					= nullptr;
+	size_t								word_count				= 0;
+	std::vector<uint8_t>				push_constants;
+	uint32_t							group_count[ 2 ]		= { 1, 1 };
+	size_t								target_word_count		= 0;
+};
+
+// Runs the kernel on the renderer's device and returns the target buffer, empty if there is
+// no host visible memory. Milliseconds from submit until the fence signals.
+static std::vector<uint32_t> RunComputeBenchmarkKernelOnDevice( Renderer & r, const ComputeBenchmarkKernel & kernel, const std::vector<uint32_t> & source, double & ms )
+{
+	auto device = r.GetVulkanDevice();
+
+	ShaderReflection reflection;
+	ReflectShader( kernel.code, kernel.word_count, reflection );
+	std::vector<VkDescriptorSetLayout> set_layouts;
+	auto layout = r.GetPipelineLayoutCache()->GetPipelineLayout( { &reflection }, &set_layouts );
+
+	VkComputePipelineCreateInfo pipeline_create_info {};
+	pipeline_create_info.sType					= VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_create_info.stage.sType			= VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_create_info.stage.stage			= VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_create_info.stage.module			= r.GetShaderModuleCache()->GetShaderModule( kernel.code, kernel.word_count );
+	pipeline_create_info.stage.pName			= reflection.entry_point.c_str();
+	pipeline_create_info.layout					= layout;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	ErrorCheck( vkCreateComputePipelines( device, r.GetVulkanPipelineCache(), 1, &pipeline_create_info, nullptr, &pipeline ) );
+
+	// Source and target in host visible, coherent memory, every implementation has some.
+	VkBuffer buffers[ 2 ] {};
+	VkDeviceMemory memories[ 2 ] {};
+	void * mapped[ 2 ] {};
+	VkDeviceSize sizes[ 2 ] = { source.size() * sizeof( uint32_t ), kernel.target_word_count * sizeof( uint32_t ) };
+	bool allocated = true;
+	for( uint32_t i=0; i < 2; ++i ) {
+		VkBufferCreateInfo buffer_create_info {};
+		buffer_create_info.sType			= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_create_info.size				= sizes[ i ];
+		buffer_create_info.usage			= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		buffer_create_info.sharingMode		= VK_SHARING_MODE_EXCLUSIVE;
+		ErrorCheck( vkCreateBuffer( device, &buffer_create_info, nullptr, &buffers[ i ] ) );
+
+		VkMemoryRequirements memory_requirements {};
+		vkGetBufferMemoryRequirements( device, buffers[ i ], &memory_requirements );
+		auto memory_type_index = FindMemoryTypeIndex( &r.GetVulkanPhysicalDeviceMemoryProperties(), memory_requirements.memoryTypeBits,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+		if( memory_type_index == UINT32_MAX ) {
+			allocated = false;
+			continue;
+		}
+		VkMemoryAllocateInfo memory_allocate_info {};
+		memory_allocate_info.sType				= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memory_allocate_info.allocationSize		= memory_requirements.size;
+		memory_allocate_info.memoryTypeIndex	= memory_type_index;
+		ErrorCheck( vkAllocateMemory( device, &memory_allocate_info, nullptr, &memories[ i ] ) );
+		ErrorCheck( vkBindBufferMemory( device, buffers[ i ], memories[ i ], 0 ) );
+		ErrorCheck( vkMapMemory( device, memories[ i ], 0, VK_WHOLE_SIZE, 0, &mapped[ i ] ) );
+	}
+
+	std::vector<uint32_t> target;
+	if( allocated ) {
+		std::memcpy( mapped[ 0 ], source.data(), size_t( sizes[ 0 ] ) );
+		std::memset( mapped[ 1 ], 0, size_t( sizes[ 1 ] ) );
+
+		VkDescriptorPoolSize pool_size { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 };
+		VkDescriptorPoolCreateInfo descriptor_pool_create_info {};
+		descriptor_pool_create_info.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		descriptor_pool_create_info.maxSets			= 1;
+		descriptor_pool_create_info.poolSizeCount	= 1;
+		descriptor_pool_create_info.pPoolSizes		= &pool_size;
+		VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+		ErrorCheck( vkCreateDescriptorPool( device, &descriptor_pool_create_info, nullptr, &descriptor_pool ) );
+
+		VkDescriptorSetAllocateInfo descriptor_set_allocate_info {};
+		descriptor_set_allocate_info.sType					= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		descriptor_set_allocate_info.descriptorPool			= descriptor_pool;
+		descriptor_set_allocate_info.descriptorSetCount		= 1;
+		descriptor_set_allocate_info.pSetLayouts			= &set_layouts[ 0 ];
+		VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+		ErrorCheck( vkAllocateDescriptorSets( device, &descriptor_set_allocate_info, &descriptor_set ) );
+
+		VkDescriptorBufferInfo buffer_infos[ 2 ] = { { buffers[ 0 ], 0, VK_WHOLE_SIZE }, { buffers[ 1 ], 0, VK_WHOLE_SIZE } };
+		VkWriteDescriptorSet write {};
+		write.sType				= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet			= descriptor_set;
+		write.dstBinding		= 0;
+		write.descriptorCount	= 2;
+		write.descriptorType	= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo		= buffer_infos;
+		vkUpdateDescriptorSets( device, 1, &write, 0, nullptr );
+
+		VkCommandPoolCreateInfo command_pool_create_info {};
+		command_pool_create_info.sType				= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		command_pool_create_info.queueFamilyIndex	= r.GetVulkanGraphicsQueueFamilyIndex();
+		VkCommandPool command_pool = VK_NULL_HANDLE;
+		ErrorCheck( vkCreateCommandPool( device, &command_pool_create_info, nullptr, &command_pool ) );
+
+		VkCommandBufferAllocateInfo command_buffer_allocate_info {};
+		command_buffer_allocate_info.sType					= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_allocate_info.commandPool			= command_pool;
+		command_buffer_allocate_info.level					= VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		command_buffer_allocate_info.commandBufferCount		= 1;
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+		ErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_allocate_info, &command_buffer ) );
+
+		VkCommandBufferBeginInfo command_buffer_begin_info {};
+		command_buffer_begin_info.sType				= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		command_buffer_begin_info.flags				= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		ErrorCheck( vkBeginCommandBuffer( command_buffer, &command_buffer_begin_info ) );
+		vkCmdBindPipeline( command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline );
+		vkCmdBindDescriptorSets( command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &descriptor_set, 0, nullptr );
+		vkCmdPushConstants( command_buffer, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, uint32_t( kernel.push_constants.size() ), kernel.push_constants.data() );
+		vkCmdDispatch( command_buffer, kernel.group_count[ 0 ], kernel.group_count[ 1 ], 1 );
+
+		// The host reads the target once the fence signals.
+		VkMemoryBarrier barrier {};
+		barrier.sType				= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask		= VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask		= VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr );
+		ErrorCheck( vkEndCommandBuffer( command_buffer ) );
+
+		VkFenceCreateInfo fence_create_info {};
+		fence_create_info.sType		= VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		VkFence fence = VK_NULL_HANDLE;
+		ErrorCheck( vkCreateFence( device, &fence_create_info, nullptr, &fence ) );
+
+		VkSubmitInfo submit_info {};
+		submit_info.sType					= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.commandBufferCount		= 1;
+		submit_info.pCommandBuffers			= &command_buffer;
+		auto begin = std::chrono::steady_clock::now();
+		{
+			auto lock = r.GetSubmissionThread()->LockQueue();
+			ErrorCheck( vkQueueSubmit( r.GetVulkanQueue(), 1, &submit_info, fence ) );
+		}
+		ErrorCheck( vkWaitForFences( device, 1, &fence, VK_TRUE, UINT64_MAX ) );
+		ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+
+		target.resize( kernel.target_word_count );
+		std::memcpy( target.data(), mapped[ 1 ], size_t( sizes[ 1 ] ) );
+
+		vkDestroyFence( device, fence, nullptr );
+		vkDestroyCommandPool( device, command_pool, nullptr );
+		vkDestroyDescriptorPool( device, descriptor_pool, nullptr );
+	}
+
+	for( uint32_t i=0; i < 2; ++i ) {
+		vkDestroyBuffer( device, buffers[ i ], nullptr );
+		vkFreeMemory( device, memories[ i ], nullptr );
+	}
+	vkDestroyPipeline( device, pipeline, nullptr );
+	return target;
+}
+
+// Runs the image kernels on the cpu executor and on the renderer's device, which is lavapipe
+// on machines without a gpu, and compares the results. Pixels may differ by one step of a
+// channel, pow() and the divisions are not exact on either side, histogram bins by a few.
+void RunCpuComputeBenchmark( Renderer & r )
 {
-	Renderer r;
+	const uint32_t width = 1920, height = 1080, run_count = 5;
+	std::vector<uint32_t> source( width * height );
+	uint32_t seed = 1;
+	for( auto & pixel : source ) {
+		seed = seed * 1664525u + 1013904223u;
+		pixel = seed;
+	}
+
+	auto push_constants = []( const void * data, size_t size ) {
+		return std::vector<uint8_t>( (const uint8_t*)data, (const uint8_t*)data + size );
+	};
+	struct { uint32_t width, height; float exposure; } tonemap_push_constants { width, height, 1.7f };
+	uint32_t blur_push_constants[ 2 ] = { width, height };
+	uint32_t histogram_push_constants[ 1 ] = { width * height };
+
+	std::vector<ComputeBenchmarkKernel> kernels( 3 );
+	kernels[ 0 ].name				= "tonemap";
+	kernels[ 0 ].code				= cpu_compute_benchmark_tonemap;
+	kernels[ 0 ].word_count			= sizeof( cpu_compute_benchmark_tonemap ) / sizeof( uint32_t );
+	kernels[ 0 ].push_constants		= push_constants( &tonemap_push_constants, sizeof( tonemap_push_constants ) );
+	kernels[ 1 ].name				= "blur";
+	kernels[ 1 ].code				= cpu_compute_benchmark_blur;
+	kernels[ 1 ].word_count			= sizeof( cpu_compute_benchmark_blur ) / sizeof( uint32_t );
+	kernels[ 1 ].push_constants		= push_constants( blur_push_constants, sizeof( blur_push_constants ) );
+	for( uint32_t i=0; i < 2; ++i ) {
+		kernels[ i ].group_count[ 0 ]		= ( width + 7 ) / 8;
+		kernels[ i ].group_count[ 1 ]		= ( height + 7 ) / 8;
+		kernels[ i ].target_word_count		= source.size();
+	}
+	kernels[ 2 ].name				= "histogram";
+	kernels[ 2 ].code				= cpu_compute_benchmark_histogram;
+	kernels[ 2 ].word_count			= sizeof( cpu_compute_benchmark_histogram ) / sizeof( uint32_t );
+	kernels[ 2 ].push_constants		= push_constants( histogram_push_constants, sizeof( histogram_push_constants ) );
+	kernels[ 2 ].group_count[ 0 ]	= uint32_t( ( source.size() + 255 ) / 256 );
+	kernels[ 2 ].target_word_count	= 256;
+
+	std::cout << "Cpu compute: " << width << "x" << height << ", " << r.GetJobSystem()->GetThreadCount() << " threads against "
+		<< r.GetVulkanPhysicalDeviceProperties().deviceName << std::endl;
+	for( auto & kernel : kernels ) {
+		CpuComputeExecutor executor( r.GetJobSystem() );
+		if( !executor.Load( kernel.code, kernel.word_count ) ) {
+			std::cout << kernel.name << ": " << executor.GetError() << std::endl;
+			continue;
+		}
+		std::vector<uint32_t> target( kernel.target_word_count );
+		executor.SetBuffer( 0, 0, source.data(), source.size() * sizeof( uint32_t ) );
+		executor.SetBuffer( 0, 1, target.data(), target.size() * sizeof( uint32_t ) );
+		executor.SetPushConstants( kernel.push_constants.data(), uint32_t( kernel.push_constants.size() ) );
 
-	r.OpenWindow( 800, 600, "Vulkan API Tutorial 7" );
+		// Best of a few runs, the histogram adds to its target so it starts from zero every time.
+		double cpu_ms = 0.0;
+		for( uint32_t run=0; run < run_count; ++run ) {
+			std::fill( target.begin(), target.end(), 0 );
+			auto begin = std::chrono::steady_clock::now();
+			executor.Dispatch( kernel.group_count[ 0 ], kernel.group_count[ 1 ], 1 );
+			auto ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+			cpu_ms = run ? std::min( cpu_ms, ms ) : ms;
+		}
 
-	while( r.Run() ) {
+		double device_ms = 0.0;
+		auto device_target = RunComputeBenchmarkKernelOnDevice( r, kernel, source, device_ms );
+		if( device_target.empty() ) {
+			std::cout << kernel.name << ": cpu " << cpu_ms << " ms, the device has no host visible memory" << std::endl;
+			continue;
+		}
+
+		uint32_t max_difference = 0;
+		for( size_t i=0; i < target.size(); ++i ) {
+			if( kernel.target_word_count == 256 ) {
+				max_difference = std::max( max_difference, uint32_t( std::abs( int64_t( target[ i ] ) - int64_t( device_target[ i ] ) ) ) );
+				continue;
+			}
+			for( uint32_t channel=0; channel < 4; ++channel ) {
+				int32_t a = ( target[ i ] >> ( channel * 8 ) ) & 0xff;
+				int32_t b = ( device_target[ i ] >> ( channel * 8 ) ) & 0xff;
+				max_difference = std::max( max_difference, uint32_t( std::abs( a - b ) ) );
+			}
+		}
+		std::cout << kernel.name << ": cpu " << cpu_ms << " ms, device " << device_ms << " ms, largest difference "
+			<< max_difference << ( kernel.target_word_count == 256 ? " per bin" : " per channel" ) << std::endl;
+	}
+}
+
+// SPIR-V of shader packs and .spv files by content hash, manifests name shaders by it.
+struct PipelineShaderLibrary
+{
+	std::vector<std::unique_ptr<ShaderPack>>	packs;
+	std::vector<std::vector<uint32_t>>			files;
+	std::unordered_map<uint64_t, std::pair<const uint32_t*, size_t>>	code;
+};
+
+static bool LoadPipelineShaderLibrary( Renderer & r, const std::vector<std::string> & file_names, PipelineShaderLibrary & library )
+{
+	for( auto & file_name : file_names ) {
+		if( file_name.size() > 4 && file_name.compare( file_name.size() - 4, 4, ".spv" ) == 0 ) {
+			library.files.push_back( LoadSpirv( file_name ) );
+			continue;
+		}
+		library.packs.push_back( std::unique_ptr<ShaderPack>( new ShaderPack( &r ) ) );
+		if( !library.packs.back()->Open( file_name ) ) {
+			std::cout << file_name << ": could not open the shader pack" << std::endl;
+			return false;
+		}
+	}
+	for( auto & code : library.files ) {
+		if( code.empty() ) continue;
+		library.code[ HashShaderCode( code.data(), code.size() ) ] = std::make_pair( code.data(), code.size() );
+	}
+	for( auto & pack : library.packs ) {
+		for( auto & name : pack->GetShaderNames() ) {
+			size_t word_count		= 0;
+			uint64_t content_hash	= 0;
+			auto code				= pack->GetCode( name, &word_count, &content_hash );
+			library.code[ content_hash ] = std::make_pair( code, word_count );
+		}
+	}
+	return true;
+}
+
+static ShaderCodeLookup MakeShaderCodeLookup( const PipelineShaderLibrary & library )
+{
+	return [ &library ]( uint64_t content_hash, size_t * word_count ) -> const uint32_t* {
+		auto found = library.code.find( content_hash );
+		if( found == library.code.end() ) return nullptr;
+		*word_count = found->second.second;
+		return found->second.first;
+	};
+}
+
+// Compiles every pipeline of a manifest or usage log on the PipelineService, all job system
+// threads at once, and saves the renderer's pipeline cache once they are done. The warm-up
+// list has the pipelines that could be baked, without duplicates, in the order of the manifest.
+static void BakePipelineCache( Renderer & r, const std::string & manifest_file, const std::string & cache_file, const std::string & warm_up_file, const std::vector<std::string> & shader_files )
+{
+	PipelineShaderLibrary library;
+	if( !LoadPipelineShaderLibrary( r, shader_files, library ) ) return;
+	auto find_code = MakeShaderCodeLookup( library );
+
+	std::vector<PipelineManifestEntry> entries;
+	if( !ReadPipelineManifest( manifest_file, entries ) ) {
+		std::cout << manifest_file << ": could not read the manifest" << std::endl;
+		return;
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	auto service = r.GetPipelineService();
+	uint32_t skipped = 0;
+	for( size_t i=0; i < entries.size(); ++i ) {
+		PipelineDescription description;
+		if( !ResolvePipelineManifestEntry( &r, entries[ i ], find_code, description ) ) {
+			std::cout << manifest_file << ": pipeline " << i << " uses a shader that is in none of the given files" << std::endl;
+			++skipped;
+			continue;
+		}
+		service->Prefetch( description );
+	}
+	service->WaitIdle();
+	auto ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
 
+	if( !r.SavePipelineCache( cache_file ) ) {
+		std::cout << cache_file << ": could not write the pipeline cache" << std::endl;
+		return;
 	}
+	auto warm_up_count = WritePipelineUsageLog( &r, warm_up_file );
+	if( warm_up_count != service->GetCompileCount() - service->GetFailedCount() ) {
+		std::cout << warm_up_file << ": could not write the warm-up list" << std::endl;
+		return;
+	}
+
+	std::ifstream cache( cache_file, std::ios::binary | std::ios::ate );
+	auto & properties = r.GetVulkanPhysicalDeviceProperties();
+	std::cout << "Baked " << service->GetCompileCount() - service->GetFailedCount() << " pipelines of " << entries.size() << " in the manifest ("
+		<< service->GetCoalescedCount() << " duplicates, " << skipped << " skipped, " << service->GetFailedCount() << " failed) in " << ms << " ms on "
+		<< r.GetJobSystem()->GetThreadCount() << " threads" << std::endl;
+	std::cout << properties.deviceName << ", driver version 0x" << std::hex << properties.driverVersion << std::dec
+		<< ": " << uint64_t( cache.tellg() ) << " byte pipeline cache, " << warm_up_count << " pipeline warm-up list" << std::endl;
+}
+
+// Everything that renders to a window, the offline tools in main() run without one.
+void RunWindowed( Renderer & r, int argc, char ** argv )
+{
+	auto w = r.OpenWindow( 800, 600, "Vulkan API Tutorial 7" );
+
+	FrameGraph graph( &r );
+
+	if( argc > 1 && std::string( argv[ 1 ] ) == "--hot-reload-benchmark" ) {
+		RunShaderHotReloadBenchmark( r, w, graph );
+	} else if( argc > 1 && std::string( argv[ 1 ] ) == "--parallel-recording-benchmark" ) {
+		RunParallelRecordingBenchmark( r, w );
+	} else if( argc > 1 && std::string( argv[ 1 ] ) == "--command-buffer-cache-benchmark" ) {
+		RunCommandBufferCacheBenchmark( r, w );
+	} else if( argc > 1 && std::string( argv[ 1 ] ) == "--render-pass-cache-benchmark" ) {
+		RunRenderPassCacheBenchmark( r, w );
+	} else if( argc > 1 && std::string( argv[ 1 ] ) == "--present-benchmark" ) {
+		// For example under Xvfb with lavapipe: xvfb-run ./main --present-benchmark
+		w->SetPresentPolicy( PresentPolicy::MAX_THROUGHPUT );
+		RunPresentBenchmark( r, w, graph, PresentPath::WSI, "WSI" );
+		RunPresentBenchmark( r, w, graph, PresentPath::XCB_SHM, "XCB MIT-SHM" );
+
+		// Same again with vkQueueSubmit and vkQueuePresentKHR on their own thread.
+		r.GetSubmissionThread()->SetEnabled( true );
+		RunPresentBenchmark( r, w, graph, PresentPath::WSI, "WSI, submission thread" );
+		RunPresentBenchmark( r, w, graph, PresentPath::XCB_SHM, "XCB MIT-SHM, submission thread" );
+	} else {
+		// The clear color follows the mouse, interactive use prefers short
+		// input to photon latency over peak frame rate.
+		r.SetLowLatencyMode( true, 1 );
+
+		// The swapchain image count follows the measured cpu and gpu frame times,
+		// --fixed-image-count keeps the count of the present policy instead.
+		bool auto_tune_image_count = true;
+		for( int i=1; i < argc; ++i ) {
+			if( std::string( argv[ i ] ) == "--fixed-image-count" ) {
+				auto_tune_image_count = false;
+			}
+		}
+		w->SetSwapchainImageCountAutoTune( auto_tune_image_count );
+
+		// --submission-thread hands queue submits and presents to a dedicated thread.
+		for( int i=1; i < argc; ++i ) {
+			if( std::string( argv[ i ] ) == "--submission-thread" ) {
+				r.GetSubmissionThread()->SetEnabled( true );
+			}
+		}
+
+		// --capture <file prefix> records every frame to disk in the background.
+		// --record-input <file> and --replay-input <file> run with a fixed 60 Hz timestep
+		// so a replayed session renders exactly the same frames as the recorded one.
+		FrameCapture * capture = nullptr;
+		for( int i=1; i + 1 < argc; ++i ) {
+			std::string option = argv[ i ];
+			if( option == "--capture" ) {
+				if( !w->IsActiveImageTransferSource() ) {
+					std::cout << "Capture is off, the surface does not allow copies from its swapchain images." << std::endl;
+					continue;
+				}
+				capture = new FrameCapture( &r, w->GetSurfaceSize().width, w->GetSurfaceSize().height, w->GetActiveImageFormat(), argv[ i + 1 ] );
+			} else if( option == "--record-input" ) {
+				w->StartInputRecording( argv[ i + 1 ] );
+				r.SetFixedTimestep( 1.0 / 60.0 );
+			} else if( option == "--replay-input" ) {
+				w->StartInputReplay( argv[ i + 1 ] );
+				r.SetFixedTimestep( 1.0 / 60.0 );
+			}
+		}
+
+		// --pipeline-cache <file> starts from a baked or saved pipeline cache and saves it again
+		// at exit, --pipeline-usage-log <file> writes every pipeline asked for at exit, the input
+		// of the next --bake-pipeline-cache, and --warm-up <list> <shader pack> queues the
+		// pipelines of a warm-up list before the first frame.
+		std::string pipeline_cache_file;
+		std::string pipeline_usage_log_file;
+		for( int i=1; i + 1 < argc; ++i ) {
+			std::string option = argv[ i ];
+			if( option == "--pipeline-cache" ) {
+				pipeline_cache_file = argv[ i + 1 ];
+				if( !r.LoadPipelineCache( pipeline_cache_file ) ) {
+					std::cout << pipeline_cache_file << ": no pipeline cache for this device and driver, starting empty" << std::endl;
+				}
+			} else if( option == "--pipeline-usage-log" ) {
+				pipeline_usage_log_file = argv[ i + 1 ];
+			} else if( option == "--warm-up" && i + 2 < argc ) {
+				PipelineShaderLibrary library;
+				if( LoadPipelineShaderLibrary( r, std::vector<std::string>( 1, argv[ i + 2 ] ), library ) ) {
+					std::cout << WarmUpPipelines( &r, argv[ i + 1 ], MakeShaderCodeLookup( library ) ) << " pipelines warming up" << std::endl;
+				}
+			}
+		}
+
+		// Input latency of the finished frames, averaged and printed once a second.
+		FrameLatency latency_sum;
+		uint32_t latency_count			= 0;
+		uint64_t latency_frame			= UINT64_MAX;
+		auto latency_print_time			= std::chrono::steady_clock::now();
+		while( r.Run() ) {
+			RenderFrame( r, w, graph, capture );
+
+			auto & latency = w->GetLastFrameLatency();
+			if( latency.frame != latency_frame && latency.input_to_complete_ms > 0.0f ) {
+				latency_frame						= latency.frame;
+				latency_sum.input_to_present_ms		+= latency.input_to_present_ms;
+				latency_sum.input_to_complete_ms	+= latency.input_to_complete_ms;
+				latency_sum.cpu_ms					+= latency.cpu_ms;
+				latency_sum.gpu_ms					+= latency.gpu_ms;
+				++latency_count;
+			}
+			auto now = std::chrono::steady_clock::now();
+			if( latency_count && now - latency_print_time >= std::chrono::seconds( 1 ) ) {
+				std::cout << "Latency: " << latency_sum.input_to_present_ms / latency_count << " ms input to present, "
+					<< latency_sum.input_to_complete_ms / latency_count << " ms input to complete, "
+					<< latency_sum.cpu_ms / latency_count << " ms cpu, " << latency_sum.gpu_ms / latency_count << " ms gpu, "
+					<< latency_count << " frames, " << w->GetSwapchainImageCount() << " swapchain images" << std::endl;
+				latency_sum				= FrameLatency();
+				latency_count			= 0;
+				latency_print_time		= now;
+			}
+		}
+
+		delete capture;
+
+		if( !pipeline_usage_log_file.empty() ) {
+			WritePipelineUsageLog( &r, pipeline_usage_log_file );
+		}
+		if( !pipeline_cache_file.empty() ) {
+			r.GetPipelineService()->WaitIdle();
+			r.SavePipelineCache( pipeline_cache_file );
+		}
+	}
+
+	// The graph's transient images may still be in use.
+	r.GetSubmissionThread()->WaitIdle();
+}
+
+int main( int argc, char ** argv )
+{
+	// --device <index> runs on another physical device, a pipeline cache is only good for the
+	// device and driver it was baked on.
+	uint32_t device_index = 0;
+	for( int i=1; i + 1 < argc; ++i ) {
+		if( std::string( argv[ i ] ) == "--device" ) {
+			char * end		= nullptr;
+			auto index		= std::strtoul( argv[ i + 1 ], &end, 10 );
+			if( !std::isdigit( (unsigned char)argv[ i + 1 ][ 0 ] ) || *end != '\0' || index > UINT32_MAX ) {
+				std::cout << argv[ i + 1 ] << ": not a device index, usage: ./main [--device <index>] ..." << std::endl;
+				return -1;
+			}
+			device_index	= uint32_t( index );
+			std::copy( argv + i + 2, argv + argc, argv + i );
+			argc -= 2;
+			break;
+		}
+	}
+
+	Renderer r( device_index );
+
+	// Offline tools and benchmarks without a window only need the device, they run headless.
+	if( argc > 2 && std::string( argv[ 1 ] ) == "--build-shader-pack" ) {
+		// ./main --build-shader-pack <pack> [--strip] shader.spv ..., the file names become the shader names.
+		// --strip removes debug instructions and compacts the ids of every shader that allows it.
+		bool strip = argc > 3 && std::string( argv[ 3 ] ) == "--strip";
+		std::vector<std::pair<std::string, std::vector<uint32_t>>> shaders;
+		for( int i=strip ? 4 : 3; i < argc; ++i ) {
+			auto code = LoadSpirv( argv[ i ] );
+			std::vector<uint32_t> compacted;
+			if( strip && StripAndCompactSpirv( code.data(), code.size(), compacted ) ) {
+				code.swap( compacted );
+			}
+			shaders.push_back( std::make_pair( std::string( argv[ i ] ), std::move( code ) ) );
+		}
+		if( !ShaderPack::Write( argv[ 2 ], shaders ) ) {
+			std::cout << argv[ 2 ] << ": could not write the shader pack" << std::endl;
+		}
+	} else if( argc > 4 && std::string( argv[ 1 ] ) == "--bake-pipeline-cache" ) {
+		// ./main [--device <index>] --bake-pipeline-cache <manifest or usage log> <cache> <warm-up list> shader.pack|shader.spv ...
+		BakePipelineCache( r, argv[ 2 ], argv[ 3 ], argv[ 4 ], std::vector<std::string>( argv + 5, argv + argc ) );
+	} else if( argc > 2 && std::string( argv[ 1 ] ) == "--shader-pack-benchmark" ) {
+		RunShaderPackBenchmark( r, argv[ 2 ] );
+	} else if( argc > 1 && std::string( argv[ 1 ] ) == "--cpu-compute-benchmark" ) {
+		RunCpuComputeBenchmark( r );
+	} else if( argc > 1 && std::string( argv[ 1 ] ) == "--pipeline-service-benchmark" ) {
+		RunPipelineServiceBenchmark( r );
+	} else if( argc > 1 && std::string( argv[ 1 ] ) == "--variant-benchmark" ) {
+		RunVariantBenchmark( r );
+	} else if( argc > 1 && std::string( argv[ 1 ] ) == "--strip-benchmark" ) {
+		// ./main --strip-benchmark [shader.spv ...]
+		RunStripBenchmark( r, std::vector<std::string>( argv + 2, argv + argc ) );
+	} else if( argc > 1 && std::string( argv[ 1 ] ) == "--reflection-benchmark" ) {
+		// ./main --reflection-benchmark [shader.spv ...]
+		RunReflectionBenchmark( r, std::vector<std::string>( argv + 2, argv + argc ) );
+	} else {
+		RunWindowed( r, argc, argv );
+	}
+
+	r.GetSubmissionThread()->WaitIdle();
 
 	return 0;
 }